@@ -0,0 +1,536 @@
+#include "arena_xml.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+namespace ArenaXml
+{
+
+namespace
+{
+
+const size_t Alignment = alignof(std::max_align_t);
+
+size_t align(size_t size)
+{
+    return (size + Alignment - 1) & ~(Alignment - 1);
+}
+
+bool isNameEnd(char c)
+{
+    return isspace(static_cast<unsigned char>(c)) || c == '/' || c == '>' || c == '=';
+}
+
+const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && isspace(static_cast<unsigned char>(*p)))
+        ++p;
+    return p;
+}
+
+// Appends the UTF-8 of a character reference.
+char *encode(char *out, unsigned long code)
+{
+    if (code < 0x80)
+        *out++ = static_cast<char>(code);
+    else if (code < 0x800)
+    {
+        *out++ = static_cast<char>(0xc0 | (code >> 6));
+        *out++ = static_cast<char>(0x80 | (code & 0x3f));
+    }
+    else if (code < 0x10000)
+    {
+        *out++ = static_cast<char>(0xe0 | (code >> 12));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        *out++ = static_cast<char>(0x80 | (code & 0x3f));
+    }
+    else
+    {
+        *out++ = static_cast<char>(0xf0 | (code >> 18));
+        *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        *out++ = static_cast<char>(0x80 | (code & 0x3f));
+    }
+    return out;
+}
+
+// Copies text into the arena with the entities replaced, which only ever
+// makes it shorter. Unknown entities are kept as they are.
+char *decode(Arena &arena, const char *p, const char *end, int *length = nullptr)
+{
+    char *text = static_cast<char *>(arena.allocate(end - p + 1));
+    char *out = text;
+    while (p < end)
+    {
+        const char *semicolon = *p == '&' ? static_cast<const char *>(memchr(p, ';', std::min<ptrdiff_t>(end - p, 12)))
+                                : nullptr;
+        if (semicolon == nullptr)
+        {
+            *out++ = *p++;
+            continue;
+        }
+        const std::string_view entity(p + 1, semicolon - p - 1);
+        if (entity == "lt")
+            *out++ = '<';
+        else if (entity == "gt")
+            *out++ = '>';
+        else if (entity == "amp")
+            *out++ = '&';
+        else if (entity == "quot")
+            *out++ = '"';
+        else if (entity == "apos")
+            *out++ = '\'';
+        else if (entity.size() > 1 && entity[0] == '#')
+        {
+            char *last = nullptr;
+            const unsigned long code = entity[1] == 'x' ? strtoul(entity.data() + 2, &last, 16)
+                                       : strtoul(entity.data() + 1, &last, 10);
+            if (last != semicolon || code > 0x10ffff)
+            {
+                *out++ = *p++;
+                continue;
+            }
+            out = encode(out, code);
+        }
+        else
+        {
+            *out++ = *p++;
+            continue;
+        }
+        p = semicolon + 1;
+    }
+    *out = '\0';
+    if (length != nullptr)
+        *length = static_cast<int>(out - text);
+    return text;
+}
+
+}
+
+// -- Arena ------------------------------------------------------------------
+
+struct Arena::Block
+{
+    Block *next;
+    size_t size;
+};
+
+Arena::Arena(size_t chunkSize) : m_ChunkSize(chunkSize)
+{
+}
+
+Arena::~Arena()
+{
+    freeBlocks();
+}
+
+Arena::Block *Arena::newBlock(size_t size)
+{
+    Block *block = static_cast<Block *>(malloc(align(sizeof(Block)) + size));
+    if (block == nullptr)
+        throw std::bad_alloc();
+    ++m_Mallocs;
+    block->next = m_Blocks;
+    block->size = size;
+    m_Blocks = block;
+    m_Reserved += size;
+    return block;
+}
+
+void Arena::freeBlocks()
+{
+    while (m_Blocks != nullptr)
+    {
+        Block *next = m_Blocks->next;
+        free(m_Blocks);
+        m_Blocks = next;
+    }
+    m_Next = m_End = nullptr;
+    m_Reserved = 0;
+}
+
+void *Arena::allocate(size_t size)
+{
+    size = align(std::max<size_t>(size, 1));
+    m_Used += size;
+    if (m_ChunkSize == 0)
+        return reinterpret_cast<char *>(newBlock(size)) + align(sizeof(Block));
+
+    if (static_cast<size_t>(m_End - m_Next) < size)
+    {
+        char *data = reinterpret_cast<char *>(newBlock(std::max(m_ChunkSize, size))) + align(sizeof(Block));
+        m_Next = data;
+        m_End = data + m_Blocks->size;
+    }
+    void *pointer = m_Next;
+    m_Next += size;
+    return pointer;
+}
+
+void Arena::reset()
+{
+    if (m_ChunkSize == 0 || (m_Blocks != nullptr && m_Blocks->next != nullptr))
+    {
+        // One chunk was not enough, start over with one that would have been.
+        if (m_ChunkSize != 0)
+            m_ChunkSize = std::min(std::max(m_ChunkSize, m_Used), MaxChunkSize);
+        freeBlocks();
+    }
+    else if (m_Blocks != nullptr)
+    {
+        m_Next = reinterpret_cast<char *>(m_Blocks) + align(sizeof(Block));
+    }
+    m_Used = 0;
+}
+
+// -- Reader -----------------------------------------------------------------
+
+Reader::Reader(size_t chunkSize) : m_Arena(chunkSize)
+{
+}
+
+void Reader::append(const char *data, size_t size)
+{
+    // Drop the messages already parsed, no tree points into the buffer.
+    if (m_Begin > 0)
+    {
+        m_Buffer.erase(0, m_Begin);
+        m_Scan -= m_Begin;
+        m_Begin = 0;
+    }
+    m_Buffer.append(data, size);
+}
+
+bool Reader::scan(size_t &end)
+{
+    for (; m_Scan < m_Buffer.size(); ++m_Scan)
+    {
+        const char c = m_Buffer[m_Scan];
+        switch (m_State)
+        {
+            case State::Outside:
+                if (c == '<')
+                {
+                    m_Begin = m_Scan;
+                    m_State = State::Open;
+                }
+                break;
+
+            case State::Text:
+                if (c == '<')
+                    m_State = State::Open;
+                break;
+
+            case State::Open:
+                m_State = c == '/' ? State::Close : c == '?' || c == '!' ? State::Special : State::Tag;
+                break;
+
+            case State::Tag:
+                if (c == '"' || c == '\'')
+                {
+                    m_Quote = c;
+                    m_State = State::Quote;
+                }
+                else if (c == '/')
+                    m_State = State::SelfClose;
+                else if (c == '>')
+                {
+                    ++m_Depth;
+                    m_State = State::Text;
+                }
+                break;
+
+            case State::Quote:
+                if (c == m_Quote)
+                    m_State = State::Tag;
+                break;
+
+            case State::SelfClose:
+                m_State = c == '>' ? State::Text : State::Tag;
+                if (c == '>' && m_Depth == 0)
+                {
+                    end = ++m_Scan;
+                    m_State = State::Outside;
+                    return true;
+                }
+                break;
+
+            case State::Close:
+                if (c == '>')
+                {
+                    m_State = State::Text;
+                    // A stray closing tag ends a message too, parse() rejects it.
+                    if (--m_Depth <= 0)
+                    {
+                        m_Depth = 0;
+                        end = ++m_Scan;
+                        m_State = State::Outside;
+                        return true;
+                    }
+                }
+                break;
+
+            case State::Special:
+                if (c == '>')
+                    m_State = m_Depth == 0 ? State::Outside : State::Text;
+                break;
+        }
+    }
+    // Nothing but space or declarations so far.
+    if (m_State == State::Outside)
+        m_Begin = m_Scan;
+    return false;
+}
+
+XMLEle *Reader::next()
+{
+    m_Arena.reset();
+    size_t end = 0;
+    while (scan(end))
+    {
+        const size_t begin = m_Begin;
+        m_Begin = end;
+        if (XMLEle *root = parse(m_Buffer.data() + begin, m_Buffer.data() + end))
+            return root;
+        ++m_Errors;
+        m_Arena.reset();
+    }
+    return nullptr;
+}
+
+XMLEle *Reader::parse(const char *p, const char *end)
+{
+    XMLEle *current = nullptr;
+    while (p < end)
+    {
+        if (*p != '<')
+        {
+            const char *text = p;
+            p = static_cast<const char *>(memchr(p, '<', end - p));
+            if (p == nullptr)
+                p = end;
+            // Space around the children is not content.
+            if (current == nullptr ||
+                    (skipSpace(text, p) == p && (current->el != nullptr || (p + 1 < end && p[1] != '/'))))
+                continue;
+            int length = 0;
+            char *pcdata = decode(m_Arena, text, p, &length);
+            if (current->pcdatalen > 0)
+            {
+                char *joined = static_cast<char *>(m_Arena.allocate(current->pcdatalen + length + 1));
+                memcpy(joined, current->pcdata, current->pcdatalen);
+                memcpy(joined + current->pcdatalen, pcdata, length + 1);
+                pcdata = joined;
+            }
+            current->pcdata = pcdata;
+            current->pcdatalen += length;
+            continue;
+        }
+
+        if (p + 1 < end && (p[1] == '?' || p[1] == '!'))
+        {
+            const bool comment = end - p >= 4 && memcmp(p, "<!--", 4) == 0;
+            const char *close = comment ? std::search(p + 4, end, "-->", "-->" + 3)
+                                : static_cast<const char *>(memchr(p, '>', end - p));
+            if (close == nullptr || close == end)
+                break;
+            p = close + (comment ? 3 : 1);
+            continue;
+        }
+
+        if (p + 1 < end && p[1] == '/')
+        {
+            const char *name = p + 2;
+            const char *close = static_cast<const char *>(memchr(name, '>', end - name));
+            if (close == nullptr)
+                break;
+            const char *nameEnd = name;
+            while (nameEnd < close && !isNameEnd(*nameEnd))
+                ++nameEnd;
+            if (current == nullptr || strncmp(current->tag, name, nameEnd - name) != 0 ||
+                    current->tag[nameEnd - name] != '\0')
+            {
+                m_LastError = "unexpected </" + std::string(name, nameEnd) + ">";
+                return nullptr;
+            }
+            p = close + 1;
+            if (current->pe == nullptr)
+                return current;
+            current = current->pe;
+            continue;
+        }
+
+        // <tag
+        XMLEle *element = static_cast<XMLEle *>(m_Arena.allocate(sizeof(XMLEle)));
+        memset(element, 0, sizeof(XMLEle));
+        const char *name = ++p;
+        while (p < end && !isNameEnd(*p))
+            ++p;
+        if (p == name)
+        {
+            m_LastError = "element without a tag";
+            return nullptr;
+        }
+        element->tag = decode(m_Arena, name, p);
+        element->pe = current;
+        if (current != nullptr)
+        {
+            if (current->lastEl != nullptr)
+                current->lastEl->next = element;
+            else
+                current->el = current->eit = element;
+            current->lastEl = element;
+            ++current->nel;
+        }
+
+        // attributes, up to > or />
+        for (;;)
+        {
+            p = skipSpace(p, end);
+            if (p >= end)
+            {
+                m_LastError = std::string("unterminated <") + element->tag;
+                return nullptr;
+            }
+            if (*p == '>')
+            {
+                ++p;
+                current = element;
+                break;
+            }
+            if (*p == '/' && p + 1 < end && p[1] == '>')
+            {
+                p += 2;
+                if (current == nullptr)
+                    return element;
+                break;
+            }
+
+            const char *attribute = p;
+            while (p < end && !isNameEnd(*p))
+                ++p;
+            const char *attributeEnd = p;
+            p = skipSpace(p, end);
+            if (attributeEnd == attribute || p >= end || *p != '=')
+            {
+                m_LastError = std::string("bad attribute in <") + element->tag;
+                return nullptr;
+            }
+            p = skipSpace(p + 1, end);
+            const char quote = p < end ? *p : '\0';
+            const char *close = quote == '"' || quote == '\'' ? static_cast<const char *>(memchr(p + 1, quote, end - p - 1))
+                                : nullptr;
+            if (close == nullptr)
+            {
+                m_LastError = std::string("unquoted attribute in <") + element->tag;
+                return nullptr;
+            }
+
+            XMLAtt *att = static_cast<XMLAtt *>(m_Arena.allocate(sizeof(XMLAtt)));
+            att->name = decode(m_Arena, attribute, attributeEnd);
+            att->valu = decode(m_Arena, p + 1, close);
+            att->ce = element;
+            att->next = nullptr;
+            if (element->lastAt != nullptr)
+                element->lastAt->next = att;
+            else
+                element->at = element->ait = att;
+            element->lastAt = att;
+            ++element->nat;
+            p = close + 1;
+        }
+    }
+    m_LastError = "incomplete message";
+    return nullptr;
+}
+
+// -- Accessors --------------------------------------------------------------
+
+char *tagXMLEle(XMLEle *ep)
+{
+    return ep->tag;
+}
+
+char *pcdataXMLEle(XMLEle *ep)
+{
+    static char empty[1] = "";
+    return ep->pcdata != nullptr ? ep->pcdata : empty;
+}
+
+int pcdatalenXMLEle(XMLEle *ep)
+{
+    return ep->pcdatalen;
+}
+
+XMLEle *parentXMLEle(XMLEle *ep)
+{
+    return ep->pe;
+}
+
+int nXMLEle(XMLEle *ep)
+{
+    return ep->nel;
+}
+
+int nXMLAtt(XMLEle *ep)
+{
+    return ep->nat;
+}
+
+XMLEle *findXMLEle(XMLEle *ep, const char *tag)
+{
+    for (XMLEle *child = ep->el; child != nullptr; child = child->next)
+        if (strcmp(child->tag, tag) == 0)
+            return child;
+    return nullptr;
+}
+
+XMLEle *nextXMLEle(XMLEle *ep, int init)
+{
+    if (init)
+        ep->eit = ep->el;
+    XMLEle *child = ep->eit;
+    if (child != nullptr)
+        ep->eit = child->next;
+    return child;
+}
+
+XMLAtt *findXMLAtt(XMLEle *ep, const char *name)
+{
+    for (XMLAtt *att = ep->at; att != nullptr; att = att->next)
+        if (strcmp(att->name, name) == 0)
+            return att;
+    return nullptr;
+}
+
+const char *findXMLAttValu(XMLEle *ep, const char *name)
+{
+    XMLAtt *att = findXMLAtt(ep, name);
+    return att != nullptr ? att->valu : "";
+}
+
+XMLAtt *nextXMLAtt(XMLEle *ep, int init)
+{
+    if (init)
+        ep->ait = ep->at;
+    XMLAtt *att = ep->ait;
+    if (att != nullptr)
+        ep->ait = att->next;
+    return att;
+}
+
+char *nameXMLAtt(XMLAtt *ap)
+{
+    return ap->name;
+}
+
+char *valuXMLAtt(XMLAtt *ap)
+{
+    return ap->valu;
+}
+
+}
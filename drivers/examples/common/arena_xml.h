@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Parses INDI XML messages into trees allocated from a bump arena that
+ * is reset after each message.
+ *
+ * lilxml, which parses the messages of ISSnoopDevice() and of the clients,
+ * mallocs every element, attribute, name and value of a message and frees
+ * them all again once the message has been dispatched. On a busy server that
+ * is thousands of short lived allocations a second between the longer lived
+ * ones of the drivers, which fragments the heap of a host that runs for
+ * weeks. Here a message is parsed into one arena that is rewound when the
+ * next message is read: once the arena has grown to the largest message seen
+ * there are no allocations at all.
+ *
+ * The tree keeps the accessors of lilxml, with the same names and signatures,
+ * found through argument dependent lookup, so code written against lilxml's
+ * XMLEle works on ArenaXml::XMLEle as it is:
+ *
+ * @code
+ * ArenaXml::Reader reader;
+ * reader.append(buffer, size);
+ * while (ArenaXml::XMLEle *root = reader.next())
+ * {
+ *     // The tree is valid until the next call to next().
+ *     if (!strcmp(tagXMLEle(root), "setNumberVector"))
+ *         for (ArenaXml::XMLEle *ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
+ *             update(findXMLAttValu(ep, "name"), atof(pcdataXMLEle(ep)));
+ * }
+ * @endcode
+ *
+ * Do not bring the namespace in with using, its XMLEle would clash with
+ * lilxml's in files that include both.
+ */
+namespace ArenaXml
+{
+
+/**
+ * @brief Bump allocator of the tree of one message.
+ *
+ * Allocations are carved out of a chunk. reset() rewinds it; a message that
+ * did not fit is freed and the chunk grows to its size, up to MaxChunkSize,
+ * so a large BLOB does not stay reserved.
+ */
+class Arena
+{
+public:
+    static constexpr size_t DefaultChunkSize = 16 * 1024;
+    static constexpr size_t MaxChunkSize = 1024 * 1024;
+
+    /** @param chunkSize 0 mallocs every allocation on its own, like lilxml, for comparisons. */
+    explicit Arena(size_t chunkSize = DefaultChunkSize);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size);
+
+    /** @brief Free everything allocated since the last reset. */
+    void reset();
+
+    /** @brief Bytes allocated since the last reset. */
+    size_t used() const
+    {
+        return m_Used;
+    }
+
+    /** @brief Bytes held from the system. */
+    size_t reserved() const
+    {
+        return m_Reserved;
+    }
+
+    /** @brief Calls to malloc() so far. */
+    uint64_t mallocs() const
+    {
+        return m_Mallocs;
+    }
+
+private:
+    struct Block;
+
+    Block *newBlock(size_t size);
+    void freeBlocks();
+
+    size_t m_ChunkSize;
+    // All blocks since the last reset, newest first.
+    Block *m_Blocks {nullptr};
+    char *m_Next {nullptr};
+    char *m_End {nullptr};
+
+    size_t m_Used {0};
+    size_t m_Reserved {0};
+    uint64_t m_Mallocs {0};
+};
+
+struct XMLEle;
+
+struct XMLAtt
+{
+    char *name;
+    char *valu;
+    XMLEle *ce;
+    XMLAtt *next;
+};
+
+struct XMLEle
+{
+    char *tag;
+    XMLEle *pe;
+
+    XMLAtt *at;
+    XMLAtt *lastAt;
+    int nat;
+
+    XMLEle *el;
+    XMLEle *lastEl;
+    int nel;
+    XMLEle *next;
+
+    char *pcdata;
+    int pcdatalen;
+
+    // What nextXMLEle() and nextXMLAtt() return next.
+    XMLEle *eit;
+    XMLAtt *ait;
+};
+
+/**
+ * @brief Splits a stream into messages, the way lilxml's readXMLEle() does,
+ * and parses each into the arena.
+ *
+ * Only a complete message is parsed, the bytes of one are scanned once as they
+ * arrive, so a BLOB coming in over many reads does not get parsed again each
+ * time. Processing instructions and comments are skipped.
+ */
+class Reader
+{
+public:
+    explicit Reader(size_t chunkSize = Arena::DefaultChunkSize);
+
+    /** @brief Bytes read from the connection. */
+    void append(const char *data, size_t size);
+
+    /**
+     * @brief The next complete message, nullptr when there is none yet.
+     *
+     * Frees the tree of the previous message. A message that is not well
+     * formed is skipped, counted in errors() and described by lastError().
+     */
+    XMLEle *next();
+
+    uint64_t errors() const
+    {
+        return m_Errors;
+    }
+
+    const std::string &lastError() const
+    {
+        return m_LastError;
+    }
+
+    const Arena &arena() const
+    {
+        return m_Arena;
+    }
+
+private:
+    enum class State
+    {
+        Outside,
+        Text,
+        Open,
+        Tag,
+        Quote,
+        SelfClose,
+        Close,
+        Special
+    };
+
+    // Looks for the end of the message starting at m_Begin.
+    bool scan(size_t &end);
+    XMLEle *parse(const char *p, const char *end);
+
+    Arena m_Arena;
+    std::string m_Buffer;
+
+    // Start of the message being scanned, and how far the scan got.
+    size_t m_Begin {0};
+    size_t m_Scan {0};
+    State m_State {State::Outside};
+    char m_Quote {0};
+    int m_Depth {0};
+
+    uint64_t m_Errors {0};
+    std::string m_LastError;
+};
+
+// The accessors of lilxml.
+
+char *tagXMLEle(XMLEle *ep);
+char *pcdataXMLEle(XMLEle *ep);
+int pcdatalenXMLEle(XMLEle *ep);
+XMLEle *parentXMLEle(XMLEle *ep);
+int nXMLEle(XMLEle *ep);
+int nXMLAtt(XMLEle *ep);
+
+/** @brief The first child with the tag, nullptr if none. */
+XMLEle *findXMLEle(XMLEle *ep, const char *tag);
+/** @brief The children one by one, init 1 to start over, nullptr after the last. */
+XMLEle *nextXMLEle(XMLEle *ep, int init);
+
+XMLAtt *findXMLAtt(XMLEle *ep, const char *name);
+/** @brief The value of the attribute, "" if there is none. */
+const char *findXMLAttValu(XMLEle *ep, const char *name);
+XMLAtt *nextXMLAtt(XMLEle *ep, int init);
+
+char *nameXMLAtt(XMLAtt *ap);
+char *valuXMLAtt(XMLAtt *ap);
+
+}
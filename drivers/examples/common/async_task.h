@@ -0,0 +1,584 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <unistd.h>
+
+/**
+ * @brief Coroutines for multi-step device protocols, run by the driver's event loop.
+ *
+ * A handshake that queries the firmware, then the limits, then the position,
+ * or a park that rotates the dome and then closes the shutter, is written as
+ * one function, but every wait returns to the event loop, so client requests
+ * and other devices are served in between:
+ *
+ *     Async::Task<> DummyDome::park()
+ *     {
+ *         MoveAbs(GetAxis1Park());
+ *         co_await Async::waitUntil(loop, MotionChanged, [this] { return atPark(); }, 120000);
+ *         ControlShutter(SHUTTER_CLOSE);
+ *         ...
+ *     }
+ *
+ * Task<T> is a lazily started coroutine that other tasks co_await. A Runner
+ * owns the outermost one; destroying or cancelling the Runner destroys the
+ * whole chain, and the timers and fd callbacks it was waiting on are removed.
+ *
+ * Needs C++20. Everything here is independent of libindi, async_task_indi.h
+ * connects it to the INDI event loop.
+ */
+namespace Async
+{
+
+/** @brief What a task waits on. Callbacks are called from the loop's thread. */
+class Loop
+{
+public:
+    virtual ~Loop() = default;
+
+    /** @brief The time timers run on, for deadlines. */
+    virtual std::chrono::nanoseconds now() const = 0;
+
+    /** @brief Call callback once after ms. @return timer id. */
+    virtual int addTimer(int ms, std::function<void()> callback) = 0;
+    virtual void removeTimer(int id) = 0;
+
+    /** @brief Call callback whenever fd is readable, until removed. @return callback id. */
+    virtual int addReader(int fd, std::function<void()> callback) = 0;
+    virtual void removeReader(int id) = 0;
+};
+
+template <typename T = void>
+class Task;
+
+namespace Detail
+{
+
+// Resumes the awaiting coroutine when a task finishes after having waited.
+// A task that finishes without waiting returns to Task::await_suspend(),
+// which carries on with the caller, so loops of such calls do not nest.
+struct FinalAwaiter
+{
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+        if (handle.promise().awaited)
+            return handle.promise().continuation;
+        return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept
+    {
+    }
+};
+
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation;
+    bool awaited {false};
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    // Drivers do not throw, an exception escaping a task is a bug.
+    void unhandled_exception() noexcept
+    {
+        std::abort();
+    }
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    void return_value(T result)
+    {
+        value = std::move(result);
+    }
+
+    T result()
+    {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void()
+    {
+    }
+
+    void result()
+    {
+    }
+};
+
+// Shared between a registration with the loop and the awaiter that made it:
+// a callback that fires after the awaiter is gone must not resume anything.
+struct Wakeup
+{
+    std::coroutine_handle<> handle;
+    bool cancelled {false};
+};
+
+}
+
+template <typename T>
+class Task
+{
+public:
+    using promise_type = Detail::Promise<T>;
+
+    Task(Task &&other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr))
+    {
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_Handle)
+                m_Handle.destroy();
+            m_Handle = std::exchange(other.m_Handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (m_Handle)
+            m_Handle.destroy();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        m_Handle.promise().continuation = caller;
+        m_Handle.resume();
+        if (m_Handle.done())
+            return false;
+        m_Handle.promise().awaited = true;
+        return true;
+    }
+
+    T await_resume()
+    {
+        return m_Handle.promise().result();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_Handle(handle)
+    {
+    }
+
+    friend promise_type;
+    friend class Runner;
+    std::coroutine_handle<promise_type> m_Handle;
+};
+
+namespace Detail
+{
+
+template <typename T>
+Task<T> Promise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}
+
+/**
+ * @brief Owns the outermost task of a sequence and starts it.
+ *
+ * Do not cancel or restart a Runner from inside the task it runs.
+ */
+class Runner
+{
+public:
+    /** @brief Cancel what is running, then run task until its first wait. */
+    void start(Task<> task)
+    {
+        cancel();
+        m_Task.emplace(std::move(task));
+        m_Task->m_Handle.resume();
+    }
+
+    /** @brief Destroy the running task, its pending waits are removed from the loop. */
+    void cancel()
+    {
+        m_Task.reset();
+    }
+
+    bool running() const
+    {
+        return m_Task && !m_Task->m_Handle.done();
+    }
+
+private:
+    std::optional<Task<>> m_Task;
+};
+
+/** @brief Awaited by sleepFor(). */
+class SleepAwaiter
+{
+public:
+    SleepAwaiter(Loop &loop, int ms) : m_Loop(loop), m_Ms(ms)
+    {
+    }
+
+    SleepAwaiter(const SleepAwaiter &) = delete;
+
+    ~SleepAwaiter()
+    {
+        if (m_Wakeup)
+        {
+            m_Wakeup->cancelled = true;
+            m_Loop.removeTimer(m_Timer);
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_Wakeup = std::make_shared<Detail::Wakeup>();
+        m_Wakeup->handle = handle;
+        m_Timer = m_Loop.addTimer(m_Ms, [this, wakeup = m_Wakeup]
+        {
+            if (wakeup->cancelled)
+                return;
+            m_Wakeup.reset();
+            wakeup->handle.resume();
+        });
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+
+private:
+    Loop &m_Loop;
+    int m_Ms;
+    int m_Timer {-1};
+    std::shared_ptr<Detail::Wakeup> m_Wakeup;
+};
+
+/** @brief co_await sleepFor(loop, ms): resume after ms. */
+inline SleepAwaiter sleepFor(Loop &loop, int ms)
+{
+    return SleepAwaiter(loop, ms);
+}
+
+/** @brief Awaited by readable(). */
+class ReadableAwaiter
+{
+public:
+    ReadableAwaiter(Loop &loop, int fd, int timeoutMs) : m_Loop(loop), m_Fd(fd), m_TimeoutMs(timeoutMs)
+    {
+    }
+
+    ReadableAwaiter(const ReadableAwaiter &) = delete;
+
+    ~ReadableAwaiter()
+    {
+        unregister();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_Wakeup = std::make_shared<Detail::Wakeup>();
+        m_Wakeup->handle = handle;
+        m_Reader = m_Loop.addReader(m_Fd, [this, wakeup = m_Wakeup]
+        {
+            if (!wakeup->cancelled)
+                finish(true);
+        });
+        if (m_TimeoutMs >= 0)
+        {
+            m_Timer = m_Loop.addTimer(m_TimeoutMs, [this, wakeup = m_Wakeup]
+            {
+                if (wakeup->cancelled)
+                    return;
+                m_Timer = -1;
+                finish(false);
+            });
+        }
+    }
+
+    bool await_resume() const noexcept
+    {
+        return m_Ready;
+    }
+
+private:
+    void finish(bool ready)
+    {
+        m_Ready = ready;
+        const std::coroutine_handle<> handle = m_Wakeup->handle;
+        unregister();
+        handle.resume();
+    }
+
+    void unregister()
+    {
+        if (!m_Wakeup)
+            return;
+        m_Wakeup->cancelled = true;
+        m_Wakeup.reset();
+        m_Loop.removeReader(m_Reader);
+        if (m_Timer != -1)
+            m_Loop.removeTimer(m_Timer);
+        m_Timer = -1;
+    }
+
+    Loop &m_Loop;
+    int m_Fd;
+    int m_TimeoutMs;
+    int m_Reader {-1};
+    int m_Timer {-1};
+    bool m_Ready {false};
+    std::shared_ptr<Detail::Wakeup> m_Wakeup;
+};
+
+/** @brief co_await readable(loop, fd, timeoutMs): true once fd can be read, false on timeout. */
+inline ReadableAwaiter readable(Loop &loop, int fd, int timeoutMs)
+{
+    return ReadableAwaiter(loop, fd, timeoutMs);
+}
+
+/**
+ * @brief Something a task can wait for, typically a property changing.
+ *
+ * The driver calls notify() wherever it updates the property, tasks waiting
+ * in wait() or waitUntil() resume and check whether it is what they wait for.
+ * Declare it before the Runner of the tasks that wait on it, so it outlives them.
+ */
+class Event
+{
+public:
+    class Waiter
+    {
+    public:
+        Waiter(Event &event, Loop &loop, int timeoutMs) : m_Event(event), m_Loop(loop), m_TimeoutMs(timeoutMs)
+        {
+        }
+
+        Waiter(const Waiter &) = delete;
+
+        ~Waiter()
+        {
+            unregister();
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_Wakeup = std::make_shared<Detail::Wakeup>();
+            m_Wakeup->handle = handle;
+            m_Event.m_Waiters.push_back(this);
+            if (m_TimeoutMs >= 0)
+            {
+                m_Timer = m_Loop.addTimer(m_TimeoutMs, [this, wakeup = m_Wakeup]
+                {
+                    if (wakeup->cancelled)
+                        return;
+                    m_Timer = -1;
+                    finish(false);
+                });
+            }
+        }
+
+        /** @brief true if notified, false on timeout. */
+        bool await_resume() const noexcept
+        {
+            return m_Notified;
+        }
+
+    private:
+        friend class Event;
+
+        void finish(bool notified)
+        {
+            m_Notified = notified;
+            const std::coroutine_handle<> handle = m_Wakeup->handle;
+            unregister();
+            handle.resume();
+        }
+
+        void unregister()
+        {
+            if (!m_Wakeup)
+                return;
+            m_Wakeup->cancelled = true;
+            m_Wakeup.reset();
+            m_Event.remove(this);
+            if (m_Timer != -1)
+                m_Loop.removeTimer(m_Timer);
+            m_Timer = -1;
+        }
+
+        Event &m_Event;
+        Loop &m_Loop;
+        int m_TimeoutMs;
+        int m_Timer {-1};
+        bool m_Notified {false};
+        std::shared_ptr<Detail::Wakeup> m_Wakeup;
+    };
+
+    Event() = default;
+    Event(const Event &) = delete;
+
+    /** @brief co_await event.wait(loop, timeoutMs), negative timeoutMs waits forever. */
+    Waiter wait(Loop &loop, int timeoutMs = -1)
+    {
+        return Waiter(*this, loop, timeoutMs);
+    }
+
+    /** @brief Resume the tasks waiting now. Tasks that wait again wait for the next notify(). */
+    void notify()
+    {
+        m_Firing.insert(m_Firing.end(), m_Waiters.begin(), m_Waiters.end());
+        m_Waiters.clear();
+        // Called again by a task resumed below: the outer call resumes them.
+        if (m_Notifying)
+            return;
+
+        // A resumed task may end, or cancel others, which removes them from m_Firing.
+        m_Notifying = true;
+        while (!m_Firing.empty())
+        {
+            Waiter *waiter = m_Firing.front();
+            m_Firing.erase(m_Firing.begin());
+            waiter->finish(true);
+        }
+        m_Notifying = false;
+    }
+
+private:
+    void remove(Waiter *waiter)
+    {
+        for (auto *list : {&m_Waiters, &m_Firing})
+        {
+            for (auto it = list->begin(); it != list->end(); ++it)
+            {
+                if (*it == waiter)
+                {
+                    list->erase(it);
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<Waiter *> m_Waiters;
+    std::vector<Waiter *> m_Firing;
+    bool m_Notifying {false};
+};
+
+/**
+ * @brief Wait until condition() holds, checked now and on every notify() of event.
+ * @param timeoutMs negative waits forever.
+ * @return false on timeout.
+ */
+template <typename Condition>
+Task<bool> waitUntil(Loop &loop, Event &event, Condition condition, int timeoutMs)
+{
+    const auto deadline = loop.now() + std::chrono::milliseconds(timeoutMs);
+    while (!condition())
+    {
+        if (timeoutMs < 0)
+        {
+            co_await event.wait(loop);
+            continue;
+        }
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - loop.now());
+        if (left.count() <= 0 || !co_await event.wait(loop, static_cast<int>(left.count())))
+            co_return condition();
+    }
+    co_return true;
+}
+
+/**
+ * @brief Read an answer up to and including terminator, like tty_read_section(),
+ * but return to the loop while the device is thinking.
+ *
+ * For request and answer protocols: whatever the device sent after the
+ * terminator in the same chunk is dropped.
+ * @return the answer, nothing on timeout or error.
+ */
+inline Task<std::optional<std::string>> readSection(Loop &loop, int fd, char terminator, int timeoutMs)
+{
+    const auto deadline = loop.now() + std::chrono::milliseconds(timeoutMs);
+    std::string answer;
+    for (;;)
+    {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - loop.now());
+        if (left.count() <= 0 || !co_await readable(loop, fd, static_cast<int>(left.count())))
+            co_return std::nullopt;
+
+        char chunk[256];
+        const ssize_t size = ::read(fd, chunk, sizeof(chunk));
+        if (size < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (size <= 0)
+            co_return std::nullopt;
+
+        answer.append(chunk, size);
+        const size_t end = answer.find(terminator);
+        if (end != std::string::npos)
+        {
+            answer.resize(end + 1);
+            co_return answer;
+        }
+    }
+}
+
+}
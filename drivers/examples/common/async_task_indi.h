@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+
+#include "libindi/eventloop.h"
+
+#include "async_task.h"
+#include "virtual_clock_device.h"
+
+namespace Async
+{
+
+/**
+ * @brief Runs tasks on the INDI event loop of the driver.
+ *
+ * Timers go through VirtualClock::shared() like SetTimer() of a
+ * VirtualClockDevice, so sleeps and timeouts follow INDI_VIRTUAL_CLOCK. File
+ * descriptors are watched with IEAddCallback().
+ */
+class IndiLoop : public Loop
+{
+public:
+    static IndiLoop &shared()
+    {
+        static IndiLoop loop;
+        return loop;
+    }
+
+    std::chrono::nanoseconds now() const override
+    {
+        return VirtualClock::shared().now();
+    }
+
+    int addTimer(int ms, std::function<void()> callback) override
+    {
+        VirtualClockEventLoop::attach();
+        return VirtualClock::shared().addTimer(std::chrono::milliseconds(ms), std::move(callback));
+    }
+
+    void removeTimer(int id) override
+    {
+        VirtualClock::shared().removeTimer(id);
+    }
+
+    int addReader(int fd, std::function<void()> callback) override
+    {
+        auto *stored = new std::function<void()>(std::move(callback));
+        const int id = IEAddCallback(fd, &IndiLoop::readable, stored);
+        m_Readers[id] = stored;
+        return id;
+    }
+
+    void removeReader(int id) override
+    {
+        auto reader = m_Readers.find(id);
+        if (reader == m_Readers.end())
+            return;
+        IERmCallback(id);
+        delete reader->second;
+        m_Readers.erase(reader);
+    }
+
+private:
+    static void readable(int, void *userpointer)
+    {
+        // The callback usually removes itself, call a copy.
+        std::function<void()> callback = *static_cast<std::function<void()> *>(userpointer);
+        callback();
+    }
+
+    std::map<int, std::function<void()> *> m_Readers;
+};
+
+}
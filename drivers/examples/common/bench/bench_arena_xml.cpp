@@ -0,0 +1,356 @@
+// Replays a day of the messages a busy observatory sends through indiserver,
+// a mount sending its coordinates ten times a second, a dome, a focuser, a
+// camera and a weather station, with a client connecting every ten minutes and
+// getting all the definitions, and parses them the way a driver or client
+// reading them would. Prints messages per second and the resident memory
+// before, after and at the highest, with the parser allocating every element,
+// attribute and string on its own, like lilxml, and with the arena. The
+// memory the consumer needs is all there after the first hour, growth after
+// that is the heap fragmenting. Built against libindi, lilxml itself is
+// measured too.
+//
+// The messages are handed to a consumer that keeps the last value of every
+// element and the last log messages, so the per message allocations of the
+// parser are interleaved with longer lived ones, like in a real process. Each
+// parser runs in a process of its own, the resident memory of one does not
+// carry over to the next.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(HAVE_LILXML)
+#include "libindi/lilxml.h"
+#endif
+
+#include "arena_xml.h"
+#include "bench_util.h"
+
+namespace
+{
+
+// -- Traffic ----------------------------------------------------------------
+
+class Traffic
+{
+public:
+    explicit Traffic(uint32_t seed) : m_Seed(seed) {}
+
+    // One hour of messages.
+    std::string hour()
+    {
+        std::string out;
+        for (int second = 0; second < 3600; ++second)
+        {
+            for (int tenth = 0; tenth < 10; ++tenth)
+                numbers("Telescope Simulator", "EQUATORIAL_EOD_COORD", {{"RA", 24}, {"DEC", 90}}, out);
+            numbers("Telescope Simulator", "HORIZONTAL_COORD", {{"AZ", 360}, {"ALT", 90}}, out);
+            numbers("Dome Simulator", "ABS_DOME_POSITION", {{"DOME_ABSOLUTE_POSITION", 360}}, out);
+            numbers("CCD Simulator", "CCD_EXPOSURE", {{"CCD_EXPOSURE_VALUE", 300}}, out);
+            if (second % 2 == 0)
+            {
+                numbers("Focuser Simulator", "ABS_FOCUS_POSITION", {{"FOCUS_ABSOLUTE_POSITION", 100000}}, out);
+                numbers("Focuser Simulator", "FOCUS_TEMPERATURE", {{"TEMPERATURE", 30}}, out);
+            }
+            if (second % 10 == 0)
+                numbers("Weather Simulator", "WEATHER_PARAMETERS",
+                {
+                    {"WEATHER_TEMPERATURE", 30}, {"WEATHER_HUMIDITY", 100}, {"WEATHER_PRESSURE", 1100},
+                    {"WEATHER_WIND_SPEED", 50}, {"WEATHER_WIND_GUST", 80}, {"WEATHER_RAIN_HOUR", 10},
+                    {"WEATHER_CLOUD_COVER", 100}, {"WEATHER_SKY_QUALITY", 22}
+                }, out);
+            if (second % 60 == 30)
+                message("CCD Simulator", "Exposure done, downloading image...", out);
+            if (second % 600 == 0)
+                definitions(out);
+        }
+        return out;
+    }
+
+    uint64_t messages() const
+    {
+        return m_Messages;
+    }
+
+private:
+    struct Element
+    {
+        const char *name;
+        double range;
+    };
+
+    double random()
+    {
+        m_Seed = m_Seed * 1664525 + 1013904223;
+        return (m_Seed >> 8) / 16777216.0;
+    }
+
+    void numbers(const char *device, const char *name, std::initializer_list<Element> elements, std::string &out)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "<setNumberVector device=\"%s\" name=\"%s\" state=\"Busy\" timeout=\"60\" "
+                 "timestamp=\"2026-10-18T21:%02d:%02d\">\n", device, name, static_cast<int>(random() * 60),
+                 static_cast<int>(random() * 60));
+        out += line;
+        for (const auto &element : elements)
+        {
+            snprintf(line, sizeof(line), "    <oneNumber name=\"%s\">\n      %.6f\n    </oneNumber>\n", element.name,
+                     random() * element.range);
+            out += line;
+        }
+        out += "</setNumberVector>\n";
+        ++m_Messages;
+    }
+
+    void message(const char *device, const char *text, std::string &out)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "<message device=\"%s\" timestamp=\"2026-10-18T21:00:00\" message=\"%s\"/>\n",
+                 device, text);
+        out += line;
+        ++m_Messages;
+    }
+
+    // What a client connecting gets, about 150 definitions.
+    void definitions(std::string &out)
+    {
+        const char *devices[] = {"Telescope Simulator", "Dome Simulator", "CCD Simulator", "Focuser Simulator",
+                                 "Weather Simulator"
+                                };
+        char line[512];
+        for (const char *device : devices)
+        {
+            for (int property = 0; property < 30; ++property)
+            {
+                const int elements = 1 + property % 7;
+                const char *kind = property % 3 == 0 ? "Switch" : property % 3 == 1 ? "Number" : "Text";
+                snprintf(line, sizeof(line), "<def%sVector device=\"%s\" name=\"PROPERTY_%d\" label=\"Property %d "
+                         "of the device\" group=\"Main Control\" state=\"Idle\" perm=\"rw\" timeout=\"60\"%s>\n",
+                         kind, device, property, property, property % 3 == 0 ? " rule=\"OneOfMany\"" : "");
+                out += line;
+                for (int element = 0; element < elements; ++element)
+                {
+                    if (property % 3 == 0)
+                        snprintf(line, sizeof(line), "    <defSwitch name=\"ELEMENT_%d\" label=\"Element %d\">\n"
+                                 "Off\n    </defSwitch>\n", element, element);
+                    else if (property % 3 == 1)
+                        snprintf(line, sizeof(line), "    <defNumber name=\"ELEMENT_%d\" label=\"Element %d\" "
+                                 "format=\"%%10.6m\" min=\"-90\" max=\"90\" step=\"0\">\n%.6f\n    </defNumber>\n",
+                                 element, element, random() * 180 - 90);
+                    else
+                        snprintf(line, sizeof(line), "    <defText name=\"ELEMENT_%d\" label=\"Element %d\">\n"
+                                 "/home/observer/images/%s/light_%06d.fits\n    </defText>\n", element, element,
+                                 device, static_cast<int>(random() * 1e6));
+                    out += line;
+                }
+                snprintf(line, sizeof(line), "</def%sVector>\n", kind);
+                out += line;
+                ++m_Messages;
+            }
+        }
+    }
+
+    uint32_t m_Seed;
+    uint64_t m_Messages {0};
+};
+
+// -- Consumer ---------------------------------------------------------------
+
+// What a driver or client keeps of the messages: the last value of every
+// element, the last log messages.
+struct Consumer
+{
+    std::unordered_map<std::string, std::string> values;
+    std::deque<std::string> log;
+    uint64_t messages {0};
+    std::string key;
+
+    // Unqualified, so lilxml's accessors are found for its XMLEle and
+    // ArenaXml's for theirs.
+    template <typename Element>
+    void dispatch(Element *root)
+    {
+        ++messages;
+        if (strcmp(tagXMLEle(root), "message") == 0)
+        {
+            log.emplace_back(findXMLAttValu(root, "message"));
+            if (log.size() > 100)
+                log.pop_front();
+            return;
+        }
+        key = findXMLAttValu(root, "device");
+        key += '.';
+        key += findXMLAttValu(root, "name");
+        key += '.';
+        const size_t property = key.size();
+        for (Element *ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
+        {
+            key.resize(property);
+            key += findXMLAttValu(ep, "name");
+            values[key].assign(pcdataXMLEle(ep), pcdatalenXMLEle(ep));
+        }
+    }
+};
+
+// -- Measurement ------------------------------------------------------------
+
+long rssKb()
+{
+    long pages = 0, resident = 0;
+    if (FILE *file = fopen("/proc/self/statm", "r"))
+    {
+        if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(file);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+struct Result
+{
+    uint64_t messages;
+    uint64_t errors;
+    uint64_t mallocs;
+    double seconds;
+    long rssStartKb;
+    // After the first hour, when the consumer has seen every element.
+    long rssWarmKb;
+    long rssEndKb;
+    long rssMaxKb;
+};
+
+// Reads as they come off a socket.
+const size_t ReadSize = 4096;
+
+template <typename Parse>
+Result replay(const std::string &hour, int hours, Parse parse)
+{
+    Result result {};
+    result.rssStartKb = result.rssMaxKb = rssKb();
+    double seconds = 0;
+    for (int h = 0; h < hours; ++h)
+    {
+        const uint64_t start = Bench::nowNs();
+        for (size_t offset = 0; offset < hour.size(); offset += ReadSize)
+            parse(hour.data() + offset, std::min(ReadSize, hour.size() - offset));
+        seconds += (Bench::nowNs() - start) * 1e-9;
+        result.rssMaxKb = std::max(result.rssMaxKb, rssKb());
+        if (h == 0)
+            result.rssWarmKb = rssKb();
+    }
+    result.rssEndKb = rssKb();
+    result.seconds = seconds;
+    return result;
+}
+
+Result runArena(const std::string &hour, int hours, size_t chunkSize)
+{
+    ArenaXml::Reader reader(chunkSize);
+    Consumer consumer;
+    Result result = replay(hour, hours, [&](const char *data, size_t size)
+    {
+        reader.append(data, size);
+        while (ArenaXml::XMLEle *root = reader.next())
+            consumer.dispatch(root);
+    });
+    result.messages = consumer.messages;
+    result.errors = reader.errors();
+    result.mallocs = reader.arena().mallocs();
+    return result;
+}
+
+#if defined(HAVE_LILXML)
+Result runLilxml(const std::string &hour, int hours)
+{
+    LilXML *lilxml = newLilXML();
+    Consumer consumer;
+    uint64_t errors = 0;
+    Result result = replay(hour, hours, [&](const char *data, size_t size)
+    {
+        char errmsg[MAXRBUF];
+        for (size_t i = 0; i < size; ++i)
+        {
+            XMLEle *root = readXMLEle(lilxml, data[i], errmsg);
+            if (root != nullptr)
+            {
+                consumer.dispatch(root);
+                delXMLEle(root);
+            }
+            else if (errmsg[0] != '\0')
+                ++errors;
+        }
+    });
+    delLilXML(lilxml);
+    result.messages = consumer.messages;
+    result.errors = errors;
+    return result;
+}
+#endif
+
+template <typename Run>
+void measure(const char *parser, Run run)
+{
+    int results[2];
+    if (pipe(results) != 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        const Result result = run();
+        if (write(results[1], &result, sizeof(result)) != sizeof(result))
+            perror("write");
+        _exit(0);
+    }
+    Result result {};
+    if (read(results[0], &result, sizeof(result)) != sizeof(result))
+        perror("read");
+    waitpid(child, nullptr, 0);
+    close(results[0]);
+    close(results[1]);
+
+    printf("arena_xml parser=%s messages=%llu errors=%llu messages_per_s=%.3g mallocs_per_message=%.2f "
+           "rss_start_kb=%ld rss_after_1h_kb=%ld rss_end_kb=%ld rss_max_kb=%ld rss_growth_after_1h_kb=%ld\n", parser,
+           static_cast<unsigned long long>(result.messages), static_cast<unsigned long long>(result.errors),
+           result.messages / result.seconds, result.messages ? static_cast<double>(result.mallocs) / result.messages : 0,
+           result.rssStartKb, result.rssWarmKb, result.rssEndKb, result.rssMaxKb, result.rssEndKb - result.rssWarmKb);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int hours = argc > 1 ? atoi(argv[1]) : 24;
+
+    Traffic traffic(42);
+    const std::string hour = traffic.hour();
+    printf("arena_xml_traffic hours=%d messages_per_hour=%llu mb_per_hour=%.1f\n", hours,
+           static_cast<unsigned long long>(traffic.messages()), hour.size() / 1e6);
+    fflush(stdout);
+
+    measure("heap", [&]
+    {
+        return runArena(hour, hours, 0);
+    });
+    measure("arena", [&]
+    {
+        return runArena(hour, hours, ArenaXml::Arena::DefaultChunkSize);
+    });
+#if defined(HAVE_LILXML)
+    measure("lilxml", [&]
+    {
+        return runLilxml(hour, hours);
+    });
+#else
+    printf("arena_xml parser=lilxml not_built\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,313 @@
+// Runs a 25 step protocol sequence against a stand-in device that takes
+// 20 ms per answer, while a client sends a message every millisecond, and
+// prints how long the client messages wait for the event loop. Once with the
+// sequence written as blocking reads, the way Handshake() does it today, and
+// once as an Async::Task that returns to the loop while the device is
+// thinking. Also the cost of calling and awaiting a task.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "async_task.h"
+#include "bench_util.h"
+
+namespace
+{
+
+const int DeviceDelayMs = 20;
+const int Steps = 25;
+const int ClientPeriodUs = 1000;
+
+// A minimal poll() event loop, what the INDI event loop does for a driver.
+class PollLoop : public Async::Loop
+{
+public:
+    std::chrono::nanoseconds now() const override
+    {
+        return std::chrono::nanoseconds(Bench::nowNs());
+    }
+
+    int addTimer(int ms, std::function<void()> callback) override
+    {
+        const int id = m_NextId++;
+        m_Timers[ {Bench::nowNs() + static_cast<uint64_t>(ms) * 1000000, id}] = std::move(callback);
+        return id;
+    }
+
+    void removeTimer(int id) override
+    {
+        for (auto it = m_Timers.begin(); it != m_Timers.end(); ++it)
+        {
+            if (it->first.second == id)
+            {
+                m_Timers.erase(it);
+                return;
+            }
+        }
+    }
+
+    int addReader(int fd, std::function<void()> callback) override
+    {
+        const int id = m_NextId++;
+        m_Readers[id] = {fd, std::move(callback)};
+        return id;
+    }
+
+    void removeReader(int id) override
+    {
+        m_Readers.erase(id);
+    }
+
+    void runOnce()
+    {
+        int timeoutMs = 10;
+        if (!m_Timers.empty())
+        {
+            const uint64_t now = Bench::nowNs(), next = m_Timers.begin()->first.first;
+            timeoutMs = next <= now ? 0 : static_cast<int>((next - now + 999999) / 1000000);
+        }
+
+        std::vector<pollfd> fds;
+        std::vector<int> ids;
+        for (const auto &reader : m_Readers)
+        {
+            fds.push_back({reader.second.first, POLLIN, 0});
+            ids.push_back(reader.first);
+        }
+        poll(fds.data(), fds.size(), timeoutMs);
+
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            auto reader = m_Readers.find(ids[i]);
+            if ((fds[i].revents & (POLLIN | POLLHUP)) && reader != m_Readers.end())
+            {
+                auto callback = reader->second.second;
+                callback();
+            }
+        }
+
+        while (!m_Timers.empty() && m_Timers.begin()->first.first <= Bench::nowNs())
+        {
+            auto callback = std::move(m_Timers.begin()->second);
+            m_Timers.erase(m_Timers.begin());
+            callback();
+        }
+    }
+
+private:
+    std::map<std::pair<uint64_t, int>, std::function<void()>> m_Timers;
+    std::map<int, std::pair<int, std::function<void()>>> m_Readers;
+    int m_NextId {1};
+};
+
+// Answers every command after DeviceDelayMs, like a slow serial device.
+void runDevice(int fd)
+{
+    std::string command;
+    char chunk[64];
+    ssize_t size;
+    while ((size = read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        command.append(chunk, size);
+        size_t end;
+        while ((end = command.find('#')) != std::string::npos)
+        {
+            command.erase(0, end + 1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(DeviceDelayMs));
+            if (write(fd, "OK#", 3) != 3)
+                return;
+        }
+    }
+}
+
+// Sends the time every ClientPeriodUs, the loop measures how long it waited.
+class Client
+{
+public:
+    Client()
+    {
+        if (pipe(m_Pipe) != 0)
+            perror("pipe");
+        fcntl(m_Pipe[0], F_SETFL, O_NONBLOCK);
+        m_Thread = std::thread([this]
+        {
+            while (!m_Stop)
+            {
+                const uint64_t now = Bench::nowNs();
+                if (write(m_Pipe[1], &now, sizeof(now)) != sizeof(now))
+                    break;
+                std::this_thread::sleep_for(std::chrono::microseconds(ClientPeriodUs));
+            }
+        });
+    }
+
+    ~Client()
+    {
+        m_Stop = true;
+        m_Thread.join();
+        close(m_Pipe[0]);
+        close(m_Pipe[1]);
+    }
+
+    int fd() const
+    {
+        return m_Pipe[0];
+    }
+
+    void handle(std::vector<double> &latenciesUs)
+    {
+        uint64_t sent;
+        while (read(m_Pipe[0], &sent, sizeof(sent)) == sizeof(sent))
+            latenciesUs.push_back((Bench::nowNs() - sent) / 1e3);
+    }
+
+private:
+    int m_Pipe[2];
+    std::thread m_Thread;
+    std::atomic<bool> m_Stop {false};
+};
+
+const char *command(int step)
+{
+    static const char *commands[] = {":FIRMWARE#", ":LIMITS#", ":POSITION#", ":STATUS#", ":TEMPERATURE#"};
+    return commands[step % 5];
+}
+
+bool blockingSequence(int fd)
+{
+    for (int step = 0; step < Steps; ++step)
+    {
+        if (write(fd, command(step), strlen(command(step))) < 0)
+            return false;
+        std::string answer;
+        char c;
+        while (read(fd, &c, 1) == 1)
+        {
+            answer += c;
+            if (c == '#')
+                break;
+        }
+        if (answer != "OK#")
+            return false;
+    }
+    return true;
+}
+
+Async::Task<> asyncSequence(Async::Loop &loop, int fd, bool &ok)
+{
+    ok = false;
+    for (int step = 0; step < Steps; ++step)
+    {
+        if (write(fd, command(step), strlen(command(step))) < 0)
+            co_return;
+        const std::optional<std::string> answer = co_await Async::readSection(loop, fd, '#', 1000);
+        if (!answer || *answer != "OK#")
+            co_return;
+    }
+    ok = true;
+}
+
+void run(const char *name, bool coroutine)
+{
+    int pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    std::thread device(runDevice, pair[1]);
+
+    PollLoop loop;
+    Client client;
+    std::vector<double> latencies;
+    loop.addReader(client.fd(), [&]
+    {
+        client.handle(latencies);
+    });
+
+    // Let the client settle, then start the sequence from a timer, like a
+    // Connect request from a client would.
+    const uint64_t settle = Bench::nowNs() + 50000000;
+    while (Bench::nowNs() < settle)
+        loop.runOnce();
+    latencies.clear();
+
+    bool done = false, ok = false;
+    uint64_t start = 0, end = 0;
+    Async::Runner runner;
+    loop.addTimer(0, [&]
+    {
+        start = Bench::nowNs();
+        if (coroutine)
+        {
+            runner.start(asyncSequence(loop, pair[0], ok));
+            return;
+        }
+        ok = blockingSequence(pair[0]);
+        end = Bench::nowNs();
+        done = true;
+    });
+    while (!done)
+    {
+        loop.runOnce();
+        if (coroutine && start != 0 && !runner.running())
+        {
+            end = Bench::nowNs();
+            done = true;
+        }
+    }
+    // What arrived during the sequence.
+    loop.runOnce();
+
+    const double maxUs = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end());
+    printf("%s ok=%d steps=%d sequence_ms=%.1f client_messages=%zu latency_p50_us=%.0f latency_p99_us=%.0f "
+           "latency_max_us=%.0f\n",
+           name, ok ? 1 : 0, Steps, (end - start) / 1e6, latencies.size(), Bench::percentile(latencies, 50),
+           Bench::percentile(latencies, 99), maxUs);
+
+    shutdown(pair[0], SHUT_RDWR);
+    device.join();
+    close(pair[0]);
+    close(pair[1]);
+}
+
+Async::Task<int> add(int a, int b)
+{
+    co_return a + b;
+}
+
+Async::Task<> sum(int count, long long &total)
+{
+    for (int i = 0; i < count; ++i)
+        total += co_await add(i, 1);
+}
+
+void benchOverhead()
+{
+    const int count = 1000000;
+    long long total = 0;
+    Async::Runner runner;
+    const uint64_t start = Bench::nowNs();
+    runner.start(sum(count, total));
+    const double ns = static_cast<double>(Bench::nowNs() - start) / count;
+    Bench::doNotOptimize(total);
+    printf("async_task_call calls=%d ns_per_call=%.1f\n", count, ns);
+}
+
+}
+
+int main()
+{
+    run("async_blocking", false);
+    run("async_coroutine", true);
+    benchOverhead();
+    return 0;
+}
@@ -0,0 +1,147 @@
+// Frames per second and CPU time per frame of the two ways the dummy CCD can
+// produce a frame for a local client:
+//
+//  classic   : render into a private frame buffer, copy it into a FITS file
+//              buffer (byte swapping on the way, as cfitsio does) and base64
+//              encode it for the XML stream.
+//  zero-copy : create a memfd, write the FITS header and render the pixels in
+//              place, then hand over the file descriptor. This is what the
+//              Fast BLOB path (IDSharedBlobAlloc) does underneath.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "fits_header.h"
+#include "star_field.h"
+
+namespace
+{
+
+double cpuSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+size_t base64Encode(const uint8_t *in, size_t size, char *out)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *p = out;
+    size_t i = 0;
+    for (; i + 2 < size; i += 3)
+    {
+        const uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        *p++ = table[(v >> 18) & 63];
+        *p++ = table[(v >> 12) & 63];
+        *p++ = table[(v >> 6) & 63];
+        *p++ = table[v & 63];
+    }
+    if (i < size)
+    {
+        const uint32_t v = (in[i] << 16) | (i + 1 < size ? in[i + 1] << 8 : 0);
+        *p++ = table[(v >> 18) & 63];
+        *p++ = table[(v >> 12) & 63];
+        *p++ = i + 1 < size ? table[(v >> 6) & 63] : '=';
+        *p++ = '=';
+    }
+    return p - out;
+}
+
+struct Result
+{
+    double fps;
+    double cpuMs;
+};
+
+Result classic(const StarField &field, int frames)
+{
+    const auto &config = field.config();
+    FitsHeader header(config.width, config.height);
+    const size_t pixels = size_t(config.width) * config.height;
+
+    const double cpu0 = cpuSeconds();
+    const uint64_t t0 = Bench::nowNs();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        std::vector<uint16_t> buffer(pixels);
+        field.render(buffer.data(), frame, 1.0);
+
+        std::vector<uint8_t> fits(header.fileSize());
+        uint16_t *data = header.write(fits.data());
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            const uint16_t value = buffer[i] ^ 0x8000;
+            data[i] = static_cast<uint16_t>((value << 8) | (value >> 8));
+        }
+
+        std::vector<char> encoded((fits.size() + 2) / 3 * 4);
+        const size_t length = base64Encode(fits.data(), fits.size(), encoded.data());
+        Bench::doNotOptimize(length);
+    }
+    const double wall = (Bench::nowNs() - t0) * 1e-9;
+    return { frames / wall, (cpuSeconds() - cpu0) * 1000 / frames };
+}
+
+Result zeroCopy(const StarField &field, int frames)
+{
+    const auto &config = field.config();
+    FitsHeader header(config.width, config.height);
+
+    const double cpu0 = cpuSeconds();
+    const uint64_t t0 = Bench::nowNs();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        int fd = memfd_create("bench_ccd", MFD_CLOEXEC);
+        if (fd < 0 || ftruncate(fd, header.fileSize()) != 0)
+        {
+            perror("memfd");
+            exit(1);
+        }
+        void *buffer = mmap(nullptr, header.fileSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (buffer == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(1);
+        }
+
+        uint16_t *data = header.write(buffer);
+        field.render(data, frame, 1.0, StarField::Layout::Fits);
+
+        // The driver would now pass fd to indiserver and forget about it.
+        munmap(buffer, header.fileSize());
+        close(fd);
+    }
+    const double wall = (Bench::nowNs() - t0) * 1e-9;
+    return { frames / wall, (cpuSeconds() - cpu0) * 1000 / frames };
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : 20;
+
+    const uint32_t sizes[][2] = { {1280, 1024}, {4144, 2822}, {9576, 6388} };
+    for (const auto &size : sizes)
+    {
+        StarField::Config config;
+        config.width = size[0];
+        config.height = size[1];
+        config.stars = size[0] * size[1] / 5000;
+        StarField field(config);
+
+        const Result a = classic(field, frames);
+        const Result b = zeroCopy(field, frames);
+        printf("ccd_transfer width=%u height=%u classic_fps=%.2f classic_cpu_ms=%.2f zerocopy_fps=%.2f zerocopy_cpu_ms=%.2f\n",
+               size[0], size[1], a.fps, a.cpuMs, b.fps, b.cpuMs);
+    }
+    return 0;
+}
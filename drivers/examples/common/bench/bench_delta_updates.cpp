@@ -0,0 +1,108 @@
+// Compares full versus delta set*Vector updates of a large number property.
+//
+// The serializer below reproduces the layout libindi uses for setNumberVector
+// messages, so the byte counts match what a driver writes to indiserver. Each
+// update changes a single element, as a dome or a filter wheel does when one
+// sensor or one slot is updated.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+#include "delta_tracker.h"
+
+namespace
+{
+
+struct Element
+{
+    char name[64];
+    double value;
+};
+
+void serialize(std::string &out, const std::vector<Element> &elements, const std::vector<size_t> *subset)
+{
+    char buffer[256];
+    out.clear();
+    out += "<setNumberVector device=\"Dummy Dome\" name=\"DOME_AUX_SENSORS\" state=\"Ok\" timeout=\"0\" "
+           "timestamp=\"2024-01-01T00:00:00\">\n";
+
+    auto one = [&](const Element &element)
+    {
+        snprintf(buffer, sizeof(buffer), "  <oneNumber name=\"%s\">\n      %.6g\n  </oneNumber>\n", element.name, element.value);
+        out += buffer;
+    };
+
+    if (subset)
+        for (size_t index : *subset)
+            one(elements[index]);
+    else
+        for (const auto &element : elements)
+            one(element);
+
+    out += "</setNumberVector>\n";
+}
+
+void run(size_t count, size_t updates)
+{
+    std::vector<Element> elements(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        snprintf(elements[i].name, sizeof(elements[i].name), "AUX_SENSOR_%zu", i + 1);
+        elements[i].value = 10.0 + i;
+    }
+
+    std::string out;
+    out.reserve(count * 64 + 256);
+
+    // Full updates
+    uint64_t fullBytes = 0;
+    uint64_t start = Bench::nowNs();
+    for (size_t u = 0; u < updates; ++u)
+    {
+        elements[u % count].value += 0.25;
+        serialize(out, elements, nullptr);
+        fullBytes += out.size();
+        Bench::doNotOptimize(out.data());
+    }
+    const double fullNs = double(Bench::nowNs() - start) / updates;
+
+    // Delta updates, including the cost of finding the dirty elements
+    DeltaTracker tracker;
+    auto value = [&elements](size_t i)
+    {
+        return elements[i].value;
+    };
+    tracker.commitAll(count, value);
+
+    uint64_t deltaBytes = 0;
+    start = Bench::nowNs();
+    for (size_t u = 0; u < updates; ++u)
+    {
+        elements[u % count].value += 0.25;
+        const auto &dirty = tracker.collect(count, value);
+        serialize(out, elements, &dirty);
+        deltaBytes += out.size();
+        Bench::doNotOptimize(out.data());
+    }
+    const double deltaNs = double(Bench::nowNs() - start) / updates;
+
+    printf("delta_updates elements=%zu full_bytes=%.1f delta_bytes=%.1f full_ns=%.1f delta_ns=%.1f bytes_saved=%.1f%%\n",
+           count, double(fullBytes) / updates, double(deltaBytes) / updates, fullNs, deltaNs,
+           100.0 * (1.0 - double(deltaBytes) / double(fullBytes)));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t updates = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+    for (size_t count : {4, 8, 16, 32, 64, 128})
+        run(count, updates);
+
+    return 0;
+}
@@ -0,0 +1,276 @@
+// A driver polls a stand-in device every 10 ms while a client sends a switch
+// every millisecond. The device answers in a millisecond, but now and then
+// stalls for longer than the 1 s read timeout, like a device that is busy or
+// a cable that is loose. Prints how long the switches wait to be handled,
+// once with the device read on the event loop, the way sendCommand() does it
+// with tty_read_section(), and once through a DeviceIoThread. Also the round
+// trip of a command to a device that answers at once, both ways.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "device_io_thread.h"
+
+namespace
+{
+
+const int PollPeriodMs = 10;
+const int ReadTimeoutMs = 1000;
+const int ClientPeriodUs = 1000;
+
+struct DeviceOptions
+{
+    int answerUs {1000};
+    // One command in stallEvery stalls for stallMs, 0 never.
+    int stallEvery {0};
+    int stallMs {1500};
+};
+
+// Answers "OK#" to every command, with the delays of options.
+void runDevice(int fd, DeviceOptions options)
+{
+    std::mt19937 random(42);
+    std::string command;
+    char chunk[64];
+    ssize_t size;
+    while ((size = read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        command.append(chunk, size);
+        size_t end;
+        while ((end = command.find('#')) != std::string::npos)
+        {
+            command.erase(0, end + 1);
+            if (options.stallEvery > 0 && random() % options.stallEvery == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(options.stallMs));
+            else if (options.answerUs > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(options.answerUs));
+            if (write(fd, "OK#", 3) != 3)
+                return;
+        }
+    }
+}
+
+// Sends the time every ClientPeriodUs, like newSwitch messages from a client.
+class Client
+{
+public:
+    Client()
+    {
+        if (pipe(m_Pipe) != 0)
+            perror("pipe");
+        fcntl(m_Pipe[0], F_SETFL, O_NONBLOCK);
+        m_Thread = std::thread([this]
+        {
+            while (!m_Stop)
+            {
+                const uint64_t now = Bench::nowNs();
+                if (write(m_Pipe[1], &now, sizeof(now)) != sizeof(now))
+                    break;
+                std::this_thread::sleep_for(std::chrono::microseconds(ClientPeriodUs));
+            }
+        });
+    }
+
+    ~Client()
+    {
+        m_Stop = true;
+        m_Thread.join();
+        close(m_Pipe[0]);
+        close(m_Pipe[1]);
+    }
+
+    int fd() const
+    {
+        return m_Pipe[0];
+    }
+
+    // What ISNewSwitch() does: handle the switch, here only measure how long it waited.
+    void handle(std::vector<double> &latenciesUs)
+    {
+        uint64_t sent;
+        while (read(m_Pipe[0], &sent, sizeof(sent)) == sizeof(sent))
+            latenciesUs.push_back((Bench::nowNs() - sent) / 1e3);
+    }
+
+private:
+    int m_Pipe[2];
+    std::thread m_Thread;
+    std::atomic<bool> m_Stop {false};
+};
+
+// sendCommand(): write, then tty_read_section() up to the terminator or the timeout.
+bool blockingCommand(int fd, const char *command, int timeoutMs)
+{
+    char chunk[64];
+    while (recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT) > 0)
+        ;
+    if (write(fd, command, strlen(command)) < 0)
+        return false;
+
+    pollfd pfd = {fd, POLLIN, 0};
+    char c;
+    for (;;)
+    {
+        if (poll(&pfd, 1, timeoutMs) <= 0 || read(fd, &c, 1) != 1)
+            return false;
+        if (c == '#')
+            return true;
+    }
+}
+
+struct Result
+{
+    std::vector<double> latencies;
+    uint64_t polls {0};
+    uint64_t timeouts {0};
+};
+
+void run(const char *name, bool threaded, const DeviceOptions &options, int seconds)
+{
+    int pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    std::thread device(runDevice, pair[1], options);
+
+    DeviceIoThread io;
+    if (threaded)
+        io.start(pair[0]);
+
+    Client client;
+    Result result;
+    uint64_t statusRequest = 0;
+    uint64_t nextPoll = Bench::nowNs();
+    const uint64_t end = Bench::nowNs() + static_cast<uint64_t>(seconds) * 1000000000;
+
+    // The event loop: the client, the answers of the I/O thread and the poll timer.
+    while (Bench::nowNs() < end)
+    {
+        const uint64_t now = Bench::nowNs();
+        const int timeoutMs = nextPoll <= now ? 0 : static_cast<int>((nextPoll - now + 999999) / 1000000);
+        pollfd fds[2] = {{client.fd(), POLLIN, 0}, {threaded ? io.eventFd() : -1, POLLIN, 0}};
+        poll(fds, 2, timeoutMs);
+
+        if (fds[0].revents & POLLIN)
+            client.handle(result.latencies);
+
+        if (fds[1].revents & POLLIN)
+        {
+            io.drain([&](const DeviceIoThread::Response & response)
+            {
+                if (response.id == statusRequest)
+                    statusRequest = 0;
+                if (!response.ok)
+                    ++result.timeouts;
+                ++result.polls;
+            });
+        }
+
+        if (Bench::nowNs() >= nextPoll)
+        {
+            nextPoll += PollPeriodMs * 1000000ull;
+            if (!threaded)
+            {
+                if (!blockingCommand(pair[0], ":STATUS#", ReadTimeoutMs))
+                    ++result.timeouts;
+                ++result.polls;
+                nextPoll = std::max(nextPoll, Bench::nowNs());
+            }
+            // A poll still waiting for its answer is not asked again.
+            else if (statusRequest == 0)
+                statusRequest = io.submit(":STATUS#", '#', ReadTimeoutMs);
+        }
+    }
+    // The switches that waited behind the last poll count too.
+    client.handle(result.latencies);
+
+    io.stop();
+    shutdown(pair[0], SHUT_RDWR);
+    device.join();
+    close(pair[0]);
+    close(pair[1]);
+
+    std::vector<double> &latencies = result.latencies;
+    const double maxUs = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end());
+    printf("%s stall_every=%d switches=%zu polls=%llu timeouts=%llu switch_p50_us=%.0f switch_p99_us=%.0f "
+           "switch_p999_us=%.0f switch_max_us=%.0f\n",
+           name, options.stallEvery, latencies.size(), static_cast<unsigned long long>(result.polls),
+           static_cast<unsigned long long>(result.timeouts), Bench::percentile(latencies, 50),
+           Bench::percentile(latencies, 99), Bench::percentile(latencies, 99.9), maxUs);
+}
+
+// Round trip to a device that answers at once: the cost of going through the thread.
+void benchRoundTrip()
+{
+    const int count = 20000;
+    DeviceOptions options;
+    options.answerUs = 0;
+
+    for (bool threaded : {false, true})
+    {
+        int pair[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+        std::thread device(runDevice, pair[1], options);
+        DeviceIoThread io;
+        if (threaded)
+            io.start(pair[0]);
+
+        std::vector<double> samples;
+        for (int i = 0; i < count; ++i)
+        {
+            const uint64_t start = Bench::nowNs();
+            if (threaded)
+            {
+                io.submit(":STATUS#", '#', ReadTimeoutMs);
+                pollfd pfd = {io.eventFd(), POLLIN, 0};
+                while (io.drain([](const DeviceIoThread::Response &) {}) == 0)
+                    poll(&pfd, 1, ReadTimeoutMs);
+            }
+            else
+                blockingCommand(pair[0], ":STATUS#", ReadTimeoutMs);
+            samples.push_back((Bench::nowNs() - start) / 1e3);
+        }
+
+        io.stop();
+        shutdown(pair[0], SHUT_RDWR);
+        device.join();
+        close(pair[0]);
+        close(pair[1]);
+
+        printf("%s commands=%d roundtrip_p50_us=%.1f roundtrip_p99_us=%.1f\n",
+               threaded ? "io_roundtrip_thread" : "io_roundtrip_inline", count, Bench::percentile(samples, 50),
+               Bench::percentile(samples, 99));
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    // The device may still answer after the driver hung up.
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int stallEvery : {0, 200, 50})
+    {
+        DeviceOptions options;
+        options.stallEvery = stallEvery;
+        run("io_inline", false, options, seconds);
+        run("io_thread", true, options, seconds);
+    }
+    benchRoundTrip();
+    return 0;
+}
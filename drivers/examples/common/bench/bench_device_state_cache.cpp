@@ -0,0 +1,121 @@
+// Connects to a simulated slow filter wheel that takes 100 ms per query, for
+// its slot count and each filter name, the way a driver does on every
+// connect, once without and once with a DeviceStateCache. Prints the time
+// until the driver is usable, how long the background verification takes
+// and whether it notices a renamed filter. Also the cost of loading and
+// saving caches of several sizes.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "device_state_cache.h"
+
+namespace
+{
+
+const int QueryMs = 100;
+const int Slots = 8;
+
+std::string filterName(int slot, bool renamed)
+{
+    static const char *names[Slots] = {"Luminance", "Red", "Green", "Blue", "Ha", "OIII", "SII", "Dark"};
+    return renamed && slot == 4 ? "Ha 3nm" : names[slot];
+}
+
+// What the driver reads from the wheel, one slow command after the other.
+DeviceStateCache::Values queryWheel(bool renamed)
+{
+    DeviceStateCache::Values values;
+    std::this_thread::sleep_for(std::chrono::milliseconds(QueryMs));
+    values["slots"] = std::to_string(Slots);
+    for (int i = 0; i < Slots; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(QueryMs));
+        values["filter." + std::to_string(i + 1)] = filterName(i, renamed);
+    }
+    return values;
+}
+
+double msSince(uint64_t start)
+{
+    return (Bench::nowNs() - start) / 1e6;
+}
+
+}
+
+int main()
+{
+    const std::string directory = "/tmp/bench_device_state_cache";
+    const std::string identity = "Dummy FilterWheel@FT1234AB";
+
+    {
+        DeviceStateCache cache(directory, identity, 1);
+        cache.clear();
+
+        // Without a cache: every fact comes from the hardware before the driver is usable.
+        uint64_t start = Bench::nowNs();
+        cache.setValues(queryWheel(false));
+        cache.save();
+        printf("device_state_connect cache=0 usable_ms=%.1f queries=%d\n", msSince(start), Slots + 1);
+    }
+
+    for (bool renamed : {false, true})
+    {
+        // With the cache: usable once the file is read, the hardware is read meanwhile.
+        DeviceStateCache cache(directory, identity, 1);
+        uint64_t start = Bench::nowNs();
+        const bool hit = cache.load();
+        const double usableMs = msSince(start);
+        cache.verify([renamed]
+        {
+            return queryWheel(renamed);
+        });
+
+        bool changed = false;
+        // What IEAddCallback() does for a driver.
+        pollfd ready { cache.readyFd(), POLLIN, 0 };
+        while (!cache.verified(changed))
+            poll(&ready, 1, -1);
+        printf("device_state_connect cache=1 hit=%d usable_ms=%.3f verified_ms=%.1f hardware_changed=%d\n", hit ? 1 : 0,
+               usableMs, msSince(start), changed ? 1 : 0);
+    }
+
+    // A cache of another schema version is not used.
+    {
+        DeviceStateCache cache(directory, identity, 2);
+        printf("device_state_schema_mismatch hit=%d\n", cache.load() ? 1 : 0);
+    }
+
+    for (int entries : {10, 100, 1000})
+    {
+        DeviceStateCache cache(directory, "bench", 1);
+        for (int i = 0; i < entries; ++i)
+            cache.set("key." + std::to_string(i), "value\twith tab " + std::to_string(i * 0.5));
+
+        const int rounds = 100;
+        uint64_t start = Bench::nowNs();
+        for (int i = 0; i < rounds; ++i)
+            cache.save();
+        const double saveUs = (Bench::nowNs() - start) / 1e3 / rounds;
+
+        start = Bench::nowNs();
+        bool ok = true;
+        for (int i = 0; i < rounds; ++i)
+            ok &= cache.load();
+        const double loadUs = (Bench::nowNs() - start) / 1e3 / rounds;
+
+        printf("device_state_file entries=%d load_us=%.1f save_us=%.1f round_trip_ok=%d\n", entries, loadUs, saveUs,
+               ok && cache.values().size() == size_t(entries) ? 1 : 0);
+        cache.clear();
+    }
+
+    DeviceStateCache(directory, identity, 1).clear();
+    rmdir(directory.c_str());
+    return 0;
+}
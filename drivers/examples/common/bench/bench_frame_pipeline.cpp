@@ -0,0 +1,180 @@
+// Streams frames from a capture thread that is faster than the sender, once
+// through FramePipeline (fixed pool, drop oldest) and once through a naive
+// unbounded mutex protected queue that allocates a frame per capture and sends
+// everything. Reports delivered fps, drops, latency and peak memory held in
+// frames.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "frame_pipeline.h"
+
+namespace
+{
+
+struct Settings
+{
+    size_t frameSize {1280 * 1024 * 2};
+    int captureFps {120};
+    int encodeMs {15};
+    int seconds {3};
+};
+
+void fill(uint8_t *data, size_t size, uint32_t sequence)
+{
+    // Stand-in for the camera read out, touches every byte once.
+    memset(data, static_cast<int>(sequence & 0xff), size);
+}
+
+void encode(const uint8_t *data, size_t size, int ms)
+{
+    Bench::doNotOptimize(data[size / 2]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void report(const char *name, uint64_t captured, uint64_t delivered, uint64_t dropped, std::vector<double> &latencies,
+            double seconds, double peakMb)
+{
+    const double p50 = Bench::percentile(latencies, 50);
+    const double p99 = Bench::percentile(latencies, 99);
+    const double max = latencies.empty() ? 0 : latencies.back();
+    printf("frame_pipeline mode=%s captured=%llu delivered=%llu dropped=%llu fps=%.1f latency_p50_ms=%.1f "
+           "latency_p99_ms=%.1f latency_max_ms=%.1f peak_frame_memory_mb=%.1f\n",
+           name, (unsigned long long)captured, (unsigned long long)delivered, (unsigned long long)dropped,
+           delivered / seconds, p50, p99, max, peakMb);
+}
+
+void runPipeline(const Settings &settings)
+{
+    FramePipeline pipeline(4, settings.frameSize);
+    std::vector<double> latencies;
+
+    std::thread sender([&]
+    {
+        while (!pipeline.isStopped())
+        {
+            FramePipeline::Frame *frame = pipeline.takeLatest(100);
+            if (frame == nullptr)
+                continue;
+            encode(frame->data.data(), frame->size, settings.encodeMs);
+            latencies.push_back((Bench::nowNs() - frame->timestamp) / 1e6);
+            pipeline.release(frame);
+        }
+    });
+
+    const auto period = std::chrono::microseconds(1000000 / settings.captureFps);
+    auto next = std::chrono::steady_clock::now();
+    const auto end = next + std::chrono::seconds(settings.seconds);
+    while (next < end)
+    {
+        if (FramePipeline::Frame *frame = pipeline.acquire())
+        {
+            fill(frame->data.data(), frame->size, 0);
+            pipeline.publish(frame);
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+    pipeline.stop();
+    sender.join();
+
+    const FramePipeline::Stats stats = pipeline.takeStats();
+    report("pool_drop_oldest", stats.captured, stats.delivered, stats.dropped + stats.overruns, latencies,
+           settings.seconds, 4.0 * settings.frameSize / 1e6);
+}
+
+void runNaive(const Settings &settings)
+{
+    struct Frame
+    {
+        std::vector<uint8_t> data;
+        uint64_t timestamp;
+    };
+    std::deque<std::unique_ptr<Frame>> queue;
+    std::mutex mutex;
+    std::atomic<bool> running {true};
+    size_t peakFrames = 0;
+    uint64_t captured = 0, delivered = 0;
+    std::vector<double> latencies;
+
+    std::thread sender([&]
+    {
+        for (;;)
+        {
+            std::unique_ptr<Frame> frame;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!queue.empty())
+                {
+                    frame = std::move(queue.front());
+                    queue.pop_front();
+                }
+            }
+            if (!frame)
+            {
+                if (!running)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            encode(frame->data.data(), frame->data.size(), settings.encodeMs);
+            latencies.push_back((Bench::nowNs() - frame->timestamp) / 1e6);
+            ++delivered;
+            // Give up on the backlog when the capture is over, like a client disconnecting.
+            if (!running)
+                break;
+        }
+    });
+
+    const auto period = std::chrono::microseconds(1000000 / settings.captureFps);
+    auto next = std::chrono::steady_clock::now();
+    const auto end = next + std::chrono::seconds(settings.seconds);
+    while (next < end)
+    {
+        std::unique_ptr<Frame> frame(new Frame);
+        frame->data.resize(settings.frameSize);
+        fill(frame->data.data(), frame->data.size(), 0);
+        frame->timestamp = Bench::nowNs();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(frame));
+            peakFrames = std::max(peakFrames, queue.size());
+        }
+        ++captured;
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+    running = false;
+    sender.join();
+
+    report("naive_unbounded", captured, delivered, 0, latencies, settings.seconds,
+           double(peakFrames) * settings.frameSize / 1e6);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Settings settings;
+    if (argc > 1)
+        settings.captureFps = atoi(argv[1]);
+    if (argc > 2)
+        settings.encodeMs = atoi(argv[2]);
+    if (argc > 3)
+        settings.seconds = atoi(argv[3]);
+
+    printf("frame_pipeline capture_fps=%d encode_ms=%d frame_bytes=%zu\n", settings.captureFps, settings.encodeMs,
+           settings.frameSize);
+    runPipeline(settings);
+    runNaive(settings);
+    return 0;
+}
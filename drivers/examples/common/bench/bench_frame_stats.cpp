@@ -0,0 +1,119 @@
+// Throughput of the FrameStats kernels on a synthesized star field, with the
+// SIMD kernels and with the scalar fallback, single threaded and on the pool.
+// The results of both paths are compared, and the measured HFR is printed next
+// to the value expected from the rendered FWHM.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "frame_stats.h"
+#include "star_field.h"
+#include "thread_pool.h"
+
+namespace
+{
+
+template <typename Function>
+double bestSeconds(int rounds, Function fn)
+{
+    double best = 1e9;
+    for (int round = 0; round < rounds; ++round)
+    {
+        const uint64_t start = Bench::nowNs();
+        fn();
+        best = std::min(best, (Bench::nowNs() - start) * 1e-9);
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t width = argc > 1 ? atoi(argv[1]) : 4144;
+    const uint32_t height = argc > 2 ? atoi(argv[2]) : 2822;
+    const size_t threads = argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+    const int rounds = 5;
+
+    StarField::Config config;
+    config.width = width;
+    config.height = height;
+    config.stars = width * height / 20000;
+    StarField field(config);
+
+    const size_t count = size_t(width) * height;
+    std::vector<uint16_t> frame(count);
+    field.render(frame.data(), 0, 1.0);
+    const double gigabytes = count * sizeof(uint16_t) / 1e9;
+
+    ThreadPool single(1), pool(threads);
+    std::vector<uint32_t> bins(65536);
+    std::vector<uint16_t> copy;
+
+    FrameStats::Result results[2];
+    for (bool simd : {false, true})
+    {
+        FrameStats::setSimdEnabled(simd);
+        const char *level = FrameStats::simdLevel();
+
+        const double rangeSeconds = bestSeconds(rounds, [&]
+        {
+            Bench::doNotOptimize(FrameStats::range(frame.data(), count));
+        });
+        const double findSeconds = bestSeconds(rounds, [&]
+        {
+            // A threshold nothing reaches, so the whole frame is scanned.
+            Bench::doNotOptimize(FrameStats::findAbove(frame.data(), count, 0xFFFF - 1));
+        });
+        printf("frame_stats kernel=range simd=%s gbps=%.2f\n", level, gigabytes / rangeSeconds);
+        printf("frame_stats kernel=find_above simd=%s gbps=%.2f\n", level, gigabytes / findSeconds);
+
+        for (ThreadPool *workers : {&single, &pool})
+        {
+            const size_t used = workers->size() + 1;
+            const double histogramSeconds = bestSeconds(rounds, [&]
+            {
+                FrameStats::histogram(frame.data(), count, bins.data(), workers);
+            });
+            const double backgroundSeconds = bestSeconds(rounds, [&]
+            {
+                Bench::doNotOptimize(FrameStats::background(frame.data(), width, height, workers));
+            });
+            const auto background = FrameStats::background(frame.data(), width, height, workers);
+            const double detectSeconds = bestSeconds(rounds, [&]
+            {
+                Bench::doNotOptimize(FrameStats::detectStars(frame.data(), width, height, background,
+                                     FrameStats::DetectOptions(), workers).size());
+            });
+            const double analyzeSeconds = bestSeconds(rounds, [&]
+            {
+                results[simd] = FrameStats::analyze(frame.data(), width, height, FrameStats::DetectOptions(), workers);
+            });
+            printf("frame_stats kernel=histogram simd=%s threads=%zu gbps=%.2f\n", level, used, gigabytes / histogramSeconds);
+            printf("frame_stats kernel=background simd=%s threads=%zu gbps=%.2f\n", level, used, gigabytes / backgroundSeconds);
+            printf("frame_stats kernel=detect_stars simd=%s threads=%zu gbps=%.2f\n", level, used, gigabytes / detectSeconds);
+            printf("frame_stats kernel=analyze simd=%s threads=%zu gbps=%.2f ms=%.1f\n", level, used,
+                   gigabytes / analyzeSeconds, analyzeSeconds * 1e3);
+        }
+    }
+
+    // The median by selection over a copy must agree with the histogram one.
+    copy = frame;
+    const uint16_t selected = FrameStats::selectMedian(copy.data(), copy.size());
+
+    const auto &result = results[1];
+    const bool same = results[0].range.sum == result.range.sum && results[0].range.min == result.range.min &&
+                      results[0].range.max == result.range.max && results[0].stars == result.stars;
+    // Mean distance from the center of a 2D gaussian is sigma * sqrt(pi / 2).
+    const double expectedHfr = config.fwhm / 2.3548 * std::sqrt(M_PI / 2);
+    printf("frame_stats_check width=%u height=%u min=%u max=%u mean=%.1f median=%u select_median=%u background=%.1f "
+           "noise=%.1f stars=%zu rendered_stars=%u hfr=%.2f expected_hfr=%.2f scalar_equal=%s\n",
+           width, height, result.range.min, result.range.max, result.mean, result.median, selected,
+           result.background.level, result.background.noise, result.stars, config.stars, result.hfr, expectedHfr,
+           same ? "yes" : "no");
+    return same && selected == result.median ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// Reacting to digital inputs from kernel edge events against reading their
+// levels on every poll, on a GpioEdge::MockChip driven by a thread playing
+// the hardware. For each way prints how long after an edge its change is
+// published, how often the loop wakes up and the CPU it takes while the inputs
+// are quiet, and, for a rain gauge whose bouncing contact closes for 30 ms
+// per tip, how many tips are reported and how many are missed.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "gpio_edge.h"
+
+namespace
+{
+
+using namespace std::chrono;
+
+struct Result
+{
+    std::vector<double> latencyUs;
+    uint64_t rising {0};
+    uint64_t changes {0};
+    uint64_t wakeups {0};
+    uint64_t bounces {0};
+    double cpuUs {0};
+};
+
+double threadCpuUs()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// The driver with edge events: sleeps on the descriptor, as the event loop
+// does on the descriptors of IEAddCallback(), and wakes for the edges and for
+// the debouncer's deadline. Told to stop through stop.
+void events(GpioEdge::MockChip &chip, nanoseconds debounce, int stop, const std::atomic<bool> &done, Result &result)
+{
+    GpioEdge::Debouncer debouncer(chip.lines(), debounce);
+    std::vector<bool> levels;
+    chip.levels(levels);
+    debouncer.reset(levels);
+
+    std::vector<GpioEdge::Event> pending, settled;
+    const double cpu = threadCpuUs();
+    auto publish = [&result](const GpioEdge::Event &event)
+    {
+        result.latencyUs.push_back((GpioEdge::monotonicNs() - event.timestampNs) / 1e3);
+        result.rising += event.rising ? 1 : 0;
+        ++result.changes;
+    };
+
+    while (!done)
+    {
+        int timeout = -1;
+        if (const uint64_t deadline = debouncer.deadline())
+        {
+            const uint64_t now = GpioEdge::monotonicNs();
+            timeout = deadline > now ? static_cast<int>((deadline - now + 999999) / 1000000) : 0;
+        }
+        pollfd fds[] {{chip.fd(), POLLIN, 0}, {stop, POLLIN, 0}};
+        poll(fds, 2, timeout);
+        ++result.wakeups;
+
+        pending.clear();
+        chip.read(pending);
+        for (const auto &event : pending)
+            if (debouncer.feed(event))
+                publish(event);
+        settled.clear();
+        debouncer.settle(GpioEdge::monotonicNs(), settled);
+        for (const auto &event : settled)
+            publish(event);
+    }
+    result.cpuUs = threadCpuUs() - cpu;
+    result.bounces = debouncer.bounces();
+}
+
+// The driver polling from TimerHit(): reads the levels every period.
+void polling(GpioEdge::MockChip &chip, milliseconds period, const std::atomic<uint64_t> &lastEdgeNs,
+             const std::atomic<bool> &done, Result &result)
+{
+    std::vector<bool> previous, levels;
+    chip.levels(previous);
+    const double cpu = threadCpuUs();
+    while (!done)
+    {
+        std::this_thread::sleep_for(period);
+        ++result.wakeups;
+        chip.levels(levels);
+        for (size_t line = 0; line < levels.size(); ++line)
+        {
+            if (levels[line] == previous[line])
+                continue;
+            result.latencyUs.push_back((GpioEdge::monotonicNs() - lastEdgeNs) / 1e3);
+            result.rising += levels[line] ? 1 : 0;
+            ++result.changes;
+        }
+        previous = levels;
+    }
+    result.cpuUs = threadCpuUs() - cpu;
+}
+
+// What the hardware does, on a thread of its own.
+using Hardware = std::function<void(GpioEdge::MockChip &, std::atomic<uint64_t> &)>;
+
+Result run(const Hardware &hardware, milliseconds period, nanoseconds debounce)
+{
+    GpioEdge::MockChip chip(4);
+    std::atomic<bool> done {false};
+    std::atomic<uint64_t> lastEdgeNs {0};
+    Result result;
+    int stop[2];
+    if (pipe(stop) != 0)
+        return result;
+
+    std::thread reader([&]
+    {
+        if (period.count() == 0)
+            events(chip, debounce, stop[0], done, result);
+        else
+            polling(chip, period, lastEdgeNs, done, result);
+    });
+    // Let the reader get to its loop.
+    std::this_thread::sleep_for(milliseconds(20));
+    hardware(chip, lastEdgeNs);
+    // The last edge still has to be seen.
+    std::this_thread::sleep_for(std::max<nanoseconds>(period * 2, debounce * 2) + milliseconds(20));
+    done = true;
+    if (write(stop[1], "x", 1) != 1)
+        perror("write");
+    reader.join();
+    close(stop[0]);
+    close(stop[1]);
+    return result;
+}
+
+std::string modeName(milliseconds period)
+{
+    return period.count() == 0 ? "events" : "poll_" + std::to_string(period.count()) + "ms";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int edges = argc > 1 ? atoi(argv[1]) : 100;
+    const int idleSeconds = argc > 2 ? atoi(argv[2]) : 5;
+    const std::vector<milliseconds> modes {milliseconds(0), milliseconds(10), milliseconds(100)};
+
+    // A limit switch changing cleanly every 250 to 350 ms.
+    for (const auto period : modes)
+    {
+        const Result result = run([edges](GpioEdge::MockChip & chip, std::atomic<uint64_t> &lastEdgeNs)
+        {
+            std::mt19937 random(7);
+            std::uniform_int_distribution<int> gap(250, 350);
+            for (int edge = 0; edge < edges; ++edge)
+            {
+                std::this_thread::sleep_for(milliseconds(gap(random)));
+                lastEdgeNs = GpioEdge::monotonicNs();
+                chip.drive(0, edge % 2 == 0);
+            }
+        }, period, nanoseconds(0));
+        std::vector<double> latency = result.latencyUs;
+        printf("gpio_edge scenario=latency mode=%s edges=%d seen=%llu p50_us=%.1f p99_us=%.1f max_us=%.1f\n",
+               modeName(period).c_str(), edges, static_cast<unsigned long long>(result.changes),
+               Bench::percentile(latency, 50), Bench::percentile(latency, 99), Bench::percentile(latency, 100));
+    }
+
+    // Nothing happens.
+    for (const auto period : modes)
+    {
+        const Result result = run([idleSeconds](GpioEdge::MockChip &, std::atomic<uint64_t> &)
+        {
+            std::this_thread::sleep_for(seconds(idleSeconds));
+        }, period, nanoseconds(0));
+        printf("gpio_edge scenario=idle mode=%s seconds=%d wakeups_per_s=%.1f cpu_us_per_s=%.1f\n",
+               modeName(period).c_str(), idleSeconds, result.wakeups / static_cast<double>(idleSeconds),
+               result.cpuUs / idleSeconds);
+    }
+
+    // A tipping bucket rain gauge: the reed contact closes for 30 ms per tip
+    // and bounces for up to 2 ms when it closes and opens. Debounced over 5 ms.
+    const int tips = edges / 2;
+    for (const auto period : modes)
+    {
+        const Result result = run([tips](GpioEdge::MockChip & chip, std::atomic<uint64_t> &lastEdgeNs)
+        {
+            std::mt19937 random(11);
+            std::uniform_int_distribution<int> gap(150, 400);
+            std::uniform_int_distribution<int> bounce(50, 400);
+            auto contact = [&](bool level)
+            {
+                lastEdgeNs = GpioEdge::monotonicNs();
+                for (int i = 0; i < 4; ++i)
+                {
+                    chip.drive(1, i % 2 == 0 ? level : !level);
+                    std::this_thread::sleep_for(microseconds(bounce(random)));
+                }
+                chip.drive(1, level);
+            };
+            for (int tip = 0; tip < tips; ++tip)
+            {
+                std::this_thread::sleep_for(milliseconds(gap(random)));
+                contact(true);
+                std::this_thread::sleep_for(milliseconds(30));
+                contact(false);
+            }
+        }, period, period.count() == 0 ? milliseconds(5) : milliseconds(0));
+        std::vector<double> latency = result.latencyUs;
+        printf("gpio_edge scenario=rain_gauge mode=%s tips=%d reported=%llu missed=%lld changes=%llu "
+               "bounces_swallowed=%llu p50_us=%.1f\n",
+               modeName(period).c_str(), tips, static_cast<unsigned long long>(result.rising),
+               static_cast<long long>(tips) - static_cast<long long>(result.rising),
+               static_cast<unsigned long long>(result.changes), static_cast<unsigned long long>(result.bounces),
+               Bench::percentile(latency, 50));
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+// Polls the 4 KB JSON status of a device with a REST interface from a local
+// stand-in web server, the way a driver would from its event loop: with a
+// new connection per request, on one kept-alive connection parsing every
+// answer into a DOM, and on one kept-alive connection taking the five fields
+// the driver publishes as the body arrives. Prints the p50 and p99 request
+// time, requests per second, the parse time per answer and the longest the
+// event loop was held by the client, after checking every value read.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#include "bench_util.h"
+#include "http_transport.h"
+#include "json_fields.h"
+
+#ifdef HAVE_NLOHMANN_JSON
+#include <nlohmann/json.hpp>
+#endif
+
+namespace
+{
+
+const double Ra = 5.5881, Dec = -5.3911, Temperature = 3.25;
+const long FocuserPosition = 31250;
+const char *const State = "Tracking";
+
+// What a mount controller with accessories answers to GET /api/status: the
+// five values the driver wants among a few kilobytes of everything else.
+std::string statusDocument()
+{
+    char head[512];
+    snprintf(head, sizeof(head),
+             "{\"device\":{\"model\":\"RC-600\",\"serial\":\"A1B2-33\",\"firmware\":\"4.2.17\",\"uptime\":918273},"
+             "\"status\":{\"state\":\"%s\",\"errors\":[],\"slewing\":false,\"parked\":false},"
+             "\"mount\":{\"ra\":%.4f,\"dec\":%.4f,\"pier\":\"east\",\"tracking\":\"sidereal\"},"
+             "\"focuser\":{\"position\":%ld,\"moving\":false,\"temperature\":2.9},", State, Ra, Dec,
+             FocuserPosition);
+    std::string document = head;
+    document += "\"ports\":[";
+    for (int port = 0; port < 12; ++port)
+    {
+        char entry[192];
+        snprintf(entry, sizeof(entry), "%s{\"name\":\"Port %d\",\"on\":%s,\"volts\":12.%d,\"amps\":%d.%02d,"
+                 "\"limit\":3.0,\"label\":\"dew heater \\\"%c\\\"\"}", port ? "," : "", port + 1,
+                 port % 3 ? "true" : "false", port % 10, port % 4, port * 7 % 100, 'A' + port);
+        document += entry;
+    }
+    document += "],\"log\":[";
+    for (int line = 0; line < 24; ++line)
+    {
+        char entry[128];
+        snprintf(entry, sizeof(entry), "%s{\"t\":%d,\"level\":\"info\",\"text\":\"guide pulse %d ms on axis %d\"}",
+                 line ? "," : "", 1000 + line * 17, 40 + line, line % 2);
+        document += entry;
+    }
+    char tail[160];
+    snprintf(tail, sizeof(tail), "],\"weather\":{\"temperature\":%.2f,\"humidity\":71.5,\"pressure\":1013.2,"
+             "\"sky\":[-18.5,-18.9,-19.1]}}", Temperature);
+    document += tail;
+    return document;
+}
+
+bool same(double value, double expected)
+{
+    return std::fabs(value - expected) < 1e-9;
+}
+
+enum class Parse
+{
+    Stream,
+    Dom
+};
+
+struct Run
+{
+    const char *name;
+    bool keepAlive;
+    Parse parse;
+    // Chunked transfer encoding from the server, 0 for Content-Length.
+    size_t chunkSize;
+    // The server closes the connection after this many requests, 0 never.
+    int keepAliveRequests;
+};
+
+void run(const Run &settings, const std::string &document, std::chrono::microseconds latency, int requests)
+{
+    Http::StandInServer::Options serverOptions;
+    serverOptions.latency = latency;
+    serverOptions.chunkSize = settings.chunkSize;
+    serverOptions.keepAliveRequests = settings.keepAliveRequests;
+    Http::StandInServer server(serverOptions);
+    if (!server.listening())
+    {
+        printf("http_transport %s cannot listen on 127.0.0.1\n", settings.name);
+        return;
+    }
+    server.set("/api/status", document);
+
+    Http::Client client;
+    Http::Client::Options options;
+    options.host = "127.0.0.1";
+    options.port = server.port();
+    options.keepAlive = settings.keepAlive;
+    if (!client.open(options))
+    {
+        printf("http_transport %s open failed\n", settings.name);
+        return;
+    }
+
+    JsonFields fields;
+    const size_t ra = fields.subscribe("mount.ra");
+    const size_t dec = fields.subscribe("mount.dec");
+    const size_t position = fields.subscribe("focuser.position");
+    const size_t temperature = fields.subscribe("weather.temperature");
+    const size_t state = fields.subscribe("status.state");
+
+    std::vector<double> requestMs;
+    uint64_t parseNs = 0;
+    size_t wrong = 0, failed = 0;
+    int sent = 0, done = 0;
+
+    Http::BodySink sink;
+    if (settings.parse == Parse::Stream)
+    {
+        sink = [&](const char *data, size_t length)
+        {
+            const uint64_t start = Bench::nowNs();
+            fields.feed(data, length);
+            parseNs += Bench::nowNs() - start;
+        };
+    }
+
+    std::function<void()> next;
+    Http::Callback answered = [&](const Http::Response & response)
+    {
+        ++done;
+        if (!response.ok || response.status != 200)
+        {
+            ++failed;
+            fields.reset();
+            next();
+            return;
+        }
+        requestMs.push_back(response.elapsed.count() / 1e6);
+
+        bool right = false;
+        const uint64_t start = Bench::nowNs();
+        if (settings.parse == Parse::Stream)
+        {
+            right = fields.finish() && same(fields.number(ra), Ra) && same(fields.number(dec), Dec) &&
+                    same(fields.number(position), FocuserPosition) &&
+                    same(fields.number(temperature), Temperature) && fields.field(state).text == State;
+            parseNs += Bench::nowNs() - start;
+            fields.reset();
+        }
+#ifdef HAVE_NLOHMANN_JSON
+        else
+        {
+            const nlohmann::json json = nlohmann::json::parse(response.body);
+            const double raValue = json["mount"]["ra"], decValue = json["mount"]["dec"];
+            const long positionValue = json["focuser"]["position"];
+            const double temperatureValue = json["weather"]["temperature"];
+            const std::string stateValue = json["status"]["state"];
+            parseNs += Bench::nowNs() - start;
+            right = same(raValue, Ra) && same(decValue, Dec) && positionValue == FocuserPosition &&
+                    same(temperatureValue, Temperature) && stateValue == State;
+        }
+#endif
+        if (!right)
+            ++wrong;
+        next();
+    };
+    next = [&]()
+    {
+        if (sent < requests)
+        {
+            ++sent;
+            if (client.get("/api/status", answered, sink) == 0)
+                ++failed;
+        }
+    };
+
+    // The driver's event loop: everything the client does runs from here, the
+    // longest it held the loop is what every other property waited.
+    const uint64_t start = Bench::nowNs();
+    uint64_t longestNs = 0;
+    auto timed = [&](const std::function<void()> &work)
+    {
+        const uint64_t begin = Bench::nowNs();
+        work();
+        longestNs = std::max(longestNs, Bench::nowNs() - begin);
+    };
+    timed(next);
+    while (done < requests && client.pending() > 0)
+    {
+        pollfd fd {client.fd(), POLLIN, 0};
+        if (poll(&fd, 1, client.nextTimeoutMs()) > 0)
+            timed([&]()
+        {
+            client.onReadable();
+        });
+        timed([&]()
+        {
+            client.expire();
+        });
+    }
+    const double seconds = (Bench::nowNs() - start) / 1e9;
+
+    const Http::Client::Stats &stats = client.stats();
+    const double p50 = Bench::percentile(requestMs, 50), p99 = Bench::percentile(requestMs, 99);
+    printf("http_transport %s requests=%d connects=%llu reused=%llu p50_ms=%.2f p99_ms=%.2f requests_per_s=%.0f "
+           "parse_us=%.1f loop_stall_max_us=%.0f failed=%zu wrong=%zu\n", settings.name, done,
+           static_cast<unsigned long long>(stats.connects), static_cast<unsigned long long>(stats.reused), p50, p99,
+           done / seconds, done ? parseNs / 1e3 / done : 0, longestNs / 1e3, failed, wrong);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int requests = argc > 1 ? atoi(argv[1]) : 500;
+    const std::chrono::microseconds latency(argc > 2 ? atoi(argv[2]) : 1000);
+    const std::string document = statusDocument();
+    printf("http_transport server latency_us=%ld document_bytes=%zu\n", static_cast<long>(latency.count()),
+           document.size());
+
+    run({"new_connection", false, Parse::Stream, 0, 0}, document, latency, requests);
+#ifdef HAVE_NLOHMANN_JSON
+    run({"keep_alive_dom", true, Parse::Dom, 0, 0}, document, latency, requests);
+#endif
+    run({"keep_alive_stream", true, Parse::Stream, 0, 0}, document, latency, requests);
+    run({"keep_alive_stream_chunked", true, Parse::Stream, 512, 0}, document, latency, requests);
+    run({"keep_alive_server_closes_every_50", true, Parse::Stream, 0, 50}, document, latency, requests);
+    return 0;
+}
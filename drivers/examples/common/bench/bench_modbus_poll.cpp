@@ -0,0 +1,147 @@
+// Polls the 40 registers of a roof controller from a local Modbus TCP
+// stand-in that answers like a device behind a gateway, one register per
+// request, merged into runs, and merged with the requests pipelined. Prints
+// the requests per poll cycle and the p50 and p99 cycle time of each, after
+// checking every value read.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "modbus_transport.h"
+
+namespace
+{
+
+using Modbus::HoldingRegisters;
+using Modbus::InputRegisters;
+
+struct Range
+{
+    Modbus::Table table;
+    uint16_t address;
+    uint16_t count;
+    // Every step-th register of the range.
+    uint16_t step;
+};
+
+// Status words and motor currents, limit switches, temperatures in every
+// other register, setpoints: 12 + 8 + 4 + 6 + 10 registers.
+const Range RoofController[] =
+{
+    {InputRegisters, 0, 12, 1},
+    {InputRegisters, 20, 8, 1},
+    {InputRegisters, 100, 4, 1},
+    {InputRegisters, 200, 12, 2},
+    {HoldingRegisters, 1000, 10, 1},
+};
+
+uint16_t expected(Modbus::Table table, uint16_t address)
+{
+    return static_cast<uint16_t>(table == HoldingRegisters ? 5000 + address : 3 * address + 1);
+}
+
+int connectTo(uint16_t port)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void run(const char *name, uint16_t port, uint16_t maxGap, uint16_t maxCount, size_t window, int cycles)
+{
+    Modbus::PollPlan plan(maxGap, maxCount);
+    for (const Range &range : RoofController)
+        for (uint16_t i = 0; i < range.count; i += range.step)
+            plan.add(range.table, range.address + i);
+
+    const int fd = connectTo(port);
+    if (fd < 0)
+    {
+        printf("modbus_poll %s connect failed\n", name);
+        return;
+    }
+    Modbus::TcpClient::Options options;
+    options.window = window;
+    Modbus::TcpClient client(fd, options);
+
+    std::vector<double> cycleMs;
+    size_t wrong = 0;
+    std::string error;
+    for (int cycle = 0; cycle < cycles; ++cycle)
+    {
+        const uint64_t start = Bench::nowNs();
+        if (!client.poll(plan, error))
+        {
+            printf("modbus_poll %s poll failed: %s\n", name, error.c_str());
+            break;
+        }
+        cycleMs.push_back((Bench::nowNs() - start) / 1e6);
+
+        for (const Range &range : RoofController)
+            for (uint16_t i = 0; i < range.count; i += range.step)
+            {
+                uint16_t value = 0;
+                const uint16_t address = range.address + i;
+                if (!plan.value(range.table, address, value) || value != expected(range.table, address))
+                    ++wrong;
+            }
+    }
+    close(fd);
+
+    const size_t requests = plan.requests().size();
+    const double p50 = Bench::percentile(cycleMs, 50), p99 = Bench::percentile(cycleMs, 99);
+    printf("modbus_poll %s registers=%zu read=%zu requests=%zu window=%zu cycle_p50_ms=%.2f cycle_p99_ms=%.2f "
+           "polls_per_s=%.0f wrong=%zu\n", name, plan.wanted(), plan.read(), requests, window, p50, p99, 1000 / p50,
+           wrong);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Modbus::StandInServer::Options options;
+    options.latency = std::chrono::microseconds(argc > 1 ? atoi(argv[1]) : 2000);
+    options.scanTime = std::chrono::microseconds(argc > 2 ? atoi(argv[2]) : 100);
+    const int cycles = argc > 3 ? atoi(argv[3]) : 100;
+    options.registers = 2048;
+
+    Modbus::StandInServer server(options);
+    if (!server.listening())
+    {
+        printf("modbus_poll cannot listen on 127.0.0.1\n");
+        return 1;
+    }
+    for (uint16_t address = 0; address < options.registers; ++address)
+    {
+        server.set(HoldingRegisters, address, expected(HoldingRegisters, address));
+        server.set(InputRegisters, address, expected(InputRegisters, address));
+    }
+    printf("modbus_poll server latency_us=%ld scan_us=%ld\n", static_cast<long>(options.latency.count()),
+           static_cast<long>(options.scanTime.count()));
+
+    run("per_register", server.port(), 0, 1, 1, cycles);
+    run("per_register_pipelined", server.port(), 0, 1, 8, cycles);
+    run("coalesced", server.port(), 8, Modbus::MaxReadCount, 1, cycles);
+    run("coalesced_pipelined", server.port(), 8, Modbus::MaxReadCount, 8, cycles);
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Throughput and compression ratio of ParallelDeflate against a single threaded
+// compress2() on a synthesized 16-bit star field, the typical ".fits.z" payload.
+// Every parallel stream is decompressed again and compared with the input.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "bench_util.h"
+#include "parallel_deflate.h"
+#include "star_field.h"
+#include "thread_pool.h"
+
+namespace
+{
+
+bool verify(const std::vector<uint8_t> &original, const uint8_t *compressed, size_t size, bool gzip)
+{
+    std::vector<uint8_t> restored(original.size());
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, gzip ? 16 + 15 : 15) != Z_OK)
+        return false;
+    stream.next_in = const_cast<Bytef *>(compressed);
+    stream.avail_in = size;
+    stream.next_out = restored.data();
+    stream.avail_out = restored.size();
+    const int rc = inflate(&stream, Z_FINISH);
+    const bool ok = rc == Z_STREAM_END && stream.total_out == original.size() && restored == original;
+    inflateEnd(&stream);
+    return ok;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t width = argc > 1 ? atoi(argv[1]) : 4144;
+    const uint32_t height = argc > 2 ? atoi(argv[2]) : 2822;
+    const size_t threads = argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+
+    StarField::Config config;
+    config.width = width;
+    config.height = height;
+    config.stars = width * height / 5000;
+    StarField field(config);
+
+    std::vector<uint8_t> frame(size_t(width) * height * 2);
+    field.render(reinterpret_cast<uint16_t *>(frame.data()), 0, 1.0);
+    const double megabytes = frame.size() / 1e6;
+
+    ThreadPool pool(threads);
+
+    for (int level : {1, 3, 6})
+    {
+        // Single threaded reference
+        std::vector<uint8_t> reference(compressBound(frame.size()));
+        uLongf referenceSize = reference.size();
+        uint64_t start = Bench::nowNs();
+        compress2(reference.data(), &referenceSize, frame.data(), frame.size(), level);
+        const double referenceSeconds = (Bench::nowNs() - start) * 1e-9;
+
+        for (auto format : {ParallelDeflate::Format::Zlib, ParallelDeflate::Format::Gzip})
+        {
+            ParallelDeflate::Options options;
+            options.level = level;
+            options.format = format;
+            options.pool = &pool;
+
+            std::vector<uint8_t> output(ParallelDeflate::bound(frame.size(), options));
+            start = Bench::nowNs();
+            const size_t size = ParallelDeflate::compress(frame.data(), frame.size(), output.data(), output.size(), options);
+            const double seconds = (Bench::nowNs() - start) * 1e-9;
+
+            const bool gzip = format == ParallelDeflate::Format::Gzip;
+            printf("parallel_deflate input_mb=%.1f threads=%zu level=%d format=%s compress2_mbps=%.1f compress2_ratio=%.3f "
+                   "parallel_mbps=%.1f parallel_ratio=%.3f speedup=%.2f valid=%s\n",
+                   megabytes, pool.size() + 1, level, gzip ? "gzip" : "zlib",
+                   megabytes / referenceSeconds, double(frame.size()) / referenceSize,
+                   megabytes / seconds, size ? double(frame.size()) / size : 0.0, referenceSeconds / seconds,
+                   size && verify(frame, output.data(), size, gzip) ? "yes" : "NO");
+        }
+    }
+
+    return 0;
+}
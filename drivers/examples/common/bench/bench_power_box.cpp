@@ -0,0 +1,256 @@
+// Drives a power box emulated behind a pseudo terminal, with the firmware
+// time of PowerBox::Model and the bytes paced at the baud rate of the line,
+// the way the power box example does it with batching off and on: a profile
+// setting every port, one command per port against one transaction, and a
+// telemetry poll, one query per port against one for all. Prints the time
+// each takes, the commands and bytes on the line, and the share of a one
+// second polling period the telemetry keeps the line busy.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "power_box.h"
+
+namespace
+{
+
+const PowerBox::Layout Ports {16, 4, 2, 6};
+
+// The box on the master side of a pseudo terminal.
+class Emulator
+{
+public:
+    explicit Emulator(int baud) : m_Model(Ports), m_Baud(baud)
+    {
+        m_Master = posix_openpt(O_RDWR | O_NOCTTY);
+        grantpt(m_Master);
+        unlockpt(m_Master);
+        m_Path = ptsname(m_Master);
+        m_Thread = std::thread([this]
+        {
+            run();
+        });
+    }
+
+    ~Emulator()
+    {
+        m_Stop = true;
+        m_Thread.join();
+        close(m_Master);
+    }
+
+    const std::string &path() const
+    {
+        return m_Path;
+    }
+
+    PowerBox::Model &model()
+    {
+        return m_Model;
+    }
+
+private:
+    void run()
+    {
+        std::string buffer;
+        while (!m_Stop)
+        {
+            pollfd fd {m_Master, POLLIN, 0};
+            if (poll(&fd, 1, 5) <= 0 || !(fd.revents & POLLIN))
+                continue;
+            char chunk[256];
+            const ssize_t size = read(m_Master, chunk, sizeof(chunk));
+            if (size <= 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            buffer.append(chunk, size);
+
+            size_t end;
+            while ((end = buffer.find('#')) != std::string::npos)
+            {
+                const std::string command = buffer.substr(0, end + 1);
+                buffer.erase(0, end + 1);
+                const std::string answer = m_Model.handle(command);
+
+                // Ten bits per byte both ways, then the firmware.
+                const auto wire = std::chrono::microseconds((command.size() + answer.size()) * 10 * 1000000 / m_Baud);
+                std::this_thread::sleep_for(wire + m_Model.processingTime(command));
+                if (write(m_Master, answer.data(), answer.size()) != static_cast<ssize_t>(answer.size()))
+                    perror("write");
+            }
+        }
+    }
+
+    PowerBox::Model m_Model;
+    int m_Baud;
+    int m_Master {-1};
+    std::string m_Path;
+    std::thread m_Thread;
+    std::atomic<bool> m_Stop {false};
+};
+
+// The driver's side of the line.
+class Line
+{
+public:
+    explicit Line(const std::string &path)
+    {
+        m_Fd = open(path.c_str(), O_RDWR | O_NOCTTY);
+        termios tty;
+        tcgetattr(m_Fd, &tty);
+        cfmakeraw(&tty);
+        tcsetattr(m_Fd, TCSANOW, &tty);
+    }
+
+    ~Line()
+    {
+        close(m_Fd);
+    }
+
+    bool command(const std::string &command, std::string &answer)
+    {
+        ++m_Commands;
+        m_Bytes += command.size();
+        if (write(m_Fd, command.data(), command.size()) != static_cast<ssize_t>(command.size()))
+            return false;
+        answer.clear();
+        while (answer.empty() || answer.back() != '#')
+        {
+            pollfd fd {m_Fd, POLLIN, 0};
+            if (poll(&fd, 1, 2000) <= 0)
+                return false;
+            char chunk[256];
+            const ssize_t size = read(m_Fd, chunk, sizeof(chunk));
+            if (size <= 0)
+                return false;
+            answer.append(chunk, size);
+        }
+        m_Bytes += answer.size();
+        return answer != "ERR#";
+    }
+
+    uint64_t commands() const
+    {
+        return m_Commands;
+    }
+
+    uint64_t bytes() const
+    {
+        return m_Bytes;
+    }
+
+private:
+    int m_Fd {-1};
+    uint64_t m_Commands {0};
+    uint64_t m_Bytes {0};
+};
+
+// Every port on, the dew heaters at 60%, the variable ports at 9 V, the
+// client setting each power port twice on the way, as the toggles of a
+// profile can.
+std::vector<PowerBox::Setting> profile()
+{
+    std::vector<PowerBox::Setting> settings;
+    for (size_t port = 0; port < Ports.power; ++port)
+        settings.push_back({PowerBox::Kind::Power, port, false});
+    for (size_t port = 0; port < Ports.power; ++port)
+        settings.push_back({PowerBox::Kind::Power, port, true});
+    for (size_t port = 0; port < Ports.dew; ++port)
+        settings.push_back({PowerBox::Kind::Dew, port, true, 60});
+    for (size_t port = 0; port < Ports.variable; ++port)
+        settings.push_back({PowerBox::Kind::Variable, port, true, 9});
+    for (size_t port = 0; port < Ports.usb; ++port)
+        settings.push_back({PowerBox::Kind::Usb, port, true});
+    return settings;
+}
+
+bool applied(PowerBox::Model &model)
+{
+    for (size_t port = 0; port < Ports.power; ++port)
+        if (!model.enabled(PowerBox::Kind::Power, port))
+            return false;
+    for (size_t port = 0; port < Ports.dew; ++port)
+        if (!model.enabled(PowerBox::Kind::Dew, port) || model.value(PowerBox::Kind::Dew, port) != 60)
+            return false;
+    return true;
+}
+
+template <typename Function>
+void measure(const char *scenario, const char *mode, int rounds, int baud, Function fn)
+{
+    Emulator emulator(baud);
+    Line line(emulator.path());
+    bool ok = true;
+    std::vector<double> ms;
+    for (int round = 0; round < rounds; ++round)
+    {
+        const uint64_t start = Bench::nowNs();
+        ok = fn(line) && ok;
+        ms.push_back((Bench::nowNs() - start) / 1e6);
+    }
+    if (std::string(scenario) == "profile")
+        ok = ok && applied(emulator.model());
+    const double median = Bench::percentile(ms, 50);
+    printf("power_box scenario=%s mode=%s ok=%d baud=%d commands=%.0f bytes=%.0f ms=%.1f", scenario, mode, ok ? 1 : 0,
+           baud, static_cast<double>(line.commands()) / rounds, static_cast<double>(line.bytes()) / rounds, median);
+    if (std::string(scenario) == "telemetry")
+        printf(" line_busy_at_1s_poll=%.1f%%", median / 10);
+    printf("\n");
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int baud = argc > 1 ? atoi(argv[1]) : 9600;
+    const int rounds = 5;
+
+    measure("profile", "per_port", rounds, baud, [](Line & line)
+    {
+        std::string answer;
+        bool ok = true;
+        for (const auto &setting : profile())
+            ok = line.command(PowerBox::command(setting), answer) && ok;
+        return ok;
+    });
+    measure("profile", "batch", rounds, baud, [](Line & line)
+    {
+        // What DummyPower::queue() collects in one round of the event loop.
+        PowerBox::Batch batch;
+        for (const auto &setting : profile())
+            batch.add(setting);
+        std::string answer;
+        return line.command(PowerBox::batchCommand(batch.take()), answer);
+    });
+
+    measure("telemetry", "per_port", rounds, baud, [](Line & line)
+    {
+        std::string answer;
+        PowerBox::Reading reading;
+        bool ok = true;
+        for (size_t port = 0; port < Ports.power; ++port)
+            ok = line.command(PowerBox::readCommand(port), answer) && PowerBox::parseReading(answer, reading) && ok;
+        return ok;
+    });
+    measure("telemetry", "bulk", rounds, baud, [](Line & line)
+    {
+        std::string answer;
+        PowerBox::Telemetry telemetry;
+        return line.command(PowerBox::TelemetryCommand, answer) && PowerBox::parseTelemetry(answer, telemetry) &&
+               telemetry.ports.size() == Ports.measured();
+    });
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Journals the changes of a small observatory, a focuser, a dome, a mount and
+// a camera's temperature, into 16 MB segments and reports the time of each
+// append, rotations included, and the records dropped while waiting for a
+// spare segment. Then scans the journal for everything, for one property and
+// for a time window, and compares with writing the same changes as text
+// lines and searching them with memmem(), the way a log is grepped today.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "property_journal.h"
+
+namespace
+{
+
+struct Property
+{
+    const char *device;
+    const char *name;
+    std::vector<std::string> elements;
+};
+
+const Property Properties[] =
+{
+    {"Focuser", "ABS_FOCUS_POSITION", {"FOCUS_ABSOLUTE_POSITION"}},
+    {"Dome", "ABS_DOME_POSITION", {"DOME_ABSOLUTE_POSITION"}},
+    {"Mount", "EQUATORIAL_EOD_COORD", {"RA", "DEC"}},
+    {"Mount", "HORIZONTAL_COORD", {"AZ", "ALT"}},
+    {"CCD", "CCD_TEMPERATURE", {"CCD_TEMPERATURE_VALUE"}},
+    {"CCD", "CCD_COOLER_POWER", {"CCD_COOLER_VALUE"}},
+};
+const size_t PropertyCount = sizeof(Properties) / sizeof(Properties[0]);
+
+void removeJournal(const std::string &directory)
+{
+    const std::string command = "rm -rf '" + directory + "'";
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "cannot remove %s\n", directory.c_str());
+}
+
+double throughput(uint64_t bytes, uint64_t ns)
+{
+    return ns > 0 ? bytes / static_cast<double>(ns) : 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int records = argc > 1 ? atoi(argv[1]) : 4000000;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp/bench-property-journal";
+    removeJournal(directory);
+
+    Journal::Writer writer;
+    Journal::Writer::Options options;
+    options.segmentBytes = 16 << 20;
+    if (!writer.open(directory, options))
+    {
+        printf("property_journal cannot open %s\n", directory.c_str());
+        return 1;
+    }
+    uint32_t ids[PropertyCount];
+    for (size_t p = 0; p < PropertyCount; ++p)
+        ids[p] = writer.define(Properties[p].device, Properties[p].name, Journal::Kind::Number,
+                               Properties[p].elements);
+
+    // The same changes as lines of text, the size of what a log would hold.
+    std::string text;
+    text.reserve(static_cast<size_t>(records) * 96);
+
+    std::vector<double> appendNs;
+    appendNs.reserve(records);
+    const int64_t firstNs = Journal::nowNs();
+    int64_t windowFrom = 0, windowTo = 0;
+    uint64_t start = Bench::nowNs();
+    for (int i = 0; i < records; ++i)
+    {
+        const size_t p = i % PropertyCount;
+        const double values[2] = {i * 0.001, -i * 0.002};
+        if (i == records / 2)
+            windowFrom = Journal::nowNs();
+        const uint64_t before = Bench::nowNs();
+        writer.append(ids[p], 2, values, Properties[p].elements.size());
+        appendNs.push_back(static_cast<double>(Bench::nowNs() - before));
+        if (i == records / 2 + records / 100)
+            windowTo = Journal::nowNs();
+    }
+    const uint64_t writeNs = Bench::nowNs() - start;
+    const Journal::Writer::Stats stats = writer.stats();
+    writer.close();
+
+    start = Bench::nowNs();
+    for (int i = 0; i < records; ++i)
+    {
+        const size_t p = i % PropertyCount;
+        char line[160];
+        const int length = snprintf(line, sizeof(line), "%" PRId64 " %s.%s Busy %s=%.6g %s=%.6g\n",
+                                    firstNs + i * 1000, Properties[p].device, Properties[p].name,
+                                    Properties[p].elements[0].c_str(), i * 0.001,
+                                    Properties[p].elements.size() > 1 ? Properties[p].elements[1].c_str() : "",
+                                    -i * 0.002);
+        text.append(line, length);
+    }
+    const std::string textPath = directory + "/changes.log";
+    const int textFd = open(textPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (textFd < 0 || write(textFd, text.data(), text.size()) != static_cast<ssize_t>(text.size()))
+        printf("property_journal cannot write %s\n", textPath.c_str());
+    if (textFd >= 0)
+        close(textFd);
+    const uint64_t textWriteNs = Bench::nowNs() - start;
+
+    const double p50 = Bench::percentile(appendNs, 50), p99 = Bench::percentile(appendNs, 99);
+    const double p999 = Bench::percentile(appendNs, 99.9);
+    printf("property_journal append records=%d segments=%llu bytes_per_record=%.1f append_p50_ns=%.0f "
+           "append_p99_ns=%.0f append_p999_ns=%.0f append_max_ns=%.0f dropped=%llu total_ms=%.1f "
+           "text_bytes_per_record=%.1f text_format_write_ms=%.1f\n", records,
+           static_cast<unsigned long long>(stats.segments),
+           static_cast<double>(stats.bytes) / records, p50, p99, p999, appendNs.back(),
+           static_cast<unsigned long long>(stats.dropped), writeNs / 1e6,
+           static_cast<double>(text.size()) / records, textWriteNs / 1e6);
+
+    Journal::Reader reader;
+    if (!reader.open(directory))
+    {
+        printf("property_journal cannot read %s\n", directory.c_str());
+        return 1;
+    }
+
+    struct Scan
+    {
+        const char *name;
+        Journal::Reader::Filter filter;
+    };
+    Scan scans[3];
+    scans[0].name = "all";
+    scans[1].name = "property";
+    scans[1].filter.device = "Dome";
+    scans[1].filter.property = "ABS_DOME_POSITION";
+    scans[2].name = "window";
+    scans[2].filter.fromNs = windowFrom;
+    scans[2].filter.toNs = windowTo;
+
+    for (const Scan &scan : scans)
+    {
+        double sum = 0;
+        // The first pass takes the pages into the page cache.
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            sum = 0;
+            start = Bench::nowNs();
+            reader.scan(scan.filter, [&sum](const Journal::Reader::Record & record)
+            {
+                sum += record.number(0);
+            });
+        }
+        const uint64_t ns = Bench::nowNs() - start;
+        const Journal::Reader::Stats &read = reader.stats();
+        Bench::doNotOptimize(sum);
+        printf("property_journal scan filter=%s segments=%llu skipped_segments=%llu records=%llu matched=%llu "
+               "scan_ms=%.1f gb_per_s=%.2f\n", scan.name, static_cast<unsigned long long>(read.segments),
+               static_cast<unsigned long long>(read.skippedSegments), static_cast<unsigned long long>(read.records),
+               static_cast<unsigned long long>(read.matched), ns / 1e6, throughput(read.bytes, ns));
+    }
+
+    // What grep does for the property filter, on a log already in memory.
+    const char needle[] = " Dome.ABS_DOME_POSITION ";
+    size_t found = 0;
+    start = Bench::nowNs();
+    for (const char *at = text.data(), *end = text.data() + text.size(); ; ++at)
+    {
+        at = static_cast<const char *>(memmem(at, end - at, needle, sizeof(needle) - 1));
+        if (at == nullptr)
+            break;
+        ++found;
+    }
+    const uint64_t grepNs = Bench::nowNs() - start;
+    printf("property_journal text filter=property bytes=%zu matched=%zu scan_ms=%.1f gb_per_s=%.2f\n", text.size(),
+           found, grepNs / 1e6, throughput(text.size(), grepNs));
+
+    removeJournal(directory);
+    return 0;
+}
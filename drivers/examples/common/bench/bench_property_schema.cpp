@@ -0,0 +1,210 @@
+// Startup cost of the properties of the custom driver example: heap
+// allocations and time to construct them and set them up, declared the usual
+// way (INDI::PropertySwitch {n} and fill() in initProperties()) and with a
+// Schema::Block and its vector structs, as in the schema driver example, plus
+// the bytes the compile-time image takes. Allocations are
+// counted with a replaced operator new; the text values INDI keeps with
+// strdup() are left out, they are the same both ways.
+//
+// Unlike the other benchmarks this one needs libindi, CMake only builds it
+// when libindi is installed.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include "libindi/indipropertynumber.h"
+#include "libindi/indipropertyswitch.h"
+#include "libindi/indipropertytext.h"
+
+#include "bench_util.h"
+#include "property_schema.h"
+
+namespace
+{
+
+std::atomic<uint64_t> g_Allocations {0};
+
+const char *Device = "My Custom Driver";
+
+// What MyCustomDriver does.
+struct Classic
+{
+    enum { SAY_HELLO_DEFAULT, SAY_HELLO_CUSTOM, SAY_HELLO_N };
+    INDI::PropertySwitch SayHelloSP  {SAY_HELLO_N};
+    INDI::PropertyText   WhatToSayTP {1};
+    INDI::PropertyNumber SayCountNP  {1};
+    enum { CAPTURE_ON, CAPTURE_OFF, CAPTURE_N };
+    INDI::PropertySwitch SerialCaptureSP {CAPTURE_N};
+    INDI::PropertyText   SerialCaptureTP {1};
+    INDI::PropertyText   SerialReplayTP  {1};
+    INDI::PropertyNumber SerialReplaySpeedNP {1};
+    enum { AUTO_DETECT_ON, AUTO_DETECT_OFF, AUTO_DETECT_N };
+    INDI::PropertySwitch AutoDetectSP {AUTO_DETECT_N};
+    enum { IO_THREAD_ON, IO_THREAD_OFF, IO_THREAD_N };
+    INDI::PropertySwitch IoThreadSP {IO_THREAD_N};
+
+    ISState lastState()
+    {
+        return IoThreadSP[IO_THREAD_OFF].getState();
+    }
+
+    void initProperties()
+    {
+        SayHelloSP[SAY_HELLO_DEFAULT].fill("SAY_HELLO_DEFAULT", "Say Hello", ISS_OFF);
+        SayHelloSP[SAY_HELLO_CUSTOM].fill("SAY_HELLO_CUSTOM", "Say Custom", ISS_OFF);
+        SayHelloSP.fill(Device, "SAY_HELLO", "Hello Commands", "Main Control", IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+        WhatToSayTP[0].fill("WHAT_TO_SAY", "What to say?", "Hello, custom world!");
+        WhatToSayTP.fill(Device, "WHAT_TO_SAY", "Got something to say?", "Main Control", IP_RW, 60, IPS_IDLE);
+        SayCountNP[0].fill("SAY_COUNT", "Count", "%0.f", 0, 0, 0, 0);
+        SayCountNP.fill(Device, "SAY_COUNT", "Say Count", "Main Control", IP_RO, 0, IPS_IDLE);
+        SerialCaptureSP[CAPTURE_ON].fill("CAPTURE_ON", "On", ISS_OFF);
+        SerialCaptureSP[CAPTURE_OFF].fill("CAPTURE_OFF", "Off", ISS_ON);
+        SerialCaptureSP.fill(Device, "SERIAL_CAPTURE", "Capture", "Options", IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+        SerialCaptureTP[0].fill("CAPTURE_FILE", "File", "/tmp/indi_mycustomdriver.cap");
+        SerialCaptureTP.fill(Device, "SERIAL_CAPTURE_FILE", "Capture", "Options", IP_RW, 60, IPS_IDLE);
+        SerialReplayTP[0].fill("REPLAY_FILE", "File", "");
+        SerialReplayTP.fill(Device, "SERIAL_REPLAY_FILE", "Replay", "Options", IP_RW, 60, IPS_IDLE);
+        SerialReplaySpeedNP[0].fill("REPLAY_SPEED", "Speed (0 = max)", "%.1f", 0, 1000, 1, 1);
+        SerialReplaySpeedNP.fill(Device, "SERIAL_REPLAY_SPEED", "Replay", "Options", IP_RW, 60, IPS_IDLE);
+        AutoDetectSP[AUTO_DETECT_ON].fill("AUTO_DETECT_ON", "On", ISS_ON);
+        AutoDetectSP[AUTO_DETECT_OFF].fill("AUTO_DETECT_OFF", "Off", ISS_OFF);
+        AutoDetectSP.fill(Device, "SERIAL_AUTO_DETECT", "Auto Detect", "Connection", IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+        IoThreadSP[IO_THREAD_ON].fill("IO_THREAD_ON", "On", ISS_OFF);
+        IoThreadSP[IO_THREAD_OFF].fill("IO_THREAD_OFF", "Off", ISS_ON);
+        IoThreadSP.fill(Device, "DEVICE_IO_THREAD", "I/O Thread", "Options", IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    }
+};
+
+// The same properties with a schema, the way indi_schemadriver declares them.
+struct Schematic
+{
+#define SAY_HELLO_ELEMENTS(X) X(SAY_HELLO_DEFAULT, "Say Hello") X(SAY_HELLO_CUSTOM, "Say Custom")
+    enum { SAY_HELLO_ELEMENTS(INDI_SCHEMA_INDEX) SAY_HELLO_N };
+    static constexpr Schema::SwitchVector<SAY_HELLO_N> SayHello
+    {
+        "SAY_HELLO", "Hello Commands", Schema::MainControlTab, IP_RW, ISR_ATMOST1, 60, IPS_IDLE,
+        {{SAY_HELLO_ELEMENTS(INDI_SCHEMA_SWITCH)}}
+    };
+    static constexpr Schema::TextVector<1> WhatToSay
+    {
+        "WHAT_TO_SAY", "Got something to say?", Schema::MainControlTab, IP_RW, 60, IPS_IDLE,
+        {{{"WHAT_TO_SAY", "What to say?", "Hello, custom world!"}}}
+    };
+    static constexpr Schema::NumberVector<1> SayCount
+    {
+        "SAY_COUNT", "Say Count", Schema::MainControlTab, IP_RO, 0, IPS_IDLE,
+        {{{"SAY_COUNT", "Count", "%0.f", 0, 0, 0, 0}}}
+    };
+#define CAPTURE_ELEMENTS(X) X(CAPTURE_ON, "On") X(CAPTURE_OFF, "Off", ISS_ON)
+    enum { CAPTURE_ELEMENTS(INDI_SCHEMA_INDEX) CAPTURE_N };
+    static constexpr Schema::SwitchVector<CAPTURE_N> SerialCapture
+    {
+        "SERIAL_CAPTURE", "Capture", Schema::OptionsTab, IP_RW, ISR_1OFMANY, 60, IPS_IDLE,
+        {{CAPTURE_ELEMENTS(INDI_SCHEMA_SWITCH)}}
+    };
+    static constexpr Schema::TextVector<1> SerialCaptureFile
+    {
+        "SERIAL_CAPTURE_FILE", "Capture", Schema::OptionsTab, IP_RW, 60, IPS_IDLE,
+        {{{"CAPTURE_FILE", "File", "/tmp/indi_mycustomdriver.cap"}}}
+    };
+    static constexpr Schema::TextVector<1> SerialReplayFile
+    {
+        "SERIAL_REPLAY_FILE", "Replay", Schema::OptionsTab, IP_RW, 60, IPS_IDLE,
+        {{{"REPLAY_FILE", "File", ""}}}
+    };
+    static constexpr Schema::NumberVector<1> SerialReplaySpeed
+    {
+        "SERIAL_REPLAY_SPEED", "Replay", Schema::OptionsTab, IP_RW, 60, IPS_IDLE,
+        {{{"REPLAY_SPEED", "Speed (0 = max)", "%.1f", 0, 1000, 1, 1}}}
+    };
+#define AUTO_DETECT_ELEMENTS(X) X(AUTO_DETECT_ON, "On", ISS_ON) X(AUTO_DETECT_OFF, "Off")
+    enum { AUTO_DETECT_ELEMENTS(INDI_SCHEMA_INDEX) AUTO_DETECT_N };
+    static constexpr Schema::SwitchVector<AUTO_DETECT_N> AutoDetect
+    {
+        "SERIAL_AUTO_DETECT", "Auto Detect", Schema::ConnectionTab, IP_RW, ISR_1OFMANY, 60, IPS_IDLE,
+        {{AUTO_DETECT_ELEMENTS(INDI_SCHEMA_SWITCH)}}
+    };
+#define IO_THREAD_ELEMENTS(X) X(IO_THREAD_ON, "On") X(IO_THREAD_OFF, "Off", ISS_ON)
+    enum { IO_THREAD_ELEMENTS(INDI_SCHEMA_INDEX) IO_THREAD_N };
+    static constexpr Schema::SwitchVector<IO_THREAD_N> IoThread
+    {
+        "DEVICE_IO_THREAD", "I/O Thread", Schema::OptionsTab, IP_RW, ISR_1OFMANY, 60, IPS_IDLE,
+        {{IO_THREAD_ELEMENTS(INDI_SCHEMA_SWITCH)}}
+    };
+
+    Schema::Block<SayHello, WhatToSay, SayCount, SerialCapture, SerialCaptureFile, SerialReplayFile,
+                  SerialReplaySpeed, AutoDetect, IoThread> Properties;
+
+    ISwitchVectorProperty *SayHelloSP  {Properties.vector<SayHello>()};
+    ITextVectorProperty   *WhatToSayTP {Properties.vector<WhatToSay>()};
+    INumberVectorProperty *SayCountNP  {Properties.vector<SayCount>()};
+    ISwitchVectorProperty *SerialCaptureSP {Properties.vector<SerialCapture>()};
+    ITextVectorProperty   *SerialCaptureTP {Properties.vector<SerialCaptureFile>()};
+    ITextVectorProperty   *SerialReplayTP  {Properties.vector<SerialReplayFile>()};
+    INumberVectorProperty *SerialReplaySpeedNP {Properties.vector<SerialReplaySpeed>()};
+    ISwitchVectorProperty *AutoDetectSP {Properties.vector<AutoDetect>()};
+    ISwitchVectorProperty *IoThreadSP {Properties.vector<IoThread>()};
+
+    ISState lastState()
+    {
+        return IoThreadSP->sp[IO_THREAD_OFF].s;
+    }
+
+    void initProperties()
+    {
+        Properties.setDevice(Device);
+    }
+};
+
+// Construct the properties with the driver object and set them up, like a
+// driver does once at startup.
+template <typename Driver>
+void run(const char *name, int rounds)
+{
+    // The first round warms up the allocator and the caches.
+    std::unique_ptr<Driver>(new Driver())->initProperties();
+
+    const uint64_t allocations = g_Allocations;
+    const uint64_t start = Bench::nowNs();
+    for (int round = 0; round < rounds; ++round)
+    {
+        std::unique_ptr<Driver> driver(new Driver());
+        driver->initProperties();
+        Bench::doNotOptimize(driver->lastState());
+    }
+    const double ns = static_cast<double>(Bench::nowNs() - start) / rounds;
+    printf("property_startup kind=%s properties=9 elements=13 allocations=%.1f ns=%.0f driver_bytes=%zu\n", name,
+           static_cast<double>(g_Allocations - allocations) / rounds, ns, sizeof(Driver));
+}
+
+}
+
+void *operator new(size_t size)
+{
+    ++g_Allocations;
+    if (void *pointer = malloc(size > 0 ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+int main(int argc, char *argv[])
+{
+    const int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+    run<Classic>("classic", rounds);
+    run<Schematic>("schema", rounds);
+    printf("property_startup_image bytes=%zu\n", decltype(Schematic::Properties)::size());
+    return 0;
+}
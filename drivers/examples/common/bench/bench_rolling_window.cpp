@@ -0,0 +1,156 @@
+// Sliding window aggregates of a weather sensor streaming thousands of
+// samples per second: a RollingWindow with its minimum, maximum, mean and
+// slope read after every sample, plus an Ewma and a Hysteresis, against
+// recomputing the same aggregates over the window for every sample. Checks
+// the results against the recomputed ones first, then prints nanoseconds and
+// samples per second per parameter for 10 s, 60 s and 5 min windows, the
+// memory of a window, and the share of a core a station with several
+// parameters at that rate needs.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "rolling_window.h"
+
+namespace
+{
+
+// Wind speed in m/s: a slow random walk with gusty noise on top.
+class Wind
+{
+public:
+    explicit Wind(unsigned seed) : m_Random(seed) {}
+
+    double next()
+    {
+        m_Base = std::max(0.0, m_Base + m_Step(m_Random));
+        return std::max(0.0, m_Base + m_Noise(m_Random));
+    }
+
+private:
+    std::mt19937_64 m_Random;
+    std::normal_distribution<double> m_Step {0, 0.01};
+    std::normal_distribution<double> m_Noise {0, 1.5};
+    double m_Base {6};
+};
+
+struct Naive
+{
+    double min, max, mean, slope;
+};
+
+Naive recompute(const std::vector<double> &times, const std::vector<double> &values, size_t first, size_t last)
+{
+    Naive result {values[first], values[first], 0, 0};
+    double st = 0, sv = 0, stt = 0, stv = 0;
+    const double origin = times[first];
+    for (size_t i = first; i < last; ++i)
+    {
+        result.min = std::min(result.min, values[i]);
+        result.max = std::max(result.max, values[i]);
+        const double t = times[i] - origin;
+        st += t;
+        sv += values[i];
+        stt += t * t;
+        stv += t * values[i];
+    }
+    const double n = static_cast<double>(last - first);
+    result.mean = sv / n;
+    result.slope = (n * stv - st * sv) / (n * stt - st * st);
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const double rate = argc > 1 ? atof(argv[1]) : 2000;
+    const int parameters = argc > 2 ? atoi(argv[2]) : 8;
+
+    // Correctness, over an hour of samples at 50 Hz in a 60 s window.
+    {
+        const double check = 50, window = 60;
+        const size_t samples = static_cast<size_t>(3600 * check);
+        std::vector<double> times(samples), values(samples);
+        Wind wind(3);
+        RollingWindow rolling(window, static_cast<size_t>(window * check) + 16);
+        double errorMinMax = 0, errorMean = 0, errorSlope = 0;
+        size_t first = 0;
+        for (size_t i = 0; i < samples; ++i)
+        {
+            times[i] = i / check;
+            values[i] = wind.next();
+            rolling.add(times[i], values[i]);
+            while (times[first] <= times[i] - window)
+                ++first;
+            if (i % 97 != 0 || i - first < 2)
+                continue;
+            const Naive naive = recompute(times, values, first, i + 1);
+            errorMinMax = std::max({errorMinMax, std::fabs(naive.min - rolling.min()), std::fabs(naive.max - rolling.max())});
+            errorMean = std::max(errorMean, std::fabs(naive.mean - rolling.mean()));
+            errorSlope = std::max(errorSlope, std::fabs(naive.slope - rolling.slope()));
+        }
+        printf("rolling_window check samples=%zu window_s=%.0f max_error_minmax=%.3g max_error_mean=%.3g "
+               "max_error_slope=%.3g\n", samples, window, errorMinMax, errorMean, errorSlope);
+    }
+
+    for (const double window : {10.0, 60.0, 300.0})
+    {
+        const size_t capacity = static_cast<size_t>(window * rate * 1.05) + 16;
+        const size_t warmup = static_cast<size_t>(window * rate);
+        const size_t measured = 2000000;
+
+        Wind wind(5);
+        RollingWindow rolling(window, capacity);
+        Ewma ewma(30);
+        Hysteresis gusts(10, 15, 2, 600);
+        double t = 0;
+        double checksum = 0;
+        for (size_t i = 0; i < warmup; ++i, t += 1 / rate)
+            rolling.add(t, wind.next());
+
+        // Wind samples drawn up front, so only the aggregates are timed.
+        std::vector<double> values(measured);
+        for (auto &value : values)
+            value = wind.next();
+
+        const uint64_t start = Bench::nowNs();
+        for (size_t i = 0; i < measured; ++i, t += 1 / rate)
+        {
+            rolling.add(t, values[i]);
+            ewma.add(t, values[i]);
+            gusts.update(t, rolling.max());
+            checksum += rolling.min() + rolling.max() + rolling.mean() + rolling.slope() + ewma.value();
+        }
+        const double ns = static_cast<double>(Bench::nowNs() - start) / measured;
+        Bench::doNotOptimize(checksum);
+        printf("rolling_window engine window_s=%.0f rate_hz=%.0f ns_per_sample=%.1f samples_per_s=%.3g bytes=%zu "
+               "saturated=%d core_share_%d_params=%.2f%%\n", window, rate, ns, 1e9 / ns, capacity * 40,
+               rolling.saturated() ? 1 : 0, parameters, parameters * rate * ns / 1e7);
+
+        // Recomputing over the window, on fewer samples, it is slow.
+        std::vector<double> times(warmup + 2000), all(warmup + 2000);
+        for (size_t i = 0; i < all.size(); ++i)
+        {
+            times[i] = i / rate;
+            all[i] = wind.next();
+        }
+        const uint64_t naiveStart = Bench::nowNs();
+        for (size_t i = warmup; i < all.size(); ++i)
+        {
+            const Naive naive = recompute(times, all, i + 1 - warmup, i + 1);
+            checksum += naive.min + naive.max + naive.mean + naive.slope;
+        }
+        const double naiveNs = static_cast<double>(Bench::nowNs() - naiveStart) / 2000;
+        Bench::doNotOptimize(checksum);
+        printf("rolling_window recompute window_s=%.0f rate_hz=%.0f ns_per_sample=%.1f samples_per_s=%.3g "
+               "core_share_%d_params=%.2f%%\n", window, rate, naiveNs, 1e9 / naiveNs, parameters,
+               parameters * rate * naiveNs / 1e7);
+    }
+    return 0;
+}
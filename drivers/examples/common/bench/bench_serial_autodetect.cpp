@@ -0,0 +1,153 @@
+// Hides a device behind one of several pseudo terminals, answering only at
+// 115200 baud, and finds it the way INDI's port search does it, one port and
+// baud rate after the other, then with SerialAutoDetect on all ports at once,
+// and once more with the cache of the previous run. Prints the time to find
+// the device and the number of probes.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "serial_autodetect.h"
+
+namespace
+{
+
+const int ProbeTimeoutMs = 100;
+
+// Pseudo terminals share their settings between both ends, so the "device"
+// on the master side sees the baud rate the probe set on the slave.
+class FakePorts
+{
+public:
+    FakePorts(size_t count, size_t devicePort) : m_DevicePort(devicePort)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const int master = posix_openpt(O_RDWR | O_NOCTTY);
+            grantpt(master);
+            unlockpt(master);
+            m_Masters.push_back(master);
+            m_Paths.push_back(ptsname(master));
+        }
+        m_Thread = std::thread([this]
+        {
+            run();
+        });
+    }
+
+    ~FakePorts()
+    {
+        m_Stop = true;
+        m_Thread.join();
+        for (int master : m_Masters)
+            close(master);
+    }
+
+    const std::vector<std::string> &paths() const
+    {
+        return m_Paths;
+    }
+
+private:
+    void run()
+    {
+        std::vector<pollfd> fds;
+        for (int master : m_Masters)
+            fds.push_back({master, POLLIN, 0});
+        std::vector<std::string> buffers(m_Masters.size());
+
+        while (!m_Stop)
+        {
+            if (poll(fds.data(), fds.size(), 5) <= 0)
+                continue;
+            // A master with no slave open reports a hangup, do not spin on it.
+            bool input = false;
+            for (size_t i = 0; i < fds.size(); ++i)
+            {
+                if (!(fds[i].revents & POLLIN))
+                    continue;
+                input = true;
+                char chunk[64];
+                const ssize_t size = read(m_Masters[i], chunk, sizeof(chunk));
+                if (size <= 0)
+                    continue;
+                buffers[i].append(chunk, size);
+                if (buffers[i].find('#') == std::string::npos)
+                    continue;
+                buffers[i].clear();
+
+                // At any other baud rate a real device would only see garbage.
+                termios tty;
+                if (i == m_DevicePort && tcgetattr(m_Masters[i], &tty) == 0 && cfgetospeed(&tty) == B115200)
+                {
+                    if (write(m_Masters[i], "OK#", 3) != 3)
+                        perror("write");
+                }
+            }
+            if (!input)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    size_t m_DevicePort;
+    std::vector<int> m_Masters;
+    std::vector<std::string> m_Paths;
+    std::thread m_Thread;
+    std::atomic<bool> m_Stop {false};
+};
+
+bool handshake(SerialAutoDetect::Link &link)
+{
+    char answer[16];
+    return link.write(":STATUS#") && link.readSection(answer, sizeof(answer), '#', ProbeTimeoutMs) == 3 &&
+           strncmp(answer, "OK#", 3) == 0;
+}
+
+void report(const char *name, const SerialAutoDetect::Result &result, const std::string &expected)
+{
+    printf("%s found=%d right_port=%d baud=%d from_cache=%d probes=%zu connect_ms=%lld\n", name, result.found ? 1 : 0,
+           result.port == expected ? 1 : 0, result.baud, result.fromCache ? 1 : 0, result.probes,
+           static_cast<long long>(result.elapsed.count()));
+    if (result.fd >= 0)
+        close(result.fd);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t ports = argc > 1 ? atoi(argv[1]) : 8;
+    const std::string cachePath = "/tmp/bench_serial_autodetect.cache";
+    unlink(cachePath.c_str());
+
+    // The device is on the last port, the configured one is stale.
+    FakePorts fake(ports, ports - 1);
+    const std::string expected = fake.paths().back();
+
+    SerialAutoDetect::Options options;
+    options.ports = fake.paths();
+    options.preferredPort = fake.paths().front();
+    options.preferredBaud = 57600;
+
+    options.maxParallel = 1;
+    report("autodetect_sequential", SerialAutoDetect::detect(handshake, options), expected);
+
+    options.maxParallel = 16;
+    options.cachePath = cachePath;
+    report("autodetect_parallel", SerialAutoDetect::detect(handshake, options), expected);
+    report("autodetect_cached", SerialAutoDetect::detect(handshake, options), expected);
+
+    unlink(cachePath.c_str());
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Records a synthetic command/answer session with a serial device to a
+// capture file, then replays it at the original speed, faster and as fast as
+// possible, the way a driver's sendCommand() would talk to the device. Prints
+// the cost of recording, the replay throughput and how closely the replayed
+// answer latencies follow the recorded ones.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "serial_capture.h"
+#include "serial_replay.h"
+
+int main(int argc, char *argv[])
+{
+    const int commands = argc > 1 ? atoi(argv[1]) : 200;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/bench_serial_replay.cap";
+
+    // A device answering in 2 to 8 ms, with a poll every 5 ms.
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> answerUs(2000, 8000);
+    double recordNs = 0;
+    {
+        SerialCapture::Writer writer;
+        if (!writer.open(path))
+        {
+            fprintf(stderr, "Cannot create %s\n", path.c_str());
+            return 1;
+        }
+        for (int i = 0; i < commands; ++i)
+        {
+            char command[32], answer[32];
+            snprintf(command, sizeof(command), ":GP%d#", i % 7);
+            snprintf(answer, sizeof(answer), "%+08.3f#", i * 0.125);
+
+            uint64_t start = Bench::nowNs();
+            writer.record(SerialCapture::Direction::Tx, command, strlen(command));
+            recordNs += Bench::nowNs() - start;
+
+            const int wait = answerUs(rng);
+            std::this_thread::sleep_for(std::chrono::microseconds(wait));
+
+            start = Bench::nowNs();
+            writer.record(SerialCapture::Direction::Rx, answer, strlen(answer));
+            recordNs += Bench::nowNs() - start;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    std::vector<SerialCapture::Record> records;
+    if (!SerialCapture::load(path, records))
+    {
+        fprintf(stderr, "Cannot read back %s\n", path.c_str());
+        return 1;
+    }
+    FILE *file = fopen(path.c_str(), "rb");
+    fseek(file, 0, SEEK_END);
+    const long fileSize = ftell(file);
+    fclose(file);
+
+    // Answer latencies as the capture has them, which is what the replay reproduces.
+    std::vector<double> recordedLatency;
+    for (size_t i = 1; i < records.size(); i += 2)
+        recordedLatency.push_back((records[i].timestamp - records[i - 1].timestamp) / 1e6);
+    const double recordedP50 = Bench::percentile(recordedLatency, 50);
+    const double recordedP99 = Bench::percentile(recordedLatency, 99);
+
+    printf("serial_capture commands=%d records=%zu file_bytes=%ld bytes_per_record=%.1f record_ns=%.0f "
+           "latency_p50_ms=%.3f latency_p99_ms=%.3f\n", commands, records.size(), fileSize,
+           double(fileSize - 24) / records.size(), recordNs / records.size(), recordedP50, recordedP99);
+
+    for (double speed : {1.0, 10.0, 0.0})
+    {
+        SerialReplay replay(records, speed);
+        std::vector<double> latency;
+        int failures = 0;
+
+        const uint64_t start = Bench::nowNs();
+        for (int i = 0; i < commands; ++i)
+        {
+            char command[32], answer[32];
+            snprintf(command, sizeof(command), ":GP%d#", i % 7);
+            const uint64_t sent = Bench::nowNs();
+            replay.write(command, strlen(command));
+            if (replay.readSection(answer, sizeof(answer), '#', 1000) < 0)
+                ++failures;
+            latency.push_back((Bench::nowNs() - sent) / 1e6);
+        }
+        const double seconds = (Bench::nowNs() - start) * 1e-9;
+
+        printf("serial_replay speed=%s commands_per_second=%.0f latency_p50_ms=%.3f latency_p99_ms=%.3f "
+               "expected_p50_ms=%.3f expected_p99_ms=%.3f mismatches=%llu failures=%d\n",
+               speed > 0 ? std::to_string(static_cast<int>(speed)).c_str() : "max", commands / seconds,
+               Bench::percentile(latency, 50), Bench::percentile(latency, 99), speed > 0 ? recordedP50 / speed : 0,
+               speed > 0 ? recordedP99 / speed : 0, (unsigned long long)replay.stats().mismatches, failures);
+    }
+
+    remove(path.c_str());
+    return 0;
+}
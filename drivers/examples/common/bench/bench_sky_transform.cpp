@@ -0,0 +1,196 @@
+// Throughput of SkyTransform::transform() in transforms per second, with the
+// SIMD kernel and with the scalar one, with and without the dome azimuth. The
+// SIMD results are checked against the scalar kernel, and, when built with
+// libnova, the horizontal coordinates of both against ln_get_hrz_from_equ()
+// called one sample at a time, the way INDI::Dome and the alignment subsystem
+// use it. Errors are the angle on the sky between two results, in arcseconds.
+// Exits nonzero when one is above an arcsecond.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#if defined(HAVE_LIBNOVA)
+#include <libnova/transform.h>
+#endif
+
+#include "bench_util.h"
+#include "sky_transform.h"
+
+namespace
+{
+
+constexpr double Pi = 3.14159265358979323846;
+constexpr double ArcsecondsPerRadian = 180.0 / Pi * 3600.0;
+
+struct Samples
+{
+    std::vector<double> ra, dec, jd;
+
+    SkyTransform::Input input() const
+    {
+        SkyTransform::Input input;
+        input.ra = ra.data();
+        input.dec = dec.data();
+        input.jd = jd.data();
+        return input;
+    }
+};
+
+struct Results
+{
+    std::vector<double> alt, az, domeAz;
+
+    explicit Results(size_t count) : alt(count), az(count), domeAz(count) {}
+
+    SkyTransform::Output output(bool dome)
+    {
+        SkyTransform::Output output;
+        output.alt = alt.data();
+        output.az = az.data();
+        output.domeAz = dome ? domeAz.data() : nullptr;
+        return output;
+    }
+};
+
+// Anywhere on the sky, 1990 to 2050, plus the poles and the exact zenith.
+Samples makeSamples(size_t count, const SkyTransform::Site &site)
+{
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    Samples samples;
+    for (size_t i = 0; i < count; ++i)
+    {
+        samples.ra.push_back(24 * uniform(random));
+        samples.dec.push_back(std::asin(2 * uniform(random) - 1) * 180 / Pi);
+        samples.jd.push_back(2447892.5 + 60 * 365.25 * uniform(random));
+    }
+    samples.dec[0] = 90;
+    samples.dec[1] = -90;
+    samples.dec[2] = site.latitude;
+    samples.ra[2] = 0;
+    samples.jd[2] = 2451545.0;
+    return samples;
+}
+
+// Angle between two directions given as altitude and azimuth in degrees, by
+// the haversine formula, which stays accurate for the small angles looked at here.
+double separationArcsec(double alt1, double az1, double alt2, double az2)
+{
+    const double d = Pi / 180;
+    const double altitude = std::sin((alt1 - alt2) * d / 2);
+    const double azimuth = std::sin((az1 - az2) * d / 2);
+    const double haversine = altitude * altitude + std::cos(alt1 * d) * std::cos(alt2 * d) * azimuth * azimuth;
+    return 2 * std::asin(std::min(1.0, std::sqrt(haversine))) * ArcsecondsPerRadian;
+}
+
+double azimuthArcsec(double az1, double az2)
+{
+    if (std::isnan(az1) || std::isnan(az2))
+        return std::isnan(az1) == std::isnan(az2) ? 0 : INFINITY;
+    return std::fabs(std::remainder(az1 - az2, 360.0)) * 3600;
+}
+
+// Largest error allowed between two kernels, or a kernel and libnova.
+const double MaxErrorArcsec = 1.0;
+
+bool compare(const char *name, const Results &a, const Results &b, size_t count, bool dome)
+{
+    double maxSeparation = 0, maxDome = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        maxSeparation = std::max(maxSeparation, separationArcsec(a.alt[i], a.az[i], b.alt[i], b.az[i]));
+        if (dome)
+            maxDome = std::max(maxDome, azimuthArcsec(a.domeAz[i], b.domeAz[i]));
+    }
+    printf("sky_transform_check %s samples=%zu max_error_arcsec=%.2e", name, count, maxSeparation);
+    if (dome)
+        printf(" max_dome_az_error_arcsec=%.2e", maxDome);
+    const bool ok = maxSeparation <= MaxErrorArcsec && maxDome <= MaxErrorArcsec;
+    printf(" within_limit=%s\n", ok ? "yes" : "no");
+    return ok;
+}
+
+template <typename Function>
+double bestSeconds(int rounds, Function fn)
+{
+    double best = 1e9;
+    for (int round = 0; round < rounds; ++round)
+    {
+        const uint64_t start = Bench::nowNs();
+        fn();
+        best = std::min(best, (Bench::nowNs() - start) * 1e-9);
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1 << 16;
+    const int rounds = 20;
+
+    SkyTransform::Site site;
+    site.latitude = 51.4769;
+    site.longitude = -0.0005;
+
+    // A 5 m dome with the pier off center and a German equatorial mount.
+    SkyTransform::DomeGeometry dome;
+    dome.radius = 2.5;
+    dome.northDisplacement = 0.3;
+    dome.eastDisplacement = -0.2;
+    dome.upDisplacement = 0.5;
+    dome.otaOffset = 0.45;
+    dome.side = SkyTransform::DomeGeometry::SideHourAngle;
+
+    const Samples samples = makeSamples(count, site);
+    Results scalar(count), simd(count);
+
+    for (bool useSimd : {false, true})
+    {
+        SkyTransform::setSimdEnabled(useSimd);
+        Results &results = useSimd ? simd : scalar;
+        for (bool withDome : {false, true})
+        {
+            const double seconds = bestSeconds(rounds, [&]
+            {
+                SkyTransform::transform(site, samples.input(), results.output(withDome), count, dome);
+            });
+            Bench::doNotOptimize(results.alt[count - 1]);
+            printf("sky_transform kernel=%s dome=%d samples=%zu transforms_per_s=%.3g ns_per_transform=%.1f\n",
+                   SkyTransform::simdLevel(), withDome ? 1 : 0, count, count / seconds, seconds * 1e9 / count);
+        }
+    }
+    bool ok = compare("simd_vs_scalar", simd, scalar, count, true);
+
+#if defined(HAVE_LIBNOVA)
+    Results nova(count);
+    const double novaSeconds = bestSeconds(rounds / 4, [&]
+    {
+        ln_lnlat_posn observer;
+        observer.lat = site.latitude;
+        observer.lng = site.longitude;
+        for (size_t i = 0; i < count; ++i)
+        {
+            ln_equ_posn equatorial;
+            equatorial.ra = samples.ra[i] * 15;
+            equatorial.dec = samples.dec[i];
+            ln_hrz_posn horizontal;
+            ln_get_hrz_from_equ(&equatorial, &observer, samples.jd[i], &horizontal);
+            nova.alt[i] = horizontal.alt;
+            // libnova measures from south.
+            nova.az[i] = std::fmod(horizontal.az + 180, 360);
+        }
+    });
+    printf("sky_transform kernel=libnova dome=0 samples=%zu transforms_per_s=%.3g ns_per_transform=%.1f\n", count,
+           count / novaSeconds, novaSeconds * 1e9 / count);
+    ok = compare("scalar_vs_libnova", scalar, nova, count, false) && ok;
+    ok = compare("simd_vs_libnova", simd, nova, count, false) && ok;
+#else
+    printf("sky_transform_check libnova=not_found\n");
+#endif
+    return ok ? 0 : 1;
+}
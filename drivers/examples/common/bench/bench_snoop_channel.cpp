@@ -0,0 +1,448 @@
+// A mount publishes its RA and DEC every millisecond, a dome in another
+// process snoops them. Prints the latency from publishing to the snooper
+// holding the values and the CPU time all processes spend per update, once
+// the way INDI does it today, as XML the publisher writes, a relay process
+// standing in for indiserver parses and writes again, and the snooper parses,
+// and once through a SnoopPublisher ring in shared memory, with the snooper
+// woken through the eventfd of its SnoopSubscriber like on the event loop.
+//
+// The XML parser here is a small one, lilxml allocates more per element, so
+// the XML path in a real indiserver costs more than measured.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "snoop_channel.h"
+
+namespace
+{
+
+const char *Device = "Bench Mount";
+const char *Property = "EQUATORIAL_EOD_COORD";
+
+double cpuUs()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// What a snooper reports back to the parent.
+struct Report
+{
+    uint64_t received;
+    // Overwritten in the ring before the snooper got to them.
+    uint64_t lost;
+    double cpuUs;
+    double p50Us;
+    double p99Us;
+    double maxUs;
+};
+
+Report report(std::vector<double> &latencies, double cpu)
+{
+    Report result {};
+    result.received = latencies.size();
+    result.cpuUs = cpu;
+    result.maxUs = latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end());
+    result.p50Us = Bench::percentile(latencies, 50);
+    result.p99Us = Bench::percentile(latencies, 99);
+    return result;
+}
+
+void sendReport(int fd, const Report &result)
+{
+    if (write(fd, &result, sizeof(result)) != sizeof(result))
+        perror("write");
+}
+
+Report receiveReport(int fd)
+{
+    Report result {};
+    if (read(fd, &result, sizeof(result)) != sizeof(result))
+        perror("read");
+    return result;
+}
+
+// -- XML --------------------------------------------------------------------
+
+struct Element
+{
+    std::string tag;
+    std::vector<std::pair<std::string, std::string>> attributes;
+    std::string pcdata;
+    std::vector<Element> children;
+
+    const char *attribute(const char *name) const
+    {
+        for (const auto &attribute : attributes)
+            if (attribute.first == name)
+                return attribute.second.c_str();
+        return "";
+    }
+};
+
+// Parses complete elements out of a stream, keeps the rest for the next read.
+class XmlReader
+{
+public:
+    void append(const char *data, size_t size)
+    {
+        m_Buffer.append(data, size);
+    }
+
+    bool next(Element &element)
+    {
+        size_t position = m_Buffer.find('<');
+        if (position == std::string::npos)
+            return false;
+        element = Element();
+        if (!parse(position, element))
+            return false;
+        m_Buffer.erase(0, position);
+        return true;
+    }
+
+private:
+    void skipSpace(size_t &position)
+    {
+        while (position < m_Buffer.size() && isspace(static_cast<unsigned char>(m_Buffer[position])))
+            ++position;
+    }
+
+    bool parse(size_t &position, Element &element)
+    {
+        // <tag
+        size_t end = m_Buffer.find_first_of(" \t\n/>", position + 1);
+        if (end == std::string::npos)
+            return false;
+        element.tag = m_Buffer.substr(position + 1, end - position - 1);
+        position = end;
+
+        // attributes
+        for (;;)
+        {
+            skipSpace(position);
+            if (position >= m_Buffer.size())
+                return false;
+            if (m_Buffer[position] == '/')
+            {
+                if (position + 1 >= m_Buffer.size())
+                    return false;
+                position += 2;
+                return true;
+            }
+            if (m_Buffer[position] == '>')
+            {
+                ++position;
+                break;
+            }
+            const size_t equals = m_Buffer.find('=', position);
+            if (equals == std::string::npos || equals + 1 >= m_Buffer.size())
+                return false;
+            const size_t close = m_Buffer.find('"', equals + 2);
+            if (close == std::string::npos)
+                return false;
+            element.attributes.emplace_back(m_Buffer.substr(position, equals - position),
+                                            m_Buffer.substr(equals + 2, close - equals - 2));
+            position = close + 1;
+        }
+
+        // content up to </tag>
+        for (;;)
+        {
+            const size_t open = m_Buffer.find('<', position);
+            if (open == std::string::npos || open + 1 >= m_Buffer.size())
+                return false;
+            element.pcdata.append(m_Buffer, position, open - position);
+            if (m_Buffer[open + 1] == '/')
+            {
+                const size_t close = m_Buffer.find('>', open);
+                if (close == std::string::npos)
+                    return false;
+                position = close + 1;
+                return true;
+            }
+            element.children.emplace_back();
+            position = open;
+            if (!parse(position, element.children.back()))
+                return false;
+        }
+    }
+
+    std::string m_Buffer;
+};
+
+void serialize(const Element &element, std::string &out)
+{
+    out += '<';
+    out += element.tag;
+    for (const auto &attribute : element.attributes)
+    {
+        out += "\n    ";
+        out += attribute.first;
+        out += "=\"";
+        out += attribute.second;
+        out += '"';
+    }
+    out += ">\n";
+    out += element.pcdata;
+    for (const Element &child : element.children)
+        serialize(child, out);
+    out += "</";
+    out += element.tag;
+    out += ">\n";
+}
+
+// IDSetNumber(): the message the mount writes for every update.
+std::string setNumberVector(double ra, double dec, uint64_t sentNs)
+{
+    char message[512];
+    // The send time rides in the timestamp, which has about the same length.
+    snprintf(message, sizeof(message),
+             "<setNumberVector device=\"%s\" name=\"%s\" state=\"Ok\" timeout=\"60\" timestamp=\"%llu\">\n"
+             "    <oneNumber name=\"RA\">\n%.10g\n    </oneNumber>\n"
+             "    <oneNumber name=\"DEC\">\n%.10g\n    </oneNumber>\n"
+             "</setNumberVector>\n",
+             Device, Property, static_cast<unsigned long long>(sentNs), ra, dec);
+    return message;
+}
+
+void drain(int fd, XmlReader &reader, const std::function<void(const Element &)> &handle)
+{
+    char chunk[4096];
+    const ssize_t size = read(fd, chunk, sizeof(chunk));
+    if (size <= 0)
+        return;
+    reader.append(chunk, size);
+    Element element;
+    while (reader.next(element))
+        handle(element);
+}
+
+// indiserver: parse what the driver wrote, write it to the snooper.
+void runRelay(int in, int out)
+{
+    XmlReader reader;
+    std::string message;
+    for (;;)
+    {
+        char chunk[4096];
+        const ssize_t size = read(in, chunk, sizeof(chunk));
+        if (size <= 0)
+            break;
+        reader.append(chunk, size);
+        Element element;
+        while (reader.next(element))
+        {
+            message.clear();
+            serialize(element, message);
+            if (write(out, message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+                return;
+        }
+    }
+}
+
+// The dome: parse the snooped message and pick out the coordinates.
+void runXmlSnooper(int in, int result, uint64_t count)
+{
+    XmlReader reader;
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    double ra = 0, dec = 0;
+    const double cpuStart = cpuUs();
+
+    pollfd fd = {in, POLLIN, 0};
+    while (latencies.size() < count && poll(&fd, 1, 2000) > 0)
+    {
+        drain(in, reader, [&](const Element & element)
+        {
+            if (element.tag != "setNumberVector" || strcmp(element.attribute("name"), Property) != 0)
+                return;
+            for (const Element &number : element.children)
+            {
+                if (strcmp(number.attribute("name"), "RA") == 0)
+                    ra = strtod(number.pcdata.c_str(), nullptr);
+                else if (strcmp(number.attribute("name"), "DEC") == 0)
+                    dec = strtod(number.pcdata.c_str(), nullptr);
+            }
+            const uint64_t sent = strtoull(element.attribute("timestamp"), nullptr, 10);
+            latencies.push_back((Bench::nowNs() - sent) / 1e3);
+        });
+    }
+    Bench::doNotOptimize(ra + dec);
+    sendReport(result, report(latencies, cpuUs() - cpuStart));
+}
+
+// -- Shared memory ----------------------------------------------------------
+
+void runShmSnooper(int ready, int result, uint64_t count)
+{
+    SnoopSubscriber subscriber;
+    while (!subscriber.open(Device, Property))
+        usleep(1000);
+    const int ra = subscriber.indexOf("RA"), dec = subscriber.indexOf("DEC");
+    const int event = subscriber.eventFd();
+    if (write(ready, "r", 1) != 1)
+        perror("write");
+
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    double coordinates = 0;
+    const double cpuStart = cpuUs();
+
+    // The event loop of the dome. SharedSnoop only takes the newest sample,
+    // here every one is taken to compare with XML, which delivers them all.
+    pollfd fd = {event, POLLIN, 0};
+    SnoopSample sample;
+    while (sample.number < count && poll(&fd, 1, 2000) > 0)
+    {
+        subscriber.clearEvent();
+        while (subscriber.next(sample))
+        {
+            coordinates += sample.values[ra] + sample.values[dec];
+            latencies.push_back((Bench::nowNs() - sample.timestampNs) / 1e3);
+        }
+    }
+    Bench::doNotOptimize(coordinates);
+    Report snooped = report(latencies, cpuUs() - cpuStart);
+    snooped.lost = subscriber.lost();
+    sendReport(result, snooped);
+}
+
+// -- Publisher --------------------------------------------------------------
+
+// Returns the time spent publishing, without the sleeps in between.
+template <typename Publish>
+double publish(uint64_t count, int periodUs, Publish publishOne)
+{
+    uint64_t busyNs = 0;
+    uint64_t next = Bench::nowNs();
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        next += periodUs * 1000ull;
+        while (Bench::nowNs() < next)
+            usleep(std::max<int64_t>(0, (static_cast<int64_t>(next) - static_cast<int64_t>(Bench::nowNs())) / 1000));
+        const uint64_t start = Bench::nowNs();
+        publishOne(5.0 + i * 1e-6, 20.0 + std::sin(i * 1e-3));
+        busyNs += Bench::nowNs() - start;
+    }
+    return busyNs / 1e3;
+}
+
+void print(const char *name, uint64_t count, double publisherCpu, const std::vector<double> &otherCpu, const Report &snooper)
+{
+    double total = publisherCpu + snooper.cpuUs;
+    for (double cpu : otherCpu)
+        total += cpu;
+    printf("%s updates=%llu received=%llu lost=%llu latency_p50_us=%.1f latency_p99_us=%.1f latency_max_us=%.1f "
+           "cpu_publisher_us=%.2f cpu_snooper_us=%.2f cpu_total_us=%.2f\n",
+           name, static_cast<unsigned long long>(count), static_cast<unsigned long long>(snooper.received),
+           static_cast<unsigned long long>(snooper.lost),
+           snooper.p50Us, snooper.p99Us, snooper.maxUs, publisherCpu / count, snooper.cpuUs / count, total / count);
+}
+
+void benchXml(uint64_t count, int periodUs)
+{
+    int toRelay[2], toSnooper[2], results[2], relayCpu[2];
+    if (pipe(toRelay) != 0 || pipe(toSnooper) != 0 || pipe(results) != 0 || pipe(relayCpu) != 0)
+        return;
+
+    const pid_t relay = fork();
+    if (relay == 0)
+    {
+        close(toRelay[1]);
+        const double start = cpuUs();
+        runRelay(toRelay[0], toSnooper[1]);
+        const double cpu = cpuUs() - start;
+        if (write(relayCpu[1], &cpu, sizeof(cpu)) != sizeof(cpu))
+            perror("write");
+        _exit(0);
+    }
+    const pid_t snooper = fork();
+    if (snooper == 0)
+    {
+        close(toRelay[1]);
+        runXmlSnooper(toSnooper[0], results[1], count);
+        _exit(0);
+    }
+    close(toRelay[0]);
+    close(toSnooper[0]);
+    close(toSnooper[1]);
+
+    const double cpu = publish(count, periodUs, [&](double ra, double dec)
+    {
+        const std::string message = setNumberVector(ra, dec, Bench::nowNs());
+        if (write(toRelay[1], message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+            perror("write");
+    });
+
+    const Report snooped = receiveReport(results[0]);
+    close(toRelay[1]);
+    double relayUs = 0;
+    if (read(relayCpu[0], &relayUs, sizeof(relayUs)) != sizeof(relayUs))
+        perror("read");
+    waitpid(relay, nullptr, 0);
+    waitpid(snooper, nullptr, 0);
+    print("snoop_xml", count, cpu, {relayUs}, snooped);
+}
+
+void benchShm(uint64_t count, int periodUs)
+{
+    SnoopPublisher publisher;
+    if (!publisher.open(Device, Property, {"RA", "DEC"}))
+    {
+        perror("shm_open");
+        return;
+    }
+
+    int ready[2], results[2];
+    if (pipe(ready) != 0 || pipe(results) != 0)
+        return;
+    const pid_t snooper = fork();
+    if (snooper == 0)
+    {
+        runShmSnooper(ready[1], results[1], count);
+        _exit(0);
+    }
+    char c;
+    if (read(ready[0], &c, 1) != 1)
+        perror("read");
+
+    const double cpu = publish(count, periodUs, [&](double ra, double dec)
+    {
+        const double values[2] = {ra, dec};
+        publisher.publish(values, 2, 1);
+    });
+
+    const Report snooped = receiveReport(results[0]);
+    waitpid(snooper, nullptr, 0);
+    print("snoop_shm", count, cpu, {}, snooped);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 5000;
+    const int periodUs = argc > 2 ? atoi(argv[2]) : 1000;
+    signal(SIGPIPE, SIG_IGN);
+
+    benchXml(count, periodUs);
+    benchShm(count, periodUs);
+    return 0;
+}
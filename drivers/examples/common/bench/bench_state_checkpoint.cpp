@@ -0,0 +1,153 @@
+// Checkpoints a dome-sized state struct into a StateCheckpoint and prints
+// the cost of a write, next to writing the same state to a file with write,
+// fsync and rename. Then kills a child process with SIGKILL while it
+// checkpoints as fast as it can, many times over, and checks that every
+// restart recovers an intact snapshot, never an older one than the last
+// restart, and how long the recovery takes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "state_checkpoint.h"
+
+namespace
+{
+
+struct State
+{
+    uint64_t counter;
+    double azimuth;
+    double targetAzimuth;
+    int32_t parked;
+    int32_t shutter;
+    int32_t backlashSteps;
+    int32_t backlashEnabled;
+    // Derived from counter, a torn snapshot would not match.
+    uint64_t check;
+};
+
+State makeState(uint64_t counter)
+{
+    State state {};
+    state.counter = counter;
+    state.azimuth = (counter % 3600) / 10.0;
+    state.targetAzimuth = 180;
+    state.parked = counter & 1;
+    state.backlashSteps = static_cast<int32_t>(counter % 100);
+    state.check = counter * 0x9E3779B97F4A7C15ull;
+    return state;
+}
+
+bool intact(const State &state)
+{
+    return state.check == state.counter * 0x9E3779B97F4A7C15ull;
+}
+
+void benchWrite(const std::string &path)
+{
+    Checkpoint<State> checkpoint;
+    checkpoint.open(path);
+
+    const int count = 1000000;
+    std::vector<double> samples;
+    uint64_t start = Bench::nowNs();
+    for (int i = 0; i < count; ++i)
+    {
+        const uint64_t before = (i & 1023) == 0 ? Bench::nowNs() : 0;
+        checkpoint.write(makeState(i));
+        if (before != 0)
+            samples.push_back(Bench::nowNs() - before);
+    }
+    const double mean = static_cast<double>(Bench::nowNs() - start) / count;
+    printf("checkpoint_mmap writes=%d mean_ns=%.1f p99_ns=%.0f\n", count, mean, Bench::percentile(samples, 99));
+
+    uint64_t flushStart = Bench::nowNs();
+    checkpoint.flush();
+    printf("checkpoint_mmap_flush us=%.1f\n", (Bench::nowNs() - flushStart) / 1e3);
+
+    // What a driver would do without the mapping, for every transition.
+    const std::string file = path + ".file";
+    const int fileCount = 200;
+    start = Bench::nowNs();
+    for (int i = 0; i < fileCount; ++i)
+    {
+        const State state = makeState(i);
+        const std::string temporary = file + ".tmp";
+        const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (::write(fd, &state, sizeof(state)) != sizeof(state))
+            perror("write");
+        fsync(fd);
+        ::close(fd);
+        rename(temporary.c_str(), file.c_str());
+    }
+    printf("checkpoint_file_fsync writes=%d mean_ns=%.1f\n", fileCount, static_cast<double>(Bench::nowNs() - start) / fileCount);
+    unlink(file.c_str());
+}
+
+void benchCrash(const std::string &path, int rounds)
+{
+    unlink(path.c_str());
+    int torn = 0, lost = 0, regressed = 0;
+    uint64_t last = 0;
+    std::vector<double> recovery;
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        const pid_t child = fork();
+        if (child == 0)
+        {
+            // Carry on from what survived, like a restarted driver does.
+            Checkpoint<State> checkpoint;
+            checkpoint.open(path);
+            State state {};
+            uint64_t counter = checkpoint.read(state) ? state.counter : 0;
+            for (;;)
+                checkpoint.write(makeState(++counter));
+        }
+
+        usleep(1000 + rand() % 4000);
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+
+        const uint64_t start = Bench::nowNs();
+        Checkpoint<State> checkpoint;
+        State state {};
+        const bool found = checkpoint.open(path) && checkpoint.read(state);
+        recovery.push_back((Bench::nowNs() - start) / 1e3);
+
+        if (!found)
+            ++lost;
+        else if (!intact(state))
+            ++torn;
+        else if (state.counter < last)
+            ++regressed;
+        else
+            last = state.counter;
+    }
+
+    printf("checkpoint_crash rounds=%d lost=%d torn=%d regressed=%d last_counter=%llu recover_p50_us=%.1f "
+           "recover_p99_us=%.1f\n",
+           rounds, lost, torn, regressed, static_cast<unsigned long long>(last), Bench::percentile(recovery, 50),
+           Bench::percentile(recovery, 99));
+    unlink(path.c_str());
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    const std::string path = "/tmp/bench_state_checkpoint.ckpt";
+
+    benchWrite(path);
+    benchCrash(path, rounds);
+    return 0;
+}
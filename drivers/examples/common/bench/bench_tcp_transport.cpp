@@ -0,0 +1,346 @@
+// Talks to a local stand-in for a serial-over-Ethernet bridge, which echoes
+// every '#' terminated command and can be told to misbehave. Prints the round
+// trip of commands written in two parts with and without TCP_NODELAY, the
+// round trip through TcpTransport, and how long the transport takes to get
+// going again when the bridge drops the connection, goes silent or is away
+// for a while, driving the reconnect the way the retry timer of
+// TcpTransportProperties does. No call may block for a connect.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "tcp_transport.h"
+
+namespace
+{
+
+// Serves one client at a time on 127.0.0.1, a new connection replaces the old one.
+class Bridge
+{
+public:
+    // Close the connection instead of answering every n-th command.
+    std::atomic<int> dropEvery {0};
+    // Swallow the next command and keep the connection open, like a half-open link.
+    std::atomic<bool> swallowNext {false};
+
+    Bridge()
+    {
+        listen();
+        m_Thread = std::thread([this]
+        {
+            run();
+        });
+    }
+
+    ~Bridge()
+    {
+        m_Stop = true;
+        m_Thread.join();
+        closeAll();
+    }
+
+    uint16_t port() const
+    {
+        return m_Port;
+    }
+
+    // Stop accepting and drop the client for a while, then come back on the same port.
+    void outage(int ms)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            closeAll();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        listen();
+    }
+
+private:
+    void listen()
+    {
+        m_Listener = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(m_Port);
+        bind(m_Listener, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        ::listen(m_Listener, 4);
+        socklen_t length = sizeof(address);
+        getsockname(m_Listener, reinterpret_cast<sockaddr *>(&address), &length);
+        m_Port = ntohs(address.sin_port);
+    }
+
+    void closeAll()
+    {
+        if (m_Client >= 0)
+            close(m_Client);
+        if (m_Listener >= 0)
+            close(m_Listener);
+        m_Client = m_Listener = -1;
+    }
+
+    void run()
+    {
+        std::string buffer;
+        int commands = 0;
+        while (!m_Stop)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            pollfd fds[2] = {{m_Listener, POLLIN, 0}, {m_Client, POLLIN, 0}};
+            if (poll(fds, 2, 1) <= 0)
+                continue;
+
+            if (fds[0].revents & POLLIN)
+            {
+                if (m_Client >= 0)
+                    close(m_Client);
+                m_Client = accept(m_Listener, nullptr, nullptr);
+                buffer.clear();
+            }
+
+            if (m_Client < 0 || !(fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            char chunk[512];
+            const ssize_t size = recv(m_Client, chunk, sizeof(chunk), 0);
+            if (size <= 0)
+            {
+                close(m_Client);
+                m_Client = -1;
+                continue;
+            }
+            buffer.append(chunk, size);
+
+            size_t end;
+            while (m_Client >= 0 && (end = buffer.find('#')) != std::string::npos)
+            {
+                const std::string command = buffer.substr(0, end + 1);
+                buffer.erase(0, end + 1);
+                ++commands;
+                if (swallowNext.exchange(false))
+                    continue;
+                if (dropEvery > 0 && commands % dropEvery == 0)
+                {
+                    close(m_Client);
+                    m_Client = -1;
+                    break;
+                }
+                ::send(m_Client, command.data(), command.size(), MSG_NOSIGNAL);
+            }
+        }
+    }
+
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::atomic<bool> m_Stop {false};
+    int m_Listener {-1};
+    int m_Client {-1};
+    uint16_t m_Port {0};
+};
+
+struct Latency
+{
+    std::vector<double> samples;
+
+    void print(const char *prefix)
+    {
+        const double p50 = Bench::percentile(samples, 50), p99 = Bench::percentile(samples, 99);
+        printf("%s commands=%zu p50_us=%.1f p99_us=%.1f max_us=%.1f", prefix, samples.size(), p50, p99,
+               samples.empty() ? 0.0 : samples.back());
+    }
+};
+
+// A driver that writes the command and its terminator separately, on a plain socket.
+void splitWrites(uint16_t port, bool noDelay, int commands)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return;
+    }
+    int value = noDelay ? 1 : 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+
+    Latency latency;
+    char answer[64];
+    for (int i = 0; i < commands; ++i)
+    {
+        const uint64_t start = Bench::nowNs();
+        ::send(fd, ":GR", 3, 0);
+        ::send(fd, "#", 1, 0);
+        size_t got = 0;
+        while (got == 0 || answer[got - 1] != '#')
+        {
+            const ssize_t size = recv(fd, answer + got, sizeof(answer) - got, 0);
+            if (size <= 0)
+                break;
+            got += size;
+        }
+        latency.samples.push_back((Bench::nowNs() - start) / 1e3);
+    }
+    close(fd);
+
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "tcp_split_write nodelay=%d", noDelay ? 1 : 0);
+    latency.print(prefix);
+    printf("\n");
+}
+
+// Runs maintain() when retryIn() asks, like the retry timer of a driver.
+// Returns the longest maintain() call in microseconds.
+double reconnect(TcpTransport &transport)
+{
+    double longest = 0;
+    for (;;)
+    {
+        const uint64_t start = Bench::nowNs();
+        const bool connected = transport.maintain();
+        longest = std::max(longest, (Bench::nowNs() - start) / 1e3);
+        if (connected)
+            return longest;
+        std::this_thread::sleep_for(std::max(transport.retryIn(), std::chrono::milliseconds(0)));
+    }
+}
+
+TcpTransport::Options options(uint16_t port)
+{
+    TcpTransport::Options options;
+    options.host = "127.0.0.1";
+    options.port = port;
+    options.commandTimeoutMs = 200;
+    options.backoffInitialMs = 20;
+    options.backoffMaxMs = 400;
+    return options;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int commands = argc > 1 ? atoi(argv[1]) : 20000;
+
+    Bridge bridge;
+
+    // Nagle holds back the terminator until the first part is acknowledged,
+    // and the bridge delays that acknowledgement waiting for an answer to send.
+    splitWrites(bridge.port(), false, 200);
+    splitWrites(bridge.port(), true, commands);
+
+    TcpTransport transport;
+    if (!transport.open(options(bridge.port())))
+    {
+        fprintf(stderr, "Cannot connect to the stand-in bridge\n");
+        return 1;
+    }
+
+    char request[32];
+    std::string response;
+    auto run = [&](const char *name, int count)
+    {
+        Latency latency;
+        int mismatches = 0;
+        double longestMaintainUs = 0;
+        const TcpTransport::Stats before = transport.stats();
+        for (int i = 0; i < count; ++i)
+        {
+            snprintf(request, sizeof(request), ":GP%d#", i);
+            const uint64_t start = Bench::nowNs();
+            const bool ok = transport.command(request, response);
+            latency.samples.push_back((Bench::nowNs() - start) / 1e3);
+            if (ok && response != request)
+                ++mismatches;
+            if (!ok)
+                longestMaintainUs = std::max(longestMaintainUs, reconnect(transport));
+        }
+        latency.print(name);
+        const TcpTransport::Stats &after = transport.stats();
+        printf(" reconnects=%llu failed=%llu wrong_answers=%d max_maintain_us=%.1f\n",
+               static_cast<unsigned long long>(after.reconnects - before.reconnects),
+               static_cast<unsigned long long>(after.failed - before.failed), mismatches, longestMaintainUs);
+    };
+
+    run("tcp_transport", commands);
+
+    // The bridge closes the connection on a command instead of answering it.
+    bridge.dropEvery = 500;
+    run("tcp_transport_drops every=500", commands);
+    bridge.dropEvery = 0;
+
+    // A half-open connection: the command vanishes and nothing tells us.
+    {
+        bridge.swallowNext = true;
+        const uint64_t start = Bench::nowNs();
+        const bool failed = !transport.command(":GR#", response);
+        const double failedMs = (Bench::nowNs() - start) / 1e6;
+        reconnect(transport);
+        const bool ok = transport.command(":GR#", response);
+        printf("tcp_transport_half_open command_timeout_ms=%d failed=%d failed_after_ms=%.1f recovered=%d recovery_ms=%.1f\n",
+               transport.options().commandTimeoutMs, failed ? 1 : 0, failedMs, ok ? 1 : 0,
+               (Bench::nowNs() - start) / 1e6);
+    }
+
+    // The bridge is away for 600 ms. Poll like a driver's TimerHit every 10 ms.
+    {
+        const TcpTransport::Stats before = transport.stats();
+        const uint64_t start = Bench::nowNs();
+        std::thread away([&]
+        {
+            bridge.outage(600);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        int failedPolls = 0;
+        uint64_t back = 0;
+        double longestPollUs = 0;
+        while (Bench::nowNs() - start < 3000000000ull)
+        {
+            const uint64_t pollStart = Bench::nowNs();
+            const bool ok = transport.maintain() && transport.command(":GR#", response);
+            longestPollUs = std::max(longestPollUs, (Bench::nowNs() - pollStart) / 1e3);
+            if (ok)
+            {
+                if (back == 0 && failedPolls > 0)
+                    back = Bench::nowNs();
+                if (back != 0)
+                    break;
+            }
+            else
+                ++failedPolls;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        away.join();
+
+        const TcpTransport::Stats &after = transport.stats();
+        printf("tcp_transport_outage away_ms=600 back_after_ms=%.1f failed_polls=%d connect_attempts=%llu max_poll_us=%.1f\n",
+               back ? (back - start) / 1e6 : -1.0, failedPolls,
+               static_cast<unsigned long long>(after.failedAttempts - before.failedAttempts + after.reconnects -
+                                               before.reconnects), longestPollUs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+// Sends the fast values of a small observatory, dome azimuth, focuser position,
+// a GPS fix and the mount coordinates, as UDP telemetry on the loopback at a
+// fixed rate and reports how many arrived and how late. Multicast when the
+// loopback takes it, unicast otherwise. Then sends a burst far faster than
+// the receiver drains a small socket buffer and checks that every datagram
+// is either received or counted as lost. Last, the bytes and time to format
+// one update as a setNumberVector message and as a datagram.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include "bench_util.h"
+#include "udp_telemetry.h"
+
+namespace
+{
+
+struct Stream
+{
+    const char *device;
+    const char *property;
+    size_t count;
+};
+
+const Stream Streams[] =
+{
+    {"Dome", "ABS_DOME_POSITION", 1},
+    {"Focuser", "ABS_FOCUS_POSITION", 1},
+    {"GPS", "GEOGRAPHIC_COORD", 3},
+    {"Mount", "EQUATORIAL_EOD_COORD", 2},
+};
+const size_t StreamCount = sizeof(Streams) / sizeof(Streams[0]);
+
+struct Route
+{
+    std::string destination;
+    std::string group;
+};
+
+bool open(const Route &route, uint16_t port, int receiveBuffer, TelemetryPublisher &publisher,
+          TelemetryReceiver &receiver)
+{
+    std::string error;
+    TelemetryReceiver::Options receiverOptions;
+    receiverOptions.port = port;
+    receiverOptions.group = route.group;
+    receiverOptions.interface = route.group.empty() ? "" : "127.0.0.1";
+    receiverOptions.receiveBuffer = receiveBuffer;
+    TelemetryPublisher::Options publisherOptions;
+    publisherOptions.destination = route.destination;
+    publisherOptions.port = port;
+    publisherOptions.interface = route.group.empty() ? "" : "127.0.0.1";
+    return receiver.open(receiverOptions, error) && publisher.open(publisherOptions, error);
+}
+
+// Multicast needs a loopback with the MULTICAST flag, containers often lack it.
+Route route(uint16_t port)
+{
+    Route multicast {TelemetryDefaultGroup, TelemetryDefaultGroup};
+    TelemetryPublisher publisher;
+    TelemetryReceiver receiver;
+    if (open(multicast, port, 0, publisher, receiver))
+    {
+        const double probe = 0;
+        publisher.publish(1, &probe, 1, 0);
+        pollfd fd {receiver.fd(), POLLIN, 0};
+        if (poll(&fd, 1, 200) > 0 && receiver.drain([](const TelemetrySample &) {}) == 1)
+            return multicast;
+    }
+    return {"127.0.0.1", ""};
+}
+
+void publishAll(TelemetryPublisher &publisher, const uint32_t *ids, uint64_t tick)
+{
+    double values[3];
+    for (size_t s = 0; s < StreamCount; ++s)
+    {
+        for (size_t v = 0; v < Streams[s].count; ++v)
+            values[v] = tick * 0.01 + v;
+        publisher.publish(ids[s], values, Streams[s].count, 2);
+    }
+}
+
+void paced(const Route &route, uint16_t port, int rate, int seconds, const uint32_t *ids)
+{
+    TelemetryPublisher publisher;
+    TelemetryReceiver receiver;
+    if (!open(route, port, 0, publisher, receiver))
+    {
+        printf("udp_telemetry paced cannot open the sockets\n");
+        return;
+    }
+
+    const int ticks = rate * seconds;
+    std::thread sender([&]()
+    {
+        const auto period = std::chrono::nanoseconds(1000000000 / rate);
+        auto next = std::chrono::steady_clock::now();
+        for (int tick = 0; tick < ticks; ++tick)
+        {
+            publishAll(publisher, ids, tick);
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    std::vector<double> latencyUs;
+    size_t wrong = 0;
+    const uint64_t expected = static_cast<uint64_t>(ticks) * StreamCount;
+    const uint64_t deadline = Bench::nowNs() + (seconds + 1) * 1000000000ull;
+    while (latencyUs.size() < expected && Bench::nowNs() < deadline)
+    {
+        pollfd fd {receiver.fd(), POLLIN, 0};
+        if (poll(&fd, 1, 100) <= 0)
+            continue;
+        receiver.drain([&](const TelemetrySample & sample)
+        {
+            latencyUs.push_back((telemetryNowNs() - sample.timestampNs) / 1e3);
+            if (sample.values[0] != (sample.sequence - 1) * 0.01)
+                ++wrong;
+        });
+    }
+    sender.join();
+
+    uint64_t lost = 0, late = 0;
+    for (size_t s = 0; s < StreamCount; ++s)
+    {
+        if (const TelemetryReceiver::StreamStats *stats = receiver.stats(ids[s]))
+        {
+            lost += stats->lost;
+            late += stats->late;
+        }
+    }
+    const size_t received = latencyUs.size();
+    const double p50 = Bench::percentile(latencyUs, 50), p99 = Bench::percentile(latencyUs, 99);
+    printf("udp_telemetry paced route=%s rate_hz=%d streams=%zu sent=%llu received=%zu lost=%llu late=%llu "
+           "latency_p50_us=%.0f latency_p99_us=%.0f latency_max_us=%.0f wrong=%zu\n",
+           route.group.empty() ? "unicast" : "multicast", rate, StreamCount,
+           static_cast<unsigned long long>(publisher.stats().sent), received, static_cast<unsigned long long>(lost),
+           static_cast<unsigned long long>(late), p50, p99, received ? latencyUs.back() : 0, wrong);
+}
+
+void burst(const Route &route, uint16_t port, int samples, const uint32_t *ids)
+{
+    TelemetryPublisher publisher;
+    TelemetryReceiver receiver;
+    // Room for a few hundred datagrams, the receiver drains it every 5 ms.
+    if (!open(route, port, 32768, publisher, receiver))
+    {
+        printf("udp_telemetry burst cannot open the sockets\n");
+        return;
+    }
+
+    std::atomic<bool> done {false};
+    std::thread sender([&]()
+    {
+        for (int tick = 0; tick < samples; ++tick)
+            publishAll(publisher, ids, tick);
+        done = true;
+    });
+
+    uint64_t received = 0;
+    const uint64_t start = Bench::nowNs();
+    bool drained = false;
+    while (!drained)
+    {
+        // Whatever was sent before the last drain is in.
+        drained = done;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        received += receiver.drain([](const TelemetrySample &) {});
+    }
+    const double seconds = (Bench::nowNs() - start) / 1e9;
+    sender.join();
+
+    uint64_t lost = 0, counted = 0;
+    for (size_t s = 0; s < StreamCount; ++s)
+    {
+        if (const TelemetryReceiver::StreamStats *stats = receiver.stats(ids[s]))
+        {
+            lost += stats->lost;
+            // The samples sent after the last that arrived are not known to be lost.
+            counted += stats->lastSequence;
+        }
+    }
+    const TelemetryPublisher::Stats &stats = publisher.stats();
+    printf("udp_telemetry burst sent=%llu dropped_by_sender=%llu datagrams_per_s=%.0f received=%llu lost=%llu "
+           "accounted=%s\n", static_cast<unsigned long long>(stats.sent),
+           static_cast<unsigned long long>(stats.dropped), (stats.sent + stats.dropped) / seconds,
+           static_cast<unsigned long long>(received), static_cast<unsigned long long>(lost),
+           received + lost == counted ? "yes" : "no");
+}
+
+void cost(int updates)
+{
+    // What IDSetNumber() writes for the dome azimuth, indiserver then parses
+    // and forwards it and every client parses it again.
+    std::string xml;
+    uint64_t start = Bench::nowNs();
+    for (int i = 0; i < updates; ++i)
+    {
+        char message[512];
+        const int length = snprintf(message, sizeof(message),
+                                    "<setNumberVector device=\"%s\" name=\"%s\" state=\"Busy\" timeout=\"60\" "
+                                    "timestamp=\"2026-10-18T21:03:%02d\">\n    <oneNumber name=\"DOME_ABSOLUTE_POSITION\">\n"
+                                    "      %.6g\n    </oneNumber>\n</setNumberVector>\n", "Dummy Dome",
+                                    "ABS_DOME_POSITION", i % 60, 123.4567 + i * 1e-3);
+        xml.assign(message, length);
+        Bench::doNotOptimize(xml);
+    }
+    const double xmlNs = static_cast<double>(Bench::nowNs() - start) / updates;
+
+    TelemetrySample sample;
+    sample.stream = telemetryStreamId("Dummy Dome", "ABS_DOME_POSITION");
+    sample.count = 1;
+    uint8_t datagram[TelemetryMaxDatagram];
+    size_t length = 0;
+    start = Bench::nowNs();
+    for (int i = 0; i < updates; ++i)
+    {
+        sample.sequence = i + 1;
+        sample.timestampNs = telemetryNowNs();
+        sample.values[0] = 123.4567 + i * 1e-3;
+        length = telemetryEncode(sample, datagram);
+        Bench::doNotOptimize(datagram);
+    }
+    const double datagramNs = static_cast<double>(Bench::nowNs() - start) / updates;
+
+    printf("udp_telemetry cost xml_bytes=%zu xml_format_ns=%.0f datagram_bytes=%zu datagram_encode_ns=%.0f\n",
+           xml.size(), xmlNs, length, datagramNs);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const int rate = argc > 1 ? atoi(argv[1]) : 100;
+    const int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    const int samples = argc > 3 ? atoi(argv[3]) : 50000;
+    const uint16_t port = 17625;
+
+    uint32_t ids[StreamCount];
+    for (size_t s = 0; s < StreamCount; ++s)
+        ids[s] = telemetryStreamId(Streams[s].device, Streams[s].property);
+
+    const Route chosen = route(port);
+    paced(chosen, port, rate, seconds, ids);
+    burst(chosen, port, samples, ids);
+    cost(1000000);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Runs a night of simulated devices polling on VirtualClock timers: in
+// discrete mode as fast as possible, twice, to check the result is the same,
+// and in scaled and real mode for a short while to see how late timers fire.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "virtual_clock.h"
+
+namespace
+{
+
+// A device re-arming its poll timer from the callback, like TimerHit() does,
+// and drifting a value a little on every poll.
+struct Device
+{
+    VirtualClock &clock;
+    VirtualClock::Duration period;
+    std::mt19937 rng;
+    double value {0};
+    uint64_t polls {0};
+    std::vector<double> *lateness;
+    VirtualClock::Duration due {0};
+
+    void start()
+    {
+        due = clock.now() + period;
+        clock.addTimer(period, [this] { poll(); });
+    }
+
+    void poll()
+    {
+        if (lateness != nullptr)
+            lateness->push_back(std::chrono::duration<double, std::milli>(clock.now() - due).count());
+        value += std::uniform_real_distribution<double>(-0.5, 0.5)(rng);
+        ++polls;
+        start();
+    }
+};
+
+struct Result
+{
+    double realSeconds;
+    double virtualSeconds;
+    uint64_t polls;
+    double checksum;
+};
+
+Result run(VirtualClock::Mode mode, double scale, double seconds, int devices, std::vector<double> *lateness)
+{
+    VirtualClock clock(mode, scale);
+    std::vector<std::unique_ptr<Device>> fleet;
+    for (int i = 0; i < devices; ++i)
+    {
+        // Poll periods of the dummy drivers: 250 ms to 2 s.
+        const auto period = std::chrono::milliseconds(250 * (1 + i % 8));
+        fleet.emplace_back(new Device{clock, period, std::mt19937(i), 0, 0, lateness});
+        fleet.back()->start();
+    }
+
+    const uint64_t start = Bench::nowNs();
+    clock.runUntil(std::chrono::duration_cast<VirtualClock::Duration>(std::chrono::duration<double>(seconds)));
+
+    Result result {(Bench::nowNs() - start) * 1e-9, clock.seconds(), 0, 0};
+    for (auto &device : fleet)
+    {
+        result.polls += device->polls;
+        result.checksum += device->value * (device->polls % 97 + 1);
+    }
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const double hours = argc > 1 ? atof(argv[1]) : 8;
+    const int devices = argc > 2 ? atoi(argv[2]) : 8;
+
+    const Result first = run(VirtualClock::Mode::Discrete, 1, hours * 3600, devices, nullptr);
+    const Result second = run(VirtualClock::Mode::Discrete, 1, hours * 3600, devices, nullptr);
+    printf("virtual_clock mode=discrete devices=%d virtual_s=%.0f real_s=%.3f speedup=%.0f polls=%llu "
+           "polls_per_second=%.0f deterministic=%s\n", devices, first.virtualSeconds, first.realSeconds,
+           first.virtualSeconds / first.realSeconds, (unsigned long long)first.polls, first.polls / first.realSeconds,
+           first.polls == second.polls && first.checksum == second.checksum ? "yes" : "no");
+
+    for (double scale : {1.0, 100.0, 1000.0})
+    {
+        std::vector<double> lateness;
+        // Two seconds of real time whatever the scale.
+        const auto mode = scale == 1.0 ? VirtualClock::Mode::Real : VirtualClock::Mode::Scaled;
+        const Result result = run(mode, scale, 2 * scale, devices, &lateness);
+        printf("virtual_clock mode=%s scale=%.0f devices=%d virtual_s=%.1f real_s=%.3f polls=%llu "
+               "late_p50_virtual_ms=%.2f late_p99_virtual_ms=%.2f\n", scale == 1.0 ? "real" : "scaled", scale, devices,
+               result.virtualSeconds, result.realSeconds, (unsigned long long)result.polls,
+               Bench::percentile(lateness, 50), Bench::percentile(lateness, 99));
+    }
+
+    return first.checksum == second.checksum ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+
+#include "libindi/indiapi.h"
+#include "libindi/indidriver.h"
+#include "libindi/indipropertynumber.h"
+#include "libindi/indipropertyswitch.h"
+
+#include "delta_tracker.h"
+
+/**
+ * @brief DeltaSender sends only the elements of a Number or Switch property that
+ * changed since the previous update.
+ *
+ * A set*Vector message may carry any subset of the elements of a vector, clients
+ * keep the values of the elements that are not mentioned. For properties with
+ * dozens of elements where only one or two change per update, this cuts most of
+ * the traffic.
+ *
+ * Definitions are not affected: defineProperty() (and so getProperties) still sends
+ * a full snapshot of the property. Use one DeltaSender per property.
+ *
+ * @code
+ * AuxSensorsNP[AUX_SENSOR_3].setValue(12.5);
+ * AuxSensorsDelta.apply(AuxSensorsNP);   // instead of AuxSensorsNP.apply();
+ * @endcode
+ */
+class DeltaSender
+{
+public:
+    /** @brief When disabled, apply() always sends the full property. */
+    void setEnabled(bool enabled)
+    {
+        m_Enabled = enabled;
+        invalidate();
+    }
+
+    bool isEnabled() const
+    {
+        return m_Enabled;
+    }
+
+    /** @brief Send a full snapshot on the next apply(). */
+    void invalidate()
+    {
+        m_Tracker.reset(0);
+    }
+
+    /** @brief Number of elements carried by the last message, 0 if nothing was sent. */
+    size_t lastSentCount() const
+    {
+        return m_LastSentCount;
+    }
+
+    /**
+     * @brief Send the changed elements of a number property.
+     * @param epsilon changes smaller than or equal to this are not sent.
+     * @return true when a setNumberVector was sent, false when nothing changed.
+     */
+    bool apply(INDI::PropertyNumber &property, double epsilon = 0)
+    {
+        const size_t count = property.count();
+        auto value = [&property](size_t i)
+        {
+            return property[i].getValue();
+        };
+
+        if (sendSnapshot(count, property.getState(), value))
+        {
+            property.apply();
+            return true;
+        }
+
+        const std::vector<size_t> &dirty = m_Tracker.collect(count, value, epsilon);
+        if (!needsUpdate(dirty, property.getState()))
+            return false;
+
+        INumberVectorProperty subset = *property.getNumber();
+        m_Numbers.clear();
+        for (size_t index : dirty)
+            m_Numbers.push_back(property[index]);
+        // A state-only change still has to name at least one element.
+        if (m_Numbers.empty())
+            m_Numbers.push_back(property[0]);
+        subset.np = m_Numbers.data();
+        subset.nnp = static_cast<int>(m_Numbers.size());
+
+        m_LastSentCount = m_Numbers.size();
+        IDSetNumber(&subset, nullptr);
+        return true;
+    }
+
+    /**
+     * @brief Send the changed elements of a switch property.
+     * @return true when a setSwitchVector was sent, false when nothing changed.
+     */
+    bool apply(INDI::PropertySwitch &property)
+    {
+        const size_t count = property.count();
+        auto value = [&property](size_t i)
+        {
+            return property[i].getState() == ISS_ON ? 1.0 : 0.0;
+        };
+
+        if (sendSnapshot(count, property.getState(), value))
+        {
+            property.apply();
+            return true;
+        }
+
+        const std::vector<size_t> &dirty = m_Tracker.collect(count, value);
+        if (!needsUpdate(dirty, property.getState()))
+            return false;
+
+        ISwitchVectorProperty subset = *property.getSwitch();
+        m_Switches.clear();
+        for (size_t index : dirty)
+            m_Switches.push_back(property[index]);
+        if (m_Switches.empty())
+            m_Switches.push_back(property[0]);
+        subset.sp = m_Switches.data();
+        subset.nsp = static_cast<int>(m_Switches.size());
+
+        m_LastSentCount = m_Switches.size();
+        IDSetSwitch(&subset, nullptr);
+        return true;
+    }
+
+private:
+    template <typename Getter>
+    bool sendSnapshot(size_t count, IPState state, Getter value)
+    {
+        if (m_Enabled && count > 0 && !m_Tracker.needsSnapshot(count))
+            return false;
+
+        m_Tracker.commitAll(count, value);
+        m_LastState = state;
+        m_LastSentCount = count;
+        return true;
+    }
+
+    bool needsUpdate(const std::vector<size_t> &dirty, IPState state)
+    {
+        const bool stateChanged = state != m_LastState;
+        m_LastState = state;
+        m_LastSentCount = 0;
+        return stateChanged || !dirty.empty();
+    }
+
+private:
+    DeltaTracker m_Tracker;
+    IPState m_LastState {IPS_IDLE};
+    bool m_Enabled {true};
+    size_t m_LastSentCount {0};
+
+    std::vector<INumber> m_Numbers;
+    std::vector<ISwitch> m_Switches;
+};
@@ -0,0 +1,28 @@
+#include "delta_tracker.h"
+
+#include <algorithm>
+
+DeltaTracker::DeltaTracker(size_t count)
+{
+    reset(count);
+}
+
+void DeltaTracker::reset(size_t count)
+{
+    m_LastSent.assign(count, 0);
+    m_Forced.assign(count, 0);
+    m_Dirty.clear();
+    m_Dirty.reserve(count);
+    m_Synced = false;
+}
+
+void DeltaTracker::markDirty(size_t index)
+{
+    if (index < m_Forced.size())
+        m_Forced[index] = 1;
+}
+
+void DeltaTracker::markAllDirty()
+{
+    std::fill(m_Forced.begin(), m_Forced.end(), 1);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief DeltaTracker remembers the element values of a property vector as they
+ * were last sent to the clients, so that the next update only needs to carry the
+ * elements that actually changed.
+ *
+ * The tracker does not know anything about INDI. The driver keeps writing values
+ * into its properties as usual and, right before sending, asks the tracker which
+ * elements differ from what the clients already have. See delta_property.h for the
+ * glue to INDI::PropertyNumber and INDI::PropertySwitch.
+ */
+class DeltaTracker
+{
+public:
+    DeltaTracker() = default;
+    explicit DeltaTracker(size_t count);
+
+    /** @brief Forget everything sent so far. The next collect() reports every element as dirty. */
+    void reset(size_t count);
+
+    /** @brief Force an element to be reported by the next collect(), even if its value did not change. */
+    void markDirty(size_t index);
+
+    /** @brief Force every element to be reported by the next collect(). */
+    void markAllDirty();
+
+    /**
+     * @brief Compare the current values against the last sent ones.
+     * @param count number of elements in the property.
+     * @param value callable returning the current value of element i.
+     * @param epsilon changes smaller than or equal to this are not reported.
+     * @return indexes of the dirty elements, in ascending order. The values are
+     * remembered as sent, so calling collect() again without any change returns nothing.
+     */
+    template <typename Getter>
+    const std::vector<size_t> &collect(size_t count, Getter value, double epsilon = 0);
+
+    /** @brief True if the tracker was never synchronized or the element count changed. */
+    bool needsSnapshot(size_t count) const
+    {
+        return !m_Synced || m_LastSent.size() != count;
+    }
+
+    /** @brief Remember all values as sent, e.g. after a full snapshot went out. */
+    template <typename Getter>
+    void commitAll(size_t count, Getter value);
+
+    size_t count() const
+    {
+        return m_LastSent.size();
+    }
+
+private:
+    std::vector<double> m_LastSent;
+    std::vector<uint8_t> m_Forced;
+    std::vector<size_t> m_Dirty;
+    bool m_Synced {false};
+};
+
+template <typename Getter>
+const std::vector<size_t> &DeltaTracker::collect(size_t count, Getter value, double epsilon)
+{
+    if (m_LastSent.size() != count)
+        reset(count);
+
+    m_Dirty.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double current = value(i);
+        const double previous = m_LastSent[i];
+
+        bool changed = !m_Synced || m_Forced[i];
+        if (!changed)
+        {
+            // NaN never compares equal, so "was NaN, still NaN" counts as unchanged.
+            const bool currentNaN = current != current, previousNaN = previous != previous;
+            if (currentNaN || previousNaN)
+                changed = currentNaN != previousNaN;
+            else
+                changed = current - previous > epsilon || previous - current > epsilon;
+        }
+
+        if (changed)
+        {
+            m_Dirty.push_back(i);
+            m_LastSent[i] = current;
+            m_Forced[i] = 0;
+        }
+    }
+    m_Synced = true;
+
+    return m_Dirty;
+}
+
+template <typename Getter>
+void DeltaTracker::commitAll(size_t count, Getter value)
+{
+    if (m_LastSent.size() != count)
+        reset(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_LastSent[i] = value(i);
+        m_Forced[i] = 0;
+    }
+    m_Synced = true;
+}
@@ -0,0 +1,238 @@
+#include "device_io_thread.h"
+
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+
+void post(int fd)
+{
+    const uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one))
+    {
+        // Only fails when the counter is about to overflow, it is signalled then.
+    }
+}
+
+void consume(int fd)
+{
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+    {
+        // EAGAIN, nothing was signalled.
+    }
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+DeviceIoThread::DeviceIoThread(size_t depth) : m_Requests(depth), m_Responses(depth), m_Depth(depth)
+{
+}
+
+DeviceIoThread::~DeviceIoThread()
+{
+    stop();
+}
+
+bool DeviceIoThread::start(int fd)
+{
+    stop();
+
+    m_WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_StopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_DoneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_WakeFd < 0 || m_StopFd < 0 || m_DoneFd < 0)
+    {
+        stop();
+        return false;
+    }
+
+    m_Fd = fd;
+    m_Stop = false;
+    m_Thread = std::thread(&DeviceIoThread::run, this);
+    return true;
+}
+
+void DeviceIoThread::stop()
+{
+    if (m_Thread.joinable())
+    {
+        m_Stop = true;
+        post(m_StopFd);
+        m_Thread.join();
+    }
+
+    // The thread is gone, both ends of the queues are ours now.
+    Request request;
+    while (m_Requests.pop(request))
+        ;
+    Response response;
+    while (m_Responses.pop(response))
+        ;
+    m_InFlight = 0;
+
+    for (int *fd : {&m_WakeFd, &m_StopFd, &m_DoneFd})
+    {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+    m_Fd = -1;
+}
+
+uint64_t DeviceIoThread::submit(const std::string &command, char terminator, int timeoutMs)
+{
+    // Every request in flight has room for its answer, the I/O thread never waits for the loop.
+    if (!isRunning() || m_InFlight >= m_Depth)
+        return 0;
+
+    Request request;
+    request.id = m_NextId++;
+    request.command = command;
+    request.terminator = terminator;
+    request.timeoutMs = timeoutMs;
+    if (!m_Requests.push(request))
+        return 0;
+
+    ++m_InFlight;
+    post(m_WakeFd);
+    return request.id;
+}
+
+size_t DeviceIoThread::drain(const std::function<void(const Response &)> &handler)
+{
+    if (!isRunning())
+        return 0;
+
+    // Clear first: an answer queued after this signals again.
+    consume(m_DoneFd);
+
+    size_t count = 0;
+    Response response;
+    while (m_Responses.pop(response))
+    {
+        --m_InFlight;
+        ++count;
+        handler(response);
+    }
+    return count;
+}
+
+void DeviceIoThread::run()
+{
+    pollfd fds[2] = {{m_WakeFd, POLLIN, 0}, {m_StopFd, POLLIN, 0}};
+    Request request;
+
+    while (!m_Stop)
+    {
+        consume(m_WakeFd);
+        while (!m_Stop && m_Requests.pop(request))
+        {
+            Response response;
+            response.id = request.id;
+            transfer(request, response);
+            if (m_Stop)
+                return;
+            m_Responses.push(response);
+            post(m_DoneFd);
+        }
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return;
+    }
+}
+
+int DeviceIoThread::waitFor(short events, int timeoutMs)
+{
+    pollfd fds[2] = {{m_Fd, events, 0}, {m_StopFd, POLLIN, 0}};
+    int rc;
+    while ((rc = poll(fds, 2, timeoutMs)) < 0 && errno == EINTR)
+        ;
+    if (rc < 0 || m_Stop)
+        return -1;
+    return (fds[0].revents & (events | POLLHUP | POLLERR)) ? 1 : 0;
+}
+
+void DeviceIoThread::discardInput()
+{
+    char chunk[256];
+    pollfd fd = {m_Fd, POLLIN, 0};
+    while (poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN) && read(m_Fd, chunk, sizeof(chunk)) > 0)
+        ;
+}
+
+void DeviceIoThread::transfer(const Request &request, Response &response)
+{
+    const int64_t start = nowNs();
+    const int64_t deadline = start + static_cast<int64_t>(request.timeoutMs) * 1000000;
+    auto left = [deadline]
+    {
+        const int64_t ns = deadline - nowNs();
+        return ns <= 0 ? 0 : static_cast<int>((ns + 999999) / 1000000);
+    };
+    auto finish = [&](bool ok, int error)
+    {
+        response.ok = ok;
+        response.error = error;
+        response.elapsed = std::chrono::nanoseconds(nowNs() - start);
+    };
+
+    discardInput();
+
+    size_t written = 0;
+    while (written < request.command.size())
+    {
+        const ssize_t rc = write(m_Fd, request.command.data() + written, request.command.size() - written);
+        if (rc > 0)
+        {
+            written += rc;
+            continue;
+        }
+        if (rc < 0 && errno != EAGAIN && errno != EINTR)
+            return finish(false, errno);
+
+        const int ready = waitFor(POLLOUT, left());
+        if (ready < 0)
+            return finish(false, ECANCELED);
+        if (ready == 0)
+            return finish(false, ETIMEDOUT);
+    }
+
+    // Like tty_read_section(), the answer ends at the first terminator.
+    char chunk[256];
+    for (;;)
+    {
+        const int ready = waitFor(POLLIN, left());
+        if (ready < 0)
+            return finish(false, ECANCELED);
+        if (ready == 0)
+            return finish(false, ETIMEDOUT);
+
+        const ssize_t rc = read(m_Fd, chunk, sizeof(chunk));
+        if (rc == 0)
+            return finish(false, EPIPE);
+        if (rc < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            return finish(false, errno);
+        }
+
+        for (ssize_t i = 0; i < rc; ++i)
+        {
+            response.answer += chunk[i];
+            if (chunk[i] == request.terminator)
+                return finish(true, 0);
+        }
+    }
+}
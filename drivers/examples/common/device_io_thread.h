@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "spsc_queue.h"
+
+/**
+ * @brief Talks to a device on a thread of its own, so a slow device does not
+ * hold up the driver's event loop.
+ *
+ * The event loop submit()s commands, the I/O thread writes them to the
+ * serial port or socket one after the other and reads each answer up to the
+ * terminator, with a timeout. Requests and answers go through two lock-free
+ * SpscQueues; the I/O thread sleeps on an eventfd until a request comes, and
+ * signals eventFd() when an answer is ready. The driver watches eventFd() on
+ * its event loop (IEAddCallback) and calls drain() from there, so answers are
+ * handled on the event loop thread like everything else, and property
+ * handlers, snooping and timers keep running while the device takes its time.
+ *
+ * Input left over from an earlier command, for example an answer that came
+ * after its timeout, is discarded before a command is written.
+ *
+ * submit(), drain() and pending() must be called from one thread, the event
+ * loop. Linux only (eventfd).
+ */
+class DeviceIoThread
+{
+public:
+    struct Response
+    {
+        /** What submit() returned. */
+        uint64_t id {0};
+        bool ok {false};
+        /** The answer including the terminator, what was read so far if not ok. */
+        std::string answer;
+        /** errno of the failure, ETIMEDOUT if the answer did not come in time. */
+        int error {0};
+        /** From taking the request off the queue to the answer. */
+        std::chrono::nanoseconds elapsed {0};
+    };
+
+    /** @param depth requests that can be in flight at the same time. */
+    explicit DeviceIoThread(size_t depth = 64);
+    ~DeviceIoThread();
+
+    DeviceIoThread(const DeviceIoThread &) = delete;
+    DeviceIoThread &operator=(const DeviceIoThread &) = delete;
+
+    /** @brief Start the thread on an open descriptor, which stays owned by the caller. */
+    bool start(int fd);
+    /** @brief Stop the thread, interrupting a transfer. Requests not answered yet are dropped. */
+    void stop();
+
+    bool isRunning() const
+    {
+        return m_Thread.joinable();
+    }
+
+    /**
+     * @brief Queue a command.
+     * @return the id of the request, 0 if not running or too many are in flight.
+     */
+    uint64_t submit(const std::string &command, char terminator, int timeoutMs);
+
+    /** @brief Call handler for every answer that is ready. Returns how many. */
+    size_t drain(const std::function<void(const Response &)> &handler);
+
+    /** @brief Readable when answers are ready. */
+    int eventFd() const
+    {
+        return m_DoneFd;
+    }
+
+    /** @brief Requests submitted and not drained yet. */
+    size_t pending() const
+    {
+        return m_InFlight;
+    }
+
+private:
+    struct Request
+    {
+        uint64_t id {0};
+        std::string command;
+        char terminator {'#'};
+        int timeoutMs {0};
+    };
+
+    void run();
+    void transfer(const Request &request, Response &response);
+    void discardInput();
+
+    // Waits for the device: 1 ready, 0 timed out, -1 stopped.
+    int waitFor(short events, int timeoutMs);
+
+    int m_Fd {-1};
+    // Event loop to I/O thread: requests queued, and stop.
+    int m_WakeFd {-1};
+    int m_StopFd {-1};
+    // I/O thread to event loop: answers queued.
+    int m_DoneFd {-1};
+
+    SpscQueue<Request> m_Requests;
+    SpscQueue<Response> m_Responses;
+    size_t m_Depth;
+    size_t m_InFlight {0};
+    uint64_t m_NextId {1};
+
+    std::thread m_Thread;
+    std::atomic<bool> m_Stop {false};
+};
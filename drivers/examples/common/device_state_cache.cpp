@@ -0,0 +1,246 @@
+#include "device_state_cache.h"
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char Magic[] = "INDI_DEVICE_STATE";
+
+std::string fileName(const std::string &identity)
+{
+    std::string name;
+    for (char c : identity)
+        name += (isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.') ? c : '_';
+    return name + ".state";
+}
+
+// Values are one line each, so line breaks, tabs and backslashes are escaped.
+std::string escape(const std::string &value)
+{
+    std::string escaped;
+    for (char c : value)
+    {
+        switch (c)
+        {
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default: escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string unescape(const std::string &value)
+{
+    std::string plain;
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        if (value[i] != '\\' || i + 1 == value.size())
+        {
+            plain += value[i];
+            continue;
+        }
+        const char c = value[++i];
+        plain += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+    }
+    return plain;
+}
+
+bool makeDirectories(const std::string &path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+    {
+        const std::string part = path.substr(0, slash);
+        if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        if (slash == std::string::npos)
+            return true;
+    }
+}
+
+}
+
+DeviceStateCache::DeviceStateCache(const std::string &directory, const std::string &identity, int schema)
+    : m_Path(directory + "/" + fileName(identity)), m_Schema(schema), m_ReadyFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+}
+
+DeviceStateCache::~DeviceStateCache()
+{
+    // Do not leave the query running against a driver that is going away.
+    if (m_Verification.valid())
+        m_Verification.wait();
+    if (m_ReadyFd >= 0)
+        close(m_ReadyFd);
+}
+
+std::string DeviceStateCache::defaultDirectory()
+{
+    const char *home = getenv("HOME");
+    return home != nullptr ? std::string(home) + "/.indi/cache" : std::string("/tmp/indi-cache");
+}
+
+bool DeviceStateCache::load()
+{
+    m_Values.clear();
+    FILE *file = fopen(m_Path.c_str(), "r");
+    if (file == nullptr)
+        return false;
+
+    char magic[32];
+    int format = 0, schema = 0;
+    bool ok = fscanf(file, "%31s %d\nschema %d\n", magic, &format, &schema) == 3 && strcmp(magic, Magic) == 0 &&
+              format == FormatVersion && schema == m_Schema;
+
+    char *line = nullptr;
+    size_t capacity = 0;
+    ssize_t length;
+    while (ok && (length = getline(&line, &capacity, file)) > 0)
+    {
+        std::string entry(line, length);
+        if (entry.back() == '\n')
+            entry.pop_back();
+        const size_t tab = entry.find('\t');
+        if (tab == std::string::npos)
+        {
+            ok = false;
+            break;
+        }
+        m_Values[entry.substr(0, tab)] = unescape(entry.substr(tab + 1));
+    }
+    free(line);
+    fclose(file);
+
+    if (!ok)
+        m_Values.clear();
+    return ok;
+}
+
+bool DeviceStateCache::save() const
+{
+    const size_t slash = m_Path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !makeDirectories(m_Path.substr(0, slash)))
+        return false;
+
+    // Write aside and rename, readers see the old file or the new one.
+    const std::string temporary = m_Path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "%s %d\nschema %d\n", Magic, FormatVersion, m_Schema);
+    for (const auto &entry : m_Values)
+        fprintf(file, "%s\t%s\n", entry.first.c_str(), escape(entry.second).c_str());
+
+    const bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !ok || rename(temporary.c_str(), m_Path.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void DeviceStateCache::clear()
+{
+    m_Values.clear();
+    unlink(m_Path.c_str());
+}
+
+bool DeviceStateCache::has(const std::string &key) const
+{
+    return m_Values.count(key) > 0;
+}
+
+std::string DeviceStateCache::get(const std::string &key, const std::string &fallback) const
+{
+    const auto entry = m_Values.find(key);
+    return entry != m_Values.end() ? entry->second : fallback;
+}
+
+int DeviceStateCache::getInt(const std::string &key, int fallback) const
+{
+    const auto entry = m_Values.find(key);
+    return entry != m_Values.end() ? atoi(entry->second.c_str()) : fallback;
+}
+
+double DeviceStateCache::getDouble(const std::string &key, double fallback) const
+{
+    const auto entry = m_Values.find(key);
+    return entry != m_Values.end() ? strtod(entry->second.c_str(), nullptr) : fallback;
+}
+
+void DeviceStateCache::set(const std::string &key, const std::string &value)
+{
+    m_Values[key] = value;
+}
+
+void DeviceStateCache::set(const std::string &key, int value)
+{
+    m_Values[key] = std::to_string(value);
+}
+
+void DeviceStateCache::set(const std::string &key, double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.17g", value);
+    m_Values[key] = text;
+}
+
+bool DeviceStateCache::update(const Values &actual)
+{
+    if (actual == m_Values)
+        return false;
+    m_Values = actual;
+    save();
+    return true;
+}
+
+void DeviceStateCache::verify(std::function<Values()> query)
+{
+    if (m_Verification.valid())
+        m_Verification.wait();
+    const int readyFd = m_ReadyFd;
+    m_Verification = std::async(std::launch::async, [query = std::move(query), readyFd]
+    {
+        const Values values = query();
+        const uint64_t one = 1;
+        if (write(readyFd, &one, sizeof(one)) != sizeof(one))
+        {
+            // Only fails when the counter is about to overflow, it is signalled then.
+        }
+        return values;
+    });
+}
+
+void DeviceStateCache::wait()
+{
+    if (m_Verification.valid())
+        m_Verification.wait();
+}
+
+bool DeviceStateCache::verified(bool &changed)
+{
+    changed = false;
+    if (!m_Verification.valid() || m_Verification.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+
+    uint64_t count;
+    if (read(m_ReadyFd, &count, sizeof(count)) != sizeof(count))
+    {
+        // The worker signals before it returns, this is not reached.
+    }
+    changed = update(m_Verification.get());
+    return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <future>
+#include <functional>
+#include <map>
+#include <string>
+
+/**
+ * @brief Static facts about a device, kept on disk between connects.
+ *
+ * Filter names, slot counts, travel limits and the like only change when
+ * somebody reconfigures the hardware, but reading them from a slow device adds
+ * seconds to every connect. A driver loads them from here and is usable right
+ * away, then verifies them against the hardware in the background and only
+ * touches its properties again if something differed. The verification
+ * signals readyFd() when it is done, the driver watches it with
+ * IEAddCallback() and calls verified() from there, on its event loop.
+ * Linux only (eventfd).
+ *
+ * One file per device identity (USB serial number, address, ...), in a text
+ * format with a format version and a schema version. The driver bumps its
+ * schema version when the meaning of its keys changes, files of another
+ * version are ignored. Files are replaced atomically.
+ */
+class DeviceStateCache
+{
+public:
+    using Values = std::map<std::string, std::string>;
+
+    /** Version of the file layout itself. */
+    static const int FormatVersion = 1;
+
+    /**
+     * @param directory where the files go, created when saving.
+     * @param identity what tells this device from others of the same driver.
+     * @param schema version of the keys the driver stores.
+     */
+    DeviceStateCache(const std::string &directory, const std::string &identity, int schema);
+    ~DeviceStateCache();
+
+    DeviceStateCache(const DeviceStateCache &) = delete;
+    DeviceStateCache &operator=(const DeviceStateCache &) = delete;
+
+    /** @brief ~/.indi/cache, or the temporary directory without a home. */
+    static std::string defaultDirectory();
+
+    const std::string &path() const
+    {
+        return m_Path;
+    }
+
+    /** @brief Read the file. False if there is none, or of another version. */
+    bool load();
+    bool save() const;
+    /** @brief Forget the values and delete the file. */
+    void clear();
+
+    bool empty() const
+    {
+        return m_Values.empty();
+    }
+
+    const Values &values() const
+    {
+        return m_Values;
+    }
+
+    void setValues(const Values &values)
+    {
+        m_Values = values;
+    }
+
+    bool has(const std::string &key) const;
+    std::string get(const std::string &key, const std::string &fallback = std::string()) const;
+    int getInt(const std::string &key, int fallback = 0) const;
+    double getDouble(const std::string &key, double fallback = 0) const;
+
+    void set(const std::string &key, const std::string &value);
+    void set(const std::string &key, int value);
+    void set(const std::string &key, double value);
+
+    /**
+     * @brief Compare what the hardware said with the cache.
+     * @return true if it differed; the cache then holds and has saved actual.
+     */
+    bool update(const Values &actual);
+
+    /**
+     * @brief Read the hardware on another thread and compare with the cache.
+     * query must not touch the driver's properties, only the device, and the
+     * driver leaves the device to it until verified() returned true.
+     */
+    void verify(std::function<Values()> query);
+
+    /**
+     * @brief Once readyFd() is readable: true if the verification finished.
+     * @param changed set if the hardware differed; the cache then holds and
+     * has saved what the hardware said.
+     */
+    bool verified(bool &changed);
+
+    /** @brief Readable when a verification finished. */
+    int readyFd() const
+    {
+        return m_ReadyFd;
+    }
+
+    /** @brief Block until a verification in flight is done, verified() still picks it up. */
+    void wait();
+
+    bool isVerifying() const
+    {
+        return m_Verification.valid();
+    }
+
+private:
+    std::string m_Path;
+    int m_Schema;
+    Values m_Values;
+    std::future<Values> m_Verification;
+    int m_ReadyFd {-1};
+};
@@ -0,0 +1,82 @@
+#include "fits_header.h"
+
+#include <cstdio>
+#include <cstring>
+
+constexpr size_t FitsHeader::BlockSize;
+
+namespace
+{
+
+constexpr size_t CardSize = 80;
+
+size_t roundToBlock(size_t bytes)
+{
+    return (bytes + FitsHeader::BlockSize - 1) / FitsHeader::BlockSize * FitsHeader::BlockSize;
+}
+
+}
+
+FitsHeader::FitsHeader(uint32_t width, uint32_t height) : m_Width(width), m_Height(height)
+{
+    addKeyword("SIMPLE", "T", "file conforms to FITS standard");
+    addKeyword("BITPIX", 16, "number of bits per data pixel");
+    addKeyword("NAXIS", 2, "number of data axes");
+    addKeyword("NAXIS1", width, "length of data axis 1");
+    addKeyword("NAXIS2", height, "length of data axis 2");
+    addKeyword("BZERO", 32768, "offset data range to that of unsigned short");
+    addKeyword("BSCALE", 1, "default scaling factor");
+}
+
+void FitsHeader::addCard(const std::string &card)
+{
+    std::string padded = card.substr(0, CardSize);
+    padded.resize(CardSize, ' ');
+    m_Cards.push_back(padded);
+}
+
+void FitsHeader::addKeyword(const std::string &name, double value, const std::string &comment)
+{
+    char card[CardSize + 1];
+    snprintf(card, sizeof(card), "%-8.8s= %20.10G / %s", name.c_str(), value, comment.c_str());
+    addCard(card);
+}
+
+void FitsHeader::addKeyword(const std::string &name, const std::string &value, const std::string &comment)
+{
+    char card[CardSize + 1];
+    // Logical values are written bare, everything else as a quoted string.
+    if (value == "T" || value == "F")
+        snprintf(card, sizeof(card), "%-8.8s= %20s / %s", name.c_str(), value.c_str(), comment.c_str());
+    else
+        snprintf(card, sizeof(card), "%-8.8s= '%-8s' / %s", name.c_str(), value.c_str(), comment.c_str());
+    addCard(card);
+}
+
+size_t FitsHeader::headerSize() const
+{
+    // +1 for the END card
+    return roundToBlock((m_Cards.size() + 1) * CardSize);
+}
+
+size_t FitsHeader::dataSize() const
+{
+    return roundToBlock(size_t(m_Width) * m_Height * sizeof(uint16_t));
+}
+
+uint16_t *FitsHeader::write(void *buffer) const
+{
+    char *out = static_cast<char *>(buffer);
+    const size_t header = headerSize();
+
+    memset(out, ' ', header);
+    for (size_t i = 0; i < m_Cards.size(); ++i)
+        memcpy(out + i * CardSize, m_Cards[i].data(), CardSize);
+    memcpy(out + m_Cards.size() * CardSize, "END", 3);
+
+    // Only the padding after the pixels needs clearing, the pixels are rendered over.
+    const size_t pixels = size_t(m_Width) * m_Height * sizeof(uint16_t);
+    memset(out + header + pixels, 0, dataSize() - pixels);
+
+    return reinterpret_cast<uint16_t *>(out + header);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Writes a minimal primary FITS header for a 16-bit image in place.
+ *
+ * This lets a driver lay out a complete FITS file in a single buffer: the header
+ * first, the pixels right after it, rendered directly where they belong. No FITS
+ * library and no intermediate copy is involved.
+ */
+class FitsHeader
+{
+public:
+    /** FITS files are made of 2880 byte blocks. */
+    static constexpr size_t BlockSize = 2880;
+
+    FitsHeader(uint32_t width, uint32_t height);
+
+    void addKeyword(const std::string &name, double value, const std::string &comment = std::string());
+    void addKeyword(const std::string &name, const std::string &value, const std::string &comment = std::string());
+
+    /** @brief Size of the header, a multiple of BlockSize. */
+    size_t headerSize() const;
+
+    /** @brief Size of the pixel data, padded to a multiple of BlockSize. */
+    size_t dataSize() const;
+
+    /** @brief Size of the whole file. */
+    size_t fileSize() const
+    {
+        return headerSize() + dataSize();
+    }
+
+    /**
+     * @brief Write the header to buffer, which must hold at least fileSize() bytes.
+     * The padding after the pixel data is cleared too. The pixels go to
+     * buffer + headerSize(), 16-bit big-endian with BZERO 32768.
+     * @return pointer to where the pixel data starts.
+     */
+    uint16_t *write(void *buffer) const;
+
+private:
+    void addCard(const std::string &card);
+
+    uint32_t m_Width, m_Height;
+    std::vector<std::string> m_Cards;
+};
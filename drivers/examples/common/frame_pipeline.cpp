@@ -0,0 +1,140 @@
+#include "frame_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+FramePipeline::FramePipeline(size_t frames, size_t frameSize)
+    : m_Frames(std::max<size_t>(frames, 3)), m_FrameSize(frameSize), m_Free(m_Frames.size())
+{
+    for (auto &frame : m_Frames)
+    {
+        frame.data.resize(frameSize);
+        m_Free.push(&frame);
+    }
+    m_LastStatsTime = now();
+}
+
+uint64_t FramePipeline::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FramePipeline::Frame *FramePipeline::acquire()
+{
+    Frame *frame = m_Spare;
+    m_Spare = nullptr;
+    if (frame == nullptr && !m_Free.pop(frame))
+    {
+        // The sender is busy with one frame and the other waits in the slot:
+        // take that one back, it is older than the capture about to start.
+        frame = m_Latest.exchange(nullptr, std::memory_order_acq_rel);
+        if (frame == nullptr)
+        {
+            m_Overruns.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    frame->size = m_FrameSize;
+    return frame;
+}
+
+void FramePipeline::publish(Frame *frame)
+{
+    frame->sequence = m_Sequence++;
+    frame->timestamp = now();
+    m_Captured.fetch_add(1, std::memory_order_relaxed);
+
+    // A frame the sender did not take is dropped, its buffer captures the next one.
+    Frame *replaced = m_Latest.exchange(frame, std::memory_order_acq_rel);
+    if (replaced != nullptr)
+    {
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+        m_Spare = replaced;
+    }
+
+    // Taking the lock orders the exchange before the sender's check in takeLatest().
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+    }
+    m_WakeUp.notify_one();
+}
+
+FramePipeline::Frame *FramePipeline::takeLatest(int timeoutMs)
+{
+    if (m_Latest.load(std::memory_order_acquire) == nullptr && !m_Stopped.load())
+    {
+        std::unique_lock<std::mutex> lock(m_WakeMutex);
+        m_WakeUp.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]
+        {
+            return m_Latest.load(std::memory_order_acquire) != nullptr || m_Stopped.load();
+        });
+    }
+
+    if (m_Stopped.load())
+        return nullptr;
+
+    // nullptr if the capture thread took it back meanwhile, a newer one follows.
+    return m_Latest.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+void FramePipeline::release(Frame *frame, bool delivered)
+{
+    if (delivered)
+    {
+        const uint64_t latency = now() - frame->timestamp;
+        m_Delivered.fetch_add(1, std::memory_order_relaxed);
+        m_LatencySum.fetch_add(latency, std::memory_order_relaxed);
+        m_LatencyCount.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t max = m_LatencyMax.load(std::memory_order_relaxed);
+        while (latency > max && !m_LatencyMax.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+            ;
+    }
+    else
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+
+    m_Free.push(frame);
+}
+
+void FramePipeline::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Stopped = true;
+    }
+    m_WakeUp.notify_all();
+}
+
+void FramePipeline::restart()
+{
+    if (Frame *frame = m_Latest.exchange(nullptr))
+        m_Free.push(frame);
+    if (m_Spare != nullptr)
+        m_Free.push(m_Spare);
+    m_Spare = nullptr;
+    m_Stopped = false;
+}
+
+FramePipeline::Stats FramePipeline::takeStats()
+{
+    Stats stats;
+    stats.captured = m_Captured.load(std::memory_order_relaxed);
+    stats.delivered = m_Delivered.load(std::memory_order_relaxed);
+    stats.dropped = m_Dropped.load(std::memory_order_relaxed);
+    stats.overruns = m_Overruns.load(std::memory_order_relaxed);
+
+    const uint64_t sum = m_LatencySum.exchange(0, std::memory_order_relaxed);
+    const uint64_t count = m_LatencyCount.exchange(0, std::memory_order_relaxed);
+    stats.latencyAverage = count ? sum / 1e6 / count : 0;
+    stats.latencyMax = m_LatencyMax.exchange(0, std::memory_order_relaxed) / 1e6;
+
+    const uint64_t time = now();
+    const double seconds = (time - m_LastStatsTime) * 1e-9;
+    stats.fps = seconds > 0 ? (stats.delivered - m_LastDelivered) / seconds : 0;
+    m_LastStatsTime = time;
+    m_LastDelivered = stats.delivered;
+
+    return stats;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "spsc_queue.h"
+
+/**
+ * @brief A capture to send pipeline for streaming frames with bounded memory.
+ *
+ * A fixed pool of frame buffers is allocated up front. The capture thread takes
+ * a free buffer, fills it and publishes it into a single latest slot; the send
+ * thread takes whatever is in the slot. A frame published while the slot still
+ * holds one the sender did not take replaces it, and the replaced frame is the
+ * next buffer the capture thread fills. When the sender falls behind, the
+ * oldest frames are dropped before anybody spends time encoding them, the
+ * sender always gets the newest, and a capture is never refused: with three
+ * buffers one is captured into, one waits in the slot and one is sent.
+ *
+ * The slot is an atomic exchange, free frames go back to the capture thread
+ * through a lock-free SPSC queue. Nothing is allocated after construction.
+ */
+class FramePipeline
+{
+public:
+    struct Frame
+    {
+        std::vector<uint8_t> data;
+        /** Bytes of data actually used. */
+        size_t size {0};
+        uint32_t sequence {0};
+        /** Capture time, steady clock nanoseconds. */
+        uint64_t timestamp {0};
+    };
+
+    struct Stats
+    {
+        uint64_t captured {0};
+        uint64_t delivered {0};
+        /** Frames dropped because the sender was behind. */
+        uint64_t dropped {0};
+        /** Frames not captured at all because every buffer was in use. */
+        uint64_t overruns {0};
+        /** Average and worst capture to delivery latency since the last takeStats(), ms. */
+        double latencyAverage {0};
+        double latencyMax {0};
+        /** Delivered frames per second since the last takeStats(). */
+        double fps {0};
+    };
+
+    /**
+     * @param frames number of preallocated buffers, at least 3: one being
+     * captured, one being sent and one in flight.
+     * @param frameSize bytes per buffer.
+     */
+    FramePipeline(size_t frames, size_t frameSize);
+
+    // Capture thread
+
+    /**
+     * @brief A buffer to capture into. With the free buffers used up, the
+     * published frame the sender did not take yet is taken back. nullptr only
+     * if the sender holds every other buffer, which three or more never allow.
+     */
+    Frame *acquire();
+
+    /** @brief Hand a captured frame to the sender, replacing one it did not take yet. */
+    void publish(Frame *frame);
+
+    // Send thread
+
+    /**
+     * @brief The newest published frame, waiting up to timeoutMs for one.
+     * Returns nullptr on timeout or after stop().
+     */
+    Frame *takeLatest(int timeoutMs);
+
+    /** @brief Give a frame back to the pool once it was sent. */
+    void release(Frame *frame, bool delivered = true);
+
+    // Any thread
+
+    /** @brief Wake up a sender blocked in takeLatest(). */
+    void stop();
+
+    /**
+     * @brief Allow takeLatest() to block again after stop(). Frames published
+     * but never taken go back to the pool, so a new stream does not start
+     * with one of the old. Call it with neither thread running.
+     */
+    void restart();
+
+    /** @brief Since stop(), until restart(). takeLatest() timing out is no reason to quit. */
+    bool isStopped() const
+    {
+        return m_Stopped.load();
+    }
+
+    /** @brief Counters, the rate and latency figures cover the time since the previous call. */
+    Stats takeStats();
+
+    size_t frameSize() const
+    {
+        return m_FrameSize;
+    }
+
+private:
+    static uint64_t now();
+
+    std::vector<Frame> m_Frames;
+    size_t m_FrameSize;
+
+    // The newest published frame the sender has not taken, or nullptr.
+    std::atomic<Frame *> m_Latest {nullptr};
+    // Filled by release() on the send thread, emptied by acquire().
+    SpscQueue<Frame *> m_Free;
+    // A frame publish() replaced, only touched by the capture thread.
+    Frame *m_Spare {nullptr};
+
+    // Only used to sleep in takeLatest(), the slot and queue are lock-free.
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeUp;
+    std::atomic<bool> m_Stopped {false};
+
+    std::atomic<uint64_t> m_Captured {0};
+    std::atomic<uint64_t> m_Delivered {0};
+    std::atomic<uint64_t> m_Dropped {0};
+    std::atomic<uint64_t> m_Overruns {0};
+    std::atomic<uint64_t> m_LatencySum {0};
+    std::atomic<uint64_t> m_LatencyCount {0};
+    std::atomic<uint64_t> m_LatencyMax {0};
+
+    // takeStats() bookkeeping
+    uint64_t m_LastStatsTime {0};
+    uint64_t m_LastDelivered {0};
+    uint32_t m_Sequence {0};
+};
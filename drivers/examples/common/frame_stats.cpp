@@ -0,0 +1,514 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FRAME_STATS_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define FRAME_STATS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "thread_pool.h"
+
+namespace
+{
+
+// Frames smaller than this are not worth waking the pool for.
+constexpr size_t MinParallelPixels = 1 << 20;
+
+// Interleaved sub-histograms, so that runs of the same sky value do not wait
+// on the increment of the previous pixel.
+constexpr size_t HistogramBanks = 4;
+constexpr size_t HistogramBins = 65536;
+
+// Background grid and sampling step inside a tile.
+constexpr uint32_t BackgroundTile = 64;
+constexpr uint32_t BackgroundStep = 4;
+
+std::atomic<bool> g_SimdEnabled {true};
+
+ThreadPool &poolOrShared(ThreadPool *pool)
+{
+    return pool != nullptr ? *pool : ThreadPool::shared();
+}
+
+// Split count items into at most one chunk per worker and run fn(begin, end) on them.
+template <typename Function>
+size_t forChunks(ThreadPool &pool, size_t count, size_t minChunk, Function fn)
+{
+    size_t chunks = std::max<size_t>(1, std::min(pool.size() + 1, count / std::max<size_t>(1, minChunk)));
+    const size_t chunkSize = (count + chunks - 1) / chunks;
+    chunks = count == 0 ? 1 : (count + chunkSize - 1) / chunkSize;
+    if (chunks == 1)
+    {
+        fn(0, 0, count);
+        return 1;
+    }
+    pool.parallelFor(chunks, [&](size_t chunk)
+    {
+        const size_t begin = chunk * chunkSize;
+        fn(chunk, begin, std::min(count, begin + chunkSize));
+    });
+    return chunks;
+}
+
+FrameStats::Range rangeScalar(const uint16_t *pixels, size_t count)
+{
+    FrameStats::Range range;
+    range.min = 0xFFFF;
+    for (size_t i = 0; i < count; ++i)
+    {
+        range.min = std::min(range.min, pixels[i]);
+        range.max = std::max(range.max, pixels[i]);
+        range.sum += pixels[i];
+    }
+    return range;
+}
+
+size_t findAboveScalar(const uint16_t *pixels, size_t count, uint16_t threshold)
+{
+    for (size_t i = 0; i < count; ++i)
+        if (pixels[i] > threshold)
+            return i;
+    return count;
+}
+
+#if defined(FRAME_STATS_AVX2)
+
+bool hasAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+__attribute__((target("avx2")))
+FrameStats::Range rangeAvx2(const uint16_t *pixels, size_t count)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i minimum = _mm256_set1_epi16(-1);
+    __m256i maximum = zero;
+    // Sums of the low and high bytes in 64 bit lanes, psadbw never overflows.
+    __m256i sumLow = zero, sumHigh = zero;
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+        minimum = _mm256_min_epu16(minimum, v);
+        maximum = _mm256_max_epu16(maximum, v);
+        sumLow = _mm256_add_epi64(sumLow, _mm256_sad_epu8(_mm256_and_si256(v, lowBytes), zero));
+        sumHigh = _mm256_add_epi64(sumHigh, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+    }
+
+    alignas(32) uint16_t minimums[16], maximums[16];
+    alignas(32) uint64_t lows[4], highs[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(minimums), minimum);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(maximums), maximum);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lows), sumLow);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(highs), sumHigh);
+
+    FrameStats::Range range = rangeScalar(pixels + i, count - i);
+    for (int lane = 0; lane < 16; ++lane)
+    {
+        range.min = std::min(range.min, minimums[lane]);
+        range.max = std::max(range.max, maximums[lane]);
+    }
+    for (int lane = 0; lane < 4; ++lane)
+        range.sum += lows[lane] + (highs[lane] << 8);
+    return range;
+}
+
+__attribute__((target("avx2")))
+size_t findAboveAvx2(const uint16_t *pixels, size_t count, uint16_t threshold)
+{
+    if (threshold == 0xFFFF)
+        return count;
+
+    // No unsigned compare on AVX2: v > t exactly when max(v, t + 1) == v.
+    const __m256i limit = _mm256_set1_epi16(static_cast<short>(threshold + 1));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+        const uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_max_epu16(v, limit), v));
+        if (mask != 0)
+            return i + __builtin_ctz(mask) / 2;
+    }
+    return i + findAboveScalar(pixels + i, count - i, threshold);
+}
+
+#elif defined(FRAME_STATS_NEON)
+
+FrameStats::Range rangeNeon(const uint16_t *pixels, size_t count)
+{
+    uint16x8_t minimum = vdupq_n_u16(0xFFFF);
+    uint16x8_t maximum = vdupq_n_u16(0);
+    uint64x2_t sum = vdupq_n_u64(0);
+
+    size_t i = 0;
+    while (i + 8 <= count)
+    {
+        // Each 32 bit lane grows by at most 2 * 65535 per step, flush well before it wraps.
+        uint32x4_t partial = vdupq_n_u32(0);
+        const size_t end = std::min(count - (count - i) % 8, i + 8 * 16384);
+        for (; i < end; i += 8)
+        {
+            const uint16x8_t v = vld1q_u16(pixels + i);
+            minimum = vminq_u16(minimum, v);
+            maximum = vmaxq_u16(maximum, v);
+            partial = vpadalq_u16(partial, v);
+        }
+        sum = vpadalq_u32(sum, partial);
+    }
+
+    FrameStats::Range range = rangeScalar(pixels + i, count - i);
+    range.min = std::min<uint16_t>(range.min, vminvq_u16(minimum));
+    range.max = std::max<uint16_t>(range.max, vmaxvq_u16(maximum));
+    range.sum += vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+    return range;
+}
+
+size_t findAboveNeon(const uint16_t *pixels, size_t count, uint16_t threshold)
+{
+    const uint16x8_t limit = vdupq_n_u16(threshold);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        if (vmaxvq_u16(vcgtq_u16(vld1q_u16(pixels + i), limit)) != 0)
+            return i + findAboveScalar(pixels + i, 8, threshold);
+    }
+    return i + findAboveScalar(pixels + i, count - i, threshold);
+}
+
+#endif
+
+void histogramChunk(const uint16_t *pixels, size_t count, uint32_t *bins)
+{
+    // One set of banks per thread, kept between calls.
+    thread_local std::vector<uint32_t> banks;
+    banks.assign(HistogramBanks * HistogramBins, 0);
+    uint32_t *bank0 = banks.data();
+    uint32_t *bank1 = bank0 + HistogramBins;
+    uint32_t *bank2 = bank1 + HistogramBins;
+    uint32_t *bank3 = bank2 + HistogramBins;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        ++bank0[pixels[i]];
+        ++bank1[pixels[i + 1]];
+        ++bank2[pixels[i + 2]];
+        ++bank3[pixels[i + 3]];
+    }
+    for (; i < count; ++i)
+        ++bank0[pixels[i]];
+
+    for (size_t bin = 0; bin < HistogramBins; ++bin)
+        bins[bin] = bank0[bin] + bank1[bin] + bank2[bin] + bank3[bin];
+}
+
+// Median and median absolute deviation of the sampled pixels of one background tile.
+void tileStatistics(const uint16_t *pixels, uint32_t width, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+                    std::vector<uint16_t> &samples, uint16_t &median, uint16_t &deviation)
+{
+    samples.clear();
+    for (uint32_t y = y0; y < y1; y += BackgroundStep)
+    {
+        const uint16_t *row = pixels + static_cast<size_t>(y) * width;
+        for (uint32_t x = x0; x < x1; x += BackgroundStep)
+            samples.push_back(row[x]);
+    }
+    median = FrameStats::selectMedian(samples.data(), samples.size());
+    for (auto &sample : samples)
+        sample = sample > median ? sample - median : median - sample;
+    deviation = FrameStats::selectMedian(samples.data(), samples.size());
+}
+
+// Flux, centroid and half flux radius of the star peaking at (x, y).
+bool measureStar(const uint16_t *pixels, uint32_t width, uint32_t x, uint32_t y, int radius, double level,
+                 FrameStats::Star &star)
+{
+    double flux = 0, sumX = 0, sumY = 0;
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+        const uint16_t *row = pixels + static_cast<size_t>(y + dy) * width + x;
+        for (int dx = -radius; dx <= radius; ++dx)
+        {
+            const double value = row[dx] - level;
+            if (value <= 0)
+                continue;
+            flux += value;
+            sumX += value * dx;
+            sumY += value * dy;
+        }
+    }
+    if (flux <= 0)
+        return false;
+
+    const double centerX = sumX / flux;
+    const double centerY = sumY / flux;
+    double weighted = 0;
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+        const uint16_t *row = pixels + static_cast<size_t>(y + dy) * width + x;
+        for (int dx = -radius; dx <= radius; ++dx)
+        {
+            const double value = row[dx] - level;
+            if (value > 0)
+                weighted += value * std::hypot(dx - centerX, dy - centerY);
+        }
+    }
+
+    star.x = x + centerX;
+    star.y = y + centerY;
+    star.flux = flux;
+    star.hfr = weighted / flux;
+    star.peak = pixels[static_cast<size_t>(y) * width + x];
+    return true;
+}
+
+}
+
+namespace FrameStats
+{
+
+const char *simdLevel()
+{
+    if (!g_SimdEnabled)
+        return "scalar";
+#if defined(FRAME_STATS_AVX2)
+    return hasAvx2() ? "avx2" : "scalar";
+#elif defined(FRAME_STATS_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void setSimdEnabled(bool enabled)
+{
+    g_SimdEnabled = enabled;
+}
+
+Range range(const uint16_t *pixels, size_t count)
+{
+    if (count == 0)
+        return Range();
+#if defined(FRAME_STATS_AVX2)
+    if (g_SimdEnabled && hasAvx2())
+        return rangeAvx2(pixels, count);
+#elif defined(FRAME_STATS_NEON)
+    if (g_SimdEnabled)
+        return rangeNeon(pixels, count);
+#endif
+    return rangeScalar(pixels, count);
+}
+
+size_t findAbove(const uint16_t *pixels, size_t count, uint16_t threshold)
+{
+#if defined(FRAME_STATS_AVX2)
+    if (g_SimdEnabled && hasAvx2())
+        return findAboveAvx2(pixels, count, threshold);
+#elif defined(FRAME_STATS_NEON)
+    if (g_SimdEnabled)
+        return findAboveNeon(pixels, count, threshold);
+#endif
+    return findAboveScalar(pixels, count, threshold);
+}
+
+void histogram(const uint16_t *pixels, size_t count, uint32_t *bins, ThreadPool *pool)
+{
+    ThreadPool &workers = poolOrShared(pool);
+    std::vector<uint32_t> partials((workers.size() + 1) * HistogramBins);
+
+    const size_t chunks = forChunks(workers, count, MinParallelPixels, [&](size_t chunk, size_t begin, size_t end)
+    {
+        histogramChunk(pixels + begin, end - begin, partials.data() + chunk * HistogramBins);
+    });
+
+    if (chunks == 1)
+    {
+        std::memcpy(bins, partials.data(), HistogramBins * sizeof(uint32_t));
+        return;
+    }
+
+    forChunks(workers, HistogramBins, HistogramBins / 16, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t bin = begin; bin < end; ++bin)
+        {
+            uint32_t total = 0;
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+                total += partials[chunk * HistogramBins + bin];
+            bins[bin] = total;
+        }
+    });
+}
+
+uint16_t histogramMedian(const uint32_t *bins, uint64_t count)
+{
+    if (count == 0)
+        return 0;
+
+    // Lower median, the same element selectMedian() picks for even counts.
+    const uint64_t target = (count - 1) / 2;
+    uint64_t seen = 0;
+    for (size_t bin = 0; bin < HistogramBins; ++bin)
+    {
+        seen += bins[bin];
+        if (seen > target)
+            return static_cast<uint16_t>(bin);
+    }
+    return 0xFFFF;
+}
+
+uint16_t selectMedian(uint16_t *values, size_t count)
+{
+    if (count == 0)
+        return 0;
+    uint16_t *middle = values + (count - 1) / 2;
+    std::nth_element(values, middle, values + count);
+    return *middle;
+}
+
+Background background(const uint16_t *pixels, uint32_t width, uint32_t height, ThreadPool *pool)
+{
+    Background result;
+    if (width == 0 || height == 0)
+        return result;
+
+    const uint32_t columns = (width + BackgroundTile - 1) / BackgroundTile;
+    const uint32_t rows = (height + BackgroundTile - 1) / BackgroundTile;
+    std::vector<uint16_t> medians(static_cast<size_t>(columns) * rows);
+    std::vector<uint16_t> deviations(medians.size());
+
+    forChunks(poolOrShared(pool), rows, 4, [&](size_t, size_t begin, size_t end)
+    {
+        std::vector<uint16_t> samples;
+        samples.reserve((BackgroundTile / BackgroundStep) * (BackgroundTile / BackgroundStep));
+        for (size_t row = begin; row < end; ++row)
+        {
+            const uint32_t y0 = row * BackgroundTile;
+            const uint32_t y1 = std::min(height, y0 + BackgroundTile);
+            for (uint32_t column = 0; column < columns; ++column)
+            {
+                const uint32_t x0 = column * BackgroundTile;
+                const uint32_t x1 = std::min(width, x0 + BackgroundTile);
+                const size_t index = row * columns + column;
+                tileStatistics(pixels, width, x0, y0, x1, y1, samples, medians[index], deviations[index]);
+            }
+        }
+    });
+
+    // Tiles holding a bright star or a gradient end up in the tails and do not move the medians.
+    result.level = selectMedian(medians.data(), medians.size());
+    result.noise = 1.4826 * selectMedian(deviations.data(), deviations.size());
+    return result;
+}
+
+std::vector<Star> detectStars(const uint16_t *pixels, uint32_t width, uint32_t height, const Background &background,
+                              const DetectOptions &options, ThreadPool *pool)
+{
+    std::vector<Star> stars;
+    const int radius = std::max(1, options.radius);
+    if (width <= 2u * radius || height <= 2u * radius)
+        return stars;
+
+    // Keep a little margin above the sky even on noiseless frames.
+    const double threshold = background.level + std::max(1.0, options.sigma * background.noise);
+    if (threshold >= 0xFFFF)
+        return stars;
+    const uint16_t limit = static_cast<uint16_t>(threshold);
+
+    ThreadPool &workers = poolOrShared(pool);
+    const uint32_t first = radius, last = height - radius;
+    std::vector<std::vector<Star>> bands(workers.size() + 1);
+
+    forChunks(workers, last - first, 64, [&](size_t band, size_t begin, size_t end)
+    {
+        auto &found = bands[band];
+        for (uint32_t y = first + begin; y < first + end && found.size() < options.maxStars; ++y)
+        {
+            const uint16_t *row = pixels + static_cast<size_t>(y) * width;
+            uint32_t x = radius;
+            const uint32_t rowEnd = width - radius;
+            while (found.size() < options.maxStars)
+            {
+                x += findAbove(row + x, rowEnd - x, limit);
+                if (x >= rowEnd)
+                    break;
+
+                const uint16_t peak = row[x];
+                const uint16_t *above = row - width;
+                const uint16_t *below = row + width;
+                // A local maximum, ties go to the first pixel in raster order so
+                // flat topped stars are found once.
+                const bool isPeak = peak > above[x - 1] && peak > above[x] && peak > above[x + 1] && peak > row[x - 1] &&
+                                    peak >= row[x + 1] && peak >= below[x - 1] && peak >= below[x] && peak >= below[x + 1];
+                // Single hot pixels have no bright neighbours.
+                const int neighbours = (above[x] > limit) + (below[x] > limit) + (row[x - 1] > limit) + (row[x + 1] > limit);
+
+                Star star;
+                if (isPeak && neighbours >= 2 && peak < options.saturation &&
+                        measureStar(pixels, width, x, y, radius, background.level, star))
+                    found.push_back(star);
+                ++x;
+            }
+        }
+    });
+
+    for (auto &band : bands)
+        stars.insert(stars.end(), band.begin(), band.end());
+    if (stars.size() > options.maxStars)
+        stars.resize(options.maxStars);
+    return stars;
+}
+
+Result analyze(const uint16_t *pixels, uint32_t width, uint32_t height, const DetectOptions &options, ThreadPool *pool)
+{
+    Result result;
+    const size_t count = static_cast<size_t>(width) * height;
+    if (count == 0)
+        return result;
+
+    ThreadPool &workers = poolOrShared(pool);
+    std::vector<Range> ranges(workers.size() + 1);
+    const size_t chunks = forChunks(workers, count, MinParallelPixels, [&](size_t chunk, size_t begin, size_t end)
+    {
+        ranges[chunk] = range(pixels + begin, end - begin);
+    });
+    result.range = ranges[0];
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+        result.range.min = std::min(result.range.min, ranges[chunk].min);
+        result.range.max = std::max(result.range.max, ranges[chunk].max);
+        result.range.sum += ranges[chunk].sum;
+    }
+    result.mean = static_cast<double>(result.range.sum) / count;
+
+    std::vector<uint32_t> bins(HistogramBins);
+    histogram(pixels, count, bins.data(), &workers);
+    result.median = histogramMedian(bins.data(), count);
+
+    result.background = background(pixels, width, height, &workers);
+
+    auto stars = detectStars(pixels, width, height, result.background, options, &workers);
+    result.stars = stars.size();
+    if (!stars.empty())
+    {
+        auto middle = stars.begin() + (stars.size() - 1) / 2;
+        std::nth_element(stars.begin(), middle, stars.end(), [](const Star & a, const Star & b)
+        {
+            return a.hfr < b.hfr;
+        });
+        result.hfr = middle->hfr;
+    }
+    return result;
+}
+
+}
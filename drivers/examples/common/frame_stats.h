@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * @brief Statistics of 16-bit frames for flats, autofocus and exposure control.
+ *
+ * range() and findAbove(), which detectStars() scans every row with, have
+ * AVX2 (x86-64, picked at runtime) and NEON (ARM) versions with a scalar
+ * fallback. The rest is scalar on purpose: the histogram is a scatter, which
+ * neither has an instruction for, so it is spread over four banks instead;
+ * the medians of the background are selections over a few hundred samples
+ * per tile; the HFR is measured on a small box around each star. Whole frames
+ * are split into tiles processed on a ThreadPool.
+ */
+namespace FrameStats
+{
+
+/** @brief Instruction set used by the kernels, "avx2", "neon" or "scalar". */
+const char *simdLevel();
+
+/** @brief Force the scalar kernels, for comparisons. */
+void setSimdEnabled(bool enabled);
+
+struct Range
+{
+    uint16_t min {0};
+    uint16_t max {0};
+    uint64_t sum {0};
+};
+
+/** @brief Minimum, maximum and sum of count pixels. */
+Range range(const uint16_t *pixels, size_t count);
+
+/** @brief Index of the first of count pixels above threshold, or count if there is none. */
+size_t findAbove(const uint16_t *pixels, size_t count, uint16_t threshold);
+
+/**
+ * @brief Full 65536 bin histogram, bins is cleared first.
+ * @param pool pool to spread the frame over, nullptr for ThreadPool::shared().
+ */
+void histogram(const uint16_t *pixels, size_t count, uint32_t *bins, ThreadPool *pool = nullptr);
+
+/** @brief Exact median from a histogram of count pixels. */
+uint16_t histogramMedian(const uint32_t *bins, uint64_t count);
+
+/**
+ * @brief Median of values by selection (nth_element), values are reordered.
+ * Cheaper than a histogram for a few thousand samples.
+ */
+uint16_t selectMedian(uint16_t *values, size_t count);
+
+struct Background
+{
+    /** Sky level in ADU, robust against stars. */
+    double level {0};
+    /** Standard deviation of the sky in ADU, from the median absolute deviation. */
+    double noise {0};
+};
+
+/**
+ * @brief Estimate the sky background: the median of sampled pixels in every tile
+ * of a grid, then the median and MAD over the tiles.
+ */
+Background background(const uint16_t *pixels, uint32_t width, uint32_t height, ThreadPool *pool = nullptr);
+
+struct Star
+{
+    double x {0}, y {0};
+    /** Total flux above background, ADU. */
+    double flux {0};
+    /** Half flux radius, pixels. */
+    double hfr {0};
+    uint16_t peak {0};
+};
+
+struct DetectOptions
+{
+    /** Pixels brighter than background + sigma * noise start a star. */
+    double sigma {5};
+    /** Radius of the box the flux and HFR are measured in. */
+    int radius {8};
+    /** Stop after this many stars, the brightest are not guaranteed. */
+    size_t maxStars {500};
+    /** Peaks at or above this are saturated and skipped. */
+    uint16_t saturation {65000};
+};
+
+/** @brief Find stars and measure their half flux radius. */
+std::vector<Star> detectStars(const uint16_t *pixels, uint32_t width, uint32_t height, const Background &background,
+                              const DetectOptions &options = DetectOptions(), ThreadPool *pool = nullptr);
+
+struct Result
+{
+    Range range;
+    double mean {0};
+    uint16_t median {0};
+    Background background;
+    size_t stars {0};
+    /** Median HFR over the detected stars, 0 if there are none. */
+    double hfr {0};
+};
+
+/** @brief Everything above in one go. */
+Result analyze(const uint16_t *pixels, uint32_t width, uint32_t height,
+               const DetectOptions &options = DetectOptions(), ThreadPool *pool = nullptr);
+
+}
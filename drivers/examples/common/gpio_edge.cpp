@@ -0,0 +1,274 @@
+#include "gpio_edge.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_GPIOD
+#include <gpiod.hpp>
+#endif
+
+namespace GpioEdge
+{
+
+uint64_t monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+// -- libgpiod ---------------------------------------------------------------
+
+#ifdef HAVE_GPIOD
+
+namespace
+{
+
+class ChipLines : public Source
+{
+public:
+    ChipLines(gpiod::line_request &&request, const std::vector<unsigned> &offsets)
+        : m_Request(std::move(request)), m_Buffer(64)
+    {
+        for (unsigned offset : offsets)
+            m_Offsets.push_back(gpiod::line::offset(offset));
+    }
+
+    int fd() const override
+    {
+        return m_Request.fd();
+    }
+
+    size_t lines() const override
+    {
+        return m_Offsets.size();
+    }
+
+    bool read(std::vector<Event> &events) override
+    {
+        try
+        {
+            // The descriptor is not non-blocking, only read what is there.
+            while (m_Request.wait_edge_events(std::chrono::nanoseconds(0)))
+            {
+                const size_t count = m_Request.read_edge_events(m_Buffer);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const gpiod::edge_event &edge = m_Buffer.get_event(i);
+                    Event event;
+                    event.line = index(edge.line_offset());
+                    event.rising = edge.type() == gpiod::edge_event::event_type::RISING_EDGE;
+                    event.timestampNs = edge.timestamp_ns().ns();
+                    events.push_back(event);
+                }
+            }
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    bool levels(std::vector<bool> &levels) override
+    {
+        try
+        {
+            const gpiod::line::values values = m_Request.get_values(m_Offsets);
+            levels.resize(values.size());
+            for (size_t i = 0; i < values.size(); ++i)
+                levels[i] = values[i] == gpiod::line::value::ACTIVE;
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+private:
+    size_t index(gpiod::line::offset offset) const
+    {
+        for (size_t i = 0; i < m_Offsets.size(); ++i)
+            if (m_Offsets[i] == offset)
+                return i;
+        return 0;
+    }
+
+    gpiod::line_request m_Request;
+    gpiod::edge_event_buffer m_Buffer;
+    gpiod::line::offsets m_Offsets;
+};
+
+}
+
+std::unique_ptr<Source> openChip(const std::string &chip, const std::vector<unsigned> &offsets,
+                                 std::chrono::microseconds debounce, bool activeLow, const std::string &consumer,
+                                 std::string &error)
+{
+    try
+    {
+        gpiod::line::offsets lines;
+        for (unsigned offset : offsets)
+            lines.push_back(gpiod::line::offset(offset));
+
+        gpiod::line_settings settings;
+        settings.set_direction(gpiod::line::direction::INPUT)
+        .set_edge_detection(gpiod::line::edge::BOTH)
+        .set_event_clock(gpiod::line::clock::MONOTONIC)
+        .set_active_low(activeLow)
+        .set_debounce_period(debounce);
+
+        gpiod::chip device(chip);
+        auto request = device.prepare_request().set_consumer(consumer).add_line_settings(lines, settings).do_request();
+        return std::unique_ptr<Source>(new ChipLines(std::move(request), offsets));
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+        return nullptr;
+    }
+}
+
+#else
+
+std::unique_ptr<Source> openChip(const std::string &, const std::vector<unsigned> &, std::chrono::microseconds, bool,
+                                 const std::string &, std::string &error)
+{
+    error = "built without libgpiod";
+    return nullptr;
+}
+
+#endif
+
+// -- MockChip ---------------------------------------------------------------
+
+MockChip::MockChip(size_t lines) : m_Lines(lines), m_Levels(new std::atomic<bool>[lines])
+{
+    for (size_t i = 0; i < lines; ++i)
+        m_Levels[i] = false;
+    if (pipe2(m_Pipe, O_CLOEXEC | O_NONBLOCK) != 0)
+        m_Pipe[0] = m_Pipe[1] = -1;
+}
+
+MockChip::~MockChip()
+{
+    if (m_Pipe[0] >= 0)
+        close(m_Pipe[0]);
+    if (m_Pipe[1] >= 0)
+        close(m_Pipe[1]);
+}
+
+void MockChip::drive(size_t line, bool level)
+{
+    if (line >= m_Lines || m_Levels[line].exchange(level) == level)
+        return;
+    Event event;
+    event.line = line;
+    event.rising = level;
+    event.timestampNs = monotonicNs();
+    // Smaller than PIPE_BUF, so events of several threads do not mix. When
+    // the pipe is full they are lost, as when the kernel's queue overflows.
+    const ssize_t written = write(m_Pipe[1], &event, sizeof(event));
+    (void)written;
+}
+
+bool MockChip::read(std::vector<Event> &events)
+{
+    Event chunk[64];
+    for (;;)
+    {
+        const ssize_t size = ::read(m_Pipe[0], chunk, sizeof(chunk));
+        if (size < 0)
+            return errno == EAGAIN;
+        if (size == 0)
+            return true;
+        events.insert(events.end(), chunk, chunk + size / sizeof(Event));
+    }
+}
+
+bool MockChip::levels(std::vector<bool> &levels)
+{
+    levels.resize(m_Lines);
+    for (size_t i = 0; i < m_Lines; ++i)
+        levels[i] = m_Levels[i];
+    return true;
+}
+
+// -- Debouncer --------------------------------------------------------------
+
+Debouncer::Debouncer(size_t lines, std::chrono::nanoseconds period) : m_Lines(lines), m_PeriodNs(period.count())
+{
+}
+
+void Debouncer::reset(const std::vector<bool> &levels)
+{
+    for (size_t i = 0; i < m_Lines.size(); ++i)
+    {
+        m_Lines[i] = Line();
+        m_Lines[i].reported = m_Lines[i].raw = i < levels.size() && levels[i];
+    }
+    m_Bounces = 0;
+}
+
+bool Debouncer::feed(const Event &event)
+{
+    if (event.line >= m_Lines.size())
+        return false;
+
+    Line &line = m_Lines[event.line];
+    const bool quiet = line.lastEdgeNs == 0 || event.timestampNs - line.lastEdgeNs >= m_PeriodNs;
+    line.raw = event.rising;
+    line.lastEdgeNs = event.timestampNs;
+
+    if (!quiet)
+    {
+        ++m_Bounces;
+        line.unsettled = true;
+        return false;
+    }
+    line.unsettled = false;
+    if (line.raw == line.reported)
+        return false;
+    line.reported = line.raw;
+    return true;
+}
+
+void Debouncer::settle(uint64_t nowNs, std::vector<Event> &changes)
+{
+    for (size_t i = 0; i < m_Lines.size(); ++i)
+    {
+        Line &line = m_Lines[i];
+        if (!line.unsettled || nowNs < line.lastEdgeNs + m_PeriodNs)
+            continue;
+        line.unsettled = false;
+        if (line.raw == line.reported)
+            continue;
+        line.reported = line.raw;
+        Event event;
+        event.line = i;
+        event.rising = line.raw;
+        event.timestampNs = line.lastEdgeNs + m_PeriodNs;
+        changes.push_back(event);
+    }
+}
+
+uint64_t Debouncer::deadline() const
+{
+    uint64_t earliest = 0;
+    for (const Line &line : m_Lines)
+    {
+        if (!line.unsettled)
+            continue;
+        const uint64_t due = line.lastEdgeNs + m_PeriodNs;
+        if (earliest == 0 || due < earliest)
+            earliest = due;
+    }
+    return earliest;
+}
+
+}
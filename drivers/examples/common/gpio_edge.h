@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Digital inputs reported by the kernel as edge events, instead of
+ * reading their levels on every poll.
+ *
+ * The GPIO character device queues an event with a timestamp for every edge
+ * on a requested line, and its file descriptor becomes readable. A driver
+ * watches fd() on its event loop (IEAddCallback) and reads the events when
+ * they come, so a limit switch or a rain sensor is published right after its
+ * edge, and nothing runs while the inputs are quiet. Pulses shorter than a
+ * poll period are not missed either.
+ *
+ * Contacts bounce. The kernel can debounce the lines itself (openChip() with
+ * a debounce period), which holds each edge back until the line has been
+ * stable for the period. Debouncer does it with the timestamps of the events
+ * instead: the first edge after a quiet period is reported at once, the
+ * bounces after it are swallowed, and if the line settled on the other level
+ * the change is reported when the period is over.
+ *
+ * MockChip stands in for a chip, for the simulation and the benchmarks.
+ */
+namespace GpioEdge
+{
+
+struct Event
+{
+    /** Index of the line in the request, not its offset on the chip. */
+    size_t line {0};
+    bool rising {false};
+    /** CLOCK_MONOTONIC of the edge, nanoseconds. */
+    uint64_t timestampNs {0};
+};
+
+/** @brief CLOCK_MONOTONIC, the clock of the event timestamps. */
+uint64_t monotonicNs();
+
+/** @brief Requested input lines of a chip. */
+class Source
+{
+public:
+    virtual ~Source() = default;
+
+    /** @brief Readable while events wait to be read. */
+    virtual int fd() const = 0;
+    virtual size_t lines() const = 0;
+    /** @brief Append the waiting events, without blocking. False on an error. */
+    virtual bool read(std::vector<Event> &events) = 0;
+    /** @brief The level of every line now. */
+    virtual bool levels(std::vector<bool> &levels) = 0;
+};
+
+/**
+ * @brief Request lines of a chip for edge events with libgpiod v2.
+ * @param chip path of the chip, as /dev/gpiochip0.
+ * @param offsets of the lines on the chip.
+ * @param debounce done by the kernel, 0 for none.
+ * @param activeLow report the lines inverted, as switches to ground with a pull-up.
+ * @return nullptr with the reason in error if the lines cannot be requested,
+ * or the library was built without libgpiod.
+ */
+std::unique_ptr<Source> openChip(const std::string &chip, const std::vector<unsigned> &offsets,
+                                 std::chrono::microseconds debounce, bool activeLow, const std::string &consumer,
+                                 std::string &error);
+
+/**
+ * @brief A chip whose lines are driven from code. drive() may be called from
+ * any thread, and queues an event when the level changes.
+ */
+class MockChip : public Source
+{
+public:
+    explicit MockChip(size_t lines);
+    ~MockChip() override;
+
+    MockChip(const MockChip &) = delete;
+    MockChip &operator=(const MockChip &) = delete;
+
+    void drive(size_t line, bool level);
+
+    int fd() const override
+    {
+        return m_Pipe[0];
+    }
+
+    size_t lines() const override
+    {
+        return m_Lines;
+    }
+
+    bool read(std::vector<Event> &events) override;
+    bool levels(std::vector<bool> &levels) override;
+
+private:
+    size_t m_Lines;
+    std::unique_ptr<std::atomic<bool>[]> m_Levels;
+    int m_Pipe[2] {-1, -1};
+};
+
+/** @brief Debounces the events of a request with their timestamps. */
+class Debouncer
+{
+public:
+    /** @param period a line has to be quiet for before an edge counts, 0 to take every change. */
+    Debouncer(size_t lines, std::chrono::nanoseconds period);
+
+    /** @brief Start from the levels read when the lines were requested. */
+    void reset(const std::vector<bool> &levels);
+
+    /** @brief True if the event changes the reported level of its line. */
+    bool feed(const Event &event);
+
+    /**
+     * @brief Report the lines that settled on the other level than reported
+     * once their period is over, as events with the time they settled.
+     */
+    void settle(uint64_t nowNs, std::vector<Event> &changes);
+
+    /** @brief When settle() has something to do, 0 if nothing waits. */
+    uint64_t deadline() const;
+
+    bool level(size_t line) const
+    {
+        return m_Lines[line].reported;
+    }
+
+    /** @brief Edges swallowed as bounces so far. */
+    uint64_t bounces() const
+    {
+        return m_Bounces;
+    }
+
+private:
+    struct Line
+    {
+        bool reported {false};
+        bool raw {false};
+        uint64_t lastEdgeNs {0};
+        // An edge was swallowed since the last reported one.
+        bool unsettled {false};
+    };
+
+    std::vector<Line> m_Lines;
+    uint64_t m_PeriodNs;
+    uint64_t m_Bounces {0};
+};
+
+}
@@ -0,0 +1,880 @@
+#include "http_transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Http
+{
+
+namespace
+{
+
+// Status line and headers longer than this are not from a device.
+const size_t MaxHeadLength = 16384;
+
+std::string lower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+    {
+        return static_cast<char>(tolower(c));
+    });
+    return text;
+}
+
+std::string trim(const std::string &text)
+{
+    const size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return std::string();
+    return text.substr(first, text.find_last_not_of(" \t\r") + 1 - first);
+}
+
+// Calls visit(name, value) for every header line of a head, the name in lower case.
+template <typename Visit>
+void headers(const std::string &head, Visit visit)
+{
+    size_t line = head.find("\r\n");
+    while (line != std::string::npos && line + 2 < head.size())
+    {
+        const size_t start = line + 2;
+        line = head.find("\r\n", start);
+        const size_t colon = head.find(':', start);
+        if (line == std::string::npos || colon == std::string::npos || colon > line)
+            continue;
+        visit(lower(head.substr(start, colon - start)), trim(head.substr(colon + 1, line - colon - 1)));
+    }
+}
+
+void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+}
+
+// -- Client -----------------------------------------------------------------
+
+Client::Client() = default;
+
+Client::~Client()
+{
+    // No callbacks from here, the driver may be half destroyed.
+    m_Queue.clear();
+    for (int fd : {m_Fd, m_Parked[0], m_Parked[1]})
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+}
+
+bool Client::open(const Options &options)
+{
+    m_Options = options;
+    if (m_Fd >= 0)
+    {
+        close();
+        return true;
+    }
+    if (pipe(m_Parked) < 0)
+        return false;
+    setNonBlocking(m_Parked[0]);
+    m_Fd = dup(m_Parked[0]);
+    return m_Fd >= 0;
+}
+
+void Client::close()
+{
+    park();
+    while (!m_Queue.empty())
+        fail("closed");
+}
+
+void Client::park()
+{
+    if (m_Fd >= 0 && m_Connected)
+        dup2(m_Parked[0], m_Fd);
+    m_Connected = false;
+    m_Used = false;
+    resetAnswer();
+}
+
+bool Client::connect(std::string &error)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    const int resolved = getaddrinfo(m_Options.host.c_str(), std::to_string(m_Options.port).c_str(), &hints, &found);
+    if (resolved != 0)
+    {
+        error = gai_strerror(resolved);
+        return false;
+    }
+
+    int socketFd = -1;
+    error = "no address";
+    for (addrinfo *address = found; address != nullptr && socketFd < 0; address = address->ai_next)
+    {
+        socketFd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socketFd < 0)
+            continue;
+        setNonBlocking(socketFd);
+        if (::connect(socketFd, address->ai_addr, address->ai_addrlen) < 0)
+        {
+            int failure = errno;
+            if (failure == EINPROGRESS)
+            {
+                pollfd pending {socketFd, POLLOUT, 0};
+                socklen_t length = sizeof(failure);
+                if (::poll(&pending, 1, m_Options.connectTimeoutMs) <= 0)
+                    failure = ETIMEDOUT;
+                else if (getsockopt(socketFd, SOL_SOCKET, SO_ERROR, &failure, &length) < 0)
+                    failure = errno;
+            }
+            if (failure != 0)
+            {
+                error = strerror(failure);
+                ::close(socketFd);
+                socketFd = -1;
+            }
+        }
+    }
+    freeaddrinfo(found);
+    if (socketFd < 0)
+        return false;
+
+    int on = 1;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    // The new connection takes the place of the placeholder, fd() stays the same.
+    dup2(socketFd, m_Fd);
+    ::close(socketFd);
+    m_Connected = true;
+    m_Used = false;
+    ++m_Stats.connects;
+    return true;
+}
+
+uint64_t Client::request(const std::string &method, const std::string &path, const std::string &body,
+                         const std::string &contentType, Callback callback, BodySink sink)
+{
+    if (m_Fd < 0 || m_Queue.size() >= m_Options.maxQueued)
+        return 0;
+
+    Pending pending;
+    pending.id = m_NextId++;
+    pending.idempotent = method != "POST" && method != "PATCH";
+    pending.callback = std::move(callback);
+    pending.sink = std::move(sink);
+    pending.response.id = pending.id;
+
+    std::string &wire = pending.wire;
+    wire = method + " " + path + " HTTP/1.1\r\nHost: " + m_Options.host + ":" + std::to_string(m_Options.port) + "\r\n";
+    if (!m_Options.keepAlive)
+        wire += "Connection: close\r\n";
+    wire += "Accept: application/json\r\n";
+    if (!body.empty() || method == "PUT" || method == "POST")
+    {
+        if (!contentType.empty())
+            wire += "Content-Type: " + contentType + "\r\n";
+        wire += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    wire += "\r\n";
+    wire += body;
+
+    const uint64_t id = pending.id;
+    m_Queue.push_back(std::move(pending));
+    sendNext();
+    return id;
+}
+
+void Client::sendNext()
+{
+    while (!m_Queue.empty() && !m_Queue.front().sent)
+    {
+        // A kept-alive connection the device closed while it was idle reads
+        // as the end of the stream; find out now rather than after sending.
+        if (m_Connected)
+        {
+            pollfd check {m_Fd, POLLIN, 0};
+            char peek;
+            if (::poll(&check, 1, 0) > 0 && recv(m_Fd, &peek, 1, MSG_PEEK) <= 0)
+                park();
+        }
+
+        std::string error;
+        if (!m_Connected && !connect(error))
+        {
+            fail(error);
+            continue;
+        }
+
+        Pending &front = m_Queue.front();
+        front.response.reused = m_Used;
+        front.sentAt = Clock::now();
+        front.sent = true;
+        resetAnswer();
+        if (!writeAll(front.wire, error))
+        {
+            const bool retry = m_Used && front.idempotent && !front.retried;
+            park();
+            if (retry)
+            {
+                front.sent = false;
+                front.retried = true;
+                ++m_Stats.retried;
+                continue;
+            }
+            fail(error);
+            continue;
+        }
+        ++m_Stats.requests;
+        if (front.response.reused)
+            ++m_Stats.reused;
+        return;
+    }
+}
+
+bool Client::writeAll(const std::string &data, std::string &error)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        const ssize_t n = ::send(m_Fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            written += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Only a large body fills the socket buffer.
+            pollfd fd {m_Fd, POLLOUT, 0};
+            if (::poll(&fd, 1, m_Options.timeoutMs) > 0)
+                continue;
+            error = "timeout sending";
+            return false;
+        }
+        error = n == 0 ? "connection closed" : strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void Client::onReadable()
+{
+    if (!m_Connected)
+        return;
+
+    char buffer[16384];
+    for (;;)
+    {
+        const ssize_t n = ::read(m_Fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        if (n <= 0)
+        {
+            const std::string error = n == 0 ? "connection closed" : strerror(errno);
+            const bool inFlight = !m_Queue.empty() && m_Queue.front().sent;
+            if (inFlight && m_UntilClose && m_Part == Part::Body)
+            {
+                // The body ends with the connection.
+                complete();
+                return;
+            }
+            const bool reused = m_Used;
+            const size_t received = m_Received;
+            park();
+            if (inFlight)
+            {
+                Pending &front = m_Queue.front();
+                if (reused && received == 0 && front.idempotent && !front.retried)
+                {
+                    front.sent = false;
+                    front.retried = true;
+                    ++m_Stats.retried;
+                }
+                else
+                    fail(error);
+            }
+            sendNext();
+            return;
+        }
+
+        size_t offset = 0;
+        while (offset < static_cast<size_t>(n))
+        {
+            if (m_Queue.empty() || !m_Queue.front().sent)
+            {
+                // Nobody asked for this, the connection cannot be trusted.
+                park();
+                sendNext();
+                return;
+            }
+            size_t used = 0;
+            std::string error;
+            const bool done = parse(buffer + offset, static_cast<size_t>(n) - offset, used, error);
+            if (!error.empty())
+            {
+                park();
+                fail(error);
+                sendNext();
+                return;
+            }
+            offset += used;
+            if (done)
+            {
+                complete();
+                if (!m_Connected)
+                    return;
+            }
+        }
+    }
+}
+
+void Client::resetAnswer()
+{
+    m_Part = Part::StatusAndHeaders;
+    m_Head.clear();
+    m_Remaining = 0;
+    m_UntilClose = false;
+    m_CloseAfter = false;
+    m_Received = 0;
+}
+
+bool Client::parse(const char *data, size_t length, size_t &used, std::string &error)
+{
+    size_t i = 0;
+    bool done = false;
+    while (i < length && !done)
+    {
+        switch (m_Part)
+        {
+            case Part::StatusAndHeaders:
+            case Part::ChunkSize:
+            case Part::Trailer:
+            {
+                // Lines, collected in m_Head until they are complete.
+                const size_t before = m_Head.size();
+                const bool head = m_Part == Part::StatusAndHeaders;
+                const char *terminator = head || m_Part == Part::Trailer ? "\r\n\r\n" : "\r\n";
+                m_Head.append(data + i, length - i);
+                // A trailer without fields is only the empty line.
+                if (m_Part == Part::Trailer && m_Head.compare(0, 2, "\r\n") == 0)
+                {
+                    i += 2 - before;
+                    m_Head.clear();
+                    done = true;
+                    break;
+                }
+                const size_t back = strlen(terminator) - 1;
+                const size_t end = m_Head.find(terminator, before > back ? before - back : 0);
+                if (end == std::string::npos)
+                {
+                    if (m_Head.size() > MaxHeadLength)
+                    {
+                        error = "answer head too long";
+                        return false;
+                    }
+                    i = length;
+                    break;
+                }
+                const size_t size = end + strlen(terminator);
+                i += size - before;
+                m_Head.resize(size);
+
+                if (head)
+                {
+                    if (!parseHead(done, error))
+                        return false;
+                }
+                else if (m_Part == Part::ChunkSize)
+                {
+                    char *last = nullptr;
+                    const unsigned long chunk = strtoul(m_Head.c_str(), &last, 16);
+                    if (last == m_Head.c_str())
+                    {
+                        error = "bad chunk size";
+                        return false;
+                    }
+                    m_Head.clear();
+                    m_Remaining = chunk;
+                    m_Part = chunk == 0 ? Part::Trailer : Part::ChunkData;
+                }
+                else
+                {
+                    m_Head.clear();
+                    done = true;
+                }
+                break;
+            }
+
+            case Part::Body:
+            case Part::ChunkData:
+            {
+                const size_t take = m_UntilClose ? length - i : std::min(length - i, m_Remaining);
+                body(data + i, take);
+                i += take;
+                if (m_UntilClose)
+                    break;
+                m_Remaining -= take;
+                if (m_Remaining == 0)
+                {
+                    if (m_Part == Part::Body)
+                        done = true;
+                    else
+                    {
+                        m_Part = Part::ChunkEnd;
+                        m_Remaining = 2;
+                    }
+                }
+                break;
+            }
+
+            case Part::ChunkEnd:
+                if (data[i] != (m_Remaining == 2 ? '\r' : '\n'))
+                {
+                    error = "bad chunk end";
+                    return false;
+                }
+                ++i;
+                if (--m_Remaining == 0)
+                    m_Part = Part::ChunkSize;
+                break;
+        }
+    }
+    used = i;
+    m_Received += i;
+    return done;
+}
+
+bool Client::parseHead(bool &done, std::string &error)
+{
+    if (m_Head.compare(0, 5, "HTTP/") != 0)
+    {
+        error = "not an HTTP answer";
+        return false;
+    }
+    const size_t space = m_Head.find(' ');
+    const int status = space == std::string::npos ? 0 : atoi(m_Head.c_str() + space + 1);
+    if (status < 100)
+    {
+        error = "bad status line";
+        return false;
+    }
+    // 100 Continue and friends come before the real answer.
+    if (status < 200)
+    {
+        m_Head.clear();
+        return true;
+    }
+
+    bool close = m_Head.compare(0, 8, "HTTP/1.0") == 0;
+    bool chunked = false;
+    long contentLength = -1;
+    headers(m_Head, [&](const std::string & name, const std::string & value)
+    {
+        if (name == "content-length")
+            contentLength = strtol(value.c_str(), nullptr, 10);
+        else if (name == "transfer-encoding")
+            chunked = lower(value).find("chunked") != std::string::npos;
+        else if (name == "connection")
+        {
+            const std::string option = lower(value);
+            if (option.find("close") != std::string::npos)
+                close = true;
+            else if (option.find("keep-alive") != std::string::npos)
+                close = false;
+        }
+    });
+
+    m_Queue.front().response.status = status;
+    m_CloseAfter = close || !m_Options.keepAlive;
+    m_Head.clear();
+    if (status == 204 || status == 304 || contentLength == 0)
+        done = true;
+    else if (chunked)
+        m_Part = Part::ChunkSize;
+    else if (contentLength > 0)
+    {
+        m_Part = Part::Body;
+        m_Remaining = static_cast<size_t>(contentLength);
+    }
+    else
+    {
+        m_Part = Part::Body;
+        m_UntilClose = true;
+        m_CloseAfter = true;
+    }
+    return true;
+}
+
+void Client::body(const char *data, size_t length)
+{
+    Pending &front = m_Queue.front();
+    if (front.sink)
+        front.sink(data, length);
+    else
+        front.response.body.append(data, length);
+}
+
+void Client::complete()
+{
+    Pending done = std::move(m_Queue.front());
+    m_Queue.pop_front();
+    done.response.ok = true;
+    done.response.elapsed = Clock::now() - done.sentAt;
+
+    if (m_CloseAfter)
+        park();
+    else
+    {
+        resetAnswer();
+        m_Used = true;
+    }
+    if (done.callback)
+        done.callback(done.response);
+    sendNext();
+}
+
+void Client::fail(const std::string &error)
+{
+    Pending failed = std::move(m_Queue.front());
+    m_Queue.pop_front();
+    failed.response.ok = false;
+    failed.response.error = error;
+    if (failed.sent)
+        failed.response.elapsed = Clock::now() - failed.sentAt;
+    ++m_Stats.failed;
+    if (failed.callback)
+        failed.callback(failed.response);
+}
+
+void Client::expire()
+{
+    if (m_Queue.empty() || !m_Queue.front().sent)
+        return;
+    if (Clock::now() - m_Queue.front().sentAt < std::chrono::milliseconds(m_Options.timeoutMs))
+        return;
+    // What is left of the answer would be taken for the next one.
+    ++m_Stats.timeouts;
+    park();
+    fail("timeout");
+    sendNext();
+}
+
+int Client::nextTimeoutMs() const
+{
+    if (m_Queue.empty() || !m_Queue.front().sent)
+        return -1;
+    const auto deadline = m_Queue.front().sentAt + std::chrono::milliseconds(m_Options.timeoutMs);
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    return static_cast<int>(std::max<long long>(0, left + 1));
+}
+
+// -- StandInServer ----------------------------------------------------------
+
+struct StandInServer::Connection
+{
+    int fd {-1};
+    std::string in;
+    struct Answer
+    {
+        Clock::time_point due;
+        std::string bytes;
+        bool close;
+    };
+    std::deque<Answer> out;
+    // When the device is done accepting the connection.
+    Clock::time_point ready;
+    Clock::time_point lastActivity;
+    Clock::time_point lastDue;
+    int served {0};
+    bool closing {false};
+};
+
+StandInServer::StandInServer(const Options &options) : m_Options(options)
+{
+    m_Listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(options.port);
+    socklen_t length = sizeof(address);
+    if (bind(m_Listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            ::listen(m_Listener, 64) < 0 ||
+            getsockname(m_Listener, reinterpret_cast<sockaddr *>(&address), &length) < 0 ||
+            pipe(m_Wake) < 0)
+    {
+        ::close(m_Listener);
+        m_Listener = -1;
+        return;
+    }
+    m_Port = ntohs(address.sin_port);
+    m_Thread = std::thread([this]
+    {
+        run();
+    });
+}
+
+StandInServer::~StandInServer()
+{
+    if (m_Thread.joinable())
+    {
+        const char stop = 0;
+        if (write(m_Wake[1], &stop, 1) < 0)
+        {
+            // The thread still stops on the closed pipe below.
+        }
+        m_Thread.join();
+    }
+    for (int fd : {m_Listener, m_Wake[0], m_Wake[1]})
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+}
+
+void StandInServer::set(const std::string &path, const std::string &body)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Resources[path] = body;
+}
+
+std::string StandInServer::get(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto found = m_Resources.find(path);
+    return found == m_Resources.end() ? std::string() : found->second;
+}
+
+std::string StandInServer::answer(const std::string &method, const std::string &path, const std::string &body,
+                                  bool close)
+{
+    int status = 404;
+    std::string content = "{\"error\":\"not found\"}";
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto found = m_Resources.find(path);
+        if (found != m_Resources.end() && (method == "GET" || method == "PUT"))
+        {
+            if (method == "PUT")
+                found->second = body;
+            status = 200;
+            content = found->second;
+        }
+        else if (found != m_Resources.end())
+        {
+            status = 405;
+            content = "{\"error\":\"method not allowed\"}";
+        }
+    }
+
+    std::string out = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Error") +
+                      "\r\nContent-Type: application/json\r\n";
+    if (close)
+        out += "Connection: close\r\n";
+    if (m_Options.chunkSize == 0)
+    {
+        out += "Content-Length: " + std::to_string(content.size()) + "\r\n\r\n" + content;
+        return out;
+    }
+    out += "Transfer-Encoding: chunked\r\n\r\n";
+    char size[16];
+    for (size_t offset = 0; offset < content.size(); offset += m_Options.chunkSize)
+    {
+        const size_t chunk = std::min(m_Options.chunkSize, content.size() - offset);
+        snprintf(size, sizeof(size), "%zx\r\n", chunk);
+        out += size;
+        out.append(content, offset, chunk);
+        out += "\r\n";
+    }
+    out += "0\r\n\r\n";
+    return out;
+}
+
+bool StandInServer::handle(Connection &connection, Clock::time_point now)
+{
+    for (;;)
+    {
+        const size_t end = connection.in.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return connection.in.size() <= MaxHeadLength;
+        const std::string head = connection.in.substr(0, end + 2);
+
+        size_t contentLength = 0;
+        bool close = head.find("HTTP/1.0") != std::string::npos;
+        headers(head, [&](const std::string & name, const std::string & value)
+        {
+            if (name == "content-length")
+                contentLength = strtoul(value.c_str(), nullptr, 10);
+            else if (name == "connection")
+                close = lower(value).find("close") != std::string::npos;
+        });
+        if (connection.in.size() < end + 4 + contentLength)
+            return true;
+
+        const size_t methodEnd = head.find(' ');
+        const size_t pathEnd = head.find(' ', methodEnd + 1);
+        if (methodEnd == std::string::npos || pathEnd == std::string::npos)
+            return false;
+        const std::string method = head.substr(0, methodEnd);
+        const std::string path = head.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+        const std::string body = connection.in.substr(end + 4, contentLength);
+        connection.in.erase(0, end + 4 + contentLength);
+
+        ++m_Requests;
+        ++connection.served;
+        if (m_Options.keepAliveRequests > 0 && connection.served >= m_Options.keepAliveRequests)
+            close = true;
+
+        // One request at a time, each a round trip after it arrived, or after
+        // the device is done accepting the connection.
+        Clock::time_point due = std::max(now, connection.ready) + m_Options.latency;
+        due = std::max(due, connection.lastDue);
+        connection.lastDue = due;
+        connection.out.push_back({due, answer(method, path, body, close), close});
+        if (close)
+        {
+            // Whatever else came on this connection is not answered.
+            connection.in.clear();
+            connection.closing = true;
+            return true;
+        }
+    }
+}
+
+void StandInServer::run()
+{
+    std::vector<std::unique_ptr<Connection>> connections;
+
+    for (;;)
+    {
+        const Clock::time_point now = Clock::now();
+        Clock::time_point wake = Clock::time_point::max();
+        std::vector<pollfd> fds {{m_Wake[0], POLLIN, 0}, {m_Listener, POLLIN, 0}};
+        for (const auto &connection : connections)
+        {
+            fds.push_back({connection->fd, static_cast<short>(connection->closing ? 0 : POLLIN), 0});
+            if (!connection->out.empty())
+                wake = std::min(wake, connection->out.front().due);
+            else
+                wake = std::min(wake, connection->lastActivity + m_Options.idleTimeout);
+        }
+
+        timespec timeout {0, 0};
+        timespec *wait = nullptr;
+        if (wake != Clock::time_point::max())
+        {
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::max(Clock::duration::zero(), wake - now)).count();
+            timeout.tv_sec = static_cast<time_t>(ns / 1000000000);
+            timeout.tv_nsec = static_cast<long>(ns % 1000000000);
+            wait = &timeout;
+        }
+        if (ppoll(fds.data(), fds.size(), wait, nullptr) < 0 && errno != EINTR)
+            break;
+        if (fds[0].revents)
+            break;
+
+        const Clock::time_point after = Clock::now();
+        for (size_t i = 0; i < connections.size(); ++i)
+        {
+            Connection &connection = *connections[i];
+            if (!(fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            char bytes[16384];
+            const ssize_t n = read(connection.fd, bytes, sizeof(bytes));
+            if (n <= 0)
+            {
+                connection.closing = true;
+                connection.out.clear();
+                continue;
+            }
+            connection.in.append(bytes, static_cast<size_t>(n));
+            connection.lastActivity = after;
+            if (!handle(connection, after))
+            {
+                connection.closing = true;
+                connection.out.clear();
+            }
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            const int accepted = accept(m_Listener, nullptr, nullptr);
+            if (accepted >= 0)
+            {
+                int on = 1;
+                setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                std::unique_ptr<Connection> connection(new Connection);
+                connection->fd = accepted;
+                // The handshake is a round trip the loopback does not take.
+                connection->ready = after + m_Options.latency + m_Options.connectTime;
+                connection->lastActivity = after;
+                connections.push_back(std::move(connection));
+                ++m_Connections;
+            }
+        }
+
+        for (auto &connection : connections)
+        {
+            while (!connection->out.empty() && connection->out.front().due <= after)
+            {
+                const Connection::Answer &answer = connection->out.front();
+                if (write(connection->fd, answer.bytes.data(), answer.bytes.size()) !=
+                        static_cast<ssize_t>(answer.bytes.size()))
+                {
+                    connection->out.clear();
+                    connection->closing = true;
+                    break;
+                }
+                const bool close = answer.close;
+                connection->out.pop_front();
+                connection->lastActivity = after;
+                if (close)
+                {
+                    connection->out.clear();
+                    break;
+                }
+            }
+            if (connection->out.empty() && !connection->closing &&
+                    after - connection->lastActivity >= m_Options.idleTimeout)
+                connection->closing = true;
+        }
+
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const std::unique_ptr<Connection> &connection)
+        {
+            if (!connection->closing || !connection->out.empty())
+                return false;
+            ::close(connection->fd);
+            return true;
+        }), connections.end());
+    }
+
+    for (auto &connection : connections)
+        ::close(connection->fd);
+}
+
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief HTTP/1.1 to a device with a REST interface from the driver's event
+ * loop, over one kept-alive connection, and a local stand-in server to run it
+ * against without a device.
+ *
+ * A new connection per request costs a TCP handshake and whatever the
+ * device's small web server takes to accept, often more than the request
+ * itself. Client keeps its connection open between requests and only opens a
+ * new one when the device closed it. A request on a kept-alive connection
+ * the device closed just before is sent again on a new one, once, if nothing
+ * of its answer came back.
+ *
+ * Requests are queued and sent one at a time on the connection; the answer
+ * is handed to a callback. Nothing blocks but opening a connection, which
+ * waits at most connectTimeoutMs and happens once, not per request. fd()
+ * stays the same descriptor for the life of the client, whatever connection
+ * is behind it, so the driver watches it on its event loop (IEAddCallback)
+ * once and calls onReadable() from there, and calls expire() from a timer to
+ * fail requests that take too long. The body can go to a sink as it arrives,
+ * a JsonFields for example, instead of being collected.
+ *
+ * Not thread safe, everything is called from the event loop.
+ */
+namespace Http
+{
+
+struct Response
+{
+    /** What request() returned. */
+    uint64_t id {0};
+    /** Got a whole answer, whatever its status. */
+    bool ok {false};
+    int status {0};
+    /** The body, unless it went to a sink. */
+    std::string body;
+    std::string error;
+    /** From sending the request to the end of the answer. */
+    std::chrono::nanoseconds elapsed {0};
+    /** Sent on a connection an earlier request had opened. */
+    bool reused {false};
+};
+
+using Callback = std::function<void(const Response &)>;
+/** @brief Takes the body as it arrives. */
+using BodySink = std::function<void(const char *data, size_t length)>;
+
+class Client
+{
+public:
+    struct Options
+    {
+        std::string host {"localhost"};
+        uint16_t port {80};
+        int connectTimeoutMs {2000};
+        /** From sending a request to the end of its answer. */
+        int timeoutMs {2000};
+        /** Off asks the device to close the connection after every answer. */
+        bool keepAlive {true};
+        /** Requests queued at most, request() returns 0 past that. */
+        size_t maxQueued {64};
+    };
+
+    struct Stats
+    {
+        uint64_t requests {0};
+        uint64_t connects {0};
+        /** Requests sent on a connection that was already open. */
+        uint64_t reused {0};
+        /** Sent again after the device closed a kept-alive connection. */
+        uint64_t retried {0};
+        uint64_t timeouts {0};
+        uint64_t failed {0};
+    };
+
+    Client();
+    ~Client();
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    /** @brief Set the device up. Connects with the first request. False if fd() cannot be made. */
+    bool open(const Options &options);
+
+    /** @brief Close the connection. Requests queued fail. */
+    void close();
+
+    /**
+     * @brief Queue a request.
+     * @param sink takes the body instead of Response::body if set.
+     * @return its id, 0 if the client is not open or the queue is full.
+     */
+    uint64_t request(const std::string &method, const std::string &path, const std::string &body,
+                     const std::string &contentType, Callback callback, BodySink sink = nullptr);
+
+    uint64_t get(const std::string &path, Callback callback, BodySink sink = nullptr)
+    {
+        return request("GET", path, std::string(), std::string(), std::move(callback), std::move(sink));
+    }
+
+    uint64_t put(const std::string &path, const std::string &json, Callback callback)
+    {
+        return request("PUT", path, json, "application/json", std::move(callback));
+    }
+
+    /** @brief Watch this for reading, the same descriptor until the client is destroyed. */
+    int fd() const
+    {
+        return m_Fd;
+    }
+
+    /** @brief Read what arrived, call the callbacks of the answers that are complete. */
+    void onReadable();
+
+    /** @brief Fail the request in flight if it took longer than timeoutMs. */
+    void expire();
+
+    /** @brief Milliseconds until expire() has something to do, -1 if nothing is in flight. */
+    int nextTimeoutMs() const;
+
+    /** @brief Requests queued or in flight. */
+    size_t pending() const
+    {
+        return m_Queue.size();
+    }
+
+    bool isConnected() const
+    {
+        return m_Connected;
+    }
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending
+    {
+        uint64_t id {0};
+        std::string wire;
+        bool idempotent {true};
+        Callback callback;
+        BodySink sink;
+        bool sent {false};
+        bool retried {false};
+        Clock::time_point sentAt;
+        Response response;
+    };
+
+    enum class Part
+    {
+        StatusAndHeaders,
+        Body,
+        ChunkSize,
+        ChunkData,
+        ChunkEnd,
+        Trailer
+    };
+
+    bool connect(std::string &error);
+    // Put the idle placeholder behind fd(), so it is never readable.
+    void park();
+    // Send the request at the front of the queue if the connection is free.
+    void sendNext();
+    bool writeAll(const std::string &data, std::string &error);
+
+    // Consume the answer from data, true when it is complete.
+    bool parse(const char *data, size_t length, size_t &used, std::string &error);
+    bool parseHead(bool &done, std::string &error);
+    void body(const char *data, size_t length);
+    void complete();
+    void fail(const std::string &error);
+    void resetAnswer();
+
+    Options m_Options;
+    int m_Fd {-1};
+    int m_Parked[2] {-1, -1};
+    bool m_Connected {false};
+    // Answers came on this connection before.
+    bool m_Used {false};
+
+    std::deque<Pending> m_Queue;
+    uint64_t m_NextId {1};
+
+    // The answer being read.
+    Part m_Part {Part::StatusAndHeaders};
+    std::string m_Head;
+    size_t m_Remaining {0};
+    bool m_UntilClose {false};
+    bool m_CloseAfter {false};
+    size_t m_Received {0};
+
+    Stats m_Stats;
+};
+
+/**
+ * @brief An HTTP/1.1 server on 127.0.0.1 that answers like the small web
+ * server of a device: each answer comes latency after its request, and
+ * accepting a connection costs another round trip plus connectTime.
+ *
+ * Serves the resources set with set() to GET, a PUT to one of them replaces
+ * it and answers the new body, anything else is a 404. Connections are kept
+ * alive unless the request asks otherwise, and closed after
+ * keepAliveRequests requests or idleTimeout without one.
+ */
+class StandInServer
+{
+public:
+    struct Options
+    {
+        /** 0 for any free port. */
+        uint16_t port {0};
+        /** Round trip of a request. */
+        std::chrono::microseconds latency {1000};
+        /** What accepting a connection takes the device, on top of the handshake round trip. */
+        std::chrono::microseconds connectTime {2000};
+        /** 0 keeps connections open for any number of requests. */
+        int keepAliveRequests {0};
+        std::chrono::milliseconds idleTimeout {5000};
+        /** Send bodies with chunked transfer encoding, in pieces of this many bytes, 0 for Content-Length. */
+        size_t chunkSize {0};
+    };
+
+    explicit StandInServer(const Options &options);
+    ~StandInServer();
+
+    StandInServer(const StandInServer &) = delete;
+    StandInServer &operator=(const StandInServer &) = delete;
+
+    bool listening() const
+    {
+        return m_Listener >= 0;
+    }
+
+    uint16_t port() const
+    {
+        return m_Port;
+    }
+
+    void set(const std::string &path, const std::string &body);
+    std::string get(const std::string &path) const;
+
+    uint64_t requests() const
+    {
+        return m_Requests;
+    }
+
+    uint64_t connections() const
+    {
+        return m_Connections;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection;
+
+    void run();
+    // Answer the requests complete in the connection's input. False to close it.
+    bool handle(Connection &connection, Clock::time_point now);
+    std::string answer(const std::string &method, const std::string &path, const std::string &body, bool close);
+
+    Options m_Options;
+    int m_Listener {-1};
+    int m_Wake[2] {-1, -1};
+    uint16_t m_Port {0};
+
+    mutable std::mutex m_Mutex;
+    std::map<std::string, std::string> m_Resources;
+
+    std::atomic<uint64_t> m_Requests {0};
+    std::atomic<uint64_t> m_Connections {0};
+    std::thread m_Thread;
+};
+
+}
@@ -0,0 +1,427 @@
+#include "json_fields.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isScalar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+}
+
+size_t JsonFields::subscribe(const std::string &path)
+{
+    auto known = m_Subscribed.find(path);
+    if (known != m_Subscribed.end())
+        return known->second;
+
+    const size_t index = m_Fields.size();
+    Field field;
+    field.path = path;
+    m_Fields.push_back(field);
+    m_Subscribed[path] = index;
+    // The containers on the way: "a.b[2].c" goes through "a", "a.b" and "a.b[2]".
+    for (size_t i = 1; i < path.size(); ++i)
+    {
+        if (path[i] == '.' || path[i] == '[')
+            m_Prefixes.insert(path.substr(0, i));
+    }
+    return index;
+}
+
+void JsonFields::reset()
+{
+    for (Field &field : m_Fields)
+    {
+        field.type = Type::Missing;
+        field.text.clear();
+    }
+    m_State = State::Value;
+    m_Stack.clear();
+    m_Path.clear();
+    m_Key.clear();
+    m_Token.clear();
+    m_Escape = 0;
+    m_HighSurrogate = 0;
+    m_Error.clear();
+}
+
+bool JsonFields::fail(const char *why)
+{
+    if (m_State != State::Error)
+        m_Error = why;
+    m_State = State::Error;
+    return false;
+}
+
+bool JsonFields::feed(const char *data, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        // Most of a document is string contents, take them a run at a time.
+        if (m_State == State::String && m_Escape == 0)
+        {
+            size_t end = i;
+            while (end < length && data[end] != '"' && data[end] != '\\' &&
+                    static_cast<unsigned char>(data[end]) >= 0x20)
+                ++end;
+            if (m_Collect)
+                m_Token.append(data + i, end - i);
+            i = end;
+            if (i == length)
+                break;
+            if (static_cast<unsigned char>(data[i]) < 0x20)
+                return fail("control character in a string");
+        }
+        if (!step(data[i++]))
+            return false;
+    }
+    return m_State != State::Error;
+}
+
+bool JsonFields::finish()
+{
+    if (m_State == State::Scalar && m_Stack.empty() && !endScalar())
+        return false;
+    if (m_State == State::Error)
+        return false;
+    if (m_State != State::Done)
+        return fail("document incomplete");
+    return true;
+}
+
+bool JsonFields::step(char c)
+{
+    switch (m_State)
+    {
+        case State::Value:
+            if (isSpace(c))
+                return true;
+            return beginValue(c);
+
+        case State::FirstElement:
+            if (isSpace(c))
+                return true;
+            if (c == ']')
+                return closeContainer(c);
+            return beginValue(c);
+
+        case State::FirstKey:
+        case State::Key:
+            if (isSpace(c))
+                return true;
+            if (c == '}' && m_State == State::FirstKey)
+                return closeContainer(c);
+            if (c != '"')
+                return fail("expected a key");
+            m_InKey = true;
+            m_Collect = m_Stack.back().tracked;
+            m_Token.clear();
+            m_State = State::String;
+            return true;
+
+        case State::Colon:
+            if (isSpace(c))
+                return true;
+            if (c != ':')
+                return fail("expected ':'");
+            m_State = State::Value;
+            return true;
+
+        case State::String:
+            if (m_Escape > 0)
+                return escape(c);
+            if (c == '\\')
+            {
+                m_Escape = 1;
+                return true;
+            }
+            // The closing quote, other characters are taken in feed().
+            if (m_HighSurrogate != 0)
+                return fail("unpaired surrogate");
+            if (m_InKey)
+            {
+                m_InKey = false;
+                if (m_Collect)
+                    m_Key.swap(m_Token);
+                m_State = State::Colon;
+                return true;
+            }
+            if (m_Capture >= 0)
+                store(Type::String);
+            endValue();
+            return true;
+
+        case State::Scalar:
+            if (isScalar(c))
+            {
+                m_Token += c;
+                return true;
+            }
+            if (!endScalar())
+                return false;
+            return step(c);
+
+        case State::AfterValue:
+            if (isSpace(c))
+                return true;
+            if (c == ',')
+            {
+                Frame &frame = m_Stack.back();
+                if (frame.array)
+                {
+                    ++frame.index;
+                    m_State = State::Value;
+                }
+                else
+                    m_State = State::Key;
+                return true;
+            }
+            if (c == '}' || c == ']')
+                return closeContainer(c);
+            return fail("expected ',' or the end of a container");
+
+        case State::Done:
+            if (isSpace(c))
+                return true;
+            return fail("data after the document");
+
+        case State::Error:
+            return false;
+    }
+    return false;
+}
+
+bool JsonFields::beginValue(char c)
+{
+    const bool parentTracked = m_Stack.empty() || m_Stack.back().tracked;
+    const size_t restore = m_Path.size();
+    if (parentTracked && !m_Stack.empty())
+    {
+        const Frame &parent = m_Stack.back();
+        if (parent.array)
+        {
+            m_Path += '[';
+            m_Path += std::to_string(parent.index);
+            m_Path += ']';
+        }
+        else
+        {
+            if (!m_Path.empty())
+                m_Path += '.';
+            m_Path += m_Key;
+        }
+    }
+
+    if (c == '{' || c == '[')
+    {
+        const bool tracked = parentTracked && (m_Stack.empty() || m_Prefixes.count(m_Path) > 0);
+        m_Stack.push_back({c == '[', tracked, 0, restore});
+        m_State = c == '[' ? State::FirstElement : State::FirstKey;
+        return true;
+    }
+
+    m_Capture = -1;
+    if (parentTracked)
+    {
+        auto subscribed = m_Subscribed.find(m_Path);
+        if (subscribed != m_Subscribed.end())
+            m_Capture = static_cast<long>(subscribed->second);
+    }
+    m_Restore = restore;
+    m_Token.clear();
+
+    if (c == '"')
+    {
+        m_InKey = false;
+        m_Collect = m_Capture >= 0;
+        m_State = State::String;
+        return true;
+    }
+    if (!isScalar(c))
+        return fail("expected a value");
+    m_Token += c;
+    m_State = State::Scalar;
+    return true;
+}
+
+void JsonFields::endValue()
+{
+    m_Path.resize(m_Restore);
+    m_State = m_Stack.empty() ? State::Done : State::AfterValue;
+}
+
+bool JsonFields::endScalar()
+{
+    // A number nobody subscribed to is only checked for what it starts with.
+    const char first = m_Token[0];
+    if (m_Capture < 0 && (first == '-' || (first >= '0' && first <= '9')))
+    {
+        endValue();
+        return true;
+    }
+    if (m_Token == "true" || m_Token == "false")
+    {
+        if (m_Capture >= 0)
+        {
+            m_Fields[m_Capture].boolean = m_Token == "true";
+            store(Type::Bool);
+        }
+    }
+    else if (m_Token == "null")
+    {
+        if (m_Capture >= 0)
+            store(Type::Null);
+    }
+    else
+    {
+        // Only numbers are left; strtod() takes more than JSON does, but not
+        // less, and what it takes of a bad number is not worth refusing.
+        char *end = nullptr;
+        const double value = strtod(m_Token.c_str(), &end);
+        if (end == m_Token.c_str() || *end != '\0')
+            return fail("bad number or literal");
+        if (m_Capture >= 0)
+        {
+            m_Fields[m_Capture].number = value;
+            store(Type::Number);
+        }
+    }
+    endValue();
+    return true;
+}
+
+void JsonFields::store(Type type)
+{
+    Field &field = m_Fields[m_Capture];
+    field.type = type;
+    field.text.swap(m_Token);
+    m_Token.clear();
+}
+
+bool JsonFields::closeContainer(char c)
+{
+    const Frame frame = m_Stack.back();
+    if (frame.array != (c == ']'))
+        return fail("mismatched bracket");
+    m_Stack.pop_back();
+    m_Restore = frame.restore;
+    endValue();
+    return true;
+}
+
+bool JsonFields::escape(char c)
+{
+    if (m_Escape == 1)
+    {
+        m_Escape = 0;
+        char decoded;
+        switch (c)
+        {
+            case '"':
+            case '\\':
+            case '/':
+                decoded = c;
+                break;
+            case 'b':
+                decoded = '\b';
+                break;
+            case 'f':
+                decoded = '\f';
+                break;
+            case 'n':
+                decoded = '\n';
+                break;
+            case 'r':
+                decoded = '\r';
+                break;
+            case 't':
+                decoded = '\t';
+                break;
+            case 'u':
+                m_Escape = 2;
+                m_Unicode = 0;
+                return true;
+            default:
+                return fail("bad escape");
+        }
+        if (m_HighSurrogate != 0)
+            return fail("unpaired surrogate");
+        if (m_Collect)
+            m_Token += decoded;
+        return true;
+    }
+
+    const int digit = hexDigit(c);
+    if (digit < 0)
+        return fail("bad \\u escape");
+    m_Unicode = m_Unicode << 4 | static_cast<unsigned>(digit);
+    if (++m_Escape < 6)
+        return true;
+    m_Escape = 0;
+
+    if (m_Unicode >= 0xD800 && m_Unicode < 0xDC00)
+    {
+        if (m_HighSurrogate != 0)
+            return fail("unpaired surrogate");
+        m_HighSurrogate = m_Unicode;
+        return true;
+    }
+    if (m_Unicode >= 0xDC00 && m_Unicode < 0xE000)
+    {
+        if (m_HighSurrogate == 0)
+            return fail("unpaired surrogate");
+        m_Unicode = 0x10000 + ((m_HighSurrogate - 0xD800) << 10) + (m_Unicode - 0xDC00);
+        m_HighSurrogate = 0;
+    }
+    else if (m_HighSurrogate != 0)
+        return fail("unpaired surrogate");
+    if (m_Collect)
+        appendUtf8(m_Unicode);
+    return true;
+}
+
+void JsonFields::appendUtf8(unsigned codepoint)
+{
+    if (codepoint < 0x80)
+        m_Token += static_cast<char>(codepoint);
+    else if (codepoint < 0x800)
+    {
+        m_Token += static_cast<char>(0xC0 | codepoint >> 6);
+        m_Token += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        m_Token += static_cast<char>(0xE0 | codepoint >> 12);
+        m_Token += static_cast<char>(0x80 | (codepoint >> 6 & 0x3F));
+        m_Token += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        m_Token += static_cast<char>(0xF0 | codepoint >> 18);
+        m_Token += static_cast<char>(0x80 | (codepoint >> 12 & 0x3F));
+        m_Token += static_cast<char>(0x80 | (codepoint >> 6 & 0x3F));
+        m_Token += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Takes the few fields a driver wants out of a JSON document as it
+ * arrives, without building the document.
+ *
+ * A device answering a status request with a few kilobytes of JSON usually
+ * has a handful of values the driver publishes. Parsing the whole answer into
+ * a DOM allocates a node, a string and a map entry for everything in it, on
+ * the event loop, to read five numbers. Here the fields are subscribed by
+ * path once, the body is fed as it comes off the socket, in pieces of any
+ * size, and only the subscribed values are kept; objects and arrays no
+ * subscription goes into are only scanned for their end.
+ *
+ * Paths join object keys with '.' and array elements with [n], from the
+ * root: "status.temperature", "axes[1].position", "[0].name". Keys holding a
+ * '.' or a '[' cannot be subscribed. Not thread safe.
+ */
+class JsonFields
+{
+public:
+    enum class Type
+    {
+        Missing,
+        Null,
+        Bool,
+        Number,
+        String
+    };
+
+    struct Field
+    {
+        std::string path;
+        Type type {Type::Missing};
+        bool boolean {false};
+        double number {0};
+        /** A string decoded, a number as written. */
+        std::string text;
+    };
+
+    /** @brief Keep the value at path from the documents fed. @return its index for field(). */
+    size_t subscribe(const std::string &path);
+
+    /** @brief Start a new document, the fields go back to Missing. */
+    void reset();
+
+    /** @brief Take the next piece of the document. False once it is not JSON. */
+    bool feed(const char *data, size_t length);
+
+    bool feed(const std::string &data)
+    {
+        return feed(data.data(), data.size());
+    }
+
+    /** @brief The document is over. False if it was incomplete or not JSON. */
+    bool finish();
+
+    const Field &field(size_t index) const
+    {
+        return m_Fields[index];
+    }
+
+    bool has(size_t index) const
+    {
+        return m_Fields[index].type != Type::Missing && m_Fields[index].type != Type::Null;
+    }
+
+    /** @brief The number at index, fallback if it is not a number. */
+    double number(size_t index, double fallback = 0) const
+    {
+        return m_Fields[index].type == Type::Number ? m_Fields[index].number : fallback;
+    }
+
+    size_t size() const
+    {
+        return m_Fields.size();
+    }
+
+    /** @brief Why feed() or finish() failed. */
+    const std::string &error() const
+    {
+        return m_Error;
+    }
+
+private:
+    enum class State
+    {
+        Value,
+        // After '[': a value or ']'.
+        FirstElement,
+        // After '{': a key or '}'.
+        FirstKey,
+        // After ',' in an object.
+        Key,
+        Colon,
+        String,
+        Scalar,
+        AfterValue,
+        Done,
+        Error
+    };
+
+    struct Frame
+    {
+        bool array;
+        bool tracked;
+        size_t index;
+        // m_Path before the segment of this container was appended.
+        size_t restore;
+    };
+
+    bool step(char c);
+    bool beginValue(char c);
+    void endValue();
+    bool endScalar();
+    void store(JsonFields::Type type);
+    bool closeContainer(char c);
+    bool escape(char c);
+    void appendUtf8(unsigned codepoint);
+    bool fail(const char *why);
+
+    std::vector<Field> m_Fields;
+    std::unordered_map<std::string, size_t> m_Subscribed;
+    // Every path a subscription goes through, the containers worth entering.
+    std::unordered_set<std::string> m_Prefixes;
+
+    State m_State {State::Value};
+    std::vector<Frame> m_Stack;
+    std::string m_Path;
+    std::string m_Key;
+    std::string m_Token;
+
+    // The string or scalar being read.
+    bool m_InKey {false};
+    bool m_Collect {false};
+    long m_Capture {-1};
+    size_t m_Restore {0};
+    // 0 outside an escape, 1 after '\', 2 to 5 in the hex digits of \u.
+    int m_Escape {0};
+    unsigned m_Unicode {0};
+    unsigned m_HighSurrogate {0};
+
+    std::string m_Error;
+};
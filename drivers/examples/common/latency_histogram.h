@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Fixed memory histogram of latencies for percentiles over long runs.
+ *
+ * Values below 32 are counted exactly, above that every power of two is split
+ * into 32 buckets, so a reported percentile is within about 3% of the true one
+ * whatever the range. Recording is a couple of instructions and never allocates.
+ * Not thread safe, merge() per thread histograms instead.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() : m_Buckets(BucketCount, 0) {}
+
+    void record(uint64_t value)
+    {
+        ++m_Buckets[index(value)];
+        ++m_Count;
+        m_Sum += value;
+        m_Min = std::min(m_Min, value);
+        m_Max = std::max(m_Max, value);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < BucketCount; ++i)
+            m_Buckets[i] += other.m_Buckets[i];
+        m_Count += other.m_Count;
+        m_Sum += other.m_Sum;
+        m_Min = std::min(m_Min, other.m_Min);
+        m_Max = std::max(m_Max, other.m_Max);
+    }
+
+    void reset()
+    {
+        std::fill(m_Buckets.begin(), m_Buckets.end(), 0);
+        m_Count = m_Sum = m_Max = 0;
+        m_Min = UINT64_MAX;
+    }
+
+    uint64_t count() const
+    {
+        return m_Count;
+    }
+
+    uint64_t min() const
+    {
+        return m_Count > 0 ? m_Min : 0;
+    }
+
+    uint64_t max() const
+    {
+        return m_Max;
+    }
+
+    double mean() const
+    {
+        return m_Count > 0 ? static_cast<double>(m_Sum) / m_Count : 0;
+    }
+
+    /** @brief Value below which p percent (0..100) of the recorded values are. */
+    uint64_t percentile(double p) const
+    {
+        if (m_Count == 0)
+            return 0;
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * m_Count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            seen += m_Buckets[i];
+            if (seen >= rank)
+                return std::min(upperBound(i), m_Max);
+        }
+        return m_Max;
+    }
+
+private:
+    static constexpr int SubBits = 5;
+    static constexpr uint64_t SubCount = 1 << SubBits;
+    static constexpr size_t BucketCount = (64 - SubBits + 1) * SubCount;
+
+    static size_t index(uint64_t value)
+    {
+        if (value < SubCount)
+            return value;
+        const int msb = 63 - __builtin_clzll(value);
+        const int group = msb - SubBits + 1;
+        return group * SubCount + ((value >> (msb - SubBits)) - SubCount);
+    }
+
+    static uint64_t upperBound(size_t index)
+    {
+        if (index < SubCount)
+            return index;
+        const size_t group = index / SubCount;
+        const uint64_t sub = index % SubCount;
+        return ((SubCount + sub + 1) << (group - 1)) - 1;
+    }
+
+    std::vector<uint64_t> m_Buckets;
+    uint64_t m_Count {0};
+    uint64_t m_Sum {0};
+    uint64_t m_Min {UINT64_MAX};
+    uint64_t m_Max {0};
+};
@@ -0,0 +1,667 @@
+#include "modbus_transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Modbus
+{
+
+namespace
+{
+
+// Transaction id, protocol id, length, unit id.
+const size_t HeaderLength = 7;
+// The length field counts the unit id and the PDU, which is at most 253 bytes.
+const uint16_t MaxFrameLength = 254;
+
+enum Exception : uint8_t
+{
+    IllegalFunction = 1,
+    IllegalAddress = 2,
+    IllegalValue = 3
+};
+
+uint16_t get16(const uint8_t *bytes)
+{
+    return static_cast<uint16_t>(bytes[0] << 8 | bytes[1]);
+}
+
+void put16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value & 0xff));
+}
+
+bool earlier(const Request &a, const Request &b)
+{
+    return a.table != b.table ? a.table < b.table : a.address < b.address;
+}
+
+std::string describe(const char *what, const Request &request)
+{
+    char text[96];
+    snprintf(text, sizeof(text), "%s reading %u %s registers at %u", what, request.count,
+             request.table == HoldingRegisters ? "holding" : "input", request.address);
+    return text;
+}
+
+}
+
+// -- PollPlan ---------------------------------------------------------------
+
+PollPlan::PollPlan(uint16_t maxGap, uint16_t maxCount)
+    : m_MaxGap(maxGap), m_MaxCount(std::max<uint16_t>(1, std::min(maxCount, MaxReadCount)))
+{
+}
+
+void PollPlan::add(Table table, uint16_t address, uint16_t count)
+{
+    if (count == 0)
+        return;
+    m_Wanted.push_back({table, address, static_cast<uint16_t>(std::min<uint32_t>(count, 65536u - address))});
+    m_Planned = false;
+}
+
+void PollPlan::clear()
+{
+    m_Wanted.clear();
+    m_Planned = false;
+}
+
+const std::vector<Request> &PollPlan::requests()
+{
+    if (!m_Planned)
+        plan();
+    return m_Requests;
+}
+
+void PollPlan::plan()
+{
+    std::vector<Request> wanted = m_Wanted;
+    std::sort(wanted.begin(), wanted.end(), earlier);
+
+    m_Requests.clear();
+    for (const Request &range : wanted)
+    {
+        uint32_t start = range.address;
+        const uint32_t end = start + range.count;
+        if (!m_Requests.empty() && m_Requests.back().table == range.table)
+        {
+            Request &last = m_Requests.back();
+            const uint32_t lastEnd = last.address + last.count;
+            if (end <= lastEnd)
+                continue;
+            // Reading the gap is cheaper than another round trip. What does
+            // not fit in the request goes on in the next.
+            const uint32_t room = last.address + m_MaxCount;
+            if (start <= lastEnd + m_MaxGap && start < room)
+            {
+                last.count = static_cast<uint16_t>(std::min(end, room) - last.address);
+                start = std::max(start, room);
+            }
+        }
+        while (start < end)
+        {
+            const uint32_t count = std::min<uint32_t>(end - start, m_MaxCount);
+            m_Requests.push_back({range.table, static_cast<uint16_t>(start), static_cast<uint16_t>(count)});
+            start += count;
+        }
+    }
+
+    m_Offsets.resize(m_Requests.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < m_Requests.size(); ++i)
+    {
+        m_Offsets[i] = offset;
+        offset += m_Requests[i].count;
+    }
+    m_Values.assign(offset, 0);
+    m_Stored.assign(m_Requests.size(), false);
+    m_Planned = true;
+}
+
+void PollPlan::store(size_t index, const uint16_t *values)
+{
+    if (!m_Planned || index >= m_Requests.size())
+        return;
+    std::copy(values, values + m_Requests[index].count, m_Values.begin() + m_Offsets[index]);
+    m_Stored[index] = true;
+}
+
+void PollPlan::invalidate()
+{
+    std::fill(m_Stored.begin(), m_Stored.end(), false);
+}
+
+bool PollPlan::value(Table table, uint16_t address, uint16_t &out) const
+{
+    if (!m_Planned)
+        return false;
+    // The last request starting at or before the address.
+    const Request key {table, address, 1};
+    auto it = std::upper_bound(m_Requests.begin(), m_Requests.end(), key, earlier);
+    if (it == m_Requests.begin())
+        return false;
+    --it;
+    const size_t index = static_cast<size_t>(it - m_Requests.begin());
+    if (it->table != table || address >= it->address + it->count || !m_Stored[index])
+        return false;
+    out = m_Values[m_Offsets[index] + (address - it->address)];
+    return true;
+}
+
+size_t PollPlan::wanted() const
+{
+    // Overlapping ranges count once.
+    std::vector<Request> wanted = m_Wanted;
+    std::sort(wanted.begin(), wanted.end(), earlier);
+    size_t total = 0;
+    uint32_t covered = 0;
+    Table table = HoldingRegisters;
+    for (size_t i = 0; i < wanted.size(); ++i)
+    {
+        uint32_t start = wanted[i].address;
+        const uint32_t end = start + wanted[i].count;
+        if (i > 0 && wanted[i].table == table)
+            start = std::max(start, covered);
+        else
+            covered = 0;
+        if (end > start)
+            total += end - start;
+        covered = std::max(covered, end);
+        table = wanted[i].table;
+    }
+    return total;
+}
+
+size_t PollPlan::read() const
+{
+    size_t total = 0;
+    for (const Request &request : m_Requests)
+        total += request.count;
+    return total;
+}
+
+// -- TcpClient --------------------------------------------------------------
+
+TcpClient::TcpClient(int fd, const Options &options) : m_Fd(fd), m_Options(options)
+{
+    m_Options.window = std::max<size_t>(1, m_Options.window);
+}
+
+void TcpClient::appendHeader(std::vector<uint8_t> &out, uint16_t transaction, uint16_t length) const
+{
+    put16(out, transaction);
+    put16(out, 0);
+    put16(out, length);
+    out.push_back(m_Options.unit);
+}
+
+long TcpClient::frameLength() const
+{
+    if (m_Buffer.size() < HeaderLength)
+        return 0;
+    const uint16_t length = get16(&m_Buffer[4]);
+    if (get16(&m_Buffer[2]) != 0 || length < 3 || length > MaxFrameLength)
+        return -1;
+    const size_t total = 6 + length;
+    return m_Buffer.size() >= total ? static_cast<long>(total) : 0;
+}
+
+bool TcpClient::fill(Clock::time_point deadline, std::string &error)
+{
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    pollfd fd {m_Fd, POLLIN, 0};
+    const int ready = left > 0 ? ::poll(&fd, 1, static_cast<int>(left) + 1) : 0;
+    if (ready < 0 && errno == EINTR)
+        return true;
+    if (ready == 0)
+    {
+        ++m_Stats.timeouts;
+        error = "timeout";
+        return false;
+    }
+    if (ready < 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    uint8_t bytes[4096];
+    const ssize_t n = ::read(m_Fd, bytes, sizeof(bytes));
+    if (n <= 0)
+    {
+        error = n == 0 ? "connection closed" : strerror(errno);
+        return false;
+    }
+    m_Buffer.insert(m_Buffer.end(), bytes, bytes + n);
+    return true;
+}
+
+bool TcpClient::nextFrame(Clock::time_point deadline, size_t &length, std::string &error)
+{
+    long frame;
+    while ((frame = frameLength()) == 0)
+    {
+        if (!fill(deadline, error))
+            return false;
+    }
+    if (frame < 0)
+    {
+        // Nothing after this can be trusted to start on a frame.
+        m_Buffer.clear();
+        m_Framed = false;
+        error = "garbled answer";
+        return false;
+    }
+    length = static_cast<size_t>(frame);
+    return true;
+}
+
+bool TcpClient::writeAll(const std::vector<uint8_t> &bytes, std::string &error)
+{
+    size_t written = 0;
+    while (written < bytes.size())
+    {
+        const ssize_t n = ::write(m_Fd, bytes.data() + written, bytes.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            error = strerror(errno);
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool TcpClient::poll(PollPlan &plan, std::string &error)
+{
+    const std::vector<Request> &requests = plan.requests();
+    plan.invalidate();
+    ++m_Stats.polls;
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(m_Options.timeoutMs);
+    std::vector<InFlight> inFlight;
+    std::vector<uint8_t> out;
+    std::vector<uint16_t> values;
+    size_t next = 0, answered = 0;
+    bool ok = true;
+
+    while (answered < requests.size())
+    {
+        // Top the window up, all in one write.
+        out.clear();
+        while (next < requests.size() && inFlight.size() < m_Options.window)
+        {
+            const Request &request = requests[next];
+            const uint16_t transaction = m_NextTransaction++;
+            appendHeader(out, transaction, 6);
+            out.push_back(request.table);
+            put16(out, request.address);
+            put16(out, request.count);
+            inFlight.push_back({transaction, next++});
+            ++m_Stats.requests;
+        }
+        if (!out.empty() && !writeAll(out, error))
+            return false;
+
+        size_t length = 0;
+        if (!nextFrame(deadline, length, error))
+        {
+            m_Owed += inFlight.size();
+            return false;
+        }
+
+        const uint8_t *frame = m_Buffer.data();
+        const uint16_t transaction = get16(frame);
+        auto match = std::find_if(inFlight.begin(), inFlight.end(), [transaction](const InFlight & pending)
+        {
+            return pending.transaction == transaction;
+        });
+        if (match == inFlight.end())
+        {
+            ++m_Stats.stray;
+            if (m_Owed > 0)
+                --m_Owed;
+            m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + length);
+            continue;
+        }
+
+        const size_t index = match->index;
+        const Request &request = requests[index];
+        inFlight.erase(match);
+        ++answered;
+
+        const uint8_t function = frame[7];
+        if (function == (request.table | 0x80))
+        {
+            ++m_Stats.exceptions;
+            if (ok)
+                error = describe(("exception " + std::to_string(frame[8])).c_str(), request);
+            ok = false;
+        }
+        else if (function != request.table || length != 9 + 2u * request.count || frame[8] != 2 * request.count)
+        {
+            if (ok)
+                error = describe("malformed answer", request);
+            ok = false;
+        }
+        else
+        {
+            values.resize(request.count);
+            for (size_t i = 0; i < request.count; ++i)
+                values[i] = get16(frame + 9 + 2 * i);
+            plan.store(index, values.data());
+        }
+        m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + length);
+    }
+    return ok;
+}
+
+bool TcpClient::writeRegisters(uint16_t address, const uint16_t *values, uint16_t count, std::string &error)
+{
+    if (count == 0 || count > 123)
+    {
+        error = "1 to 123 registers per write";
+        return false;
+    }
+
+    const uint16_t transaction = m_NextTransaction++;
+    std::vector<uint8_t> out;
+    appendHeader(out, transaction, static_cast<uint16_t>(7 + 2 * count));
+    out.push_back(16);
+    put16(out, address);
+    put16(out, count);
+    out.push_back(static_cast<uint8_t>(2 * count));
+    for (uint16_t i = 0; i < count; ++i)
+        put16(out, values[i]);
+    if (!writeAll(out, error))
+        return false;
+    ++m_Stats.requests;
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(m_Options.timeoutMs);
+    for (;;)
+    {
+        size_t length = 0;
+        if (!nextFrame(deadline, length, error))
+        {
+            ++m_Owed;
+            return false;
+        }
+        const uint8_t *frame = m_Buffer.data();
+        const bool mine = get16(frame) == transaction;
+        const uint8_t function = frame[7];
+        const uint8_t code = length > 8 ? frame[8] : 0;
+        m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + length);
+        if (!mine)
+        {
+            ++m_Stats.stray;
+            if (m_Owed > 0)
+                --m_Owed;
+            continue;
+        }
+        if (function == 16)
+            return true;
+        if (function == (16 | 0x80))
+        {
+            ++m_Stats.exceptions;
+            error = "exception " + std::to_string(code) + " writing " + std::to_string(count) + " registers at " +
+                    std::to_string(address);
+        }
+        else
+            error = "malformed answer to a write";
+        return false;
+    }
+}
+
+bool TcpClient::settle(int waitMs, std::string &error)
+{
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(waitMs);
+    while (m_Framed && (m_Owed > 0 || !m_Buffer.empty()))
+    {
+        size_t length = 0;
+        if (!nextFrame(deadline, length, error))
+            return false;
+        m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + length);
+        ++m_Stats.stray;
+        if (m_Owed > 0)
+            --m_Owed;
+    }
+    if (!m_Framed)
+    {
+        error = "lost the framing";
+        return false;
+    }
+    return true;
+}
+
+// -- StandInServer ----------------------------------------------------------
+
+StandInServer::StandInServer(const Options &options)
+    : m_Options(options), m_Holding(options.registers, 0), m_Input(options.registers, 0)
+{
+    m_Listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(options.port);
+    socklen_t length = sizeof(address);
+    if (bind(m_Listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            ::listen(m_Listener, 4) < 0 ||
+            getsockname(m_Listener, reinterpret_cast<sockaddr *>(&address), &length) < 0 ||
+            pipe(m_Wake) < 0)
+    {
+        close(m_Listener);
+        m_Listener = -1;
+        return;
+    }
+    m_Port = ntohs(address.sin_port);
+    m_Thread = std::thread([this]
+    {
+        run();
+    });
+}
+
+StandInServer::~StandInServer()
+{
+    if (m_Thread.joinable())
+    {
+        const char stop = 0;
+        if (write(m_Wake[1], &stop, 1) < 0)
+        {
+            // The thread still stops on the closed pipe below.
+        }
+        m_Thread.join();
+    }
+    for (int fd : {m_Listener, m_Wake[0], m_Wake[1]})
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void StandInServer::set(Table table, uint16_t address, uint16_t value)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<uint16_t> &registers = table == HoldingRegisters ? m_Holding : m_Input;
+    if (address < registers.size())
+        registers[address] = value;
+}
+
+uint16_t StandInServer::get(Table table, uint16_t address) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const std::vector<uint16_t> &registers = table == HoldingRegisters ? m_Holding : m_Input;
+    return address < registers.size() ? registers[address] : 0;
+}
+
+std::vector<uint8_t> StandInServer::handle(const uint8_t *pdu, size_t length)
+{
+    const uint8_t unit = pdu[0];
+    const uint8_t function = length > 1 ? pdu[1] : 0;
+    std::vector<uint8_t> answer {unit, function};
+    auto exception = [&](Exception code)
+    {
+        return std::vector<uint8_t> {unit, static_cast<uint8_t>(function | 0x80), code};
+    };
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const uint32_t size = m_Options.registers;
+    switch (function)
+    {
+        case HoldingRegisters:
+        case InputRegisters:
+        {
+            if (length != 6)
+                return exception(IllegalValue);
+            const uint16_t address = get16(pdu + 2), count = get16(pdu + 4);
+            if (count < 1 || count > MaxReadCount)
+                return exception(IllegalValue);
+            if (uint32_t(address) + count > size)
+                return exception(IllegalAddress);
+            const std::vector<uint16_t> &registers = function == HoldingRegisters ? m_Holding : m_Input;
+            answer.push_back(static_cast<uint8_t>(2 * count));
+            for (uint16_t i = 0; i < count; ++i)
+                put16(answer, registers[address + i]);
+            return answer;
+        }
+        case 6:
+        {
+            if (length != 6)
+                return exception(IllegalValue);
+            const uint16_t address = get16(pdu + 2);
+            if (address >= size)
+                return exception(IllegalAddress);
+            m_Holding[address] = get16(pdu + 4);
+            return std::vector<uint8_t>(pdu, pdu + length);
+        }
+        case 16:
+        {
+            if (length < 7)
+                return exception(IllegalValue);
+            const uint16_t address = get16(pdu + 2), count = get16(pdu + 4);
+            if (count < 1 || count > 123 || pdu[6] != 2 * count || length != 7 + 2u * count)
+                return exception(IllegalValue);
+            if (uint32_t(address) + count > size)
+                return exception(IllegalAddress);
+            for (uint16_t i = 0; i < count; ++i)
+                m_Holding[address + i] = get16(pdu + 7 + 2 * i);
+            return std::vector<uint8_t>(pdu, pdu + 6);
+        }
+        default:
+            return exception(IllegalFunction);
+    }
+}
+
+void StandInServer::run()
+{
+    int client = -1;
+    std::vector<uint8_t> in;
+    std::deque<Pending> pending;
+    Clock::time_point scanFree;
+
+    auto drop = [&]
+    {
+        if (client >= 0)
+            close(client);
+        client = -1;
+        in.clear();
+        pending.clear();
+    };
+
+    for (;;)
+    {
+        pollfd fds[3] = {{m_Wake[0], POLLIN, 0}, {m_Listener, POLLIN, 0}, {client, POLLIN, 0}};
+        timespec timeout {0, 0};
+        timespec *wait = nullptr;
+        if (!pending.empty())
+        {
+            const auto left = std::max(Clock::duration::zero(), pending.front().due - Clock::now());
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+            timeout.tv_sec = static_cast<time_t>(ns / 1000000000);
+            timeout.tv_nsec = static_cast<long>(ns % 1000000000);
+            wait = &timeout;
+        }
+        if (ppoll(fds, client >= 0 ? 3 : 2, wait, nullptr) < 0 && errno != EINTR)
+            break;
+        if (fds[0].revents)
+            break;
+
+        if (fds[1].revents & POLLIN)
+        {
+            const int accepted = accept(m_Listener, nullptr, nullptr);
+            if (accepted >= 0)
+            {
+                drop();
+                client = accepted;
+                int on = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+        }
+
+        if (client >= 0 && (fds[2].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            uint8_t bytes[4096];
+            const ssize_t n = read(client, bytes, sizeof(bytes));
+            if (n <= 0)
+                drop();
+            else
+            {
+                in.insert(in.end(), bytes, bytes + n);
+                const Clock::time_point now = Clock::now();
+                while (in.size() >= HeaderLength)
+                {
+                    const uint16_t length = get16(&in[4]);
+                    if (get16(&in[2]) != 0 || length < 2 || length > MaxFrameLength)
+                    {
+                        drop();
+                        break;
+                    }
+                    if (in.size() < 6u + length)
+                        break;
+
+                    // The request travels for half the latency, waits for the
+                    // scan of the ones before it, and the answer travels back.
+                    const std::vector<uint8_t> answer = handle(&in[6], length);
+                    const Clock::time_point arrives = now + m_Options.latency / 2;
+                    scanFree = std::max(arrives, scanFree) + m_Options.scanTime;
+                    Pending reply {scanFree + m_Options.latency / 2, {in[0], in[1], 0, 0}};
+                    put16(reply.answer, static_cast<uint16_t>(answer.size()));
+                    reply.answer.insert(reply.answer.end(), answer.begin(), answer.end());
+                    pending.push_back(std::move(reply));
+                    ++m_Requests;
+                    in.erase(in.begin(), in.begin() + 6 + length);
+                }
+            }
+        }
+
+        const Clock::time_point now = Clock::now();
+        while (client >= 0 && !pending.empty() && pending.front().due <= now)
+        {
+            const std::vector<uint8_t> &answer = pending.front().answer;
+            if (write(client, answer.data(), answer.size()) != static_cast<ssize_t>(answer.size()))
+            {
+                drop();
+                break;
+            }
+            pending.pop_front();
+        }
+    }
+    drop();
+}
+
+}
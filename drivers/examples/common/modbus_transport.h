@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Polling many Modbus registers in few round trips: a plan that merges
+ * the registers a driver polls into the fewest read requests, a Modbus TCP
+ * client that keeps several of them in flight, and a stand-in server to run
+ * both against without a device.
+ *
+ * Every request is a round trip, and on a PLC or a TCP to RS-485 gateway the
+ * round trip costs far more than the registers it carries. Reading 40
+ * scattered registers one call at a time is 40 round trips; merged into the
+ * runs they fall in, and with a few registers nobody asked for read to bridge
+ * small gaps, it is a handful. Modbus TCP matches answers to requests by the
+ * transaction id of the MBAP header, so those can also be written back to
+ * back instead of one after the other's answer.
+ *
+ * The plan does not care how its requests are sent. Over Modbus RTU, or with
+ * nanomodbus, read each of plan.requests() and store() the result.
+ */
+namespace Modbus
+{
+
+/** @brief The register tables, by the function code that reads them. */
+enum Table : uint8_t
+{
+    HoldingRegisters = 3,
+    InputRegisters = 4
+};
+
+/** @brief Registers one read request of function 3 or 4 may ask for. */
+const uint16_t MaxReadCount = 125;
+
+struct Request
+{
+    Table table;
+    uint16_t address;
+    uint16_t count;
+};
+
+/**
+ * @brief The registers a driver polls, merged into read requests, and their
+ * values from the last poll.
+ */
+class PollPlan
+{
+public:
+    /**
+     * @param maxGap registers nobody asked for a request may read to reach the
+     * next ones instead of starting a new request. Devices that answer unmapped
+     * addresses with an exception need 0.
+     * @param maxCount registers per request, at most MaxReadCount.
+     */
+    explicit PollPlan(uint16_t maxGap = 8, uint16_t maxCount = MaxReadCount);
+
+    /** @brief Poll count registers from address on. */
+    void add(Table table, uint16_t address, uint16_t count = 1);
+
+    void clear();
+
+    /** @brief The read requests, planned again after add() or clear(). */
+    const std::vector<Request> &requests();
+
+    /** @brief Take the values read for request index, requests()[index].count of them. */
+    void store(size_t index, const uint16_t *values);
+
+    /** @brief Forget the values, before a poll. */
+    void invalidate();
+
+    /** @brief The last value read of a register. False if it is not polled or was not read. */
+    bool value(Table table, uint16_t address, uint16_t &out) const;
+
+    /** @brief Registers asked for, and read by the requests with the gaps. */
+    size_t wanted() const;
+    size_t read() const;
+
+private:
+    void plan();
+
+    uint16_t m_MaxGap;
+    uint16_t m_MaxCount;
+    std::vector<Request> m_Wanted;
+    bool m_Planned {true};
+
+    std::vector<Request> m_Requests;
+    // Where the values of each request start in m_Values.
+    std::vector<size_t> m_Offsets;
+    std::vector<uint16_t> m_Values;
+    std::vector<bool> m_Stored;
+};
+
+/**
+ * @brief Reads the requests of a PollPlan over Modbus TCP with up to window
+ * of them in flight, and writes holding registers.
+ *
+ * The socket is the caller's, the PortFD of an INDI TCP connection for
+ * example, and may also be used by nanomodbus between polls. Answers are
+ * matched by transaction id, so they may come in any order, and a late answer
+ * to a poll that timed out is skipped. A window of 1 is one request after the
+ * other, for servers that do not take pipelined requests. Not thread safe.
+ */
+class TcpClient
+{
+public:
+    struct Options
+    {
+        uint8_t unit {1};
+        /** Requests written before waiting for an answer. */
+        size_t window {8};
+        int timeoutMs {1000};
+    };
+
+    struct Stats
+    {
+        uint64_t polls {0};
+        uint64_t requests {0};
+        uint64_t exceptions {0};
+        uint64_t timeouts {0};
+        /** Answers to no request in flight, late ones after a timeout. */
+        uint64_t stray {0};
+    };
+
+    TcpClient(int fd, const Options &options);
+
+    /**
+     * @brief Read all the requests of the plan.
+     * @return false with the reason in error if one failed. The values of the
+     * requests answered are stored all the same.
+     */
+    bool poll(PollPlan &plan, std::string &error);
+
+    /** @brief Write count holding registers from address on, function 16. */
+    bool writeRegisters(uint16_t address, const uint16_t *values, uint16_t count, std::string &error);
+
+    /**
+     * @brief True when no answer is still due and nothing is left unread.
+     * After a timeout the late answers still come. poll() and
+     * writeRegisters() skip them, but anything else reading the socket, such
+     * as nanomodbus, takes them for its own. Call settle() first.
+     */
+    bool settled() const
+    {
+        return m_Owed == 0 && m_Buffer.empty() && m_Framed;
+    }
+
+    /**
+     * @brief Read and drop the late answers, waiting up to waitMs for them.
+     * @return false if they did not all come or the stream lost its framing.
+     * Then reconnect before anything else uses the socket.
+     */
+    bool settle(int waitMs, std::string &error);
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct InFlight
+    {
+        uint16_t transaction;
+        size_t index;
+    };
+
+    // The length of the answer at the start of m_Buffer, 0 if it is not all
+    // there yet, -1 if the bytes are not an MBAP frame.
+    long frameLength() const;
+    // The next whole answer, waiting for it until the deadline.
+    bool nextFrame(Clock::time_point deadline, size_t &length, std::string &error);
+    // Wait for bytes until the deadline. False on a timeout or a closed socket.
+    bool fill(Clock::time_point deadline, std::string &error);
+    bool writeAll(const std::vector<uint8_t> &bytes, std::string &error);
+    void appendHeader(std::vector<uint8_t> &out, uint16_t transaction, uint16_t length) const;
+
+    int m_Fd;
+    Options m_Options;
+    uint16_t m_NextTransaction {1};
+    // Bytes received past the last whole answer.
+    std::vector<uint8_t> m_Buffer;
+    // Answers to requests that timed out, still to come.
+    size_t m_Owed {0};
+    // False once bytes that are not a frame were dropped.
+    bool m_Framed {true};
+    Stats m_Stats;
+};
+
+/**
+ * @brief A Modbus TCP server on 127.0.0.1 with holding and input registers,
+ * that answers like a device behind a gateway: each request waits the round
+ * trip latency, and the requests are worked on one at a time for scanTime
+ * each, so requests in flight overlap their latency but not their scan.
+ *
+ * Answers functions 3, 4, 6 and 16, others with an illegal function
+ * exception, addresses past the registers with an illegal address one. Serves
+ * one client at a time, a new connection replaces the old one.
+ */
+class StandInServer
+{
+public:
+    struct Options
+    {
+        /** 0 for any free port. */
+        uint16_t port {0};
+        uint16_t registers {1024};
+        std::chrono::microseconds latency {2000};
+        std::chrono::microseconds scanTime {100};
+    };
+
+    explicit StandInServer(const Options &options);
+    ~StandInServer();
+
+    StandInServer(const StandInServer &) = delete;
+    StandInServer &operator=(const StandInServer &) = delete;
+
+    /** @brief False if it could not listen. */
+    bool listening() const
+    {
+        return m_Listener >= 0;
+    }
+
+    uint16_t port() const
+    {
+        return m_Port;
+    }
+
+    void set(Table table, uint16_t address, uint16_t value);
+    uint16_t get(Table table, uint16_t address) const;
+
+    /** @brief Requests answered. */
+    uint64_t requests() const
+    {
+        return m_Requests;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending
+    {
+        Clock::time_point due;
+        std::vector<uint8_t> answer;
+    };
+
+    void run();
+    // The answer to one request, from its unit id on.
+    std::vector<uint8_t> handle(const uint8_t *pdu, size_t length);
+
+    Options m_Options;
+    int m_Listener {-1};
+    int m_Wake[2] {-1, -1};
+    uint16_t m_Port {0};
+
+    mutable std::mutex m_Mutex;
+    std::vector<uint16_t> m_Holding;
+    std::vector<uint16_t> m_Input;
+
+    std::atomic<uint64_t> m_Requests {0};
+    std::thread m_Thread;
+};
+
+}
@@ -0,0 +1,194 @@
+#include "parallel_deflate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+#include "thread_pool.h"
+
+namespace
+{
+
+// Dictionary size of deflate.
+constexpr size_t WindowSize = 32768;
+
+// zlib: 2 byte header, 4 byte adler32. gzip: 10 byte header, 8 byte trailer.
+size_t headerSize(ParallelDeflate::Format format)
+{
+    return format == ParallelDeflate::Format::Gzip ? 10 : 2;
+}
+
+size_t trailerSize(ParallelDeflate::Format format)
+{
+    return format == ParallelDeflate::Format::Gzip ? 8 : 4;
+}
+
+size_t chunkCount(size_t size, size_t chunkSize)
+{
+    return std::max<size_t>(1, (size + chunkSize - 1) / chunkSize);
+}
+
+size_t chunkBound(size_t size)
+{
+    // deflateBound() for raw deflate plus room for the sync flush marker and
+    // the empty stored block zlib may add.
+    return size + (size >> 12) + (size >> 14) + (size >> 25) + 13 + 5 + 6;
+}
+
+void putBigEndian32(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+void putLittleEndian32(uint8_t *out, uint32_t value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+}
+
+struct Chunk
+{
+    const uint8_t *input;
+    size_t size;
+    // where this chunk was compressed to, and how much it produced
+    uint8_t *output;
+    size_t capacity;
+    size_t produced;
+    uint32_t check;
+    bool ok;
+};
+
+}
+
+size_t ParallelDeflate::bound(size_t size, const Options &options)
+{
+    const size_t chunkSize = std::max<size_t>(options.chunkSize, WindowSize);
+    const size_t chunks = chunkCount(size, chunkSize);
+    return headerSize(options.format) + trailerSize(options.format) + chunks * chunkBound(chunkSize);
+}
+
+size_t ParallelDeflate::compress(const void *input, size_t size, void *output, size_t capacity, const Options &options)
+{
+    if (capacity < bound(size, options))
+        return 0;
+
+    const uint8_t *in = static_cast<const uint8_t *>(input);
+    uint8_t *out = static_cast<uint8_t *>(output);
+    const size_t chunkSize = std::max<size_t>(options.chunkSize, WindowSize);
+    const size_t chunks = chunkCount(size, chunkSize);
+    const int level = std::min(9, std::max(1, options.level));
+    const bool gzip = options.format == Format::Gzip;
+
+    // Every chunk gets its own slot in the output buffer, sized for the worst case.
+    std::vector<Chunk> work(chunks);
+    uint8_t *slot = out + headerSize(options.format);
+    for (size_t i = 0; i < chunks; ++i)
+    {
+        work[i].input = in + i * chunkSize;
+        work[i].size = std::min(chunkSize, size - std::min(size, i * chunkSize));
+        work[i].output = slot;
+        work[i].capacity = chunkBound(chunkSize);
+        work[i].produced = 0;
+        work[i].ok = false;
+        slot += work[i].capacity;
+    }
+
+    auto deflateChunk = [&](size_t i)
+    {
+        Chunk &chunk = work[i];
+        const bool last = i + 1 == chunks;
+
+        chunk.check = gzip ? crc32(0L, chunk.input, chunk.size) : adler32(1L, chunk.input, chunk.size);
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return;
+
+        // Prime with the input in front of this chunk, it is right there in memory.
+        if (i > 0)
+        {
+            const size_t dictionary = std::min(WindowSize, i * chunkSize);
+            deflateSetDictionary(&stream, chunk.input - dictionary, dictionary);
+        }
+
+        stream.next_in = const_cast<Bytef *>(chunk.input);
+        stream.avail_in = chunk.size;
+        stream.next_out = chunk.output;
+        stream.avail_out = chunk.capacity;
+
+        const int rc = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        chunk.ok = last ? rc == Z_STREAM_END : (rc == Z_OK && stream.avail_in == 0);
+        chunk.produced = chunk.capacity - stream.avail_out;
+        deflateEnd(&stream);
+    };
+
+    ThreadPool &pool = options.pool ? *options.pool : ThreadPool::shared();
+    pool.parallelFor(chunks, deflateChunk);
+
+    // Header
+    uint8_t *p = out;
+    if (gzip)
+    {
+        const uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, static_cast<uint8_t>(level >= 9 ? 2 : level == 1 ? 4 : 0), 3 };
+        memcpy(p, header, sizeof(header));
+        p += sizeof(header);
+    }
+    else
+    {
+        // CMF: deflate with a 32K window. FLEVEL from the level, FCHECK makes it a multiple of 31.
+        const uint8_t cmf = 0x78;
+        uint8_t flg = static_cast<uint8_t>((level == 1 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+        flg += 31 - ((cmf * 256 + flg) % 31);
+        *p++ = cmf;
+        *p++ = flg;
+    }
+
+    // Move the chunks together and combine the checksums.
+    uint32_t check = gzip ? crc32(0L, Z_NULL, 0) : adler32(0L, Z_NULL, 0);
+    for (size_t i = 0; i < chunks; ++i)
+    {
+        const Chunk &chunk = work[i];
+        if (!chunk.ok)
+            return 0;
+        memmove(p, chunk.output, chunk.produced);
+        p += chunk.produced;
+        check = gzip ? crc32_combine(check, chunk.check, chunk.size) : adler32_combine(check, chunk.check, chunk.size);
+    }
+
+    // Trailer
+    if (gzip)
+    {
+        putLittleEndian32(p, check);
+        putLittleEndian32(p + 4, static_cast<uint32_t>(size));
+        p += 8;
+    }
+    else
+    {
+        putBigEndian32(p, check);
+        p += 4;
+    }
+
+    return p - out;
+}
+
+int ParallelDeflate::levelForLinkSpeed(double megabitsPerSecond)
+{
+    // Unknown or local: the transfer is nearly free, only cheap compression pays off.
+    if (megabitsPerSecond <= 0 || megabitsPerSecond >= 1000)
+        return 1;
+    if (megabitsPerSecond >= 300)
+        return 2;
+    if (megabitsPerSecond >= 80)
+        return 3;
+    if (megabitsPerSecond >= 20)
+        return 6;
+    return 9;
+}
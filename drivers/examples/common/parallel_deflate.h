@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class ThreadPool;
+
+/**
+ * @brief ParallelDeflate compresses a buffer on several cores and produces a single
+ * standard zlib (or gzip) stream, so ".z" BLOBs stay readable by every client
+ * with a plain uncompress().
+ *
+ * The input is split into chunks that are deflated independently on a thread pool.
+ * Every chunk but the last ends with a sync flush, which byte-aligns the output so
+ * the chunks can simply be concatenated. Each chunk is primed with the 32 KiB of
+ * input in front of it, so the ratio is within a fraction of a percent of a single
+ * threaded compress2(). The checksums are computed per chunk and combined.
+ *
+ * The input is read in place and the output is written into a caller supplied
+ * buffer, for example one from IDSharedBlobAlloc(), so nothing is copied besides
+ * moving the compressed chunks together.
+ */
+class ParallelDeflate
+{
+public:
+    enum class Format
+    {
+        Zlib,
+        Gzip
+    };
+
+    struct Options
+    {
+        /** zlib compression level 1..9, see levelForLinkSpeed(). */
+        int level {1};
+        /** Bytes of input per chunk. Smaller chunks spread better, larger ones compress better. */
+        size_t chunkSize {1 << 20};
+        Format format {Format::Zlib};
+        /** Pool to run on, nullptr uses ThreadPool::shared(). */
+        ThreadPool *pool {nullptr};
+    };
+
+    /** @brief Upper bound of the compressed size of size bytes of input. */
+    static size_t bound(size_t size, const Options &options);
+
+    /**
+     * @brief Compress size bytes at input into output.
+     * @param capacity size of output, at least bound(size, options).
+     * @return compressed size, or 0 on failure.
+     */
+    static size_t compress(const void *input, size_t size, void *output, size_t capacity, const Options &options);
+
+    /**
+     * @brief A compression level that keeps the total of compression plus transfer
+     * time low for a given link speed. Fast links want fast compression, on slow
+     * links every byte saved is worth more CPU time.
+     * @param megabitsPerSecond link speed, 0 or less when unknown.
+     */
+    static int levelForLinkSpeed(double megabitsPerSecond);
+};
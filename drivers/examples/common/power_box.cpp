@@ -0,0 +1,332 @@
+#include "power_box.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace PowerBox
+{
+
+namespace
+{
+
+// What the box takes per command, with the latency timer of its USB serial
+// adapter, per port it switches and per port it measures.
+const std::chrono::microseconds CommandTime(8000);
+const std::chrono::microseconds SwitchTime(1500);
+const std::chrono::microseconds MeasureTime(400);
+
+// The body of a command, without ':' and '#'.
+bool body(const std::string &command, std::string &text)
+{
+    if (command.size() < 3 || command.front() != ':' || command.back() != '#')
+        return false;
+    text = command.substr(1, command.size() - 2);
+    return true;
+}
+
+void appendReading(const Reading &reading, std::string &out)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.2f,%.2f", reading.voltage, reading.current);
+    out += text;
+}
+
+bool parsePair(const char *text, const char **end, Reading &reading)
+{
+    char *last = nullptr;
+    reading.voltage = strtod(text, &last);
+    if (last == text || *last != ',')
+        return false;
+    text = last + 1;
+    reading.current = strtod(text, &last);
+    if (last == text)
+        return false;
+    *end = last;
+    return true;
+}
+
+}
+
+std::string command(const Setting &setting)
+{
+    char text[48];
+    if (setting.kind == Kind::Dew || setting.kind == Kind::Variable)
+        snprintf(text, sizeof(text), "%c%zu=%d,%.1f", static_cast<char>(setting.kind), setting.port + 1,
+                 setting.enabled ? 1 : 0, setting.value);
+    else
+        snprintf(text, sizeof(text), "%c%zu=%d", static_cast<char>(setting.kind), setting.port + 1,
+                 setting.enabled ? 1 : 0);
+    return std::string(":") + text + "#";
+}
+
+std::string batchCommand(const std::vector<Setting> &settings)
+{
+    std::string out = ":B";
+    for (size_t i = 0; i < settings.size(); ++i)
+    {
+        const std::string one = command(settings[i]);
+        if (i > 0)
+            out += ';';
+        out.append(one, 1, one.size() - 2);
+    }
+    return out + "#";
+}
+
+std::string readCommand(size_t port)
+{
+    return ":R" + std::to_string(port + 1) + "#";
+}
+
+bool parseReading(const std::string &answer, Reading &reading)
+{
+    const char *end = nullptr;
+    return parsePair(answer.c_str(), &end, reading) && (*end == '\0' || *end == '#');
+}
+
+bool parseTelemetry(const std::string &answer, Telemetry &telemetry)
+{
+    telemetry.ports.clear();
+    const char *text = answer.c_str();
+    const char *end = nullptr;
+    if (!parsePair(text, &end, telemetry.input))
+        return false;
+    while (*end == ';')
+    {
+        Reading reading;
+        if (!parsePair(end + 1, &end, reading))
+            return false;
+        telemetry.ports.push_back(reading);
+    }
+    return *end == '\0' || *end == '#';
+}
+
+// -- Batch ------------------------------------------------------------------
+
+void Batch::add(const Setting &setting)
+{
+    for (auto &pending : m_Settings)
+    {
+        if (pending.kind == setting.kind && pending.port == setting.port)
+        {
+            pending = setting;
+            return;
+        }
+    }
+    m_Settings.push_back(setting);
+}
+
+std::vector<Setting> Batch::take()
+{
+    std::vector<Setting> settings;
+    settings.swap(m_Settings);
+    return settings;
+}
+
+// -- Model ------------------------------------------------------------------
+
+Model::Model(const Layout &layout)
+    : m_Layout(layout), m_Power(layout.power), m_Dew(layout.dew), m_Variable(layout.variable), m_Usb(layout.usb)
+{
+}
+
+std::vector<Model::Port> &Model::ports(Kind kind)
+{
+    return const_cast<std::vector<Port> &>(static_cast<const Model *>(this)->ports(kind));
+}
+
+const std::vector<Model::Port> &Model::ports(Kind kind) const
+{
+    switch (kind)
+    {
+        case Kind::Power:
+            return m_Power;
+        case Kind::Dew:
+            return m_Dew;
+        case Kind::Variable:
+            return m_Variable;
+        case Kind::Usb:
+            break;
+    }
+    return m_Usb;
+}
+
+bool Model::enabled(Kind kind, size_t port) const
+{
+    return port < ports(kind).size() && ports(kind)[port].enabled;
+}
+
+double Model::value(Kind kind, size_t port) const
+{
+    return port < ports(kind).size() ? ports(kind)[port].value : 0;
+}
+
+bool Model::parseSetting(const std::string &text, std::vector<Setting> &staged) const
+{
+    if (text.empty())
+        return false;
+    Setting setting;
+    setting.kind = static_cast<Kind>(text[0]);
+    if (setting.kind != Kind::Power && setting.kind != Kind::Dew && setting.kind != Kind::Variable &&
+            setting.kind != Kind::Usb)
+        return false;
+
+    const char *p = text.c_str() + 1;
+    char *last = nullptr;
+    const unsigned long port = strtoul(p, &last, 10);
+    if (last == p || port < 1 || port > ports(setting.kind).size() || *last != '=' ||
+            (last[1] != '0' && last[1] != '1'))
+        return false;
+    setting.port = port - 1;
+    setting.enabled = last[1] == '1';
+    p = last + 2;
+
+    if (setting.kind == Kind::Dew || setting.kind == Kind::Variable)
+    {
+        if (*p != ',')
+            return false;
+        setting.value = strtod(p + 1, &last);
+        if (last == p + 1)
+            return false;
+        p = last;
+        const bool valid = setting.kind == Kind::Dew ? setting.value >= 0 && setting.value <= 100
+                           : setting.value >= 3 && setting.value <= 12;
+        if (!valid)
+            return false;
+    }
+    if (*p != '\0')
+        return false;
+    staged.push_back(setting);
+    return true;
+}
+
+Reading Model::reading(Kind kind, size_t port) const
+{
+    Reading result;
+    const Port &state = ports(kind)[port];
+    if (!state.enabled)
+        return result;
+    switch (kind)
+    {
+        case Kind::Power:
+            result.voltage = inputVoltage();
+            result.current = 0.4 + 0.15 * (port % 5);
+            break;
+        case Kind::Dew:
+            result.voltage = inputVoltage() * state.value / 100;
+            result.current = 2.5 * state.value / 100;
+            break;
+        case Kind::Variable:
+            result.voltage = state.value;
+            result.current = state.value / 8;
+            break;
+        case Kind::Usb:
+            break;
+    }
+    return result;
+}
+
+double Model::totalCurrent() const
+{
+    double total = 0.1;
+    for (size_t port = 0; port < m_Power.size(); ++port)
+        total += m_Power[port].enabled ? 0.4 + 0.15 * (port % 5) : 0;
+    for (const auto &port : m_Dew)
+        total += port.enabled ? 2.5 * port.value / 100 : 0;
+    for (const auto &port : m_Variable)
+        total += port.enabled ? port.value / 8 : 0;
+    return total;
+}
+
+double Model::inputVoltage() const
+{
+    // The supply sags under load.
+    return 12.4 - 0.03 * totalCurrent();
+}
+
+std::string Model::handle(const std::string &command)
+{
+    ++m_Commands;
+    std::string text;
+    if (!body(command, text))
+        return "ERR#";
+
+    std::vector<Setting> staged;
+    switch (text[0])
+    {
+        case 'B':
+        {
+            size_t start = 1;
+            for (;;)
+            {
+                const size_t end = std::min(text.find(';', start), text.size());
+                if (!parseSetting(text.substr(start, end - start), staged))
+                    return "ERR#";
+                if (end == text.size())
+                    break;
+                start = end + 1;
+            }
+            break;
+        }
+
+        case 'R':
+        {
+            char *last = nullptr;
+            const unsigned long port = strtoul(text.c_str() + 1, &last, 10);
+            if (last == text.c_str() + 1 || *last != '\0' || port < 1 || port > m_Power.size())
+                return "ERR#";
+            std::string answer;
+            appendReading(reading(Kind::Power, port - 1), answer);
+            return answer + "#";
+        }
+
+        case 'T':
+        {
+            if (text.size() != 1)
+                return "ERR#";
+            std::string answer;
+            appendReading({inputVoltage(), totalCurrent()}, answer);
+            for (Kind kind : {Kind::Power, Kind::Dew, Kind::Variable})
+            {
+                for (size_t port = 0; port < ports(kind).size(); ++port)
+                {
+                    answer += ';';
+                    appendReading(reading(kind, port), answer);
+                }
+            }
+            return answer + "#";
+        }
+
+        default:
+            if (!parseSetting(text, staged))
+                return "ERR#";
+            break;
+    }
+
+    for (const auto &setting : staged)
+    {
+        Port &port = ports(setting.kind)[setting.port];
+        port.enabled = setting.enabled;
+        port.value = setting.value;
+    }
+    return "OK#";
+}
+
+std::chrono::microseconds Model::processingTime(const std::string &command) const
+{
+    if (command.size() < 2)
+        return CommandTime;
+    switch (command[1])
+    {
+        case 'B':
+            return CommandTime + SwitchTime * (1 + std::count(command.begin(), command.end(), ';'));
+        case 'R':
+            return CommandTime + MeasureTime;
+        case 'T':
+            return CommandTime + MeasureTime * static_cast<int64_t>(m_Layout.measured() + 1);
+        default:
+            return CommandTime + SwitchTime;
+    }
+}
+
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The serial protocol of the power box example, the batch that merges
+ * the settings of several ports into one transaction, and a model of the box
+ * answering the protocol, for the simulation and the benchmarks.
+ *
+ * A command and its answer end in '#'. Ports are numbered from 1 on the wire.
+ *
+ * | Command                 |                                          | Answer            |
+ * |-------------------------|------------------------------------------|-------------------|
+ * | `:P3=1#`                | power port 3 on                          | `OK#`             |
+ * | `:D2=1,45.0#`           | dew port 2 on at 45% duty cycle          | `OK#`             |
+ * | `:V1=1,9.0#`            | variable port 1 on at 9 V                | `OK#`             |
+ * | `:U4=0#`                | USB port 4 off                           | `OK#`             |
+ * | `:BP3=1;D2=1,45.0;U4=0#`| all of the above in one transaction      | `OK#`             |
+ * | `:R3#`                  | volts and amps of power port 3           | `12.10,1.25#`     |
+ * | `:T#`                   | input volts and total amps, then those   | `12.10,5.30;12.10,1.25;...#` |
+ * |                         | of every power, dew and variable port    |                   |
+ *
+ * A command the box rejects answers `ERR#`. A batch is applied as a whole or
+ * not at all.
+ */
+namespace PowerBox
+{
+
+enum class Kind : char
+{
+    Power = 'P',
+    Dew = 'D',
+    Variable = 'V',
+    Usb = 'U'
+};
+
+struct Setting
+{
+    Kind kind;
+    // From 0.
+    size_t port;
+    bool enabled;
+    // Duty cycle in % of a dew port, volts of a variable port.
+    double value {0};
+};
+
+struct Reading
+{
+    double voltage {0};
+    double current {0};
+};
+
+struct Telemetry
+{
+    Reading input;
+    // Power ports, then dew ports, then variable ports.
+    std::vector<Reading> ports;
+};
+
+struct Layout
+{
+    size_t power {0};
+    size_t dew {0};
+    size_t variable {0};
+    size_t usb {0};
+
+    /** @brief The ports :T# reports on. */
+    constexpr size_t measured() const
+    {
+        return power + dew + variable;
+    }
+};
+
+const char TelemetryCommand[] = ":T#";
+
+/** @brief The command of one setting. */
+std::string command(const Setting &setting);
+/** @brief One command for all the settings. */
+std::string batchCommand(const std::vector<Setting> &settings);
+/** @brief The command reading one power port. */
+std::string readCommand(size_t port);
+
+/** @brief Parse the answer to readCommand(), with or without the '#'. */
+bool parseReading(const std::string &answer, Reading &reading);
+/** @brief Parse the answer to TelemetryCommand. */
+bool parseTelemetry(const std::string &answer, Telemetry &telemetry);
+
+/**
+ * @brief Settings waiting to be sent. A port set again before they are sent
+ * keeps its place and takes the new setting.
+ */
+class Batch
+{
+public:
+    void add(const Setting &setting);
+
+    bool empty() const
+    {
+        return m_Settings.empty();
+    }
+
+    size_t size() const
+    {
+        return m_Settings.size();
+    }
+
+    /** @brief The settings, and forget them. */
+    std::vector<Setting> take();
+
+private:
+    std::vector<Setting> m_Settings;
+};
+
+/**
+ * @brief The box: applies commands and answers them, and knows how long its
+ * firmware takes for each.
+ */
+class Model
+{
+public:
+    explicit Model(const Layout &layout);
+
+    /** @brief The answer to a command, ':' and '#' included. */
+    std::string handle(const std::string &command);
+
+    /**
+     * @brief Time the box needs for a command, the serial line not included:
+     * a fixed cost per command, what a USB serial adapter adds to each round
+     * trip included, and a little more per port switched or measured.
+     */
+    std::chrono::microseconds processingTime(const std::string &command) const;
+
+    const Layout &layout() const
+    {
+        return m_Layout;
+    }
+
+    bool enabled(Kind kind, size_t port) const;
+    double value(Kind kind, size_t port) const;
+
+    uint64_t commands() const
+    {
+        return m_Commands;
+    }
+
+private:
+    struct Port
+    {
+        bool enabled {false};
+        double value {0};
+    };
+
+    std::vector<Port> &ports(Kind kind);
+    const std::vector<Port> &ports(Kind kind) const;
+    // Checks a setting of the form P3=1 and adds it to staged.
+    bool parseSetting(const std::string &text, std::vector<Setting> &staged) const;
+    Reading reading(Kind kind, size_t port) const;
+    double totalCurrent() const;
+    double inputVoltage() const;
+
+    Layout m_Layout;
+    std::vector<Port> m_Power, m_Dew, m_Variable, m_Usb;
+    uint64_t m_Commands {0};
+};
+
+}
@@ -0,0 +1,632 @@
+#include "property_journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Journal
+{
+
+namespace
+{
+
+const char Magic[8] = {'I', 'N', 'D', 'I', 'J', 'R', 'N', 'L'};
+const uint32_t Version = 1;
+const char Suffix[] = ".journal";
+
+struct SegmentHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t index;
+    /** When the segment got its first record, 0 before. */
+    int64_t createdNs;
+    uint64_t segmentBytes;
+};
+
+static_assert(sizeof(SegmentHeader) <= SegmentHeaderSize, "the segment header grew past its room");
+
+size_t roundUp(size_t value)
+{
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+std::string segmentName(uint64_t index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%010llu%s", static_cast<unsigned long long>(index), Suffix);
+    return name;
+}
+
+// The segments in directory with their index, oldest first.
+std::vector<std::pair<uint64_t, std::string>> listSegments(const std::string &directory)
+{
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr)
+        return segments;
+    while (const dirent *entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        const size_t suffix = sizeof(Suffix) - 1;
+        if (name.size() <= suffix || name.compare(name.size() - suffix, suffix, Suffix) != 0)
+            continue;
+        char *end = nullptr;
+        const unsigned long long index = strtoull(name.c_str(), &end, 10);
+        if (end != name.c_str() + name.size() - suffix)
+            continue;
+        segments.emplace_back(index, directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// When the segment at path got its first record, 0 for a spare never used
+// and -1 for a file that is not a segment.
+int64_t createdAt(const std::string &path)
+{
+    SegmentHeader header;
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    const bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                       memcmp(header.magic, Magic, sizeof(Magic)) == 0 && header.version == Version;
+    ::close(fd);
+    return valid ? header.createdNs : -1;
+}
+
+void makeDirectories(const std::string &directory)
+{
+    for (size_t next = directory.find('/', 1); ; next = directory.find('/', next + 1))
+    {
+        mkdir(directory.substr(0, next).c_str(), 0755);
+        if (next == std::string::npos)
+            break;
+    }
+}
+
+}
+
+std::string defaultDirectory()
+{
+    const char *home = getenv("HOME");
+    return home != nullptr ? std::string(home) + "/.indi/journal" : std::string("/tmp/indi-journal");
+}
+
+int64_t nowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// -- Writer -----------------------------------------------------------------
+
+Writer::~Writer()
+{
+    close();
+}
+
+bool Writer::open(const std::string &directory, const Options &options)
+{
+    close();
+
+    m_Directory = directory;
+    m_Options = options;
+    m_Options.segmentBytes = std::max<size_t>(roundUp(options.segmentBytes), 64 << 10);
+    m_Stats = Stats();
+    m_Gap = 0;
+    makeDirectories(directory);
+
+    auto existing = listSegments(directory);
+    // The spare of a writer that did not close.
+    while (!existing.empty() && createdAt(existing.back().second) == 0)
+    {
+        unlink(existing.back().second.c_str());
+        existing.pop_back();
+    }
+    const uint64_t index = existing.empty() ? 1 : existing.back().first + 1;
+    if (!createSegment(index, m_Current))
+        return false;
+    m_Map = m_Current.map;
+    reinterpret_cast<SegmentHeader *>(m_Map)->createdNs = nowNs();
+    ++m_Stats.segments;
+
+    // Defined before, for a journal reopened after a reconnect.
+    for (size_t i = 0; i < m_DeviceNames.size(); ++i)
+        writeDevice(static_cast<uint32_t>(i + 1), m_DeviceNames[i]);
+    for (const Definition &definition : m_Definitions)
+        writeDefinition(definition);
+
+    m_Stop = false;
+    m_SpareReady = false;
+    m_SpareWanted = true;
+    m_Thread = std::thread([this]
+    {
+        run();
+    });
+    return true;
+}
+
+void Writer::close()
+{
+    if (m_Thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_Wake.notify_one();
+        m_Thread.join();
+    }
+    for (Segment &segment : m_Retired)
+        retire(segment);
+    m_Retired.clear();
+    if (m_SpareReady)
+    {
+        // Never used, nothing to keep.
+        munmap(m_Spare.map, m_Options.segmentBytes);
+        ::close(m_Spare.fd);
+        unlink((m_Directory + "/" + segmentName(m_Spare.index)).c_str());
+        m_SpareReady = false;
+    }
+    if (m_Map != nullptr)
+        retire(m_Current);
+    m_Map = nullptr;
+}
+
+bool Writer::createSegment(uint64_t index, Segment &segment) const
+{
+    const std::string path = m_Directory + "/" + segmentName(index);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    // Blocks allocated now rather than on the first write to each page.
+    if (posix_fallocate(fd, 0, m_Options.segmentBytes) != 0 &&
+            ftruncate(fd, static_cast<off_t>(m_Options.segmentBytes)) != 0)
+    {
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    void *map = mmap(nullptr, m_Options.segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    SegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.headerSize = SegmentHeaderSize;
+    header.index = index;
+    header.segmentBytes = m_Options.segmentBytes;
+    memcpy(map, &header, sizeof(header));
+
+    segment.fd = fd;
+    segment.map = static_cast<uint8_t *>(map);
+    segment.used = SegmentHeaderSize;
+    segment.index = index;
+    return true;
+}
+
+void Writer::retire(Segment &segment) const
+{
+    msync(segment.map, segment.used, MS_ASYNC);
+    munmap(segment.map, m_Options.segmentBytes);
+    // A zero length after the last record, for readers that mapped the file
+    // at its full size and would fault past a shorter end.
+    const size_t size = std::min(segment.used + sizeof(RecordHeader), m_Options.segmentBytes);
+    if (ftruncate(segment.fd, static_cast<off_t>(size)) != 0)
+    {
+        // Left at its full size, still readable.
+    }
+    ::close(segment.fd);
+    segment.map = nullptr;
+    segment.fd = -1;
+}
+
+void Writer::run()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for (;;)
+    {
+        m_Wake.wait(lock, [this]
+        {
+            return m_Stop || (m_SpareWanted && !m_SpareReady) || !m_Retired.empty();
+        });
+        if (m_Stop)
+            return;
+
+        std::vector<Segment> retired;
+        retired.swap(m_Retired);
+        const bool prepare = m_SpareWanted && !m_SpareReady;
+        const uint64_t index = m_Current.index + 1;
+        lock.unlock();
+
+        for (Segment &segment : retired)
+            retire(segment);
+        if (m_Options.keepSegments > 0 && !retired.empty())
+        {
+            auto segments = listSegments(m_Directory);
+            // The current segment is not finished, the spare is created below.
+            while (segments.size() > m_Options.keepSegments + 1)
+            {
+                unlink(segments.front().second.c_str());
+                segments.erase(segments.begin());
+            }
+        }
+        Segment spare;
+        const bool ready = prepare && createSegment(index, spare);
+
+        lock.lock();
+        if (ready)
+        {
+            m_Spare = spare;
+            m_SpareReady = true;
+            m_SpareWanted = false;
+        }
+        else if (prepare)
+        {
+            // Try again with the next record that does not fit.
+            m_SpareWanted = false;
+        }
+    }
+}
+
+bool Writer::rotate()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!m_SpareReady)
+        {
+            m_SpareWanted = true;
+            m_Wake.notify_one();
+            return false;
+        }
+        m_Retired.push_back(m_Current);
+        m_Current = m_Spare;
+        m_SpareReady = false;
+        m_SpareWanted = true;
+    }
+    m_Wake.notify_one();
+
+    m_Map = m_Current.map;
+    reinterpret_cast<SegmentHeader *>(m_Map)->createdNs = nowNs();
+    ++m_Stats.segments;
+
+    // Each segment can be read alone.
+    m_Rotating = true;
+    for (size_t i = 0; i < m_DeviceNames.size(); ++i)
+        writeDevice(static_cast<uint32_t>(i + 1), m_DeviceNames[i]);
+    for (const Definition &definition : m_Definitions)
+        writeDefinition(definition);
+    m_Rotating = false;
+    return true;
+}
+
+uint8_t *Writer::reserve(size_t length)
+{
+    if (m_Map == nullptr)
+        return nullptr;
+    if (m_Current.used + length > m_Options.segmentBytes)
+    {
+        // Definitions that do not fit a fresh segment are not worth another.
+        if (m_Rotating || length > m_Options.segmentBytes - SegmentHeaderSize || !rotate())
+            return nullptr;
+    }
+    return m_Map + m_Current.used;
+}
+
+void Writer::commit(uint8_t *record, Kind kind, int state, size_t count, uint32_t device, uint32_t property,
+                    int64_t timestampNs, size_t length)
+{
+    RecordHeader *header = reinterpret_cast<RecordHeader *>(record);
+    header->kind = kind;
+    header->state = static_cast<uint8_t>(state);
+    header->count = static_cast<uint16_t>(count);
+    header->device = device;
+    header->property = property;
+    header->timestampNs = timestampNs;
+    // A reader sees the record whole or not at all.
+    __atomic_store_n(&header->length, static_cast<uint32_t>(length), __ATOMIC_RELEASE);
+    m_Current.used += length;
+    m_Stats.bytes += length;
+}
+
+bool Writer::writeDevice(uint32_t id, const std::string &name)
+{
+    const size_t length = roundUp(sizeof(RecordHeader) + name.size() + 1);
+    uint8_t *record = reserve(length);
+    if (record == nullptr)
+        return false;
+    memcpy(record + sizeof(RecordHeader), name.c_str(), name.size() + 1);
+    commit(record, Kind::DefineDevice, 0, 0, id, 0, nowNs(), length);
+    return true;
+}
+
+bool Writer::writeDefinition(const Definition &definition)
+{
+    size_t payload = definition.property.size() + 1;
+    for (const std::string &element : definition.elements)
+        payload += element.size() + 1;
+    const size_t length = roundUp(sizeof(RecordHeader) + payload);
+    uint8_t *record = reserve(length);
+    if (record == nullptr)
+        return false;
+    uint8_t *at = record + sizeof(RecordHeader);
+    memcpy(at, definition.property.c_str(), definition.property.size() + 1);
+    at += definition.property.size() + 1;
+    for (const std::string &element : definition.elements)
+    {
+        memcpy(at, element.c_str(), element.size() + 1);
+        at += element.size() + 1;
+    }
+    commit(record, Kind::DefineProperty, static_cast<int>(definition.kind), definition.elements.size(),
+           definition.device, definition.id, nowNs(), length);
+    return true;
+}
+
+bool Writer::writeGap()
+{
+    const size_t length = sizeof(RecordHeader) + sizeof(uint64_t);
+    uint8_t *record = reserve(length);
+    if (record == nullptr)
+        return false;
+    memcpy(record + sizeof(RecordHeader), &m_Gap, sizeof(m_Gap));
+    commit(record, Kind::Gap, 0, 0, 0, 0, nowNs(), length);
+    m_Gap = 0;
+    return true;
+}
+
+uint32_t Writer::define(const std::string &device, const std::string &property, Kind kind,
+                        const std::vector<std::string> &elements)
+{
+    if (m_Map == nullptr)
+        return 0;
+
+    auto known = m_Ids.find(device + '\0' + property);
+    if (known != m_Ids.end())
+    {
+        Definition &definition = m_Definitions[known->second - 1];
+        if (definition.kind == kind && definition.elements == elements)
+            return definition.id;
+        definition.kind = kind;
+        definition.elements = elements;
+        writeDefinition(definition);
+        return definition.id;
+    }
+
+    uint32_t deviceId;
+    auto knownDevice = m_Devices.find(device);
+    if (knownDevice != m_Devices.end())
+        deviceId = knownDevice->second;
+    else
+    {
+        m_DeviceNames.push_back(device);
+        deviceId = static_cast<uint32_t>(m_DeviceNames.size());
+        m_Devices[device] = deviceId;
+        writeDevice(deviceId, device);
+    }
+
+    // Should the record not fit now, the next segment starts with it.
+    Definition definition {static_cast<uint32_t>(m_Definitions.size() + 1), deviceId, kind, property, elements};
+    m_Definitions.push_back(definition);
+    m_Ids[device + '\0' + property] = definition.id;
+    writeDefinition(definition);
+    return definition.id;
+}
+
+bool Writer::append(uint32_t id, int state, const double *values, size_t count, int64_t timestampNs)
+{
+    if (m_Gap > 0)
+        writeGap();
+    const size_t length = sizeof(RecordHeader) + count * sizeof(double);
+    uint8_t *record = id > 0 && id <= m_Definitions.size() ? reserve(length) : nullptr;
+    if (record == nullptr)
+    {
+        ++m_Stats.dropped;
+        ++m_Gap;
+        return false;
+    }
+    memcpy(record + sizeof(RecordHeader), values, count * sizeof(double));
+    commit(record, Kind::Number, state, count, m_Definitions[id - 1].device, id, timestampNs, length);
+    ++m_Stats.records;
+    return true;
+}
+
+bool Writer::append(uint32_t id, int state, const uint8_t *states, size_t count, int64_t timestampNs)
+{
+    if (m_Gap > 0)
+        writeGap();
+    const size_t length = roundUp(sizeof(RecordHeader) + count);
+    uint8_t *record = id > 0 && id <= m_Definitions.size() ? reserve(length) : nullptr;
+    if (record == nullptr)
+    {
+        ++m_Stats.dropped;
+        ++m_Gap;
+        return false;
+    }
+    memcpy(record + sizeof(RecordHeader), states, count);
+    const Definition &definition = m_Definitions[id - 1];
+    commit(record, definition.kind == Kind::Light ? Kind::Light : Kind::Switch, state, count, definition.device,
+           id, timestampNs, length);
+    ++m_Stats.records;
+    return true;
+}
+
+bool Writer::append(uint32_t id, int state, const char *const *texts, size_t count, int64_t timestampNs)
+{
+    if (m_Gap > 0)
+        writeGap();
+    size_t payload = 0;
+    for (size_t i = 0; i < count; ++i)
+        payload += (texts[i] != nullptr ? strlen(texts[i]) : 0) + 1;
+    const size_t length = roundUp(sizeof(RecordHeader) + payload);
+    uint8_t *record = id > 0 && id <= m_Definitions.size() ? reserve(length) : nullptr;
+    if (record == nullptr)
+    {
+        ++m_Stats.dropped;
+        ++m_Gap;
+        return false;
+    }
+    uint8_t *at = record + sizeof(RecordHeader);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t size = texts[i] != nullptr ? strlen(texts[i]) : 0;
+        memcpy(at, texts[i] != nullptr ? texts[i] : "", size);
+        at[size] = 0;
+        at += size + 1;
+    }
+    commit(record, Kind::Text, state, count, m_Definitions[id - 1].device, id, timestampNs, length);
+    ++m_Stats.records;
+    return true;
+}
+
+// -- Reader -----------------------------------------------------------------
+
+double Reader::Record::number(size_t i) const
+{
+    double value;
+    memcpy(&value, payload + i * sizeof(double), sizeof(value));
+    return value;
+}
+
+bool Reader::open(const std::string &directory)
+{
+    m_Segments.clear();
+    m_Created.clear();
+    for (const auto &segment : listSegments(directory))
+    {
+        // A spare the writer has not started yet holds nothing.
+        const int64_t created = createdAt(segment.second);
+        if (created <= 0)
+            continue;
+        m_Segments.push_back(segment.second);
+        m_Created.push_back(created);
+    }
+    return !m_Segments.empty();
+}
+
+bool Reader::scan(const Filter &filter, const Handler &handler)
+{
+    m_Stats = Stats();
+    bool ok = true;
+    for (size_t i = 0; i < m_Segments.size(); ++i)
+    {
+        // A segment ends where the next one starts.
+        if (m_Created[i] > filter.toNs || (i + 1 < m_Segments.size() && m_Created[i + 1] < filter.fromNs))
+        {
+            ++m_Stats.skippedSegments;
+            continue;
+        }
+        ok &= scanSegment(m_Segments[i], filter, handler);
+    }
+    return ok;
+}
+
+bool Reader::scanSegment(const std::string &path, const Filter &filter, const Handler &handler)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < SegmentHeaderSize)
+    {
+        ::close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, size, MADV_SEQUENTIAL);
+    const uint8_t *data = static_cast<const uint8_t *>(map);
+    ++m_Stats.segments;
+
+    // The ids of this segment.
+    std::vector<std::string> devices;
+    struct Property
+    {
+        std::string name;
+        std::vector<std::string> elements;
+        bool wanted {false};
+    };
+    std::vector<Property> properties;
+    std::vector<uint8_t> wanted;
+
+    size_t offset = SegmentHeaderSize;
+    while (offset + sizeof(RecordHeader) <= size)
+    {
+        const RecordHeader *header = reinterpret_cast<const RecordHeader *>(data + offset);
+        const uint32_t length = __atomic_load_n(&header->length, __ATOMIC_ACQUIRE);
+        if (length < sizeof(RecordHeader) || length % 8 != 0 || offset + length > size)
+            break;
+        ++m_Stats.records;
+        const uint8_t *payload = data + offset + sizeof(RecordHeader);
+
+        if (header->property < wanted.size() && wanted[header->property] && header->timestampNs >= filter.fromNs &&
+                header->timestampNs <= filter.toNs && header->kind >= Kind::Number && header->kind <= Kind::Text &&
+                header->device < devices.size())
+        {
+            const Property &property = properties[header->property];
+            Record record {&devices[header->device], &property.name, &property.elements, header->kind,
+                           header->state, header->timestampNs, header->count, payload};
+            ++m_Stats.matched;
+            handler(record);
+        }
+        else if (header->kind == Kind::DefineDevice)
+        {
+            if (devices.size() <= header->device)
+                devices.resize(header->device + 1);
+            devices[header->device] = reinterpret_cast<const char *>(payload);
+        }
+        else if (header->kind == Kind::DefineProperty)
+        {
+            if (properties.size() <= header->property)
+            {
+                properties.resize(header->property + 1);
+                wanted.resize(header->property + 1, 0);
+            }
+            Property &property = properties[header->property];
+            const char *text = reinterpret_cast<const char *>(payload);
+            property.name = text;
+            property.elements.clear();
+            for (unsigned element = 0; element < header->count; ++element)
+            {
+                text += strlen(text) + 1;
+                property.elements.push_back(text);
+            }
+            const bool deviceMatches = filter.device.empty() ||
+                                       (header->device < devices.size() && devices[header->device] == filter.device);
+            wanted[header->property] = deviceMatches && (filter.property.empty() || property.name == filter.property);
+        }
+        else if (header->kind == Kind::Gap)
+        {
+            uint64_t dropped;
+            memcpy(&dropped, payload, sizeof(dropped));
+            m_Stats.dropped += dropped;
+        }
+        offset += length;
+    }
+    m_Stats.bytes += offset;
+    munmap(map, size);
+    return true;
+}
+
+}
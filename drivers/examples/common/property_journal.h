@@ -0,0 +1,278 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Every property change of a driver as a compact binary record in a
+ * directory of memory mapped segment files, and a reader that scans them.
+ *
+ * Reconstructing a night from the text of indiserver -l and the driver logs
+ * means formatting every change as text and then grepping gigabytes of it.
+ * Here a change is appended as a record of a few dozen bytes: the device
+ * and property as small ids, the state, the values and a CLOCK_REALTIME
+ * timestamp. An append is a copy into a shared mapping, no system call, so
+ * it runs on the event loop at every apply(). The pages belong to the kernel
+ * and survive a crash of the driver.
+ *
+ * A segment holds segmentBytes. The next one is created, sized and mapped
+ * ahead by a background thread, which also writes back, unmaps and trims
+ * the finished ones, so moving to the next segment costs the event loop a
+ * few pointer swaps. Should it not be ready, records are dropped and counted
+ * rather than waiting for the disk; a Gap record marks where.
+ *
+ * Every segment starts with the definitions of the devices and properties
+ * journaled so far, so each one can be read alone and old ones deleted. A
+ * record's length is written last; a reader stops at a length of 0, which
+ * is where the writer is, or where it crashed.
+ *
+ * One writer per directory. A process with several devices shares one
+ * journal, ids are per device and property.
+ */
+
+namespace Journal
+{
+
+enum class Kind : uint8_t
+{
+    DefineDevice = 1,
+    DefineProperty = 2,
+    Number = 3,
+    Switch = 4,
+    Light = 5,
+    Text = 6,
+    // Records dropped before this one.
+    Gap = 7,
+};
+
+/** The first bytes of every record, 8 byte aligned. */
+struct RecordHeader
+{
+    /** Of the whole record, a multiple of 8; 0 ends the segment so far. */
+    uint32_t length;
+    Kind kind;
+    /** IPState, or the Kind of the values for DefineProperty. */
+    uint8_t state;
+    /** Values that follow, or elements of a DefineProperty. */
+    uint16_t count;
+    uint32_t device;
+    uint32_t property;
+    /** CLOCK_REALTIME nanoseconds. */
+    int64_t timestampNs;
+};
+
+static_assert(sizeof(RecordHeader) == 24, "the record header is part of the file format");
+
+/** Bytes before the first record of a segment. */
+const size_t SegmentHeaderSize = 64;
+
+/** @brief ~/.indi/journal, or the temporary directory without a home. */
+std::string defaultDirectory();
+
+/** @brief CLOCK_REALTIME in nanoseconds. */
+int64_t nowNs();
+
+class Writer
+{
+public:
+    struct Options
+    {
+        size_t segmentBytes {64 << 20};
+        /** Finished segments kept, the oldest are deleted; 0 keeps all. */
+        size_t keepSegments {0};
+    };
+
+    struct Stats
+    {
+        uint64_t records {0};
+        uint64_t bytes {0};
+        uint64_t segments {0};
+        /** The next segment was not ready. */
+        uint64_t dropped {0};
+    };
+
+    Writer() = default;
+    ~Writer();
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    /** @brief Create the directory and the first segment, after the segments already there. */
+    bool open(const std::string &directory, const Options &options);
+    bool open(const std::string &directory)
+    {
+        return open(directory, Options());
+    }
+
+    /** @brief Write back and trim the current segment. */
+    void close();
+
+    bool isOpen() const
+    {
+        return m_Map != nullptr;
+    }
+
+    /**
+     * @brief The id of device.property for append(), defining it in the
+     * journal the first time or when its elements change.
+     * @return 0 if the journal is not open.
+     */
+    uint32_t define(const std::string &device, const std::string &property, Kind kind,
+                    const std::vector<std::string> &elements);
+
+    /** @brief Number values, in the order of the elements. */
+    bool append(uint32_t id, int state, const double *values, size_t count, int64_t timestampNs = nowNs());
+
+    /** @brief Switch or Light states, in the order of the elements. */
+    bool append(uint32_t id, int state, const uint8_t *states, size_t count, int64_t timestampNs = nowNs());
+
+    /** @brief Text values, in the order of the elements. */
+    bool append(uint32_t id, int state, const char *const *texts, size_t count, int64_t timestampNs = nowNs());
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+private:
+    struct Definition
+    {
+        uint32_t id;
+        uint32_t device;
+        Kind kind;
+        std::string property;
+        std::vector<std::string> elements;
+    };
+
+    struct Segment
+    {
+        int fd {-1};
+        uint8_t *map {nullptr};
+        size_t used {0};
+        uint64_t index {0};
+    };
+
+    // Room for a record of length bytes, moving to the next segment if needed.
+    uint8_t *reserve(size_t length);
+    // Set the header, the length last.
+    void commit(uint8_t *record, Kind kind, int state, size_t count, uint32_t device, uint32_t property,
+                int64_t timestampNs, size_t length);
+    bool writeDevice(uint32_t id, const std::string &name);
+    bool writeDefinition(const Definition &definition);
+    bool writeGap();
+    bool rotate();
+
+    bool createSegment(uint64_t index, Segment &segment) const;
+    void retire(Segment &segment) const;
+    void run();
+
+    std::string m_Directory;
+    Options m_Options;
+    Stats m_Stats;
+
+    uint8_t *m_Map {nullptr};
+    Segment m_Current;
+    bool m_Rotating {false};
+    uint64_t m_Gap {0};
+
+    std::unordered_map<std::string, uint32_t> m_Devices;
+    std::vector<std::string> m_DeviceNames;
+    std::unordered_map<std::string, uint32_t> m_Ids;
+    std::vector<Definition> m_Definitions;
+
+    // The background thread: prepares m_Spare, retires m_Retired.
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Stop {false};
+    bool m_SpareWanted {false};
+    bool m_SpareReady {false};
+    Segment m_Spare;
+    std::vector<Segment> m_Retired;
+};
+
+/** @brief Scans the segments of a journal directory. */
+class Reader
+{
+public:
+    struct Filter
+    {
+        /** Empty for any. */
+        std::string device;
+        std::string property;
+        int64_t fromNs {std::numeric_limits<int64_t>::min()};
+        int64_t toNs {std::numeric_limits<int64_t>::max()};
+    };
+
+    struct Record
+    {
+        const std::string *device;
+        const std::string *property;
+        /** The element names, in the order of the values. */
+        const std::vector<std::string> *elements;
+        Kind kind;
+        int state;
+        int64_t timestampNs;
+        size_t count;
+        const uint8_t *payload;
+
+        double number(size_t i) const;
+        /** ISState of a switch, IPState of a light. */
+        int stateOf(size_t i) const
+        {
+            return payload[i];
+        }
+        /** The texts, one after the other, each ending with a 0. */
+        const char *texts() const
+        {
+            return reinterpret_cast<const char *>(payload);
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t segments {0};
+        /** Skipped by their time. */
+        uint64_t skippedSegments {0};
+        uint64_t records {0};
+        uint64_t matched {0};
+        uint64_t bytes {0};
+        /** Records dropped by the writer, from Gap records. */
+        uint64_t dropped {0};
+    };
+
+    using Handler = std::function<void(const Record &)>;
+
+    /** @brief The segments in the directory, oldest first. False if there are none. */
+    bool open(const std::string &directory);
+
+    const std::vector<std::string> &segments() const
+    {
+        return m_Segments;
+    }
+
+    /** @brief Hand every record that matches filter to handler, oldest first. */
+    bool scan(const Filter &filter, const Handler &handler);
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+private:
+    bool scanSegment(const std::string &path, const Filter &filter, const Handler &handler);
+
+    std::vector<std::string> m_Segments;
+    std::vector<int64_t> m_Created;
+    Stats m_Stats;
+};
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "libindi/indipropertylight.h"
+#include "libindi/indipropertynumber.h"
+#include "libindi/indipropertyswitch.h"
+#include "libindi/indipropertytext.h"
+
+#include "property_journal.h"
+
+/**
+ * @brief Journal the changes of INDI properties.
+ *
+ * Define a property once, when it is defined to clients, and keep the id.
+ * Appending is then a copy of its values into the journal, cheap enough to do
+ * next to every apply().
+ *
+ * @code
+ * // updateProperties(), once connected:
+ * FocusAbsPosJournal = journalDefine(Journal, FocusAbsPosNP);
+ * // wherever FocusAbsPosNP.apply() is called:
+ * journalAppend(Journal, FocusAbsPosJournal, FocusAbsPosNP);
+ * @endcode
+ */
+
+namespace JournalDetail
+{
+
+template <typename Property>
+std::vector<std::string> elementNames(const Property &property)
+{
+    std::vector<std::string> names;
+    names.reserve(property.size());
+    for (size_t i = 0; i < property.size(); ++i)
+        names.push_back(property[i].getName());
+    return names;
+}
+
+}
+
+inline uint32_t journalDefine(Journal::Writer &writer, const INDI::PropertyNumber &property)
+{
+    return writer.define(property.getDeviceName(), property.getName(), Journal::Kind::Number,
+                         JournalDetail::elementNames(property));
+}
+
+inline uint32_t journalDefine(Journal::Writer &writer, const INDI::PropertySwitch &property)
+{
+    return writer.define(property.getDeviceName(), property.getName(), Journal::Kind::Switch,
+                         JournalDetail::elementNames(property));
+}
+
+inline uint32_t journalDefine(Journal::Writer &writer, const INDI::PropertyLight &property)
+{
+    return writer.define(property.getDeviceName(), property.getName(), Journal::Kind::Light,
+                         JournalDetail::elementNames(property));
+}
+
+inline uint32_t journalDefine(Journal::Writer &writer, const INDI::PropertyText &property)
+{
+    return writer.define(property.getDeviceName(), property.getName(), Journal::Kind::Text,
+                         JournalDetail::elementNames(property));
+}
+
+/** @brief The values and state of property now, id from journalDefine(). */
+inline bool journalAppend(Journal::Writer &writer, uint32_t id, const INDI::PropertyNumber &property)
+{
+    const size_t count = property.size();
+    double values[64];
+    if (count > 64)
+        return false;
+    for (size_t i = 0; i < count; ++i)
+        values[i] = property[i].getValue();
+    return writer.append(id, property.getState(), values, count);
+}
+
+inline bool journalAppend(Journal::Writer &writer, uint32_t id, const INDI::PropertySwitch &property)
+{
+    const size_t count = property.size();
+    uint8_t states[256];
+    if (count > 256)
+        return false;
+    for (size_t i = 0; i < count; ++i)
+        states[i] = static_cast<uint8_t>(property[i].getState());
+    return writer.append(id, property.getState(), states, count);
+}
+
+inline bool journalAppend(Journal::Writer &writer, uint32_t id, const INDI::PropertyLight &property)
+{
+    const size_t count = property.size();
+    uint8_t states[256];
+    if (count > 256)
+        return false;
+    for (size_t i = 0; i < count; ++i)
+        states[i] = static_cast<uint8_t>(property[i].getState());
+    return writer.append(id, property.getState(), states, count);
+}
+
+inline bool journalAppend(Journal::Writer &writer, uint32_t id, const INDI::PropertyText &property)
+{
+    const size_t count = property.size();
+    const char *texts[64];
+    if (count > 64)
+        return false;
+    for (size_t i = 0; i < count; ++i)
+        texts[i] = property[i].getText();
+    return writer.append(id, property.getState(), texts, count);
+}
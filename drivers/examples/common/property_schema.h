@@ -0,0 +1,368 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "libindi/indiapi.h"
+
+/**
+ * @brief Driver properties declared once at compile time, with the storage of
+ * all of them in one block.
+ *
+ * A property declared the usual way, `INDI::PropertySwitch SayHelloSP {SAY_HELLO_N}`,
+ * allocates its elements on the heap, and initProperties() then copies the name,
+ * label and format of every element into them one fill() at a time. With a
+ * schema the elements of a property are listed once, the enum of their indexes
+ * is generated from the list, and the vector and element structs of every
+ * property are laid out, names and all, by the compiler. A Block holds them in
+ * one piece and is initialized with a single copy of that image.
+ *
+ * The driver works with the vector structs in the block through the classic
+ * API (defineProperty(), IUUpdateSwitch(), IDSetSwitch(), ...). The
+ * INDI::PropertySwitch and friends cannot view them: they keep their elements
+ * in their own typed private object, which a plain vector struct does not have.
+ *
+ * @code
+ * // In the class of the driver: the element names double as the enum.
+ * #define SAY_HELLO_ELEMENTS(X) \
+ *     X(SAY_HELLO_DEFAULT, "Say Hello") \
+ *     X(SAY_HELLO_CUSTOM, "Say Custom")
+ * enum { SAY_HELLO_ELEMENTS(INDI_SCHEMA_INDEX) SAY_HELLO_N };
+ * static constexpr Schema::SwitchVector<SAY_HELLO_N> SayHello
+ * {
+ *     "SAY_HELLO", "Hello Commands", Schema::MainControlTab, IP_RW, ISR_ATMOST1, 60, IPS_IDLE,
+ *     {{SAY_HELLO_ELEMENTS(INDI_SCHEMA_SWITCH)}}
+ * };
+ *
+ * Schema::Block<SayHello, ...> Properties;
+ * ISwitchVectorProperty *SayHelloSP {Properties.vector<SayHello>()};
+ *
+ * // initProperties(), instead of the fill() calls:
+ * Properties.setDevice(getDeviceName());
+ * // updateProperties():
+ * defineProperty(SayHelloSP);
+ * // ISNewSwitch():
+ * IUUpdateSwitch(SayHelloSP, states, names, n);
+ * IDSetSwitch(SayHelloSP, nullptr);
+ * @endcode
+ *
+ * Text values stay on the heap, INDI reallocates them when a client sets them.
+ */
+
+/** @brief Generates the enum of element indexes from an element list. */
+#define INDI_SCHEMA_INDEX(name, ...) name,
+/** @brief Element list entries: (NAME, label[, state]). */
+#define INDI_SCHEMA_SWITCH(name, ...) Schema::Switch {#name, __VA_ARGS__},
+/** @brief Element list entries: (NAME, label, format, min, max, step, value). */
+#define INDI_SCHEMA_NUMBER(name, ...) Schema::Number {#name, __VA_ARGS__},
+/** @brief Element list entries: (NAME, label, text). */
+#define INDI_SCHEMA_TEXT(name, ...) Schema::Text {#name, __VA_ARGS__},
+
+namespace Schema
+{
+
+// The groups of INDI::DefaultDevice, which are not constants in libindi.
+constexpr std::string_view MainControlTab = "Main Control";
+constexpr std::string_view ConnectionTab = "Connection";
+constexpr std::string_view OptionsTab = "Options";
+constexpr std::string_view InfoTab = "General Info";
+
+struct Switch
+{
+    std::string_view name;
+    std::string_view label;
+    ISState state {ISS_OFF};
+};
+
+struct Number
+{
+    std::string_view name;
+    std::string_view label;
+    std::string_view format;
+    double min {0};
+    double max {0};
+    double step {0};
+    double value {0};
+};
+
+struct Text
+{
+    std::string_view name;
+    std::string_view label;
+    std::string_view text;
+};
+
+template <size_t N>
+struct SwitchVector
+{
+    using Element = ISwitch;
+    using Vector = ISwitchVectorProperty;
+
+    std::string_view name;
+    std::string_view label;
+    std::string_view group;
+    IPerm perm;
+    ISRule rule;
+    double timeout;
+    IPState state;
+    std::array<Switch, N> elements;
+};
+
+template <size_t N>
+struct NumberVector
+{
+    using Element = INumber;
+    using Vector = INumberVectorProperty;
+
+    std::string_view name;
+    std::string_view label;
+    std::string_view group;
+    IPerm perm;
+    double timeout;
+    IPState state;
+    std::array<Number, N> elements;
+};
+
+template <size_t N>
+struct TextVector
+{
+    using Element = IText;
+    using Vector = ITextVectorProperty;
+
+    std::string_view name;
+    std::string_view label;
+    std::string_view group;
+    IPerm perm;
+    double timeout;
+    IPState state;
+    std::array<Text, N> elements;
+};
+
+/** @brief The vector and element structs of one property, next to each other. */
+template <typename Descriptor>
+struct Storage
+{
+    typename Descriptor::Vector vector;
+    typename Descriptor::Element elements[std::tuple_size<decltype(Descriptor::elements)>::value];
+};
+
+namespace Detail
+{
+
+// A name that does not fit stops the compilation where the image is built.
+template <size_t Size>
+constexpr void copy(char (&target)[Size], std::string_view source)
+{
+    if (source.size() >= Size)
+        throw "name, label or format too long for INDI";
+    for (size_t i = 0; i < source.size(); ++i)
+        target[i] = source[i];
+}
+
+template <typename Descriptor>
+constexpr void checkNames(const Descriptor &descriptor)
+{
+    for (size_t i = 0; i < descriptor.elements.size(); ++i)
+        for (size_t j = i + 1; j < descriptor.elements.size(); ++j)
+            if (descriptor.elements[i].name == descriptor.elements[j].name)
+                throw "two elements of a property with the same name";
+}
+
+template <typename Descriptor>
+constexpr void fillVector(typename Descriptor::Vector &vector, const Descriptor &descriptor)
+{
+    checkNames(descriptor);
+    copy(vector.name, descriptor.name);
+    copy(vector.label, descriptor.label);
+    copy(vector.group, descriptor.group);
+    vector.p = descriptor.perm;
+    vector.timeout = descriptor.timeout;
+    vector.s = descriptor.state;
+}
+
+template <size_t N>
+constexpr Storage<SwitchVector<N>> image(const SwitchVector<N> &descriptor)
+{
+    Storage<SwitchVector<N>> storage {};
+    fillVector(storage.vector, descriptor);
+    storage.vector.r = descriptor.rule;
+    storage.vector.nsp = static_cast<int>(N);
+    for (size_t i = 0; i < N; ++i)
+    {
+        copy(storage.elements[i].name, descriptor.elements[i].name);
+        copy(storage.elements[i].label, descriptor.elements[i].label);
+        storage.elements[i].s = descriptor.elements[i].state;
+    }
+    return storage;
+}
+
+template <size_t N>
+constexpr Storage<NumberVector<N>> image(const NumberVector<N> &descriptor)
+{
+    Storage<NumberVector<N>> storage {};
+    fillVector(storage.vector, descriptor);
+    storage.vector.nnp = static_cast<int>(N);
+    for (size_t i = 0; i < N; ++i)
+    {
+        copy(storage.elements[i].name, descriptor.elements[i].name);
+        copy(storage.elements[i].label, descriptor.elements[i].label);
+        copy(storage.elements[i].format, descriptor.elements[i].format);
+        storage.elements[i].min = descriptor.elements[i].min;
+        storage.elements[i].max = descriptor.elements[i].max;
+        storage.elements[i].step = descriptor.elements[i].step;
+        storage.elements[i].value = descriptor.elements[i].value;
+    }
+    return storage;
+}
+
+template <size_t N>
+constexpr Storage<TextVector<N>> image(const TextVector<N> &descriptor)
+{
+    Storage<TextVector<N>> storage {};
+    fillVector(storage.vector, descriptor);
+    storage.vector.ntp = static_cast<int>(N);
+    for (size_t i = 0; i < N; ++i)
+    {
+        copy(storage.elements[i].name, descriptor.elements[i].name);
+        copy(storage.elements[i].label, descriptor.elements[i].label);
+    }
+    return storage;
+}
+
+// The pointers between a vector and its elements, and the text values, which
+// cannot be part of the image.
+template <size_t N>
+void link(Storage<SwitchVector<N>> &storage, const SwitchVector<N> &)
+{
+    storage.vector.sp = storage.elements;
+    for (auto &element : storage.elements)
+        element.svp = &storage.vector;
+}
+
+template <size_t N>
+void link(Storage<NumberVector<N>> &storage, const NumberVector<N> &)
+{
+    storage.vector.np = storage.elements;
+    for (auto &element : storage.elements)
+        element.nvp = &storage.vector;
+}
+
+template <size_t N>
+void link(Storage<TextVector<N>> &storage, const TextVector<N> &descriptor)
+{
+    storage.vector.tp = storage.elements;
+    for (size_t i = 0; i < N; ++i)
+    {
+        storage.elements[i].tvp = &storage.vector;
+        storage.elements[i].text = strndup(descriptor.elements[i].text.data(), descriptor.elements[i].text.size());
+    }
+}
+
+template <typename Descriptor>
+void release(Storage<Descriptor> &)
+{
+}
+
+template <size_t N>
+void release(Storage<TextVector<N>> &storage)
+{
+    for (auto &element : storage.elements)
+    {
+        free(element.text);
+        element.text = nullptr;
+    }
+}
+
+template <const auto &A, const auto &B>
+struct Same : std::false_type
+{
+};
+
+template <const auto &A>
+struct Same<A, A> : std::true_type
+{
+};
+
+template <const auto &Descriptor, const auto &... Descriptors>
+constexpr size_t indexOf()
+{
+    size_t index = 0;
+    const bool found = ((Same<Descriptor, Descriptors>::value ? true : (++index, false)) || ...);
+    return found ? index : throw "the property is not part of the block";
+}
+
+}
+
+/**
+ * @brief The storage of a set of properties declared as static constexpr
+ * descriptors, in declaration order.
+ *
+ * Declare it before the INDI properties that view it, so that it outlives them.
+ */
+template <const auto &... Descriptors>
+class Block
+{
+public:
+    Block() : m_Storage(Image)
+    {
+        std::apply([](auto &... storage)
+        {
+            (Detail::link(storage, Descriptors), ...);
+        }, m_Storage);
+    }
+
+    ~Block()
+    {
+        std::apply([](auto &... storage)
+        {
+            (Detail::release(storage), ...);
+        }, m_Storage);
+    }
+
+    Block(const Block &) = delete;
+    Block &operator=(const Block &) = delete;
+
+    /** @brief Set the device of all properties, from initProperties(). */
+    void setDevice(const char *device)
+    {
+        std::apply([device](auto &... storage)
+        {
+            ((strncpy(storage.vector.device, device, MAXINDIDEVICE - 1),
+              storage.vector.device[MAXINDIDEVICE - 1] = '\0'), ...);
+        }, m_Storage);
+    }
+
+    /** @brief The vector and elements of a property of the block. */
+    template <const auto &Descriptor>
+    auto &storage()
+    {
+        return std::get<Detail::indexOf<Descriptor, Descriptors...>()>(m_Storage);
+    }
+
+    /** @brief The vector struct of a property of the block, for the classic API. */
+    template <const auto &Descriptor>
+    typename std::decay_t<decltype(Descriptor)>::Vector *vector()
+    {
+        return &storage<Descriptor>().vector;
+    }
+
+    /** @brief Bytes of property storage, for comparisons. */
+    static constexpr size_t size()
+    {
+        return sizeof(Image);
+    }
+
+private:
+    using Tuple = std::tuple<Storage<std::decay_t<decltype(Descriptors)>>...>;
+    static constexpr Tuple Image {Detail::image(Descriptors)...};
+
+    Tuple m_Storage;
+};
+
+}
@@ -0,0 +1,200 @@
+#include "rolling_window.h"
+
+#include <cmath>
+
+// -- RollingWindow ----------------------------------------------------------
+
+RollingWindow::RollingWindow(double window, size_t capacity)
+    : m_Window(window), m_Ring(capacity > 0 ? capacity : 1), m_Min(m_Ring.size()), m_Max(m_Ring.size())
+{
+}
+
+void RollingWindow::clear()
+{
+    m_Head = m_Size = 0;
+    m_Oldest = m_Sequence;
+    m_Saturated = false;
+    m_Min.clear();
+    m_Max.clear();
+    m_SumValue = m_SumTime = m_SumTime2 = m_SumTimeValue = 0;
+    m_Removed = 0;
+}
+
+void RollingWindow::add(double time, double value)
+{
+    expire(time);
+    if (m_Size == m_Ring.size())
+    {
+        popOldest();
+        m_Saturated = true;
+    }
+    if (m_Size == 0)
+        m_Origin = time;
+
+    m_Ring[wrap(m_Head + m_Size, m_Ring.size())] = {time, value};
+    ++m_Size;
+
+    const double t = time - m_Origin;
+    m_SumValue += value;
+    m_SumTime += t;
+    m_SumTime2 += t * t;
+    m_SumTimeValue += t * value;
+
+    m_Min.push(m_Sequence, value, [](double kept, double added)
+    {
+        return kept < added;
+    });
+    m_Max.push(m_Sequence, value, [](double kept, double added)
+    {
+        return kept > added;
+    });
+    ++m_Sequence;
+}
+
+void RollingWindow::expire(double time)
+{
+    while (m_Size > 0 && m_Ring[m_Head].time <= time - m_Window)
+        popOldest();
+}
+
+void RollingWindow::popOldest()
+{
+    const Sample &oldest = m_Ring[m_Head];
+    const double t = oldest.time - m_Origin;
+    m_SumValue -= oldest.value;
+    m_SumTime -= t;
+    m_SumTime2 -= t * t;
+    m_SumTimeValue -= t * oldest.value;
+
+    m_Head = wrap(m_Head + 1, m_Ring.size());
+    --m_Size;
+    ++m_Oldest;
+    m_Min.expire(m_Oldest);
+    m_Max.expire(m_Oldest);
+
+    if (m_Size == 0)
+    {
+        m_SumValue = m_SumTime = m_SumTime2 = m_SumTimeValue = 0;
+        m_Removed = 0;
+    }
+    // Once per ring length, so it stays a constant cost per sample.
+    else if (++m_Removed >= m_Ring.size())
+        recompute();
+}
+
+void RollingWindow::recompute()
+{
+    m_Origin = m_Ring[m_Head].time;
+    m_SumValue = m_SumTime = m_SumTime2 = m_SumTimeValue = 0;
+    for (size_t i = 0; i < m_Size; ++i)
+    {
+        const Sample &sample = m_Ring[wrap(m_Head + i, m_Ring.size())];
+        const double t = sample.time - m_Origin;
+        m_SumValue += sample.value;
+        m_SumTime += t;
+        m_SumTime2 += t * t;
+        m_SumTimeValue += t * sample.value;
+    }
+    m_Removed = 0;
+}
+
+double RollingWindow::min() const
+{
+    return m_Size > 0 ? m_Min.front() : 0;
+}
+
+double RollingWindow::max() const
+{
+    return m_Size > 0 ? m_Max.front() : 0;
+}
+
+double RollingWindow::sum() const
+{
+    return m_SumValue;
+}
+
+double RollingWindow::mean() const
+{
+    return m_Size > 0 ? m_SumValue / m_Size : 0;
+}
+
+double RollingWindow::slope() const
+{
+    const double n = static_cast<double>(m_Size);
+    const double denominator = n * m_SumTime2 - m_SumTime * m_SumTime;
+    if (m_Size < 2 || denominator <= 0)
+        return 0;
+    return (n * m_SumTimeValue - m_SumTime * m_SumValue) / denominator;
+}
+
+// -- Ewma -------------------------------------------------------------------
+
+void Ewma::add(double time, double value)
+{
+    if (m_Empty || m_TimeConstant <= 0)
+    {
+        m_Value = value;
+        m_Last = time;
+        m_Empty = false;
+        return;
+    }
+    const double elapsed = time - m_Last;
+    if (elapsed > 0)
+        m_Value += (1 - std::exp(-elapsed / m_TimeConstant)) * (value - m_Value);
+    m_Last = time;
+}
+
+// -- Hysteresis -------------------------------------------------------------
+
+Hysteresis::Hysteresis(double warning, double danger, double band, double hold)
+{
+    setLimits(warning, danger, band, hold);
+}
+
+void Hysteresis::setLimits(double warning, double danger, double band, double hold)
+{
+    m_Warning = warning;
+    m_Danger = danger;
+    m_Band = band;
+    m_Hold = hold;
+}
+
+Hysteresis::Level Hysteresis::target(double value, double margin) const
+{
+    if (value >= m_Danger - margin)
+        return Danger;
+    if (value >= m_Warning - margin)
+        return Warning;
+    return Clear;
+}
+
+Hysteresis::Level Hysteresis::update(double time, double value)
+{
+    const Level up = target(value, 0);
+    if (up > m_Level)
+    {
+        m_Level = up;
+        m_Low = false;
+        ++m_Changes;
+        return m_Level;
+    }
+
+    const Level down = target(value, m_Band);
+    if (down >= m_Level)
+    {
+        m_Low = false;
+        return m_Level;
+    }
+    if (!m_Low)
+    {
+        m_Low = true;
+        m_LowSince = time;
+    }
+    if (time - m_LowSince >= m_Hold)
+    {
+        m_Level = down;
+        m_Low = false;
+        ++m_Changes;
+    }
+    return m_Level;
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Minimum, maximum, mean, sum and trend of a stream of samples over a
+ * sliding time window, at a constant cost per sample whatever the length of
+ * the window.
+ *
+ * The samples are kept in a ring buffer, so the oldest leave the window in
+ * the order they came. The sums behind the mean, the sum and the least
+ * squares slope are kept up to date by adding the new sample and subtracting
+ * the ones that leave, and recomputed from the ring now and then so rounding
+ * does not accumulate. The minimum and maximum come from monotonic queues: a
+ * sample that can no longer be the minimum because a smaller one came after
+ * it is dropped at once, so the front of the queue is the minimum and each
+ * sample enters and leaves the queue once.
+ *
+ * Holds at most capacity samples. Past that the oldest are dropped before
+ * they leave the window, and saturated() says so. Not thread safe.
+ */
+class RollingWindow
+{
+public:
+    /**
+     * @param window seconds a sample counts for.
+     * @param capacity samples the window holds, the sample rate times the window.
+     */
+    RollingWindow(double window, size_t capacity);
+
+    /** @brief Add a sample. Times must not go backwards. */
+    void add(double time, double value);
+
+    /** @brief Let the samples older than the window before time leave, without adding one. */
+    void expire(double time);
+
+    void clear();
+
+    size_t count() const
+    {
+        return m_Size;
+    }
+
+    bool empty() const
+    {
+        return m_Size == 0;
+    }
+
+    double window() const
+    {
+        return m_Window;
+    }
+
+    /** @brief Samples were dropped before they left the window. */
+    bool saturated() const
+    {
+        return m_Saturated;
+    }
+
+    /** @brief Of the samples in the window, 0 without samples. */
+    double min() const;
+    double max() const;
+    double mean() const;
+    double sum() const;
+    /** @brief Least squares slope of the samples, change of the value per second. */
+    double slope() const;
+
+private:
+    struct Sample
+    {
+        double time;
+        double value;
+    };
+
+    // An index past the end of a ring back to its start, without dividing.
+    static size_t wrap(size_t index, size_t size)
+    {
+        return index >= size ? index - size : index;
+    }
+
+    // Sequence numbers of the samples that can still be the minimum or the
+    // maximum, in a ring as long as the window.
+    class MonotonicQueue
+    {
+    public:
+        explicit MonotonicQueue(size_t capacity) : m_Ring(capacity) {}
+
+        // The entries at the back the new value beats go, better(kept, added)
+        // says if the kept one stays.
+        template <typename Better>
+        void push(uint64_t sequence, double value, Better better)
+        {
+            while (m_Size > 0 && !better(m_Ring[back()].value, value))
+                --m_Size;
+            m_Ring[wrap(m_Head + m_Size, m_Ring.size())] = {sequence, value};
+            ++m_Size;
+        }
+
+        void expire(uint64_t oldest)
+        {
+            while (m_Size > 0 && m_Ring[m_Head].sequence < oldest)
+            {
+                m_Head = wrap(m_Head + 1, m_Ring.size());
+                --m_Size;
+            }
+        }
+
+        double front() const
+        {
+            return m_Ring[m_Head].value;
+        }
+
+        void clear()
+        {
+            m_Head = m_Size = 0;
+        }
+
+    private:
+        struct Entry
+        {
+            uint64_t sequence;
+            double value;
+        };
+
+        size_t back() const
+        {
+            return wrap(m_Head + m_Size - 1, m_Ring.size());
+        }
+
+        std::vector<Entry> m_Ring;
+        size_t m_Head {0};
+        size_t m_Size {0};
+    };
+
+    void popOldest();
+    void recompute();
+
+    double m_Window;
+    std::vector<Sample> m_Ring;
+    size_t m_Head {0};
+    size_t m_Size {0};
+    // Of the next sample, and of the oldest in the ring.
+    uint64_t m_Sequence {0};
+    uint64_t m_Oldest {0};
+    bool m_Saturated {false};
+
+    MonotonicQueue m_Min;
+    MonotonicQueue m_Max;
+
+    // Times are taken from m_Origin so their squares keep their precision.
+    double m_Origin {0};
+    double m_SumValue {0};
+    double m_SumTime {0};
+    double m_SumTime2 {0};
+    double m_SumTimeValue {0};
+    // Samples that left since the sums were last recomputed.
+    size_t m_Removed {0};
+};
+
+/** @brief Exponentially weighted moving average over time, for samples at any rate. */
+class Ewma
+{
+public:
+    /** @param timeConstant seconds after which a step is followed by 63%. */
+    explicit Ewma(double timeConstant) : m_TimeConstant(timeConstant) {}
+
+    void add(double time, double value);
+
+    void clear()
+    {
+        m_Empty = true;
+    }
+
+    bool empty() const
+    {
+        return m_Empty;
+    }
+
+    double value() const
+    {
+        return m_Value;
+    }
+
+private:
+    double m_TimeConstant;
+    double m_Value {0};
+    double m_Last {0};
+    bool m_Empty {true};
+};
+
+/**
+ * @brief Clear, warning or danger for a value that rises towards danger, as
+ * a gust maximum or a rain rate, without flapping around the limits.
+ *
+ * A level is entered as soon as the value reaches its limit. It is only left
+ * after the value stayed below the limit minus band for hold seconds.
+ */
+class Hysteresis
+{
+public:
+    enum Level
+    {
+        Clear,
+        Warning,
+        Danger
+    };
+
+    Hysteresis(double warning, double danger, double band, double hold);
+
+    void setLimits(double warning, double danger, double band, double hold);
+
+    /** @brief Take a value, times must not go backwards. @return the level. */
+    Level update(double time, double value);
+
+    Level level() const
+    {
+        return m_Level;
+    }
+
+    /** @brief Times the level changed. */
+    uint64_t changes() const
+    {
+        return m_Changes;
+    }
+
+private:
+    Level target(double value, double margin) const;
+
+    double m_Warning;
+    double m_Danger;
+    double m_Band;
+    double m_Hold;
+    Level m_Level {Clear};
+    // The value is low enough to step down, since m_LowSince.
+    bool m_Low {false};
+    double m_LowSince {0};
+    uint64_t m_Changes {0};
+};
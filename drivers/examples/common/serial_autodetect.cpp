@@ -0,0 +1,361 @@
+#include "serial_autodetect.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+speed_t speedFor(int baud)
+{
+    switch (baud)
+    {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: return B0;
+    }
+}
+
+std::string resolve(const std::string &path)
+{
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) != nullptr ? std::string(resolved) : path;
+}
+
+bool readLine(const std::string &path, std::string &line)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return false;
+    char buffer[256] = {0};
+    const bool ok = fgets(buffer, sizeof(buffer), file) != nullptr;
+    fclose(file);
+    line = buffer;
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r' || line.back() == ' '))
+        line.pop_back();
+    return ok;
+}
+
+// The cache: one "key port baud" line per device, the key is the USB serial
+// number or "port:<path>" for adapters without one.
+struct CacheEntry
+{
+    std::string port;
+    int baud;
+};
+
+std::string cacheKey(const std::string &port, const std::string &usbSerial)
+{
+    return usbSerial.empty() ? "port:" + port : usbSerial;
+}
+
+std::map<std::string, CacheEntry> loadCache(const std::string &path)
+{
+    std::map<std::string, CacheEntry> cache;
+    FILE *file = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return cache;
+
+    char key[256], port[PATH_MAX];
+    int baud;
+    while (fscanf(file, "%255s %4095s %d", key, port, &baud) == 3)
+        cache[key] = {port, baud};
+    fclose(file);
+    return cache;
+}
+
+void saveCache(const std::string &path, const std::map<std::string, CacheEntry> &cache)
+{
+    if (path.empty())
+        return;
+    // Write aside and rename, a crash never leaves half a cache behind.
+    const std::string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == nullptr)
+        return;
+    for (const auto &entry : cache)
+        fprintf(file, "%s %s %d\n", entry.first.c_str(), entry.second.port.c_str(), entry.second.baud);
+    if (fclose(file) == 0)
+        rename(temporary.c_str(), path.c_str());
+}
+
+bool waitFor(int fd, short events, int cancelFd, int timeoutMs)
+{
+    pollfd fds[2] = {{fd, events, 0}, {cancelFd, POLLIN, 0}};
+    int rc;
+    do
+    {
+        rc = poll(fds, cancelFd >= 0 ? 2 : 1, timeoutMs);
+    }
+    while (rc < 0 && errno == EINTR);
+    return rc > 0 && fds[0].revents != 0 && (cancelFd < 0 || fds[1].revents == 0);
+}
+
+}
+
+bool SerialAutoDetect::Link::cancelled() const
+{
+    if (m_CancelFd < 0)
+        return false;
+    pollfd pfd = {m_CancelFd, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+bool SerialAutoDetect::Link::write(const char *data, size_t size)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        const ssize_t rc = ::write(m_Fd, data + written, size - written);
+        if (rc > 0)
+            written += rc;
+        else if (rc < 0 && errno == EINTR)
+            continue;
+        else if (rc < 0 && errno == EAGAIN && waitFor(m_Fd, POLLOUT, m_CancelFd, 1000))
+            continue;
+        else
+            return false;
+    }
+    return true;
+}
+
+bool SerialAutoDetect::Link::write(const char *text)
+{
+    return write(text, strlen(text));
+}
+
+int SerialAutoDetect::Link::readSection(char *buffer, size_t size, char stop, int timeoutMs)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    size_t got = 0;
+    while (got < size)
+    {
+        const int left = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count());
+        if (left <= 0 || !waitFor(m_Fd, POLLIN, m_CancelFd, left))
+            return -1;
+
+        // A byte at a time, whatever follows the stop byte stays in the port.
+        const ssize_t rc = ::read(m_Fd, buffer + got, 1);
+        if (rc == 1)
+        {
+            if (buffer[got++] == stop)
+                return static_cast<int>(got);
+        }
+        else if (rc == 0 || (errno != EINTR && errno != EAGAIN))
+            return -1;
+    }
+    return -1;
+}
+
+int SerialAutoDetect::openPort(const std::string &port, int baud)
+{
+    const speed_t speed = speedFor(baud);
+    if (speed == B0)
+        return -1;
+
+    const int fd = open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // Like tty_connect(): never talk to a port another driver holds.
+    termios tty;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || tcgetattr(fd, &tty) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSTOPB | PARENB);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tty) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+std::vector<std::string> SerialAutoDetect::listPorts()
+{
+    std::vector<std::string> ports;
+    for (const char *pattern : {"/dev/serial/by-id/*", "/dev/ttyUSB*", "/dev/ttyACM*", "/dev/cu.usb*"})
+    {
+        glob_t matches;
+        if (glob(pattern, 0, nullptr, &matches) == 0)
+        {
+            for (size_t i = 0; i < matches.gl_pathc; ++i)
+                ports.push_back(resolve(matches.gl_pathv[i]));
+        }
+        globfree(&matches);
+    }
+    std::sort(ports.begin(), ports.end());
+    ports.erase(std::unique(ports.begin(), ports.end()), ports.end());
+    return ports;
+}
+
+std::string SerialAutoDetect::usbSerial(const std::string &port)
+{
+    const std::string device = resolve(port);
+    const std::string name = device.substr(device.find_last_of('/') + 1);
+
+    // /sys/class/tty/ttyUSB0/device is the interface, the USB device with its
+    // serial file is one or two levels up.
+    std::string path = resolve("/sys/class/tty/" + name + "/device");
+    for (int level = 0; level < 4 && path.compare(0, 13, "/sys/devices/") == 0; ++level)
+    {
+        std::string vendor, serial;
+        if (readLine(path + "/idVendor", vendor))
+            return readLine(path + "/serial", serial) ? serial : std::string();
+        path = path.substr(0, path.find_last_of('/'));
+    }
+    return std::string();
+}
+
+SerialAutoDetect::Result SerialAutoDetect::detect(const Probe &probe, const Options &options)
+{
+    const auto start = Clock::now();
+    Result result;
+
+    std::vector<std::string> ports = options.ports.empty() ? listPorts() : options.ports;
+    if (!options.preferredPort.empty())
+    {
+        const std::string preferred = resolve(options.preferredPort);
+        ports.erase(std::remove(ports.begin(), ports.end(), preferred), ports.end());
+        ports.insert(ports.begin(), preferred);
+    }
+
+    std::vector<std::string> serials;
+    for (const std::string &port : ports)
+        serials.push_back(usbSerial(port));
+
+    std::map<std::string, CacheEntry> cache = loadCache(options.cachePath);
+
+    int cancelPipe[2];
+    if (pipe(cancelPipe) != 0)
+        return result;
+
+    std::mutex mutex;
+    std::atomic<size_t> probes {0};
+
+    // Probe one port at the given baud rates, in order. The first success wins.
+    auto probePort = [&](size_t index, const std::vector<int> &bauds)
+    {
+        for (int baud : bauds)
+        {
+            const int fd = openPort(ports[index], baud);
+            if (fd < 0)
+                return;
+
+            Link link(fd, cancelPipe[0]);
+            if (link.cancelled())
+            {
+                close(fd);
+                return;
+            }
+
+            ++probes;
+            if (probe(link))
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!result.found)
+                {
+                    result.found = true;
+                    result.port = ports[index];
+                    result.baud = baud;
+                    result.usbSerial = serials[index];
+                    result.fd = fd;
+                    // Wakes up every other probe, they see cancelled().
+                    const char byte = 1;
+                    if (::write(cancelPipe[1], &byte, 1) != 1)
+                        perror("SerialAutoDetect");
+                    return;
+                }
+            }
+            close(fd);
+        }
+    };
+
+    // A device we know, wherever it is now: straight to its baud rate.
+    for (size_t i = 0; i < ports.size() && !result.found; ++i)
+    {
+        const auto entry = cache.find(cacheKey(ports[i], serials[i]));
+        if (entry != cache.end())
+        {
+            probePort(i, {entry->second.baud});
+            result.fromCache = result.found;
+        }
+    }
+
+    // Everything, each port on its own thread, likely baud rates first.
+    if (!result.found && !ports.empty())
+    {
+        std::vector<int> bauds = options.bauds;
+        if (std::find(bauds.begin(), bauds.end(), options.preferredBaud) != bauds.end())
+        {
+            bauds.erase(std::remove(bauds.begin(), bauds.end(), options.preferredBaud), bauds.end());
+            bauds.insert(bauds.begin(), options.preferredBaud);
+        }
+
+        std::atomic<size_t> next {0};
+        auto worker = [&]
+        {
+            for (size_t i = next++; i < ports.size(); i = next++)
+                probePort(i, bauds);
+        };
+
+        std::vector<std::thread> threads;
+        const size_t count = std::min(ports.size(), std::max<size_t>(1, options.maxParallel));
+        for (size_t i = 1; i < count; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    close(cancelPipe[0]);
+    close(cancelPipe[1]);
+
+    if (result.found)
+    {
+        CacheEntry &entry = cache[cacheKey(result.port, result.usbSerial)];
+        if (entry.port != result.port || entry.baud != result.baud)
+        {
+            entry = {result.port, result.baud};
+            saveCache(options.cachePath, cache);
+        }
+    }
+
+    result.probes = probes;
+    result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    return result;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Finds the port and baud rate a serial device answers on.
+ *
+ * Every candidate port is probed on its own thread, trying the baud rates one
+ * after the other, since a port can only be open once. The first probe that
+ * recognizes the device wins and the others are cancelled: their reads return
+ * right away. So a scan costs about one probe timeout per baud rate, however
+ * many ports there are, instead of one per port and baud rate.
+ *
+ * The winning port and baud rate are cached by the USB serial number of the
+ * adapter, or by the port when it has none. When a cached device shows up
+ * again, under whatever name the hub gave it this time, it is probed alone at
+ * its cached baud rate before anything else.
+ */
+class SerialAutoDetect
+{
+public:
+    /** @brief What a probe gets to talk to one candidate. */
+    class Link
+    {
+    public:
+        Link(int fd, int cancelFd) : m_Fd(fd), m_CancelFd(cancelFd) {}
+
+        int fd() const
+        {
+            return m_Fd;
+        }
+
+        /** @brief Another probe already found the device, give up. */
+        bool cancelled() const;
+
+        bool write(const char *data, size_t size);
+        bool write(const char *text);
+
+        /**
+         * @brief Read up to and including stop, like tty_read_section().
+         * @return bytes read, -1 on timeout, cancellation or error.
+         */
+        int readSection(char *buffer, size_t size, char stop, int timeoutMs);
+
+    private:
+        int m_Fd;
+        int m_CancelFd;
+    };
+
+    /** @brief Send a handshake over the link, true if the device answered as expected. */
+    using Probe = std::function<bool(Link &link)>;
+
+    struct Options
+    {
+        /** Ports to probe, empty for listPorts(). */
+        std::vector<std::string> ports;
+        /** Baud rates to try on every port. */
+        std::vector<int> bauds {9600, 19200, 38400, 57600, 115200, 230400};
+        /** Tried first, usually the configured port and baud rate. */
+        std::string preferredPort;
+        int preferredBaud {0};
+        /** File with the last good mappings, empty for no cache. */
+        std::string cachePath;
+        /** Ports probed at the same time. */
+        size_t maxParallel {16};
+    };
+
+    struct Result
+    {
+        bool found {false};
+        std::string port;
+        int baud {0};
+        std::string usbSerial;
+        /** Still open at the found baud rate, owned by the caller. -1 if not found. */
+        int fd {-1};
+        bool fromCache {false};
+        /** Port and baud combinations that were tried. */
+        size_t probes {0};
+        std::chrono::milliseconds elapsed {0};
+    };
+
+    static Result detect(const Probe &probe, const Options &options);
+
+    /** @brief USB serial ports of the system, by-id links resolved. */
+    static std::vector<std::string> listPorts();
+
+    /** @brief iSerial of the USB device behind a tty, empty if it is not USB or has none. */
+    static std::string usbSerial(const std::string &port);
+
+    /** @brief Open a port raw 8N1 at baud, non-blocking. -1 on failure. */
+    static int openPort(const std::string &port, int baud);
+};
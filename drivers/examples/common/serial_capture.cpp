@@ -0,0 +1,156 @@
+#include "serial_capture.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+const char Magic[8] = {'I', 'N', 'D', 'I', 'S', 'C', 'A', 'P'};
+const uint8_t Version = 1;
+const size_t HeaderSize = 24;
+
+size_t putVarint(uint8_t *out, uint64_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        out[size++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+bool getVarint(FILE *file, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        const int c = fgetc(file);
+        if (c == EOF)
+            return false;
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if ((c & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+}
+
+namespace SerialCapture
+{
+
+Writer::~Writer()
+{
+    close();
+}
+
+bool Writer::open(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_File != nullptr)
+        fclose(m_File);
+
+    m_File = fopen(path.c_str(), "wb");
+    if (m_File == nullptr)
+        return false;
+
+    uint8_t header[HeaderSize] = {0};
+    memcpy(header, Magic, sizeof(Magic));
+    header[8] = Version;
+    const uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+    for (int i = 0; i < 8; ++i)
+        header[16 + i] = static_cast<uint8_t>(now >> (8 * i));
+
+    m_Start = std::chrono::steady_clock::now();
+    m_Last = 0;
+    m_Records = 0;
+    if (fwrite(header, sizeof(header), 1, m_File) != 1)
+    {
+        fclose(m_File);
+        m_File = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Writer::close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_File != nullptr)
+        fclose(m_File);
+    m_File = nullptr;
+}
+
+void Writer::record(Direction direction, const void *data, size_t size)
+{
+    // Taken before the lock, so waiting for another thread does not shift the time.
+    const auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_File == nullptr || size == 0)
+        return;
+
+    const uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_Start).count();
+    const uint64_t delta = timestamp > m_Last ? timestamp - m_Last : 0;
+    m_Last = std::max(timestamp, m_Last);
+
+    uint8_t prefix[1 + 10 + 10];
+    prefix[0] = static_cast<uint8_t>(direction);
+    size_t length = 1;
+    length += putVarint(prefix + length, delta);
+    length += putVarint(prefix + length, size);
+
+    // stdio buffers, so this is a memcpy most of the time and never a syscall per byte.
+    fwrite(prefix, 1, length, m_File);
+    fwrite(data, 1, size, m_File);
+    ++m_Records;
+}
+
+bool load(const std::string &path, std::vector<Record> &records)
+{
+    records.clear();
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    uint8_t header[HeaderSize];
+    bool ok = fread(header, sizeof(header), 1, file) == 1 && memcmp(header, Magic, sizeof(Magic)) == 0 &&
+              header[8] == Version;
+
+    uint64_t timestamp = 0;
+    while (ok)
+    {
+        const int direction = fgetc(file);
+        if (direction == EOF)
+            break;
+
+        uint64_t delta = 0, size = 0;
+        if ((direction != static_cast<int>(Direction::Tx) && direction != static_cast<int>(Direction::Rx)) ||
+                !getVarint(file, delta) || !getVarint(file, size) || size > (1u << 24))
+        {
+            ok = false;
+            break;
+        }
+
+        Record record;
+        record.direction = static_cast<Direction>(direction);
+        timestamp += delta;
+        record.timestamp = timestamp;
+        record.data.resize(size);
+        if (fread(record.data.data(), 1, size, file) != size)
+        {
+            ok = false;
+            break;
+        }
+        records.push_back(std::move(record));
+    }
+
+    fclose(file);
+    return ok;
+}
+
+}
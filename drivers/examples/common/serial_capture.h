@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Recording of serial traffic with monotonic timestamps.
+ *
+ * The file starts with a 24 byte header: "INDISCAP", a version byte, three
+ * reserved bytes and the wall clock start time in nanoseconds since the epoch,
+ * little-endian. Then one record per read or write:
+ *
+ *     direction (1 byte, 1 = driver to device, 2 = device to driver)
+ *     nanoseconds since the previous record (LEB128 varint)
+ *     length (LEB128 varint)
+ *     data
+ *
+ * A command and its answer usually take under 20 bytes of overhead.
+ */
+namespace SerialCapture
+{
+
+enum class Direction : uint8_t
+{
+    Tx = 1,
+    Rx = 2,
+};
+
+struct Record
+{
+    Direction direction {Direction::Tx};
+    /** Nanoseconds since the capture was started. */
+    uint64_t timestamp {0};
+    std::vector<uint8_t> data;
+};
+
+/** @brief Appends records to a capture file. Thread safe. */
+class Writer
+{
+public:
+    Writer() = default;
+    ~Writer();
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    /** @brief Create or truncate path and write the header. */
+    bool open(const std::string &path);
+    void close();
+
+    bool isOpen() const
+    {
+        return m_File != nullptr;
+    }
+
+    /** @brief Record data that was just written to or read from the device. */
+    void record(Direction direction, const void *data, size_t size);
+
+    uint64_t records() const
+    {
+        return m_Records;
+    }
+
+private:
+    std::mutex m_Mutex;
+    FILE *m_File {nullptr};
+    std::chrono::steady_clock::time_point m_Start;
+    uint64_t m_Last {0};
+    uint64_t m_Records {0};
+};
+
+/** @brief Read all records of a capture file, false if it is not one or is truncated. */
+bool load(const std::string &path, std::vector<Record> &records);
+
+}
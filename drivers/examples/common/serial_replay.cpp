@@ -0,0 +1,121 @@
+#include "serial_replay.h"
+
+#include <algorithm>
+#include <thread>
+
+using SerialCapture::Direction;
+
+SerialReplay::SerialReplay(std::vector<SerialCapture::Record> records, double speed)
+    : m_Records(std::move(records)), m_Speed(std::max(0.0, speed)), m_Anchor(std::chrono::steady_clock::now())
+{
+}
+
+double SerialReplay::progress() const
+{
+    return m_Records.empty() ? 1.0 : static_cast<double>(std::min(m_Index, m_Records.size())) / m_Records.size();
+}
+
+void SerialReplay::advance(size_t bytes)
+{
+    m_Offset += bytes;
+    if (m_Offset >= m_Records[m_Index].data.size())
+    {
+        ++m_Index;
+        m_Offset = 0;
+    }
+}
+
+bool SerialReplay::write(const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    m_Stats.bytesWritten += size;
+
+    // Whatever the device said before this command is flushed.
+    while (!atEnd() && m_Records[m_Index].direction == Direction::Rx)
+    {
+        m_Stats.discarded += m_Records[m_Index].data.size() - m_Offset;
+        advance(m_Records[m_Index].data.size() - m_Offset);
+    }
+
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (atEnd() || m_Records[m_Index].direction != Direction::Tx)
+        {
+            // The driver says more than it did in the capture.
+            mismatches += size - i;
+            break;
+        }
+        const auto &record = m_Records[m_Index];
+        if (record.data[m_Offset] != bytes[i])
+            ++mismatches;
+        m_AnchorTimestamp = record.timestamp;
+        advance(1);
+    }
+
+    m_Anchor = std::chrono::steady_clock::now();
+    m_Stats.mismatches += mismatches;
+    return mismatches == 0;
+}
+
+int SerialReplay::readUntil(uint8_t *buffer, size_t size, int stop, int timeoutMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    size_t count = 0;
+
+    while (count < size)
+    {
+        // The device stays quiet until the driver sends the next command.
+        if (atEnd() || m_Records[m_Index].direction != Direction::Rx)
+        {
+            if (count > 0)
+                break;
+            if (m_Speed > 0)
+                std::this_thread::sleep_until(deadline);
+            return -1;
+        }
+
+        const auto &record = m_Records[m_Index];
+        if (m_Speed > 0)
+        {
+            const double delay = (record.timestamp - std::min(record.timestamp, m_AnchorTimestamp)) / m_Speed;
+            const auto due = m_Anchor + std::chrono::nanoseconds(static_cast<int64_t>(delay));
+            if (due > deadline)
+            {
+                std::this_thread::sleep_until(deadline);
+                m_Stats.bytesRead += count;
+                return count > 0 ? static_cast<int>(count) : -1;
+            }
+            std::this_thread::sleep_until(due);
+        }
+
+        while (count < size && m_Offset < record.data.size())
+        {
+            const uint8_t byte = record.data[m_Offset++];
+            buffer[count++] = byte;
+            if (stop >= 0 && byte == stop)
+            {
+                size = count;
+                break;
+            }
+        }
+        if (m_Offset >= record.data.size())
+        {
+            ++m_Index;
+            m_Offset = 0;
+        }
+    }
+
+    m_Stats.bytesRead += count;
+    return static_cast<int>(count);
+}
+
+int SerialReplay::readSection(void *buffer, size_t size, uint8_t stop, int timeoutMs)
+{
+    return readUntil(static_cast<uint8_t *>(buffer), size, stop, timeoutMs);
+}
+
+int SerialReplay::read(void *buffer, size_t size, int timeoutMs)
+{
+    return readUntil(static_cast<uint8_t *>(buffer), size, -1, timeoutMs);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "serial_capture.h"
+
+/**
+ * @brief Plays a serial capture back to a driver in place of the device.
+ *
+ * The driver writes its commands as usual and they are checked against the
+ * recorded ones. The recorded answers become readable as long after the write
+ * as they came after it in the capture, divided by the speed. At speed 0 they
+ * are readable right away, which benchmarks the driver logic alone.
+ *
+ * Pending answers are discarded when the driver writes, like tcflush() before
+ * a command does on a real port.
+ */
+class SerialReplay
+{
+public:
+    struct Stats
+    {
+        uint64_t bytesWritten {0};
+        uint64_t bytesRead {0};
+        /** Written bytes that differ from the capture. */
+        uint64_t mismatches {0};
+        /** Recorded answers the driver never read. */
+        uint64_t discarded {0};
+    };
+
+    /** @param speed 1 for the original timing, 10 for ten times faster, 0 for no waiting at all. */
+    explicit SerialReplay(std::vector<SerialCapture::Record> records, double speed = 1.0);
+
+    /** @brief The driver writes to the device. False if it differs from the capture. */
+    bool write(const void *data, size_t size);
+
+    /**
+     * @brief Read up to and including stop, like tty_read_section().
+     * @return bytes read, or -1 when nothing arrived within timeoutMs or the capture is over.
+     */
+    int readSection(void *buffer, size_t size, uint8_t stop, int timeoutMs);
+
+    /** @brief Read up to size bytes, like tty_read(). Same return as readSection(). */
+    int read(void *buffer, size_t size, int timeoutMs);
+
+    bool atEnd() const
+    {
+        return m_Index >= m_Records.size();
+    }
+
+    /** @brief Position in the capture, 0 to 1. */
+    double progress() const;
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+private:
+    int readUntil(uint8_t *buffer, size_t size, int stop, int timeoutMs);
+    void advance(size_t bytes);
+
+    std::vector<SerialCapture::Record> m_Records;
+    double m_Speed {1.0};
+
+    // Next byte to be written or read.
+    size_t m_Index {0};
+    size_t m_Offset {0};
+
+    // The recorded answers are timed from the last write, here and in the capture.
+    std::chrono::steady_clock::time_point m_Anchor;
+    uint64_t m_AnchorTimestamp {0};
+
+    Stats m_Stats;
+};
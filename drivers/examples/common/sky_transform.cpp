@@ -0,0 +1,525 @@
+#include "sky_transform.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SKY_TRANSFORM_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define SKY_TRANSFORM_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+constexpr double J2000 = 2451545.0;
+constexpr double Pi = 3.14159265358979323846;
+constexpr double DegreesToRadians = Pi / 180.0;
+constexpr double RadiansToDegrees = 180.0 / Pi;
+
+// Below this sine of the zenith distance libnova gives up on the azimuth.
+constexpr double ZenithLimit = 1e-5;
+
+std::atomic<bool> g_SimdEnabled {true};
+
+// Mean sidereal time at Greenwich in degrees, unreduced, as ln_get_mean_sidereal_time().
+inline double meanSidereal(double jd)
+{
+    const double days = jd - J2000;
+    const double centuries = days / 36525.0;
+    return 280.46061837 + 360.98564736629 * days + centuries * centuries * (0.000387933 - centuries / 38710000.0);
+}
+
+// Where the optical axis starting at center along direction leaves a dome of
+// radius around the origin, see INDI::Dome::Intersection().
+inline double domeAzimuth(const double center[3], const double direction[3], double radius)
+{
+    const double b = 2 * (direction[0] * center[0] + direction[1] * center[1] + direction[2] * center[2]);
+    const double c = center[0] * center[0] + center[1] * center[1] + center[2] * center[2] - radius * radius;
+    const double discriminant = b * b - 4 * c;
+    if (radius <= 0 || discriminant < 0)
+        return NAN;
+
+    // Pointing above the horizon the far root is in front of the mount.
+    double mu = (-b + std::sqrt(discriminant)) / 2;
+    if (mu < 0)
+        mu = (-b - std::sqrt(discriminant)) / 2;
+    const double x = center[0] + mu * direction[0];
+    const double y = center[1] + mu * direction[1];
+    const double azimuth = std::atan2(x, y) * RadiansToDegrees;
+    return azimuth < 0 ? azimuth + 360 : azimuth;
+}
+
+// Sign of DM_OTA_OFFSET for a sample, hourAngle in radians, positive west.
+inline double otaSide(SkyTransform::DomeGeometry::Side side, double hourAngle)
+{
+    switch (side)
+    {
+        case SkyTransform::DomeGeometry::SideEast:
+            return -1;
+        case SkyTransform::DomeGeometry::SideWest:
+            return 1;
+        case SkyTransform::DomeGeometry::SideHourAngle:
+            return hourAngle > 0 ? -1 : 1;
+        default:
+            return 0;
+    }
+}
+
+// One sample with libm, the formulas of ln_get_hrz_from_equ() and INDI::Dome::GetTargetAz().
+// domeAz is nullptr when it is not needed.
+void transformScalar(const SkyTransform::Site &site, const SkyTransform::DomeGeometry &dome, double ra, double dec,
+                     double jd, double &alt, double &az, double *domeAz)
+{
+    const double sidereal = std::fmod(meanSidereal(jd), 360.0);
+    const double hourAngle = (sidereal + site.longitude - ra * 15.0) * DegreesToRadians;
+    const double latitude = site.latitude * DegreesToRadians;
+    const double declination = dec * DegreesToRadians;
+
+    const double sinAlt = std::sin(latitude) * std::sin(declination) +
+                          std::cos(latitude) * std::cos(declination) * std::cos(hourAngle);
+    alt = std::asin(sinAlt) * RadiansToDegrees;
+
+    const double zenith = std::sin(std::acos(sinAlt));
+    if (std::fabs(zenith) < ZenithLimit)
+    {
+        az = dec > 0 ? 0 : 180;
+        alt = (dec > 0 && site.latitude > 0) || (dec < 0 && site.latitude < 0) ? 90 : -90;
+    }
+    else
+    {
+        // libnova measures from south.
+        const double sinAz = std::cos(declination) * std::sin(hourAngle) / zenith;
+        const double cosAz = (std::sin(latitude) * std::cos(declination) * std::cos(hourAngle) -
+                              std::cos(latitude) * std::sin(declination)) / zenith;
+        az = std::atan2(sinAz, cosAz) * RadiansToDegrees + 180;
+        if (az >= 360)
+            az -= 360;
+    }
+
+    if (domeAz == nullptr)
+        return;
+
+    // OpticalCenter(): the optical axis circles the mount center in the plane of the equator.
+    const double offset = dome.otaOffset * otaSide(dome.side, std::remainder(hourAngle, 2 * Pi));
+    const double center[3] =
+    {
+        dome.eastDisplacement - offset * std::cos(hourAngle),
+        dome.northDisplacement + offset * std::sin(hourAngle) * std::sin(latitude),
+        dome.upDisplacement + offset * std::sin(hourAngle) * std::cos(latitude),
+    };
+    // OpticalVector()
+    const double direction[3] =
+    {
+        std::cos(alt * DegreesToRadians) * std::sin(az * DegreesToRadians),
+        std::cos(alt * DegreesToRadians) * std::cos(az * DegreesToRadians),
+        std::sin(alt * DegreesToRadians),
+    };
+    *domeAz = domeAzimuth(center, direction, dome.radius);
+}
+
+void transformScalar(const SkyTransform::Site &site, const SkyTransform::Input &input,
+                     const SkyTransform::Output &output, size_t count, const SkyTransform::DomeGeometry &dome)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        double alt, az;
+        transformScalar(site, dome, input.ra[i], input.dec[i], input.jd[i], alt, az,
+                        output.domeAz != nullptr ? output.domeAz + i : nullptr);
+        if (output.alt != nullptr)
+            output.alt[i] = alt;
+        if (output.az != nullptr)
+            output.az[i] = az;
+    }
+}
+
+// Coefficients of the Cephes sin(), cos() and atan(), valid on [-pi/4, pi/4]
+// and [0, 0.66], to a few units in the last place.
+constexpr double SinCoefficients[6] =
+{
+    1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+    -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1,
+};
+constexpr double CosCoefficients[6] =
+{
+    -1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+    2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2,
+};
+constexpr double AtanNumerator[5] =
+{
+    -8.750608600031904122785E-1, -1.615753718733365076637E1, -7.500855792314704667340E1,
+    -1.228866684490136173410E2, -6.485021904942025371773E1,
+};
+constexpr double AtanDenominator[5] =
+{
+    2.485846490142306297962E1, 1.650270098316988542046E2, 4.328810604912902668951E2,
+    4.853903996359136964868E2, 1.945506571482613964425E2,
+};
+// pi/2 in three parts, so that x - n pi/2 is exact for the angles seen here.
+constexpr double HalfPi1 = 1.57079625129699707031E0;
+constexpr double HalfPi2 = 7.54978941586159635335E-8;
+constexpr double HalfPi3 = 5.39030285815811905290E-15;
+// The part of pi/4 a double does not hold.
+constexpr double QuarterPiLow = 3.061616997868382943065E-17;
+
+#if defined(SKY_TRANSFORM_AVX2) || defined(SKY_TRANSFORM_NEON)
+
+// The SIMD kernel is written once against these, the operators of the vector
+// types themselves are the GCC / clang vector extensions.
+#if defined(SKY_TRANSFORM_AVX2)
+
+bool hasAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+}
+
+// Everything up to pop_options is compiled for AVX2 and FMA, and only called
+// when the CPU has them.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+struct Lanes
+{
+    using Vector = __m256d;
+    using Mask = __m256d;
+    static constexpr size_t Width = 4;
+
+    static Vector set(double value)
+    {
+        return _mm256_set1_pd(value);
+    }
+    static Vector load(const double *values)
+    {
+        return _mm256_loadu_pd(values);
+    }
+    static void store(double *values, Vector v)
+    {
+        _mm256_storeu_pd(values, v);
+    }
+    static Vector sqrt(Vector v)
+    {
+        return _mm256_sqrt_pd(v);
+    }
+    static Vector round(Vector v)
+    {
+        return _mm256_round_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    static Vector floor(Vector v)
+    {
+        return _mm256_floor_pd(v);
+    }
+    static Vector abs(Vector v)
+    {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v);
+    }
+    static Vector min(Vector a, Vector b)
+    {
+        return _mm256_min_pd(a, b);
+    }
+    static Vector max(Vector a, Vector b)
+    {
+        return _mm256_max_pd(a, b);
+    }
+    static Mask less(Vector a, Vector b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+    }
+    static Mask both(Mask a, Mask b)
+    {
+        return _mm256_and_pd(a, b);
+    }
+    // mask ? a : b
+    static Vector select(Mask mask, Vector a, Vector b)
+    {
+        return _mm256_blendv_pd(b, a, mask);
+    }
+};
+
+#else
+
+struct Lanes
+{
+    using Vector = float64x2_t;
+    using Mask = uint64x2_t;
+    static constexpr size_t Width = 2;
+
+    static Vector set(double value)
+    {
+        return vdupq_n_f64(value);
+    }
+    static Vector load(const double *values)
+    {
+        return vld1q_f64(values);
+    }
+    static void store(double *values, Vector v)
+    {
+        vst1q_f64(values, v);
+    }
+    static Vector sqrt(Vector v)
+    {
+        return vsqrtq_f64(v);
+    }
+    static Vector round(Vector v)
+    {
+        return vrndnq_f64(v);
+    }
+    static Vector floor(Vector v)
+    {
+        return vrndmq_f64(v);
+    }
+    static Vector abs(Vector v)
+    {
+        return vabsq_f64(v);
+    }
+    static Vector min(Vector a, Vector b)
+    {
+        return vminq_f64(a, b);
+    }
+    static Vector max(Vector a, Vector b)
+    {
+        return vmaxq_f64(a, b);
+    }
+    static Mask less(Vector a, Vector b)
+    {
+        return vcltq_f64(a, b);
+    }
+    static Mask both(Mask a, Mask b)
+    {
+        return vandq_u64(a, b);
+    }
+    static Vector select(Mask mask, Vector a, Vector b)
+    {
+        return vbslq_f64(mask, a, b);
+    }
+};
+
+#endif
+
+template <size_t N>
+inline Lanes::Vector polynomial(Lanes::Vector x, const double (&coefficients)[N])
+{
+    Lanes::Vector result = Lanes::set(coefficients[0]);
+    for (size_t i = 1; i < N; ++i)
+        result = result * x + Lanes::set(coefficients[i]);
+    return result;
+}
+
+// Both at once, |x| up to a few pi.
+inline void sinCos(Lanes::Vector x, Lanes::Vector &sine, Lanes::Vector &cosine)
+{
+    const Lanes::Vector quadrant = Lanes::round(x * Lanes::set(2 / Pi));
+    const Lanes::Vector r = ((x - quadrant * Lanes::set(HalfPi1)) - quadrant * Lanes::set(HalfPi2)) -
+                            quadrant * Lanes::set(HalfPi3);
+    const Lanes::Vector z = r * r;
+    const Lanes::Vector s = r + r * z * polynomial(z, SinCoefficients);
+    const Lanes::Vector c = Lanes::set(1) - Lanes::set(0.5) * z + z * z * polynomial(z, CosCoefficients);
+
+    // Quadrant 0..3: (s, c), (c, -s), (-s, -c), (-c, s).
+    const Lanes::Vector q = quadrant - Lanes::set(4) * Lanes::floor(quadrant * Lanes::set(0.25));
+    const Lanes::Mask odd = Lanes::less(Lanes::set(0.5), q - Lanes::set(2) * Lanes::floor(q * Lanes::set(0.5)));
+    const Lanes::Mask sineNegative = Lanes::less(Lanes::set(1.5), q);
+    const Lanes::Mask cosineNegative = Lanes::both(Lanes::less(Lanes::set(0.5), q), Lanes::less(q, Lanes::set(2.5)));
+    const Lanes::Vector sine0 = Lanes::select(odd, c, s);
+    const Lanes::Vector cosine0 = Lanes::select(odd, s, c);
+    sine = Lanes::select(sineNegative, -sine0, sine0);
+    cosine = Lanes::select(cosineNegative, -cosine0, cosine0);
+}
+
+inline Lanes::Vector atan2(Lanes::Vector y, Lanes::Vector x)
+{
+    const Lanes::Vector ax = Lanes::abs(x);
+    const Lanes::Vector ay = Lanes::abs(y);
+    // In [0, 1], 0 for atan2(0, 0) like libm.
+    const Lanes::Vector t = Lanes::min(ax, ay) / Lanes::max(Lanes::max(ax, ay), Lanes::set(1e-300));
+
+    const Lanes::Mask reduce = Lanes::less(Lanes::set(0.66), t);
+    const Lanes::Vector u = Lanes::select(reduce, (t - Lanes::set(1)) / (t + Lanes::set(1)), t);
+    const Lanes::Vector z = u * u;
+    Lanes::Vector denominator = z + Lanes::set(AtanDenominator[0]);
+    for (size_t i = 1; i < 5; ++i)
+        denominator = denominator * z + Lanes::set(AtanDenominator[i]);
+    Lanes::Vector angle = u + u * (z * polynomial(z, AtanNumerator) / denominator);
+    angle = angle + Lanes::select(reduce, Lanes::set(Pi / 4 + QuarterPiLow), Lanes::set(0));
+
+    angle = Lanes::select(Lanes::less(ax, ay), Lanes::set(Pi / 2) - angle, angle);
+    angle = Lanes::select(Lanes::less(x, Lanes::set(0)), Lanes::set(Pi) - angle, angle);
+    return Lanes::select(Lanes::less(y, Lanes::set(0)), -angle, angle);
+}
+
+// Degrees in [0, 360) of an atan2() result.
+inline Lanes::Vector azimuthDegrees(Lanes::Vector angle)
+{
+    const Lanes::Vector degrees = angle * Lanes::set(RadiansToDegrees);
+    return Lanes::select(Lanes::less(degrees, Lanes::set(0)), degrees + Lanes::set(360), degrees);
+}
+
+void transformBlock(const SkyTransform::Site &site, const SkyTransform::DomeGeometry &dome, const double *ra,
+                    const double *dec, const double *jd, double *alt, double *az, double *domeAz)
+{
+    using V = Lanes::Vector;
+    const V zero = Lanes::set(0);
+    const V sinLatitude = Lanes::set(std::sin(site.latitude * DegreesToRadians));
+    const V cosLatitude = Lanes::set(std::cos(site.latitude * DegreesToRadians));
+
+    // Hour angle in degrees, reduced to [-180, 180] before it becomes radians.
+    const V days = Lanes::load(jd) - Lanes::set(J2000);
+    const V centuries = days * Lanes::set(1 / 36525.0);
+    const V sidereal = Lanes::set(280.46061837 + site.longitude) + Lanes::set(360.98564736629) * days +
+                       centuries * centuries * (Lanes::set(0.000387933) - centuries * Lanes::set(1 / 38710000.0));
+    V hourAngle = sidereal - Lanes::load(ra) * Lanes::set(15);
+    hourAngle = (hourAngle - Lanes::set(360) * Lanes::round(hourAngle * Lanes::set(1 / 360.0))) *
+                Lanes::set(DegreesToRadians);
+    const V declination = Lanes::load(dec);
+
+    V sinH, cosH, sinDec, cosDec;
+    sinCos(hourAngle, sinH, cosH);
+    sinCos(declination * Lanes::set(DegreesToRadians), sinDec, cosDec);
+
+    // The unit vector to the object: east, north, up.
+    const V east = -(cosDec * sinH);
+    const V north = sinDec * cosLatitude - cosDec * cosH * sinLatitude;
+    const V up = sinLatitude * sinDec + cosLatitude * cosDec * cosH;
+    const V horizontal = Lanes::sqrt(Lanes::max(Lanes::set(1) - up * up, zero));
+
+    V altitude = atan2(up, horizontal) * Lanes::set(RadiansToDegrees);
+    V azimuth = azimuthDegrees(atan2(east, north));
+
+    // At the zenith, what ln_get_hrz_from_equ() returns.
+    const Lanes::Mask zenith = Lanes::less(horizontal, Lanes::set(ZenithLimit));
+    const Lanes::Mask decNorth = Lanes::less(zero, declination);
+    const Lanes::Mask decSouth = Lanes::less(declination, zero);
+    const Lanes::Mask never = Lanes::less(zero, zero);
+    const Lanes::Mask up90 = site.latitude > 0 ? decNorth : site.latitude < 0 ? decSouth : never;
+    altitude = Lanes::select(zenith, Lanes::select(up90, Lanes::set(90), Lanes::set(-90)), altitude);
+    azimuth = Lanes::select(zenith, Lanes::select(decNorth, zero, Lanes::set(180)), azimuth);
+
+    if (alt != nullptr)
+        Lanes::store(alt, altitude);
+    if (az != nullptr)
+        Lanes::store(az, azimuth);
+    if (domeAz == nullptr)
+        return;
+    if (dome.radius <= 0)
+    {
+        Lanes::store(domeAz, Lanes::set(NAN));
+        return;
+    }
+
+    V side;
+    switch (dome.side)
+    {
+        case SkyTransform::DomeGeometry::SideHourAngle:
+            side = Lanes::select(Lanes::less(zero, hourAngle), Lanes::set(-1), Lanes::set(1));
+            break;
+        default:
+            side = Lanes::set(otaSide(dome.side, 0));
+            break;
+    }
+    const V offset = Lanes::set(dome.otaOffset) * side;
+    const V x = Lanes::set(dome.eastDisplacement) - offset * cosH;
+    const V y = Lanes::set(dome.northDisplacement) + offset * sinH * sinLatitude;
+    const V z = Lanes::set(dome.upDisplacement) + offset * sinH * cosLatitude;
+
+    // The zenith case above does not change where the optical axis points.
+    const V b = Lanes::set(2) * (east * x + north * y + up * z);
+    const V c = x * x + y * y + z * z - Lanes::set(dome.radius * dome.radius);
+    const V discriminant = b * b - Lanes::set(4) * c;
+    const V root = Lanes::sqrt(Lanes::max(discriminant, zero));
+    const V far = (root - b) * Lanes::set(0.5);
+    const V mu = Lanes::select(Lanes::less(far, zero), (-b - root) * Lanes::set(0.5), far);
+    const V target = azimuthDegrees(atan2(x + mu * east, y + mu * north));
+    // The mount is outside the dome.
+    Lanes::store(domeAz, Lanes::select(Lanes::less(discriminant, zero), Lanes::set(NAN), target));
+}
+
+void transformSimd(const SkyTransform::Site &site, const SkyTransform::Input &input,
+                   const SkyTransform::Output &output, size_t count, const SkyTransform::DomeGeometry &dome)
+{
+    const size_t width = Lanes::Width;
+    size_t i = 0;
+    for (; i + width <= count; i += width)
+    {
+        transformBlock(site, dome, input.ra + i, input.dec + i, input.jd + i,
+                       output.alt != nullptr ? output.alt + i : nullptr, output.az != nullptr ? output.az + i : nullptr,
+                       output.domeAz != nullptr ? output.domeAz + i : nullptr);
+    }
+    if (i == count)
+        return;
+
+    // The rest through the same kernel, padded with copies of the last sample.
+    double ra[width], dec[width], jd[width], alt[width], az[width], domeAz[width];
+    for (size_t lane = 0; lane < width; ++lane)
+    {
+        const size_t from = i + lane < count ? i + lane : count - 1;
+        ra[lane] = input.ra[from];
+        dec[lane] = input.dec[from];
+        jd[lane] = input.jd[from];
+    }
+    transformBlock(site, dome, ra, dec, jd, alt, az, output.domeAz != nullptr ? domeAz : nullptr);
+    for (size_t lane = 0; i + lane < count; ++lane)
+    {
+        if (output.alt != nullptr)
+            output.alt[i + lane] = alt[lane];
+        if (output.az != nullptr)
+            output.az[i + lane] = az[lane];
+        if (output.domeAz != nullptr)
+            output.domeAz[i + lane] = domeAz[lane];
+    }
+}
+
+#if defined(SKY_TRANSFORM_AVX2)
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+#endif
+
+}
+
+namespace SkyTransform
+{
+
+const char *simdLevel()
+{
+    if (!g_SimdEnabled)
+        return "scalar";
+#if defined(SKY_TRANSFORM_AVX2)
+    return hasAvx2() ? "avx2" : "scalar";
+#elif defined(SKY_TRANSFORM_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void setSimdEnabled(bool enabled)
+{
+    g_SimdEnabled = enabled;
+}
+
+void transform(const Site &site, const Input &input, const Output &output, size_t count, const DomeGeometry &dome)
+{
+    if (count == 0)
+        return;
+#if defined(SKY_TRANSFORM_AVX2)
+    if (g_SimdEnabled && hasAvx2())
+        return transformSimd(site, input, output, count, dome);
+#elif defined(SKY_TRANSFORM_NEON)
+    if (g_SimdEnabled)
+        return transformSimd(site, input, output, count, dome);
+#endif
+    transformScalar(site, input, output, count, dome);
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Batch conversion of equatorial coordinates to horizontal coordinates
+ * and to the azimuth a dome has to turn to, for dome slaving and alignment.
+ *
+ * A dome that predicts where the mount will be, or an alignment model that
+ * re-evaluates its sync points, converts many (RA, Dec, JD) samples at once.
+ * The samples are passed as a structure of arrays and converted four (AVX2,
+ * x86-64, picked at runtime) or two (NEON, ARM) at a time, with polynomial
+ * sine, cosine and arctangent accurate to a few units in the last place. The
+ * scalar fallback calls libm with the formulas of libnova's
+ * ln_get_hrz_from_equ(), which is what INDI::Dome uses for a single sample.
+ *
+ * Like ln_get_hrz_from_equ() the transform uses the mean sidereal time and
+ * applies no refraction, nutation or aberration: RA and Dec are expected in
+ * the equinox of date (EQUATORIAL_EOD_COORD) and the azimuth is measured from
+ * north through east, the INDI convention.
+ */
+namespace SkyTransform
+{
+
+/** @brief Instruction set used by the kernels, "avx2", "neon" or "scalar". */
+const char *simdLevel();
+
+/** @brief Force the scalar kernel, for comparisons. */
+void setSimdEnabled(bool enabled);
+
+struct Site
+{
+    /** Degrees, north positive. */
+    double latitude {0};
+    /** Degrees, east positive. */
+    double longitude {0};
+};
+
+/**
+ * @brief Where the telescope sits in the dome, the DOME_MEASUREMENTS of
+ * INDI::Dome, in meters.
+ */
+struct DomeGeometry
+{
+    /** Side of the pier the optical axis is on, DM_OTA_SIDE. */
+    enum Side
+    {
+        /** Ignore the offset, use the center of the mount. */
+        SideIgnore,
+        SideEast,
+        SideWest,
+        /** From the hour angle of every sample: east of the pier while pointing west. */
+        SideHourAngle,
+    };
+
+    double radius {0};
+    double northDisplacement {0};
+    double eastDisplacement {0};
+    double upDisplacement {0};
+    /** Distance from the optical axis to the center of the mount. */
+    double otaOffset {0};
+    Side side {SideHourAngle};
+};
+
+/** @brief count samples, element i of every array is sample i. */
+struct Input
+{
+    /** Hours. */
+    const double *ra {nullptr};
+    /** Degrees. */
+    const double *dec {nullptr};
+    /** Julian date (UT). */
+    const double *jd {nullptr};
+};
+
+/** @brief Arrays of count values, nullptr for the ones not needed. */
+struct Output
+{
+    /** Degrees. */
+    double *alt {nullptr};
+    /** Degrees, 0 north, 90 east. */
+    double *az {nullptr};
+    /**
+     * Degrees, the azimuth of the point where the optical axis leaves the dome,
+     * what INDI::Dome::GetTargetAz() computes. NaN if the mount is not inside
+     * the dome.
+     */
+    double *domeAz {nullptr};
+};
+
+/** @brief Convert count samples. dome is only used for output.domeAz. */
+void transform(const Site &site, const Input &input, const Output &output, size_t count,
+               const DomeGeometry &dome = DomeGeometry());
+
+}
@@ -0,0 +1,397 @@
+#include "snoop_channel.h"
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char Magic[8] = {'I', 'N', 'D', 'I', 'S', 'N', 'O', 'P'};
+const uint32_t Version = 1;
+const size_t NameSize = 64;
+
+struct Slot
+{
+    // The sample in the slot, 0 while it is being written.
+    std::atomic<uint64_t> number;
+    int64_t timestampNs;
+    int32_t state;
+    uint32_t count;
+    double values[SnoopMaxValues];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "the segment is shared between processes, its atomics must not need a lock");
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value, timeout, nullptr, 0);
+}
+
+}
+
+struct SnoopSegment
+{
+    // Written last by the publisher, a segment without it is not ready or closed.
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t count;
+    int32_t publisher;
+    char names[SnoopMaxValues][NameSize];
+
+    // The newest sample.
+    alignas(64) std::atomic<uint64_t> head;
+    // Bumped with every sample, the futex subscribers sleep on.
+    std::atomic<uint32_t> published;
+    std::atomic<uint32_t> sleepers;
+
+    alignas(64) Slot ring[1];
+
+    Slot &slot(uint64_t number)
+    {
+        return ring[number % slots];
+    }
+};
+
+namespace
+{
+
+uint64_t magicValue()
+{
+    uint64_t value;
+    memcpy(&value, Magic, sizeof(value));
+    return value;
+}
+
+size_t segmentSize(size_t slots)
+{
+    return offsetof(SnoopSegment, ring) + slots * sizeof(Slot);
+}
+
+}
+
+std::string snoopSegmentName(const std::string &device, const std::string &property)
+{
+    std::string name = "/indi-snoop." + device + "." + property;
+    for (size_t i = 1; i < name.size(); ++i)
+    {
+        const char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '-'))
+            name[i] = '_';
+    }
+    return name.substr(0, NAME_MAX);
+}
+
+SnoopPublisher::~SnoopPublisher()
+{
+    close();
+}
+
+bool SnoopPublisher::open(const std::string &device, const std::string &property, const std::vector<std::string> &names,
+                          size_t slots)
+{
+    close();
+    if (names.size() > SnoopMaxValues || slots < 2)
+        return false;
+
+    // A segment left behind by an instance that crashed is replaced, its
+    // subscribers notice the dead publisher and open the new one.
+    m_Name = snoopSegmentName(device, property);
+    shm_unlink(m_Name.c_str());
+    const int fd = shm_open(m_Name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+
+    m_MapSize = segmentSize(slots);
+    if (ftruncate(fd, m_MapSize) != 0)
+    {
+        ::close(fd);
+        shm_unlink(m_Name.c_str());
+        return false;
+    }
+    void *map = mmap(nullptr, m_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(m_Name.c_str());
+        return false;
+    }
+
+    // ftruncate() zeroed it: no samples, every slot empty.
+    m_Segment = static_cast<SnoopSegment *>(map);
+    m_Segment->version = Version;
+    m_Segment->slots = static_cast<uint32_t>(slots);
+    m_Segment->count = static_cast<uint32_t>(names.size());
+    m_Segment->publisher = getpid();
+    for (size_t i = 0; i < names.size(); ++i)
+        strncpy(m_Segment->names[i], names[i].c_str(), NameSize - 1);
+    m_Segment->magic.store(magicValue(), std::memory_order_release);
+    return true;
+}
+
+void SnoopPublisher::close()
+{
+    if (m_Segment == nullptr)
+        return;
+    // Tells subscribers that still have it mapped.
+    m_Segment->magic.store(0);
+    munmap(m_Segment, m_MapSize);
+    m_Segment = nullptr;
+    // Subscribers keep their mapping until they notice.
+    shm_unlink(m_Name.c_str());
+}
+
+void SnoopPublisher::publish(const double *values, size_t count, int state)
+{
+    if (m_Segment == nullptr)
+        return;
+    if (count > m_Segment->count)
+        count = m_Segment->count;
+
+    const uint64_t number = m_Segment->head.load(std::memory_order_relaxed) + 1;
+    Slot &slot = m_Segment->slot(number);
+
+    slot.number.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.timestampNs = nowNs();
+    slot.state = state;
+    slot.count = static_cast<uint32_t>(count);
+    memcpy(slot.values, values, count * sizeof(double));
+
+    slot.number.store(number, std::memory_order_release);
+    m_Segment->head.store(number);
+
+    // Subscribers register as sleepers before checking head, so one of the
+    // two sees the other.
+    m_Segment->published.fetch_add(1);
+    if (m_Segment->sleepers.load() > 0)
+        futex(&m_Segment->published, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+SnoopSubscriber::~SnoopSubscriber()
+{
+    close();
+}
+
+bool SnoopSubscriber::open(const std::string &device, const std::string &property)
+{
+    close();
+
+    const int fd = shm_open(snoopSegmentName(device, property).c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < segmentSize(2))
+    {
+        ::close(fd);
+        return false;
+    }
+    m_MapSize = info.st_size;
+    void *map = mmap(nullptr, m_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    m_Segment = static_cast<SnoopSegment *>(map);
+    if (m_Segment->magic.load(std::memory_order_acquire) != magicValue() || m_Segment->version != Version ||
+            segmentSize(m_Segment->slots) != m_MapSize || m_Segment->count > SnoopMaxValues)
+    {
+        close();
+        return false;
+    }
+
+    m_Next = m_Segment->head.load() + 1;
+    m_Lost = 0;
+    return true;
+}
+
+void SnoopSubscriber::close()
+{
+    stopNotify();
+    if (m_Segment != nullptr)
+        munmap(m_Segment, m_MapSize);
+    m_Segment = nullptr;
+}
+
+bool SnoopSubscriber::isAlive() const
+{
+    if (m_Segment == nullptr || m_Segment->magic.load() != magicValue())
+        return false;
+    return kill(m_Segment->publisher, 0) == 0 || errno == EPERM;
+}
+
+int SnoopSubscriber::indexOf(const std::string &name) const
+{
+    if (m_Segment == nullptr)
+        return -1;
+    for (uint32_t i = 0; i < m_Segment->count; ++i)
+    {
+        if (strncmp(m_Segment->names[i], name.c_str(), NameSize) == 0)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool SnoopSubscriber::read(uint64_t number, SnoopSample &sample) const
+{
+    const Slot &slot = m_Segment->slot(number);
+    if (slot.number.load(std::memory_order_acquire) != number)
+        return false;
+
+    sample.number = number;
+    sample.timestampNs = slot.timestampNs;
+    sample.state = slot.state;
+    sample.count = slot.count <= SnoopMaxValues ? slot.count : SnoopMaxValues;
+    memcpy(sample.values, slot.values, sample.count * sizeof(double));
+
+    // Still the same sample after the copy, or the publisher lapped us.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.number.load(std::memory_order_relaxed) == number;
+}
+
+bool SnoopSubscriber::latest(SnoopSample &sample) const
+{
+    if (m_Segment == nullptr)
+        return false;
+    for (;;)
+    {
+        const uint64_t head = m_Segment->head.load(std::memory_order_acquire);
+        if (head == 0)
+            return false;
+        if (read(head, sample))
+            return true;
+    }
+}
+
+bool SnoopSubscriber::next(SnoopSample &sample)
+{
+    if (m_Segment == nullptr)
+        return false;
+    for (;;)
+    {
+        const uint64_t head = m_Segment->head.load(std::memory_order_acquire);
+        if (m_Next > head)
+            return false;
+
+        // The slot after head is the next one written, the oldest safe one is the one after that.
+        const uint64_t oldest = head + 2 > m_Segment->slots ? head + 2 - m_Segment->slots : 1;
+        if (m_Next < oldest)
+        {
+            m_Lost += oldest - m_Next;
+            m_Next = oldest;
+        }
+
+        if (read(m_Next, sample))
+        {
+            ++m_Next;
+            return true;
+        }
+        // Overwritten while we read it.
+        ++m_Lost;
+        ++m_Next;
+    }
+}
+
+bool SnoopSubscriber::wait(uint64_t number, int timeoutMs) const
+{
+    if (m_Segment == nullptr)
+        return false;
+
+    const int64_t deadline = nowNs() + static_cast<int64_t>(timeoutMs) * 1000000;
+    for (;;)
+    {
+        const uint32_t published = m_Segment->published.load();
+        m_Segment->sleepers.fetch_add(1);
+        if (m_Segment->head.load() > number)
+        {
+            m_Segment->sleepers.fetch_sub(1);
+            return true;
+        }
+
+        const int64_t left = deadline - nowNs();
+        if (left <= 0)
+        {
+            m_Segment->sleepers.fetch_sub(1);
+            return false;
+        }
+        const timespec timeout = {static_cast<time_t>(left / 1000000000), static_cast<long>(left % 1000000000)};
+        // Returns at once if a sample came after the load above.
+        futex(&m_Segment->published, FUTEX_WAIT, published, &timeout);
+        m_Segment->sleepers.fetch_sub(1);
+    }
+}
+
+int SnoopSubscriber::eventFd()
+{
+    if (m_Segment == nullptr)
+        return -1;
+    if (m_EventFd >= 0)
+        return m_EventFd;
+
+    m_EventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_EventFd < 0)
+        return -1;
+
+    m_Stop = false;
+    m_Notify = std::thread([this]
+    {
+        uint64_t seen = m_Segment->head.load();
+        while (!m_Stop)
+        {
+            // Also wakes now and then to see whether it should stop.
+            if (!wait(seen, 200))
+                continue;
+            seen = m_Segment->head.load();
+            const uint64_t one = 1;
+            if (::write(m_EventFd, &one, sizeof(one)) != sizeof(one))
+            {
+                // The counter is about to overflow, the loop is behind but signalled.
+            }
+        }
+    });
+    return m_EventFd;
+}
+
+void SnoopSubscriber::clearEvent()
+{
+    uint64_t count;
+    if (m_EventFd >= 0 && ::read(m_EventFd, &count, sizeof(count)) != sizeof(count))
+    {
+        // Nothing was signalled.
+    }
+}
+
+void SnoopSubscriber::stopNotify()
+{
+    if (m_Notify.joinable())
+    {
+        m_Stop = true;
+        // Wakes the other sleepers too, they check head and sleep again.
+        m_Segment->published.fetch_add(1);
+        futex(&m_Segment->published, FUTEX_WAKE, INT_MAX, nullptr);
+        m_Notify.join();
+    }
+    if (m_EventFd >= 0)
+        ::close(m_EventFd);
+    m_EventFd = -1;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Shared memory path for snooped Number properties between drivers on
+ * the same host.
+ *
+ * A snooped value normally travels as XML: the publisher serializes it,
+ * indiserver parses and forwards it, the subscriber parses it again. For
+ * values that change often, like the coordinates of a mount a dome is slaved
+ * to, a publisher can also write them into a ring of samples in a POSIX shared
+ * memory segment named after the device and property. A subscriber on the
+ * same host maps it and reads the samples directly.
+ *
+ * Every slot of the ring is a seqlock: the writer marks it as being written,
+ * copies the values and publishes the sample number last, and a reader that
+ * sees the number change under it reads again. The publisher never waits for
+ * subscribers. Subscribers that want to be woken sleep on a futex in the
+ * segment, which the publisher only wakes when somebody sleeps.
+ *
+ * The segment outlives a publisher that crashed, so subscribers check that
+ * the publisher is alive and fall back to XML when it is not. The XML path
+ * stays on in any case, for clients and for snoopers on other hosts.
+ */
+
+/** @brief Elements per property carried by the ring. */
+const size_t SnoopMaxValues = 16;
+
+// The layout of the segment, see snoop_channel.cpp.
+struct SnoopSegment;
+
+struct SnoopSample
+{
+    /** Counts from 1 per publisher. */
+    uint64_t number {0};
+    /** steady_clock (CLOCK_MONOTONIC) of the publisher, nanoseconds. */
+    int64_t timestampNs {0};
+    /** IPState of the property. */
+    int32_t state {0};
+    uint32_t count {0};
+    double values[SnoopMaxValues] {};
+};
+
+/** @brief Name of the segment for a property, valid for shm_open(). */
+std::string snoopSegmentName(const std::string &device, const std::string &property);
+
+class SnoopPublisher
+{
+public:
+    SnoopPublisher() = default;
+    ~SnoopPublisher();
+
+    SnoopPublisher(const SnoopPublisher &) = delete;
+    SnoopPublisher &operator=(const SnoopPublisher &) = delete;
+
+    /**
+     * @brief Create the segment of device.property, replacing a stale one.
+     * @param names the element names, in the order values are published.
+     */
+    bool open(const std::string &device, const std::string &property, const std::vector<std::string> &names,
+              size_t slots = 64);
+    /** @brief Remove the segment, subscribers fall back to XML. */
+    void close();
+
+    bool isOpen() const
+    {
+        return m_Segment != nullptr;
+    }
+
+    /** @brief Publish count values, in the order of the names. */
+    void publish(const double *values, size_t count, int state);
+
+private:
+    SnoopSegment *m_Segment {nullptr};
+    size_t m_MapSize {0};
+    std::string m_Name;
+};
+
+class SnoopSubscriber
+{
+public:
+    SnoopSubscriber() = default;
+    ~SnoopSubscriber();
+
+    SnoopSubscriber(const SnoopSubscriber &) = delete;
+    SnoopSubscriber &operator=(const SnoopSubscriber &) = delete;
+
+    /** @brief Map the segment of device.property. False if nobody publishes it on this host. */
+    bool open(const std::string &device, const std::string &property);
+    void close();
+
+    bool isOpen() const
+    {
+        return m_Segment != nullptr;
+    }
+
+    /** @brief The publisher is still running. */
+    bool isAlive() const;
+
+    /** @brief Index of an element in the samples, -1 if it is not published. */
+    int indexOf(const std::string &name) const;
+
+    /** @brief The newest sample. False if there is none yet. */
+    bool latest(SnoopSample &sample) const;
+
+    /**
+     * @brief The sample after the last one returned by next(), for subscribers
+     * that need every sample. Samples the ring overwrote before they were read
+     * are skipped and counted in lost().
+     * @return false if there is no newer one.
+     */
+    bool next(SnoopSample &sample);
+
+    uint64_t lost() const
+    {
+        return m_Lost;
+    }
+
+    /**
+     * @brief Sleep until a sample newer than number is published.
+     * @return false on timeout.
+     */
+    bool wait(uint64_t number, int timeoutMs) const;
+
+    /**
+     * @brief Readable whenever a new sample was published, from a thread that
+     * waits on the futex. For the driver's event loop.
+     */
+    int eventFd();
+
+    /** @brief Call after handling eventFd() becoming readable. */
+    void clearEvent();
+
+private:
+    bool read(uint64_t number, SnoopSample &sample) const;
+    void stopNotify();
+
+    SnoopSegment *m_Segment {nullptr};
+    size_t m_MapSize {0};
+    uint64_t m_Next {1};
+    uint64_t m_Lost {0};
+
+    int m_EventFd {-1};
+    std::thread m_Notify;
+    std::atomic<bool> m_Stop {false};
+};
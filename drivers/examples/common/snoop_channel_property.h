@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "libindi/eventloop.h"
+#include "libindi/indipropertynumber.h"
+#include "libindi/lilxml.h"
+
+#include "snoop_channel.h"
+
+/**
+ * @brief Publish a Number property to snoopers on the same host, next to the
+ * XML every snooper and client gets from apply().
+ *
+ * @code
+ * // A mount, after EqNP.apply():
+ * publishSnoop(EqSnoop, EqNP);
+ * @endcode
+ */
+inline bool publishSnoop(SnoopPublisher &publisher, const INDI::PropertyNumber &property)
+{
+    if (!publisher.isOpen())
+    {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < property.size(); ++i)
+            names.push_back(property[i].getName());
+        if (!publisher.open(property.getDeviceName(), property.getName(), names))
+            return false;
+    }
+
+    double values[SnoopMaxValues];
+    const size_t count = property.size() < SnoopMaxValues ? property.size() : SnoopMaxValues;
+    for (size_t i = 0; i < count; ++i)
+        values[i] = property[i].getValue();
+    publisher.publish(values, count, property.getState());
+    return true;
+}
+
+/**
+ * @brief Receives a Number property another driver on this host publishes with
+ * publishSnoop(), on the event loop of the driver.
+ *
+ * The XML snoop keeps arriving in ISSnoopDevice(). While the shared memory
+ * delivers, covers() tells which messages carry nothing new; when the
+ * publisher goes away the driver is back on XML alone.
+ *
+ * @code
+ * // TimerHit(): (re)attach while the option is on
+ * if (!MountSnoop.isActive())
+ *     MountSnoop.watch(mount, "EQUATORIAL_EOD_COORD", [this](const SnoopSample &sample) { ... });
+ * // ISSnoopDevice():
+ * if (MountSnoop.covers(root))
+ *     return true;
+ * @endcode
+ */
+class SharedSnoop
+{
+public:
+    using Handler = std::function<void(const SnoopSample &)>;
+
+    ~SharedSnoop()
+    {
+        stop();
+    }
+
+    /** @brief Start receiving device.property. False if it is not published on this host. */
+    bool watch(const char *device, const char *property, Handler handler)
+    {
+        stop();
+        if (device == nullptr || property == nullptr || !m_Subscriber.open(device, property))
+            return false;
+        // Left behind by a publisher that crashed.
+        if (!m_Subscriber.isAlive())
+        {
+            m_Subscriber.close();
+            return false;
+        }
+
+        const int fd = m_Subscriber.eventFd();
+        if (fd < 0)
+        {
+            m_Subscriber.close();
+            return false;
+        }
+        m_Device = device;
+        m_Property = property;
+        m_Handler = std::move(handler);
+        m_Handled = 0;
+        m_Callback = IEAddCallback(fd, &SharedSnoop::published, this);
+
+        // What was published before we came.
+        deliver();
+        return true;
+    }
+
+    void stop()
+    {
+        if (m_Callback >= 0)
+            IERmCallback(m_Callback);
+        m_Callback = -1;
+        m_Subscriber.close();
+        m_Device.clear();
+        m_Property.clear();
+    }
+
+    /** @brief Watching and the publisher is still there. */
+    bool isActive() const
+    {
+        return m_Subscriber.isAlive();
+    }
+
+    /** @brief Watching device.property, whether or not it is still published. */
+    bool isWatching(const char *device, const char *property) const
+    {
+        return m_Subscriber.isOpen() && device != nullptr && property != nullptr && m_Device == device &&
+               m_Property == property;
+    }
+
+    /** @brief Index of an element in the samples, -1 if it is not published. */
+    int indexOf(const char *name) const
+    {
+        return m_Subscriber.indexOf(name);
+    }
+
+    /** @brief root is the XML of the property this delivers, and it is still delivering. */
+    bool covers(XMLEle *root) const
+    {
+        if (!isActive())
+            return false;
+        const char *device = findXMLAttValu(root, "device");
+        const char *property = findXMLAttValu(root, "name");
+        return strcmp(tagXMLEle(root), "setNumberVector") == 0 && m_Device == device && m_Property == property;
+    }
+
+private:
+    static void published(int, void *userpointer)
+    {
+        SharedSnoop *snoop = static_cast<SharedSnoop *>(userpointer);
+        snoop->m_Subscriber.clearEvent();
+        snoop->deliver();
+    }
+
+    // Only the newest sample counts for a snooper.
+    void deliver()
+    {
+        SnoopSample sample;
+        if (!m_Subscriber.latest(sample) || sample.number == m_Handled)
+            return;
+        m_Handled = sample.number;
+        m_Handler(sample);
+    }
+
+    SnoopSubscriber m_Subscriber;
+    std::string m_Device;
+    std::string m_Property;
+    Handler m_Handler;
+    uint64_t m_Handled {0};
+    int m_Callback {-1};
+};
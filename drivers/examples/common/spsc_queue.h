@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *
+ * push() and pop() never block and never allocate. The capacity is rounded up
+ * to a power of two.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_Items.resize(size);
+        m_Mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    size_t capacity() const
+    {
+        return m_Items.size();
+    }
+
+    /** @brief Producer side. Returns false if the queue is full. */
+    bool push(const T &item)
+    {
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail - m_CachedHead == m_Items.size())
+        {
+            m_CachedHead = m_Head.load(std::memory_order_acquire);
+            if (tail - m_CachedHead == m_Items.size())
+                return false;
+        }
+        m_Items[tail & m_Mask] = item;
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief Consumer side. Returns false if the queue is empty. */
+    bool pop(T &item)
+    {
+        const size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_CachedTail)
+        {
+            m_CachedTail = m_Tail.load(std::memory_order_acquire);
+            if (head == m_CachedTail)
+                return false;
+        }
+        item = m_Items[head & m_Mask];
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief Approximate number of queued items, exact when called from either end. */
+    size_t size() const
+    {
+        return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    // Keep the two ends on their own cache lines, or producer and consumer keep
+    // stealing the line from each other.
+    static constexpr size_t CacheLine = 64;
+
+    std::vector<T> m_Items;
+    size_t m_Mask {0};
+
+    alignas(CacheLine) std::atomic<size_t> m_Head {0};
+    size_t m_CachedTail {0};   // consumer's copy of m_Tail
+
+    alignas(CacheLine) std::atomic<size_t> m_Tail {0};
+    size_t m_CachedHead {0};   // producer's copy of m_Head
+};
@@ -0,0 +1,120 @@
+#include "star_field.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// xorshift32, plenty for simulated noise and much faster than <random>.
+inline uint32_t nextRandom(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+inline double uniform(uint32_t &state)
+{
+    return (nextRandom(state) >> 8) * (1.0 / 16777216.0);
+}
+
+constexpr int ProfileOversample = 8;
+
+}
+
+StarField::StarField(const Config &config) : m_Config(config)
+{
+    uint32_t state = config.seed ? config.seed : 1;
+
+    m_Stars.resize(config.stars);
+    for (auto &star : m_Stars)
+    {
+        star.x = uniform(state) * config.width;
+        star.y = uniform(state) * config.height;
+        // Few bright stars, many faint ones.
+        const double u = uniform(state);
+        star.peak = config.peak * u * u * u;
+    }
+
+    const double sigma = config.fwhm / 2.3548;
+    m_Radius = std::max(1, static_cast<int>(std::ceil(sigma * 4)));
+
+    // profile[i] = exp(-r^2 / 2 sigma^2) with r^2 = i / ProfileOversample
+    const int samples = (m_Radius * m_Radius + 2) * ProfileOversample;
+    m_Profile.resize(samples);
+    for (int i = 0; i < samples; ++i)
+        m_Profile[i] = static_cast<float>(std::exp(-(double(i) / ProfileOversample) / (2 * sigma * sigma)));
+}
+
+void StarField::shift(double dx, double dy)
+{
+    for (auto &star : m_Stars)
+    {
+        star.x += dx;
+        star.y += dy;
+    }
+}
+
+void StarField::render(uint16_t *pixels, uint32_t frame, double exposure, Layout layout) const
+{
+    const uint32_t width = m_Config.width, height = m_Config.height;
+    const double background = m_Config.background * exposure;
+    uint32_t state = (frame + 1) * 2654435761u ^ m_Config.seed;
+    if (state == 0)
+        state = 1;
+
+    // Background plus noise. The sum of two uniforms is close enough to
+    // gaussian for a simulator and keeps this loop cheap.
+    const float noiseScale = static_cast<float>(m_Config.noise * 1.2247 / 16777216.0);
+    const float base = static_cast<float>(background);
+    for (size_t i = 0, n = size_t(width) * height; i < n; ++i)
+    {
+        const uint32_t r1 = nextRandom(state) >> 8, r2 = nextRandom(state) >> 8;
+        const float value = base + (float(r1) + float(r2) - 16777216.0f) * noiseScale;
+        pixels[i] = static_cast<uint16_t>(std::min(65535.0f, std::max(0.0f, value)));
+    }
+
+    // Stars, each one only touches the pixels within its radius.
+    const int radius = m_Radius;
+    for (const auto &star : m_Stars)
+    {
+        const int cx = static_cast<int>(std::lround(star.x)), cy = static_cast<int>(std::lround(star.y));
+        const float peak = static_cast<float>(star.peak * exposure);
+        if (cx + radius < 0 || cy + radius < 0 || cx - radius >= int(width) || cy - radius >= int(height) || peak < 1)
+            continue;
+
+        const int x0 = std::max(0, cx - radius), x1 = std::min(int(width) - 1, cx + radius);
+        const int y0 = std::max(0, cy - radius), y1 = std::min(int(height) - 1, cy + radius);
+        for (int y = y0; y <= y1; ++y)
+        {
+            const double dy = y - star.y;
+            uint16_t *row = pixels + size_t(y) * width;
+            for (int x = x0; x <= x1; ++x)
+            {
+                const double dx = x - star.x;
+                const size_t index = static_cast<size_t>((dx * dx + dy * dy) * ProfileOversample);
+                if (index >= m_Profile.size())
+                    continue;
+                const uint32_t value = row[x] + static_cast<uint32_t>(peak * m_Profile[index]);
+                row[x] = static_cast<uint16_t>(std::min<uint32_t>(value, 65535));
+            }
+        }
+    }
+
+    if (layout == Layout::Fits)
+        toFitsLayout(pixels, size_t(width) * height);
+}
+
+void StarField::toFitsLayout(uint16_t *pixels, size_t count)
+{
+    // Unsigned to signed with BZERO 32768 is a flip of the top bit.
+    const uint16_t probe = 1;
+    const bool hostIsLittleEndian = *reinterpret_cast<const uint8_t *>(&probe) == 1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint16_t value = pixels[i] ^ 0x8000;
+        pixels[i] = hostIsLittleEndian ? static_cast<uint16_t>((value << 8) | (value >> 8)) : value;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief StarField synthesizes 16-bit star field frames for simulated cameras.
+ *
+ * The star catalog is generated once from a seed, every frame then adds fresh
+ * noise. Frames are rendered straight into a caller supplied buffer, so a driver
+ * can render into the memory it is going to send (see the dummy CCD).
+ */
+class StarField
+{
+public:
+    struct Config
+    {
+        uint32_t width {1280};
+        uint32_t height {1024};
+        uint32_t stars {200};
+        /** Full width at half maximum of the stars, in pixels. */
+        double fwhm {3.0};
+        /** Sky background in ADU per second of exposure. */
+        double background {200};
+        /** Peak ADU of the brightest star for a one second exposure. */
+        double peak {20000};
+        /** Read noise in ADU, roughly gaussian. */
+        double noise {10};
+        uint32_t seed {1};
+    };
+
+    struct Star
+    {
+        double x, y;
+        double peak;
+    };
+
+    /** How the rendered pixels are stored. */
+    enum class Layout
+    {
+        /** Host order unsigned 16-bit, as INDI::CCDChip frame buffers expect. */
+        Native,
+        /** Big-endian signed 16-bit with BZERO 32768, the FITS data layout. */
+        Fits
+    };
+
+    explicit StarField(const Config &config);
+
+    const Config &config() const
+    {
+        return m_Config;
+    }
+
+    const std::vector<Star> &stars() const
+    {
+        return m_Stars;
+    }
+
+    /**
+     * @brief Render a frame.
+     * @param pixels destination, at least width x height pixels.
+     * @param frame frame counter, selects the noise pattern.
+     * @param exposure exposure duration in seconds, scales background and stars.
+     * @param layout pixel layout. The conversion to the FITS layout is done in
+     * place, the frame is never copied.
+     */
+    void render(uint16_t *pixels, uint32_t frame, double exposure, Layout layout = Layout::Native) const;
+
+    /**
+     * @brief Convert host order pixels to the FITS layout in place, for frames
+     * that are looked at before they are sent.
+     */
+    static void toFitsLayout(uint16_t *pixels, size_t count);
+
+    /** @brief Move the whole field, e.g. to simulate tracking errors. */
+    void shift(double dx, double dy);
+
+private:
+    Config m_Config;
+    std::vector<Star> m_Stars;
+    // PSF profile sampled on a 1/8 pixel grid, avoids exp() per pixel.
+    std::vector<float> m_Profile;
+    int m_Radius {0};
+};
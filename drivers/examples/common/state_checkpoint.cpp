@@ -0,0 +1,200 @@
+#include "state_checkpoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+namespace
+{
+
+const char Magic[8] = {'I', 'N', 'D', 'I', 'C', 'K', 'P', 'T'};
+const uint32_t Version = 1;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t schema;
+    uint64_t size;
+};
+
+// The header gets a cache line of its own, so do the slots.
+const size_t HeaderSize = 64;
+
+size_t roundUp(size_t value, size_t to)
+{
+    return (value + to - 1) / to * to;
+}
+
+}
+
+struct StateCheckpoint::Slot
+{
+    // 0 while the slot is being written.
+    std::atomic<uint64_t> sequence;
+    int64_t wallTime;
+    uint32_t crc;
+    uint32_t reserved;
+    uint8_t data[1];
+};
+
+StateCheckpoint::~StateCheckpoint()
+{
+    close();
+}
+
+bool StateCheckpoint::open(const std::string &path, size_t size, uint32_t schema)
+{
+    close();
+
+    const size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0)
+    {
+        const std::string directory = path.substr(0, slash);
+        for (size_t next = directory.find('/', 1); ; next = directory.find('/', next + 1))
+        {
+            mkdir(directory.substr(0, next).c_str(), 0755);
+            if (next == std::string::npos)
+                break;
+        }
+    }
+
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    m_Size = size;
+    m_SlotSize = roundUp(offsetof(Slot, data) + size, 64);
+    m_MapSize = HeaderSize + 2 * m_SlotSize;
+
+    struct stat info;
+    const bool fresh = fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != m_MapSize;
+    if (fresh && ftruncate(fd, m_MapSize) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, m_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    m_Map = static_cast<uint8_t *>(map);
+
+    FileHeader *header = reinterpret_cast<FileHeader *>(m_Map);
+    if (fresh || memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version ||
+            header->schema != schema || header->size != size)
+    {
+        // Somebody else's file, or an older layout of the state: start over.
+        memset(m_Map, 0, m_MapSize);
+        memcpy(header->magic, Magic, sizeof(Magic));
+        header->version = Version;
+        header->schema = schema;
+        header->size = size;
+    }
+
+    m_Sequence = std::max(slot(0)->sequence.load(), slot(1)->sequence.load());
+    return true;
+}
+
+void StateCheckpoint::close()
+{
+    if (m_Map != nullptr)
+        munmap(m_Map, m_MapSize);
+    m_Map = nullptr;
+}
+
+StateCheckpoint::Slot *StateCheckpoint::slot(int index) const
+{
+    return reinterpret_cast<Slot *>(m_Map + HeaderSize + index * m_SlotSize);
+}
+
+void StateCheckpoint::write(const void *data)
+{
+    if (m_Map == nullptr)
+        return;
+
+    const uint64_t sequence = ++m_Sequence;
+    Slot *target = slot(sequence & 1);
+
+    target->sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(target->data, data, m_Size);
+    target->wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count();
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(&sequence), sizeof(sequence));
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(&target->wallTime), sizeof(target->wallTime));
+    target->crc = static_cast<uint32_t>(crc32(crc, target->data, m_Size));
+
+    target->sequence.store(sequence, std::memory_order_release);
+}
+
+bool StateCheckpoint::read(void *data, uint64_t *sequence, int64_t *wallTimeNs) const
+{
+    if (m_Map == nullptr)
+        return false;
+
+    // Newest slot first.
+    int order[2] = {0, 1};
+    if (slot(1)->sequence.load(std::memory_order_acquire) > slot(0)->sequence.load(std::memory_order_acquire))
+        std::swap(order[0], order[1]);
+
+    for (int index : order)
+    {
+        const Slot *candidate = slot(index);
+        const uint64_t number = candidate->sequence.load(std::memory_order_acquire);
+        if (number == 0)
+            continue;
+
+        uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(&number), sizeof(number));
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(&candidate->wallTime), sizeof(candidate->wallTime));
+        if (static_cast<uint32_t>(crc32(crc, candidate->data, m_Size)) != candidate->crc)
+            continue;
+
+        memcpy(data, candidate->data, m_Size);
+        if (sequence != nullptr)
+            *sequence = number;
+        if (wallTimeNs != nullptr)
+            *wallTimeNs = candidate->wallTime;
+        return true;
+    }
+    return false;
+}
+
+void StateCheckpoint::reset()
+{
+    if (m_Map == nullptr)
+        return;
+    slot(0)->sequence.store(0, std::memory_order_release);
+    slot(1)->sequence.store(0, std::memory_order_release);
+    m_Sequence = 0;
+}
+
+void StateCheckpoint::flush()
+{
+    if (m_Map != nullptr)
+        msync(m_Map, m_MapSize, MS_SYNC);
+}
+
+std::string StateCheckpoint::defaultDirectory()
+{
+    const char *home = getenv("HOME");
+    return home != nullptr ? std::string(home) + "/.indi/checkpoint" : std::string("/tmp/indi-checkpoint");
+}
+
+double StateCheckpoint::secondsSince(int64_t wallTimeNs)
+{
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+    return (now - wallTimeNs) / 1e9;
+}
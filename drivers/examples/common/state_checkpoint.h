@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+/**
+ * @brief Keeps the latest snapshot of a driver's state in a memory mapped file.
+ *
+ * indiserver restarts a driver that crashed. With its position, park state and
+ * targets checkpointed here, the new instance picks up where the old one died
+ * and only has to cross-check with the hardware instead of homing it.
+ *
+ * A write is a copy into the shared mapping, there is no system call, so a
+ * driver can checkpoint on every poll and every transition. The pages belong
+ * to the kernel, so they survive the process; flush() also writes them to the
+ * disk and waits, for power loss.
+ *
+ * The file holds two slots, written in turn. A slot is invalidated before it
+ * is written and gets its sequence number and CRC last, so a crash in the
+ * middle of a write leaves the previous snapshot in the other slot intact.
+ */
+class StateCheckpoint
+{
+public:
+    StateCheckpoint() = default;
+    ~StateCheckpoint();
+
+    StateCheckpoint(const StateCheckpoint &) = delete;
+    StateCheckpoint &operator=(const StateCheckpoint &) = delete;
+
+    /**
+     * @brief Map the file, creating it if needed.
+     * A file with another size or schema is started over.
+     */
+    bool open(const std::string &path, size_t size, uint32_t schema = 1);
+    void close();
+
+    bool isOpen() const
+    {
+        return m_Map != nullptr;
+    }
+
+    /** @brief Store a snapshot of size bytes. */
+    void write(const void *data);
+
+    /**
+     * @brief The newest intact snapshot.
+     * @param wallTimeNs when it was written, nanoseconds since the epoch.
+     * @return false if there is none.
+     */
+    bool read(void *data, uint64_t *sequence = nullptr, int64_t *wallTimeNs = nullptr) const;
+
+    /** @brief Forget the snapshots, for example after homing. */
+    void reset();
+
+    /**
+     * @brief Write the pages to disk and wait for it. Polls only need to
+     * survive the process, transitions also a power cut, so only they flush.
+     */
+    void flush();
+
+    /** @brief ~/.indi/checkpoint, or the temporary directory without a home. */
+    static std::string defaultDirectory();
+
+    /** @brief Age of a snapshot written at wallTimeNs, in seconds. */
+    static double secondsSince(int64_t wallTimeNs);
+
+private:
+    struct Slot;
+    Slot *slot(int index) const;
+
+    uint8_t *m_Map {nullptr};
+    size_t m_MapSize {0};
+    size_t m_Size {0};
+    size_t m_SlotSize {0};
+    uint64_t m_Sequence {0};
+};
+
+/** @brief A StateCheckpoint of a plain struct. */
+template <typename T>
+class Checkpoint
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpointed state must be trivially copyable");
+
+public:
+    bool open(const std::string &path, uint32_t schema = 1)
+    {
+        return m_File.open(path, sizeof(T), schema);
+    }
+
+    void close()
+    {
+        m_File.close();
+    }
+
+    bool isOpen() const
+    {
+        return m_File.isOpen();
+    }
+
+    void write(const T &state)
+    {
+        m_File.write(&state);
+    }
+
+    bool read(T &state, int64_t *wallTimeNs = nullptr) const
+    {
+        return m_File.read(&state, nullptr, wallTimeNs);
+    }
+
+    void reset()
+    {
+        m_File.reset();
+    }
+
+    void flush()
+    {
+        m_File.flush();
+    }
+
+private:
+    StateCheckpoint m_File;
+};
@@ -0,0 +1,390 @@
+#include "tcp_transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+
+namespace
+{
+
+int remainingMs(std::chrono::steady_clock::time_point deadline)
+{
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return std::max<int>(0, static_cast<int>(left.count()));
+}
+
+bool waitFor(int fd, short events, int timeoutMs)
+{
+    pollfd pfd = {fd, events, 0};
+    int rc;
+    do
+    {
+        rc = poll(&pfd, 1, timeoutMs);
+    }
+    while (rc < 0 && errno == EINTR);
+    return rc > 0;
+}
+
+bool setOption(int fd, int level, int name, int value)
+{
+    return setsockopt(fd, level, name, &value, sizeof(value)) == 0;
+}
+
+}
+
+TcpTransport::~TcpTransport()
+{
+    close();
+}
+
+bool TcpTransport::open(const Options &options)
+{
+    close();
+    m_Options = options;
+
+    startConnect();
+    if (m_State == State::Connecting && waitFor(m_ConnectFd, POLLOUT, m_Options.connectTimeoutMs))
+        finishConnect();
+    if (m_State == State::Connecting)
+        failConnect();
+    return m_State == State::Connected;
+}
+
+bool TcpTransport::attach(int fd, const Options &options)
+{
+    close();
+    m_Options = options;
+
+    // The INDI TCP plugin can also open UDP sockets, nothing to do for those.
+    int type = 0;
+    socklen_t length = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length) != 0 || type != SOCK_STREAM || !applyOptions(fd))
+        return false;
+
+    m_Fd = fd;
+    m_Owned = false;
+    m_State = State::Connected;
+    ++m_Stats.connects;
+    return true;
+}
+
+void TcpTransport::setOptions(const Options &options)
+{
+    m_Options = options;
+    if (m_State == State::Connected)
+        applyOptions(m_Fd);
+}
+
+void TcpTransport::close()
+{
+    if (m_ConnectFd >= 0)
+        ::close(m_ConnectFd);
+    m_ConnectFd = -1;
+    if (m_Owned && m_Fd >= 0)
+        ::close(m_Fd);
+    m_Fd = -1;
+    m_Owned = false;
+    m_State = State::Disconnected;
+    m_InFlight.clear();
+    m_Buffer.clear();
+    m_Attempt = 0;
+    m_NextAttempt = Clock::time_point();
+}
+
+bool TcpTransport::command(const std::string &request, std::string &response)
+{
+    return send(request) && receive(response);
+}
+
+bool TcpTransport::send(const std::string &request)
+{
+    // Fail fast until maintain() gets the connection back.
+    if (m_State != State::Connected)
+    {
+        ++m_Stats.failed;
+        return false;
+    }
+
+    m_InFlight.push_back({request, Clock::now()});
+    if (writeAll(request))
+        return true;
+    broken();
+    return false;
+}
+
+bool TcpTransport::receive(std::string &response)
+{
+    if (m_InFlight.empty() || m_State != State::Connected)
+        return false;
+
+    const ReadResult result = readAnswer(response);
+    if (result == ReadResult::Ok)
+    {
+        m_Stats.lastRoundTrip = Clock::now() - m_InFlight.front().sentAt;
+        m_InFlight.pop_front();
+        return true;
+    }
+
+    if (result == ReadResult::Timeout)
+    {
+        ++m_Stats.timeouts;
+        if (!m_Options.reconnectOnTimeout)
+        {
+            m_InFlight.pop_front();
+            ++m_Stats.failed;
+            return false;
+        }
+    }
+
+    broken();
+    return false;
+}
+
+bool TcpTransport::maintain()
+{
+    switch (m_State)
+    {
+        case State::Connected:
+            return true;
+
+        case State::Connecting:
+            if (waitFor(m_ConnectFd, POLLOUT, 0))
+                finishConnect();
+            else if (Clock::now() >= m_ConnectDeadline)
+                failConnect();
+            break;
+
+        case State::Disconnected:
+            if (m_Options.port == 0 || Clock::now() < m_NextAttempt)
+                return false;
+            startConnect();
+            break;
+    }
+    return m_State == State::Connected;
+}
+
+std::chrono::milliseconds TcpTransport::retryIn() const
+{
+    using std::chrono::milliseconds;
+    switch (m_State)
+    {
+        case State::Connected:
+            return milliseconds(-1);
+        case State::Connecting:
+            // Check on the connect often, it usually takes a round trip.
+            return std::min(milliseconds(20), milliseconds(remainingMs(m_ConnectDeadline)));
+        case State::Disconnected:
+            break;
+    }
+    return milliseconds(remainingMs(m_NextAttempt));
+}
+
+std::chrono::milliseconds TcpTransport::backoff(const Options &options, int attempt)
+{
+    if (attempt <= 0)
+        return std::chrono::milliseconds(0);
+    const int64_t delay = int64_t(options.backoffInitialMs) << std::min(attempt - 1, 30);
+    return std::chrono::milliseconds(std::min<int64_t>(delay, options.backoffMaxMs));
+}
+
+std::chrono::milliseconds TcpTransport::jitteredBackoff(int attempt)
+{
+    // Half fixed, half random, so drivers that lost the same bridge do not all
+    // knock on it again at the same moment.
+    const int64_t delay = backoff(m_Options, attempt).count();
+    if (delay <= 1)
+        return std::chrono::milliseconds(delay);
+    std::uniform_int_distribution<int64_t> jitter(0, delay / 2);
+    return std::chrono::milliseconds(delay - delay / 2 + jitter(m_Random));
+}
+
+void TcpTransport::startConnect()
+{
+    ++m_Attempt;
+    m_State = State::Disconnected;
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    const std::string port = std::to_string(m_Options.port);
+    if (getaddrinfo(m_Options.host.c_str(), port.c_str(), &hints, &addresses) != 0)
+    {
+        failConnect();
+        return;
+    }
+
+    // One address per attempt, the first one a connect can start on.
+    for (addrinfo *address = addresses; address != nullptr && m_ConnectFd < 0; address = address->ai_next)
+    {
+        const int fd = socket(address->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            continue;
+
+        // Non-blocking only for the connect, so an unreachable bridge never
+        // holds up the caller.
+        m_ConnectFlags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, m_ConnectFlags | O_NONBLOCK);
+        applyOptions(fd);
+
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS)
+            m_ConnectFd = fd;
+        else
+            ::close(fd);
+    }
+    freeaddrinfo(addresses);
+
+    if (m_ConnectFd < 0)
+    {
+        failConnect();
+        return;
+    }
+    m_State = State::Connecting;
+    m_ConnectDeadline = Clock::now() + std::chrono::milliseconds(m_Options.connectTimeoutMs);
+}
+
+void TcpTransport::finishConnect()
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(m_ConnectFd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+    {
+        failConnect();
+        return;
+    }
+    fcntl(m_ConnectFd, F_SETFL, m_ConnectFlags);
+
+    // Keep the descriptor number, whoever holds it (PortFD) keeps working.
+    if (m_Fd >= 0)
+    {
+        dup2(m_ConnectFd, m_Fd);
+        ::close(m_ConnectFd);
+        ++m_Stats.reconnects;
+    }
+    else
+    {
+        m_Fd = m_ConnectFd;
+        m_Owned = true;
+        ++m_Stats.connects;
+    }
+    m_ConnectFd = -1;
+    m_State = State::Connected;
+    m_Buffer.clear();
+    m_Attempt = 0;
+}
+
+void TcpTransport::failConnect()
+{
+    if (m_ConnectFd >= 0)
+        ::close(m_ConnectFd);
+    m_ConnectFd = -1;
+    m_State = State::Disconnected;
+    ++m_Stats.failedAttempts;
+    m_NextAttempt = Clock::now() + jitteredBackoff(m_Attempt);
+}
+
+bool TcpTransport::applyOptions(int socketFd) const
+{
+    if (!setOption(socketFd, IPPROTO_TCP, TCP_NODELAY, m_Options.noDelay ? 1 : 0))
+        return false;
+
+    // The rest is best effort, not every platform has every knob.
+    setOption(socketFd, SOL_SOCKET, SO_KEEPALIVE, m_Options.keepAliveIdle > 0 ? 1 : 0);
+    if (m_Options.keepAliveIdle > 0)
+    {
+#ifdef TCP_KEEPIDLE
+        setOption(socketFd, IPPROTO_TCP, TCP_KEEPIDLE, m_Options.keepAliveIdle);
+#elif defined(TCP_KEEPALIVE)
+        setOption(socketFd, IPPROTO_TCP, TCP_KEEPALIVE, m_Options.keepAliveIdle);
+#endif
+#ifdef TCP_KEEPINTVL
+        setOption(socketFd, IPPROTO_TCP, TCP_KEEPINTVL, std::max(1, m_Options.keepAliveInterval));
+#endif
+#ifdef TCP_KEEPCNT
+        setOption(socketFd, IPPROTO_TCP, TCP_KEEPCNT, std::max(1, m_Options.keepAliveCount));
+#endif
+    }
+#ifdef TCP_USER_TIMEOUT
+    setOption(socketFd, IPPROTO_TCP, TCP_USER_TIMEOUT, std::max(0, m_Options.userTimeoutMs));
+#endif
+#ifdef SO_NOSIGPIPE
+    setOption(socketFd, SOL_SOCKET, SO_NOSIGPIPE, 1);
+#endif
+    return true;
+}
+
+bool TcpTransport::writeAll(const std::string &data)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(m_Options.commandTimeoutMs);
+    size_t written = 0;
+    while (written < data.size())
+    {
+        const ssize_t rc = ::send(m_Fd, data.data() + written, data.size() - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (rc > 0)
+        {
+            written += rc;
+            continue;
+        }
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(m_Fd, POLLOUT, remainingMs(deadline)))
+            continue;
+        return false;
+    }
+    return true;
+}
+
+TcpTransport::ReadResult TcpTransport::readAnswer(std::string &response)
+{
+    const auto deadline = Clock::now() + std::chrono::milliseconds(m_Options.commandTimeoutMs);
+    size_t scanned = 0;
+    for (;;)
+    {
+        const size_t end = m_Buffer.find(m_Options.terminator, scanned);
+        if (end != std::string::npos)
+        {
+            response.assign(m_Buffer, 0, end + 1);
+            m_Buffer.erase(0, end + 1);
+            return ReadResult::Ok;
+        }
+        scanned = m_Buffer.size();
+
+        if (!waitFor(m_Fd, POLLIN, remainingMs(deadline)))
+            return Clock::now() >= deadline ? ReadResult::Timeout : ReadResult::Closed;
+
+        char chunk[512];
+        const ssize_t rc = recv(m_Fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (rc > 0)
+            m_Buffer.append(chunk, rc);
+        else if (rc == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+            return ReadResult::Closed;
+    }
+}
+
+void TcpTransport::broken()
+{
+    m_Stats.failed += m_InFlight.size();
+    m_InFlight.clear();
+    m_Buffer.clear();
+    m_State = State::Disconnected;
+    // The first attempt goes out on the next maintain(), the backoff starts after it.
+    m_Attempt = 0;
+    m_NextAttempt = Clock::now();
+}
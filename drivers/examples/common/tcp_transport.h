@@ -0,0 +1,206 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+
+/**
+ * @brief A TCP connection to a serial-over-Ethernet bridge that survives drops.
+ *
+ * The socket gets TCP_NODELAY, so short commands are not held back by Nagle's
+ * algorithm, and keepalive plus TCP_USER_TIMEOUT, so a half-open connection
+ * fails within seconds instead of hours.
+ *
+ * Commands that were written but not answered yet are in flight. When the
+ * connection breaks, or an answer does not arrive in time, the commands in
+ * flight fail at once and the transport is Disconnected. maintain() then
+ * reconnects without blocking: it starts a non-blocking connect, checks on it
+ * the next time and waits a jittered exponential backoff between attempts.
+ * retryIn() says when to call it again, for a timer on the event loop.
+ *
+ * A driver can attach() to the socket the INDI TCP connection plugin opened:
+ * reconnects then dup2() the new socket onto the same descriptor, so PortFD
+ * stays valid and the plugin still closes it on disconnect.
+ *
+ * Not thread safe. Only open() waits for a connect, command() waits at most
+ * commandTimeoutMs for its answer.
+ */
+class TcpTransport
+{
+public:
+    struct Options
+    {
+        std::string host {"localhost"};
+        uint16_t port {0};
+
+        bool noDelay {true};
+        /** Keepalive: idle seconds before the first probe, seconds between probes, probes. 0 disables. */
+        int keepAliveIdle {5};
+        int keepAliveInterval {2};
+        int keepAliveCount {3};
+        /** TCP_USER_TIMEOUT: unacknowledged data fails the connection after this, 0 for the system default. */
+        int userTimeoutMs {5000};
+
+        int connectTimeoutMs {2000};
+        /** No answer within this is treated as a dead connection, see reconnectOnTimeout. */
+        int commandTimeoutMs {1000};
+        bool reconnectOnTimeout {true};
+
+        /** Backoff before reconnect attempt n > 0 is min(backoffMax, backoffInitial * 2^(n-1)), jittered by half. */
+        int backoffInitialMs {100};
+        int backoffMaxMs {5000};
+
+        /** Answers end with this byte. */
+        char terminator {'#'};
+    };
+
+    enum class State
+    {
+        Disconnected,
+        /** A reconnect is under way, see maintain(). */
+        Connecting,
+        Connected,
+    };
+
+    struct Stats
+    {
+        uint64_t connects {0};
+        uint64_t reconnects {0};
+        uint64_t failedAttempts {0};
+        /** Commands that failed, including those in flight when the connection broke. */
+        uint64_t failed {0};
+        uint64_t timeouts {0};
+        /** Round trip of the last answered command. */
+        std::chrono::nanoseconds lastRoundTrip {0};
+    };
+
+    TcpTransport() = default;
+    ~TcpTransport();
+
+    TcpTransport(const TcpTransport &) = delete;
+    TcpTransport &operator=(const TcpTransport &) = delete;
+
+    /** @brief Connect to options.host:port, waiting up to connectTimeoutMs. The transport owns the socket. */
+    bool open(const Options &options);
+
+    /**
+     * @brief Take over a connected socket opened by somebody else.
+     * The options are applied to it, the descriptor stays owned by the caller.
+     * @return false if fd is not a TCP socket.
+     */
+    bool attach(int fd, const Options &options);
+
+    /** @brief Change the options, the socket options take effect right away. */
+    void setOptions(const Options &options);
+
+    /** @brief Close an owned socket, forget an attached one. Commands in flight are dropped. */
+    void close();
+
+    /**
+     * @brief Write a command and wait for its answer, including the terminator.
+     * Fails right away while not connected.
+     */
+    bool command(const std::string &request, std::string &response);
+
+    /** @brief Write a command without waiting, answers come back in order from receive(). */
+    bool send(const std::string &request);
+
+    /** @brief The answer to the oldest command in flight. */
+    bool receive(std::string &response);
+
+    /**
+     * @brief Move a reconnect along without blocking: check the connect under
+     * way, or start one once the backoff has passed.
+     * @return true when connected.
+     */
+    bool maintain();
+
+    /**
+     * @brief When maintain() has something to do again: soon while
+     * connecting, when the backoff ends while disconnected.
+     * @return -1 while connected.
+     */
+    std::chrono::milliseconds retryIn() const;
+
+    State state() const
+    {
+        return m_State;
+    }
+
+    bool isConnected() const
+    {
+        return m_State == State::Connected;
+    }
+
+    int fd() const
+    {
+        return m_Fd;
+    }
+
+    size_t inFlight() const
+    {
+        return m_InFlight.size();
+    }
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+    const Options &options() const
+    {
+        return m_Options;
+    }
+
+    /** @brief Backoff before reconnect attempt n, without jitter. */
+    static std::chrono::milliseconds backoff(const Options &options, int attempt);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class ReadResult
+    {
+        Ok,
+        Timeout,
+        Closed,
+    };
+
+    bool applyOptions(int socketFd) const;
+    bool writeAll(const std::string &data);
+    ReadResult readAnswer(std::string &response);
+
+    // The reconnect state machine: Disconnected -> Connecting -> Connected,
+    // back to Disconnected with a backoff when the attempt fails.
+    void startConnect();
+    void finishConnect();
+    void failConnect();
+    // Fail the commands in flight and leave the reconnect to maintain().
+    void broken();
+    std::chrono::milliseconds jitteredBackoff(int attempt);
+
+    Options m_Options;
+    int m_Fd {-1};
+    bool m_Owned {false};
+    State m_State {State::Disconnected};
+    // The socket of the connect under way.
+    int m_ConnectFd {-1};
+    int m_ConnectFlags {0};
+    Clock::time_point m_ConnectDeadline;
+
+    struct Pending
+    {
+        std::string request;
+        Clock::time_point sentAt;
+    };
+    std::deque<Pending> m_InFlight;
+    // Bytes received past the last answer.
+    std::string m_Buffer;
+
+    int m_Attempt {0};
+    Clock::time_point m_NextAttempt;
+    std::minstd_rand m_Random {std::random_device{}()};
+
+    Stats m_Stats;
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <termios.h>
+
+#include "libindi/connectionplugins/connectiontcp.h"
+#include "libindi/defaultdevice.h"
+#include "libindi/eventloop.h"
+#include "libindi/indicom.h"
+#include "libindi/indilogger.h"
+#include "libindi/indipropertynumber.h"
+
+#include "tcp_transport.h"
+
+/**
+ * @brief The settings and status properties of a TcpTransport.
+ *
+ * TCP_TRANSPORT holds the keepalive, timeout and backoff settings and is saved
+ * in the config. TCP_TRANSPORT_STATUS shows reconnects, failed commands and
+ * the last round trip while connected over TCP.
+ *
+ * The driver sends its commands with command(), which goes through
+ * Tcp.command() over TCP. A command that finds the bridge gone fails at once
+ * and a timer on the event loop reconnects in the background, so the driver
+ * never waits for a connect.
+ *
+ * @code
+ * // initProperties():
+ * TcpProperties.fill(getDeviceName(), Tcp);
+ * // ISGetProperties():
+ * TcpProperties.define(this);
+ * // updateProperties():
+ * TcpProperties.updateProperties(this);
+ * // saveConfigItems():
+ * TcpProperties.save(fp);
+ * // Handshake(), after the INDI TCP plugin connected:
+ * TcpProperties.attach(this, tcpConnection, PortFD);
+ * // Queries, over TCP or serial:
+ * TcpProperties.command(PortFD, ":GA#", answer);
+ * // TimerHit():
+ * TcpProperties.poll();
+ * @endcode
+ */
+class TcpTransportProperties
+{
+public:
+    enum
+    {
+        KEEPALIVE_IDLE,
+        USER_TIMEOUT,
+        COMMAND_TIMEOUT,
+        BACKOFF_MAX,
+        SETTING_N,
+    };
+    INDI::PropertyNumber SettingsNP {SETTING_N};
+
+    enum
+    {
+        RECONNECTS,
+        FAILED,
+        ROUND_TRIP,
+        STATUS_N,
+    };
+    INDI::PropertyNumber StatusNP {STATUS_N};
+
+    /** @brief Fill both properties, a new setting is applied to transport right away. */
+    void fill(const char *device, TcpTransport &transport)
+    {
+        m_Transport = &transport;
+
+        SettingsNP[KEEPALIVE_IDLE].fill("KEEPALIVE_IDLE", "Keepalive idle (s)", "%.0f", 0, 600, 1, 5);
+        SettingsNP[USER_TIMEOUT].fill("USER_TIMEOUT", "User timeout (ms)", "%.0f", 0, 60000, 500, 5000);
+        SettingsNP[COMMAND_TIMEOUT].fill("COMMAND_TIMEOUT", "Command timeout (ms)", "%.0f", 50, 30000, 100, 1000);
+        SettingsNP[BACKOFF_MAX].fill("BACKOFF_MAX", "Max backoff (ms)", "%.0f", 100, 60000, 500, 5000);
+        SettingsNP.fill(device, "TCP_TRANSPORT", "TCP Transport", CONNECTION_TAB, IP_RW, 60, IPS_IDLE);
+        SettingsNP.onUpdate([this, &transport]
+        {
+            transport.setOptions(options(transport.options().host.c_str(), transport.options().port));
+            SettingsNP.setState(IPS_OK);
+            SettingsNP.apply();
+        });
+
+        StatusNP[RECONNECTS].fill("RECONNECTS", "Reconnects", "%.0f", 0, 1e9, 0, 0);
+        StatusNP[FAILED].fill("FAILED", "Failed commands", "%.0f", 0, 1e9, 0, 0);
+        StatusNP[ROUND_TRIP].fill("ROUND_TRIP", "Round trip (ms)", "%.2f", 0, 1e6, 0, 0);
+        StatusNP.fill(device, "TCP_TRANSPORT_STATUS", "TCP Status", CONNECTION_TAB, IP_RO, 0, IPS_IDLE);
+    }
+
+    /** @brief Define and load the settings. */
+    void define(INDI::DefaultDevice *device)
+    {
+        device->defineProperty(SettingsNP);
+        device->loadConfig(SettingsNP);
+    }
+
+    /**
+     * @brief Hand the socket of the INDI TCP plugin to the transport, when the
+     * device is connected through it and not simulated.
+     * @return true if the transport took the socket.
+     */
+    bool attach(INDI::DefaultDevice *device, Connection::TCP *connection, int fd)
+    {
+        if (device->isSimulation() || device->getActiveConnection() != connection)
+            return false;
+        if (m_Transport->attach(fd, options(connection->host(), connection->port())))
+            return true;
+        DEBUGDEVICE(device->getDeviceName(), INDI::Logger::DBG_WARNING,
+                    "Not a TCP stream, automatic reconnects are disabled.");
+        return false;
+    }
+
+    /** @brief The status while connected over TCP. Disconnecting forgets the plugin's socket. */
+    void updateProperties(INDI::DefaultDevice *device)
+    {
+        if (device->isConnected())
+        {
+            if (m_Transport->fd() >= 0)
+                device->defineProperty(StatusNP);
+        }
+        else
+        {
+            device->deleteProperty(StatusNP);
+            if (m_RetryTimer != -1)
+                IERmTimer(m_RetryTimer);
+            m_RetryTimer = -1;
+            // The plugin closed the socket.
+            m_Transport->close();
+        }
+    }
+
+    /**
+     * @brief Write a command ending in '#' and read its answer, through the
+     * transport when it took the socket, otherwise on the serial port fd.
+     */
+    bool command(int fd, const std::string &request, std::string &response)
+    {
+        if (m_Transport->fd() >= 0)
+        {
+            if (m_Transport->command(request, response))
+                return true;
+            // Start reconnecting right away if the bridge is gone.
+            poll();
+            return false;
+        }
+
+        char answer[256];
+        int written = 0, read = 0;
+        tcflush(fd, TCIOFLUSH);
+        if (tty_write_string(fd, request.c_str(), &written) != TTY_OK ||
+                tty_nread_section(fd, answer, sizeof(answer), '#', 1, &read) != TTY_OK)
+            return false;
+        response.assign(answer, read);
+        return true;
+    }
+
+    void save(FILE *fp) const
+    {
+        SettingsNP.save(fp);
+    }
+
+    /**
+     * @brief Move a reconnect along and send the status, from the poll timer.
+     * While disconnected it also runs from its own timer, as often as
+     * retryIn() asks.
+     */
+    void poll()
+    {
+        if (m_Transport->fd() < 0)
+            return;
+        m_Transport->maintain();
+        update(*m_Transport);
+
+        const int delay = static_cast<int>(m_Transport->retryIn().count());
+        if (delay >= 0 && m_RetryTimer == -1)
+            m_RetryTimer = IEAddTimer(delay, &TcpTransportProperties::retry, this);
+    }
+
+    /** @brief Transport options from the settings, for the bridge at host:port. */
+    TcpTransport::Options options(const char *host, uint32_t port) const
+    {
+        TcpTransport::Options options;
+        options.host = host != nullptr ? host : "";
+        options.port = static_cast<uint16_t>(port);
+        options.keepAliveIdle = static_cast<int>(SettingsNP[KEEPALIVE_IDLE].getValue());
+        options.userTimeoutMs = static_cast<int>(SettingsNP[USER_TIMEOUT].getValue());
+        options.commandTimeoutMs = static_cast<int>(SettingsNP[COMMAND_TIMEOUT].getValue());
+        options.backoffMaxMs = static_cast<int>(SettingsNP[BACKOFF_MAX].getValue());
+        return options;
+    }
+
+    /** @brief Send the status if anything changed. */
+    void update(const TcpTransport &transport)
+    {
+        const TcpTransport::Stats &stats = transport.stats();
+        const double values[STATUS_N] =
+        {
+            double(stats.reconnects), double(stats.failed),
+            std::chrono::duration<double, std::milli>(stats.lastRoundTrip).count()
+        };
+        const IPState state = transport.isConnected() ? IPS_OK :
+                              transport.state() == TcpTransport::State::Connecting ? IPS_BUSY : IPS_ALERT;
+
+        bool changed = StatusNP.getState() != state;
+        for (int i = 0; i < STATUS_N; ++i)
+            changed |= StatusNP[i].getValue() != values[i];
+        if (!changed)
+            return;
+
+        for (int i = 0; i < STATUS_N; ++i)
+            StatusNP[i].setValue(values[i]);
+        StatusNP.setState(state);
+        StatusNP.apply();
+    }
+
+private:
+    static void retry(void *userpointer)
+    {
+        auto *self = static_cast<TcpTransportProperties *>(userpointer);
+        self->m_RetryTimer = -1;
+        self->poll();
+    }
+
+    TcpTransport *m_Transport {nullptr};
+    int m_RetryTimer {-1};
+};
@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // The caller of parallelFor() works too, so start one worker less.
+    for (size_t i = 1; i < threads; ++i)
+        m_Workers.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WakeUp.notify_all();
+    for (auto &worker : m_Workers)
+        worker.join();
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task)
+{
+    if (count == 0)
+        return;
+
+    if (m_Workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    // One batch at a time, wait for a concurrent caller to finish.
+    m_Done.wait(lock, [this] { return m_Task == nullptr; });
+
+    m_Task = &task;
+    m_Next = 0;
+    m_Count = count;
+    m_Pending = count;
+    ++m_Generation;
+    m_WakeUp.notify_all();
+
+    while (m_Next < m_Count)
+    {
+        size_t index = m_Next++;
+        lock.unlock();
+        task(index);
+        lock.lock();
+        --m_Pending;
+    }
+
+    m_Done.wait(lock, [this] { return m_Pending == 0; });
+    m_Task = nullptr;
+    m_Done.notify_all();
+}
+
+void ThreadPool::run()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for (;;)
+    {
+        m_WakeUp.wait(lock, [&] { return m_Stop || (m_Task != nullptr && m_Generation != seen && m_Next < m_Count); });
+        if (m_Stop)
+            return;
+
+        const std::function<void(size_t)> *task = m_Task;
+        while (m_Next < m_Count)
+        {
+            size_t index = m_Next++;
+            lock.unlock();
+            (*task)(index);
+            lock.lock();
+            if (--m_Pending == 0)
+                m_Done.notify_all();
+        }
+        seen = m_Generation;
+    }
+}
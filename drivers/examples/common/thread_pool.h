@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads for data parallel work on frames.
+ *
+ * Workers are started once and reused, so splitting a frame into chunks costs a
+ * queue push per chunk and no thread creation.
+ */
+class ThreadPool
+{
+public:
+    /** @param threads number of workers, 0 picks the number of cores. */
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const
+    {
+        return m_Workers.size();
+    }
+
+    /**
+     * @brief Run task(0) ... task(count - 1) on the workers and wait for all of them.
+     * The calling thread works on the tasks too.
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+    /** @brief A pool shared by everybody in the process, sized to the number of cores. */
+    static ThreadPool &shared();
+
+private:
+    void run();
+
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    std::condition_variable m_Done;
+
+    // The batch being worked on, protected by m_Mutex.
+    const std::function<void(size_t)> *m_Task {nullptr};
+    size_t m_Next {0};
+    size_t m_Count {0};
+    size_t m_Pending {0};
+    uint64_t m_Generation {0};
+    bool m_Stop {false};
+};
@@ -0,0 +1,357 @@
+#include "udp_telemetry.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <random>
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+
+const uint32_t Magic = 0x4D4C5449; // "ITLM" read as little endian
+const uint8_t Version = 1;
+// Datagrams read per recvmmsg().
+const unsigned Batch = 32;
+
+void put32(uint8_t *at, uint32_t value)
+{
+    value = htole32(value);
+    memcpy(at, &value, sizeof(value));
+}
+
+void put64(uint8_t *at, uint64_t value)
+{
+    value = htole64(value);
+    memcpy(at, &value, sizeof(value));
+}
+
+uint32_t get32(const uint8_t *at)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return le32toh(value);
+}
+
+uint64_t get64(const uint8_t *at)
+{
+    uint64_t value;
+    memcpy(&value, at, sizeof(value));
+    return le64toh(value);
+}
+
+bool parseAddress(const std::string &text, in_addr &address, std::string &error)
+{
+    if (inet_pton(AF_INET, text.c_str(), &address) == 1)
+        return true;
+    error = "not an IPv4 address: " + text;
+    return false;
+}
+
+}
+
+uint32_t telemetryStreamId(const std::string &device, const std::string &property)
+{
+    uint32_t hash = 2166136261u;
+    auto add = [&hash](char c)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    };
+    for (char c : device)
+        add(c);
+    add('.');
+    for (char c : property)
+        add(c);
+    return hash;
+}
+
+size_t telemetryEncode(const TelemetrySample &sample, uint8_t *buffer)
+{
+    const size_t count = sample.count < TelemetryMaxValues ? sample.count : TelemetryMaxValues;
+    put32(buffer, Magic);
+    buffer[4] = Version;
+    buffer[5] = static_cast<uint8_t>(count);
+    buffer[6] = static_cast<uint8_t>(sample.state);
+    buffer[7] = 0;
+    put32(buffer + 8, sample.stream);
+    put32(buffer + 12, sample.session);
+    put64(buffer + 16, sample.sequence);
+    put64(buffer + 24, static_cast<uint64_t>(sample.timestampNs));
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t bits;
+        memcpy(&bits, &sample.values[i], sizeof(bits));
+        put64(buffer + TelemetryHeaderSize + 8 * i, bits);
+    }
+    return TelemetryHeaderSize + 8 * count;
+}
+
+bool telemetryDecode(const uint8_t *data, size_t length, TelemetrySample &sample)
+{
+    if (length < TelemetryHeaderSize || get32(data) != Magic || data[4] != Version)
+        return false;
+    const size_t count = data[5];
+    // Longer is fine, a later version may add to the end.
+    if (count > TelemetryMaxValues || length < TelemetryHeaderSize + 8 * count)
+        return false;
+    sample.count = static_cast<uint32_t>(count);
+    sample.state = data[6];
+    sample.stream = get32(data + 8);
+    sample.session = get32(data + 12);
+    sample.sequence = get64(data + 16);
+    sample.timestampNs = static_cast<int64_t>(get64(data + 24));
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint64_t bits = get64(data + TelemetryHeaderSize + 8 * i);
+        memcpy(&sample.values[i], &bits, sizeof(bits));
+    }
+    return true;
+}
+
+int64_t telemetryNowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// -- TelemetryPublisher -----------------------------------------------------
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+    close();
+}
+
+bool TelemetryPublisher::open(const Options &options, std::string &error)
+{
+    close();
+
+    memset(&m_Destination, 0, sizeof(m_Destination));
+    m_Destination.sin_family = AF_INET;
+    m_Destination.sin_port = htons(options.port);
+    if (!parseAddress(options.destination, m_Destination.sin_addr, error))
+        return false;
+
+    m_Fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_Fd < 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    if (IN_MULTICAST(ntohl(m_Destination.sin_addr.s_addr)))
+    {
+        const int ttl = options.ttl;
+        // Receivers on this host get it too.
+        const int loop = 1;
+        setsockopt(m_Fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(m_Fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        if (!options.interface.empty())
+        {
+            in_addr interface;
+            if (!parseAddress(options.interface, interface, error) ||
+                    setsockopt(m_Fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0)
+            {
+                if (error.empty())
+                    error = strerror(errno);
+                close();
+                return false;
+            }
+        }
+    }
+
+    std::random_device random;
+    m_Session = random();
+    m_Sequences.clear();
+    m_Stats = Stats();
+    return true;
+}
+
+void TelemetryPublisher::close()
+{
+    if (m_Fd >= 0)
+        ::close(m_Fd);
+    m_Fd = -1;
+}
+
+bool TelemetryPublisher::publish(uint32_t stream, const double *values, size_t count, int state)
+{
+    if (m_Fd < 0)
+        return false;
+
+    TelemetrySample sample;
+    sample.stream = stream;
+    sample.session = m_Session;
+    sample.sequence = ++m_Sequences[stream];
+    sample.state = state;
+    sample.count = static_cast<uint32_t>(count < TelemetryMaxValues ? count : TelemetryMaxValues);
+    memcpy(sample.values, values, sample.count * sizeof(double));
+    sample.timestampNs = telemetryNowNs();
+
+    uint8_t buffer[TelemetryMaxDatagram];
+    const size_t length = telemetryEncode(sample, buffer);
+    if (sendto(m_Fd, buffer, length, 0, reinterpret_cast<const sockaddr *>(&m_Destination),
+               sizeof(m_Destination)) == static_cast<ssize_t>(length))
+    {
+        ++m_Stats.sent;
+        return true;
+    }
+    // The sequence number is used up, receivers count the datagram as lost.
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+        ++m_Stats.dropped;
+    else
+        ++m_Stats.failed;
+    return false;
+}
+
+// -- TelemetryReceiver ------------------------------------------------------
+
+TelemetryReceiver::~TelemetryReceiver()
+{
+    close();
+}
+
+bool TelemetryReceiver::open(const Options &options, std::string &error)
+{
+    close();
+
+    in_addr group {}, interface {};
+    interface.s_addr = htonl(INADDR_ANY);
+    if (!options.group.empty() && !parseAddress(options.group, group, error))
+        return false;
+    if (!options.interface.empty() && !parseAddress(options.interface, interface, error))
+        return false;
+
+    m_Fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_Fd < 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+    // Several clients on one host listen to the same group.
+    const int on = 1;
+    setsockopt(m_Fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (options.receiveBuffer > 0)
+        setsockopt(m_Fd, SOL_SOCKET, SO_RCVBUF, &options.receiveBuffer, sizeof(options.receiveBuffer));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(m_Fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        error = strerror(errno);
+        close();
+        return false;
+    }
+
+    if (!options.group.empty())
+    {
+        ip_mreq membership;
+        membership.imr_multiaddr = group;
+        membership.imr_interface = interface;
+        if (setsockopt(m_Fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+        {
+            error = std::string("cannot join ") + options.group + ": " + strerror(errno);
+            close();
+            return false;
+        }
+    }
+
+    m_Streams.clear();
+    m_Malformed = 0;
+    return true;
+}
+
+void TelemetryReceiver::close()
+{
+    if (m_Fd >= 0)
+        ::close(m_Fd);
+    m_Fd = -1;
+}
+
+size_t TelemetryReceiver::drain(const Handler &handler)
+{
+    if (m_Fd < 0)
+        return 0;
+
+    uint8_t buffers[Batch][TelemetryMaxDatagram + 1];
+    iovec vectors[Batch];
+    mmsghdr messages[Batch];
+    memset(messages, 0, sizeof(messages));
+    for (unsigned i = 0; i < Batch; ++i)
+    {
+        vectors[i].iov_base = buffers[i];
+        vectors[i].iov_len = sizeof(buffers[i]);
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t delivered = 0;
+    for (;;)
+    {
+        const int received = recvmmsg(m_Fd, messages, Batch, MSG_DONTWAIT, nullptr);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return delivered;
+
+        for (int i = 0; i < received; ++i)
+        {
+            TelemetrySample sample;
+            if (!telemetryDecode(buffers[i], messages[i].msg_len, sample))
+            {
+                ++m_Malformed;
+                continue;
+            }
+
+            StreamStats &stream = m_Streams[sample.stream];
+            if (stream.received == 0 || stream.session != sample.session)
+            {
+                // A new publisher, or the old one restarted.
+                stream = StreamStats();
+                stream.session = sample.session;
+                stream.lastSequence = sample.sequence - 1;
+            }
+            ++stream.received;
+            if (sample.sequence <= stream.lastSequence)
+            {
+                // Counted as lost when the newer one came. Older than the
+                // window it cannot be told from a duplicate, it stays lost.
+                const uint64_t age = stream.lastSequence - sample.sequence;
+                const uint64_t bit = age < 64 ? uint64_t(1) << age : 0;
+                if (stream.seen & bit)
+                    ++stream.duplicates;
+                else
+                {
+                    ++stream.late;
+                    if (bit != 0 && stream.lost > 0)
+                        --stream.lost;
+                    stream.seen |= bit;
+                }
+                continue;
+            }
+            const uint64_t advance = sample.sequence - stream.lastSequence;
+            stream.lost += advance - 1;
+            stream.seen = (advance < 64 ? stream.seen << advance : 0) | 1;
+            stream.lastSequence = sample.sequence;
+            handler(sample);
+            ++delivered;
+        }
+        if (received < static_cast<int>(Batch))
+            return delivered;
+    }
+}
+
+const TelemetryReceiver::StreamStats *TelemetryReceiver::stats(uint32_t stream) const
+{
+    auto found = m_Streams.find(stream);
+    return found == m_Streams.end() ? nullptr : &found->second;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include <netinet/in.h>
+
+/**
+ * @brief UDP side channel for Number properties that change faster than XML
+ * through indiserver should carry them, to clients on any host.
+ *
+ * The encoder of a dome, a focuser during a move or a GPS fix are worth
+ * having at 50 to 100 Hz. As setNumberVector messages each of them is
+ * formatted by the driver, parsed and forwarded by indiserver and parsed
+ * again by every client. Here the driver also sends them as fixed layout
+ * datagrams, unicast or multicast, and clients that want the rate receive
+ * them directly. The XML path keeps running at the polling rate and stays
+ * the authority: a client that misses datagrams or does not listen loses
+ * nothing but the rate.
+ *
+ * A datagram is a 32 byte header and up to TelemetryMaxValues doubles, all
+ * little endian:
+ *
+ *     0  magic     u32  "ITLM"
+ *     4  version   u8   1
+ *     5  count     u8   values that follow
+ *     6  state     u8   IPState of the property
+ *     7  reserved  u8
+ *     8  stream    u32  telemetryStreamId(device, property)
+ *     12 session   u32  random per publisher, changes when it restarts
+ *     16 sequence  u64  per stream, from 1
+ *     24 timestamp i64  CLOCK_REALTIME nanoseconds when it was sent
+ *     32 values    f64 × count, in the order of the property's elements
+ *
+ * The stream id is a hash of the device and property names, so a client
+ * that knows the property from its definition knows its stream without
+ * asking. The publisher never blocks: a datagram the socket cannot take is
+ * dropped and counted. The receiver counts the gaps in the sequence as lost,
+ * drops what arrives after a newer sample of the same stream and tells late
+ * samples from duplicates for the last 64 sequence numbers.
+ */
+
+/** @brief Values per datagram. */
+const size_t TelemetryMaxValues = 16;
+const size_t TelemetryHeaderSize = 32;
+const size_t TelemetryMaxDatagram = TelemetryHeaderSize + 8 * TelemetryMaxValues;
+const uint16_t TelemetryDefaultPort = 7625;
+/** In the organization-local scope, routers do not forward it off site. */
+const char *const TelemetryDefaultGroup = "239.255.73.78";
+
+struct TelemetrySample
+{
+    uint32_t stream {0};
+    uint32_t session {0};
+    uint64_t sequence {0};
+    /** CLOCK_REALTIME of the publisher, nanoseconds. */
+    int64_t timestampNs {0};
+    /** IPState of the property. */
+    int32_t state {0};
+    uint32_t count {0};
+    double values[TelemetryMaxValues] {};
+};
+
+/** @brief The stream id of device.property, 32 bit FNV-1a of "device.property". */
+uint32_t telemetryStreamId(const std::string &device, const std::string &property);
+
+/** @brief Write sample as a datagram to buffer, TelemetryMaxDatagram bytes at most. @return its length. */
+size_t telemetryEncode(const TelemetrySample &sample, uint8_t *buffer);
+
+/** @brief Read a datagram. False if it is not one. */
+bool telemetryDecode(const uint8_t *data, size_t length, TelemetrySample &sample);
+
+/** @brief CLOCK_REALTIME in nanoseconds, what the timestamps are. */
+int64_t telemetryNowNs();
+
+class TelemetryPublisher
+{
+public:
+    struct Options
+    {
+        /** A multicast group, or the address of one client. */
+        std::string destination {TelemetryDefaultGroup};
+        uint16_t port {TelemetryDefaultPort};
+        /** Hops multicast datagrams go, 1 stays on the local network. */
+        int ttl {1};
+        /** IPv4 address of the interface to send multicast on, empty for the default. */
+        std::string interface;
+    };
+
+    struct Stats
+    {
+        uint64_t sent {0};
+        /** The socket buffer was full. */
+        uint64_t dropped {0};
+        uint64_t failed {0};
+    };
+
+    TelemetryPublisher() = default;
+    ~TelemetryPublisher();
+
+    TelemetryPublisher(const TelemetryPublisher &) = delete;
+    TelemetryPublisher &operator=(const TelemetryPublisher &) = delete;
+
+    /** @brief Open the socket. False with error if the destination is not an IPv4 address. */
+    bool open(const Options &options, std::string &error);
+    void close();
+
+    bool isOpen() const
+    {
+        return m_Fd >= 0;
+    }
+
+    /** @brief Send count values of stream, without blocking. False if it was not sent. */
+    bool publish(uint32_t stream, const double *values, size_t count, int state);
+
+    const Stats &stats() const
+    {
+        return m_Stats;
+    }
+
+private:
+    int m_Fd {-1};
+    sockaddr_in m_Destination {};
+    uint32_t m_Session {0};
+    std::unordered_map<uint32_t, uint64_t> m_Sequences;
+    Stats m_Stats;
+};
+
+class TelemetryReceiver
+{
+public:
+    struct Options
+    {
+        uint16_t port {TelemetryDefaultPort};
+        /** The multicast group to join, empty for unicast only. */
+        std::string group {TelemetryDefaultGroup};
+        /** IPv4 address of the interface to join on, empty for the default. */
+        std::string interface;
+        /** SO_RCVBUF in bytes, 0 for the system default. */
+        int receiveBuffer {0};
+    };
+
+    /** Counted per session, a restarted publisher starts them over. */
+    struct StreamStats
+    {
+        uint64_t received {0};
+        /** Gaps in the sequence that are still open. */
+        uint64_t lost {0};
+        /** Arrived after a newer sample, not delivered. Closes its gap. */
+        uint64_t late {0};
+        /** Arrived before, not delivered. */
+        uint64_t duplicates {0};
+        uint64_t lastSequence {0};
+        /** Bit n set: lastSequence - n arrived. */
+        uint64_t seen {0};
+        uint32_t session {0};
+    };
+
+    using Handler = std::function<void(const TelemetrySample &)>;
+
+    TelemetryReceiver() = default;
+    ~TelemetryReceiver();
+
+    TelemetryReceiver(const TelemetryReceiver &) = delete;
+    TelemetryReceiver &operator=(const TelemetryReceiver &) = delete;
+
+    bool open(const Options &options, std::string &error);
+    void close();
+
+    /** @brief Watch this for reading, on the client's event loop or in poll(). */
+    int fd() const
+    {
+        return m_Fd;
+    }
+
+    /**
+     * @brief Read every datagram waiting, without blocking, and hand the
+     * samples that are newer than the last of their stream to handler.
+     * @return the samples handed over.
+     */
+    size_t drain(const Handler &handler);
+
+    /** @brief What came of a stream so far, nullptr if nothing did. */
+    const StreamStats *stats(uint32_t stream) const;
+
+    /** @brief Datagrams that were not telemetry. */
+    uint64_t malformed() const
+    {
+        return m_Malformed;
+    }
+
+private:
+    int m_Fd {-1};
+    std::unordered_map<uint32_t, StreamStats> m_Streams;
+    uint64_t m_Malformed {0};
+};
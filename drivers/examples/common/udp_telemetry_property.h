@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+#include "libindi/defaultdevice.h"
+#include "libindi/indipropertynumber.h"
+#include "libindi/indipropertyswitch.h"
+#include "libindi/indipropertytext.h"
+
+#include "udp_telemetry.h"
+
+/**
+ * @brief Send a Number property as UDP telemetry, on the stream of its device
+ * and name, next to the XML that apply() sends at the polling rate.
+ *
+ * @code
+ * // A telemetry timer at TelemetryProperties::periodMs():
+ * publishTelemetry(Telemetry, DomeAbsPosNP);
+ * @endcode
+ */
+inline bool publishTelemetry(TelemetryPublisher &publisher, const INDI::PropertyNumber &property)
+{
+    double values[TelemetryMaxValues];
+    const size_t count = property.size() < TelemetryMaxValues ? property.size() : TelemetryMaxValues;
+    for (size_t i = 0; i < count; ++i)
+        values[i] = property[i].getValue();
+    return publisher.publish(telemetryStreamId(property.getDeviceName(), property.getName()), values, count,
+                             property.getState());
+}
+
+/**
+ * @brief The same for the classic properties some base classes still have,
+ * such as FocusAbsPosNP of INDI::Focuser and LocationNP of INDI::GPS.
+ */
+inline bool publishTelemetry(TelemetryPublisher &publisher, const INumberVectorProperty &property)
+{
+    double values[TelemetryMaxValues];
+    const size_t count = static_cast<size_t>(property.nnp) < TelemetryMaxValues ? property.nnp : TelemetryMaxValues;
+    for (size_t i = 0; i < count; ++i)
+        values[i] = property.np[i].value;
+    return publisher.publish(telemetryStreamId(property.device, property.name), values, count, property.s);
+}
+
+/**
+ * @brief The settings of a TelemetryPublisher, saved in the config.
+ *
+ * UDP_TELEMETRY switches the side channel on and off, and opens or closes
+ * the publisher right away. UDP_TELEMETRY_DESTINATION is the multicast group
+ * or the client to send to, and the interface for multicast.
+ * UDP_TELEMETRY_SETTINGS holds the port, the rate and the multicast TTL.
+ *
+ * @code
+ * // initProperties():
+ * TelemetrySettings.fill(getDeviceName(), Telemetry);
+ * // ISGetProperties():
+ * TelemetrySettings.define(this);
+ * // saveConfigItems():
+ * TelemetrySettings.save(fp);
+ * @endcode
+ */
+class TelemetryProperties
+{
+public:
+    enum
+    {
+        TELEMETRY_ON,
+        TELEMETRY_OFF,
+        TELEMETRY_N,
+    };
+    INDI::PropertySwitch EnableSP {TELEMETRY_N};
+
+    enum
+    {
+        DESTINATION,
+        INTERFACE,
+        DESTINATION_N,
+    };
+    INDI::PropertyText DestinationTP {DESTINATION_N};
+
+    enum
+    {
+        PORT,
+        RATE,
+        TTL,
+        SETTING_N,
+    };
+    INDI::PropertyNumber SettingsNP {SETTING_N};
+
+    /** @brief Fill the properties, changes reopen publisher when it is on. */
+    void fill(const char *device, TelemetryPublisher &publisher)
+    {
+        EnableSP[TELEMETRY_ON].fill("TELEMETRY_ON", "On", ISS_OFF);
+        EnableSP[TELEMETRY_OFF].fill("TELEMETRY_OFF", "Off", ISS_ON);
+        EnableSP.fill(device, "UDP_TELEMETRY", "UDP Telemetry", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+        EnableSP.onUpdate([this, &publisher]
+        {
+            apply(publisher);
+        });
+
+        DestinationTP[DESTINATION].fill("DESTINATION", "Group or client", TelemetryDefaultGroup);
+        DestinationTP[INTERFACE].fill("INTERFACE", "Interface address", "");
+        DestinationTP.fill(device, "UDP_TELEMETRY_DESTINATION", "Telemetry To", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+        DestinationTP.onUpdate([this, &publisher]
+        {
+            DestinationTP.setState(IPS_OK);
+            DestinationTP.apply();
+            apply(publisher);
+        });
+
+        SettingsNP[PORT].fill("PORT", "Port", "%.0f", 1, 65535, 1, TelemetryDefaultPort);
+        SettingsNP[RATE].fill("RATE", "Rate (Hz)", "%.0f", 1, 200, 10, 50);
+        SettingsNP[TTL].fill("TTL", "Multicast TTL", "%.0f", 0, 255, 1, 1);
+        SettingsNP.fill(device, "UDP_TELEMETRY_SETTINGS", "Telemetry", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+        SettingsNP.onUpdate([this, &publisher]
+        {
+            SettingsNP.setState(IPS_OK);
+            SettingsNP.apply();
+            apply(publisher);
+        });
+    }
+
+    /** @brief Define and load the properties, opens the publisher if the config has it on. */
+    void define(INDI::DefaultDevice *device)
+    {
+        device->defineProperty(EnableSP);
+        device->defineProperty(DestinationTP);
+        device->defineProperty(SettingsNP);
+        device->loadConfig(DestinationTP);
+        device->loadConfig(SettingsNP);
+        device->loadConfig(EnableSP);
+    }
+
+    void save(FILE *fp) const
+    {
+        EnableSP.save(fp);
+        DestinationTP.save(fp);
+        SettingsNP.save(fp);
+    }
+
+    bool isEnabled() const
+    {
+        return EnableSP.findOnSwitchIndex() == TELEMETRY_ON;
+    }
+
+    /** @brief Between two datagrams of a stream. */
+    int periodMs() const
+    {
+        return static_cast<int>(1000 / SettingsNP[RATE].getValue());
+    }
+
+    TelemetryPublisher::Options options() const
+    {
+        TelemetryPublisher::Options options;
+        options.destination = DestinationTP[DESTINATION].getText();
+        options.interface = DestinationTP[INTERFACE].getText();
+        options.port = static_cast<uint16_t>(SettingsNP[PORT].getValue());
+        options.ttl = static_cast<int>(SettingsNP[TTL].getValue());
+        return options;
+    }
+
+private:
+    // Open or close publisher as the settings say. A destination that is not
+    // an address leaves it closed and the switch in alert.
+    void apply(TelemetryPublisher &publisher)
+    {
+        std::string error;
+        publisher.close();
+        if (isEnabled() && !publisher.open(options(), error))
+        {
+            EnableSP.setState(IPS_ALERT);
+            EnableSP.apply("Cannot send telemetry: %s", error.c_str());
+            return;
+        }
+        EnableSP.setState(isEnabled() ? IPS_OK : IPS_IDLE);
+        EnableSP.apply();
+    }
+};
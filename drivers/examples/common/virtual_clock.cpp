@@ -0,0 +1,238 @@
+#include "virtual_clock.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+VirtualClock::VirtualClock(Mode mode, double scale)
+    : m_Mode(mode), m_Scale(mode == Mode::Scaled && scale > 0 ? scale : 1.0),
+      m_RealAnchor(std::chrono::steady_clock::now()), m_WallStart(std::chrono::system_clock::now())
+{
+}
+
+VirtualClock::Mode VirtualClock::mode() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Mode;
+}
+
+double VirtualClock::scale() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Scale;
+}
+
+void VirtualClock::setMode(Mode mode, double scale)
+{
+    std::function<void()> wakeUp;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_VirtualAnchor = nowLocked();
+        m_RealAnchor = std::chrono::steady_clock::now();
+        m_Mode = mode;
+        m_Scale = mode == Mode::Scaled && scale > 0 ? scale : 1.0;
+        wakeUp = m_WakeUp;
+    }
+    if (wakeUp)
+        wakeUp();
+}
+
+VirtualClock::Duration VirtualClock::nowLocked() const
+{
+    if (m_Mode == Mode::Discrete)
+        return m_VirtualAnchor;
+    const auto real = std::chrono::steady_clock::now() - m_RealAnchor;
+    if (m_Mode == Mode::Real)
+        return m_VirtualAnchor + std::chrono::duration_cast<Duration>(real);
+    return m_VirtualAnchor + Duration(static_cast<int64_t>(std::chrono::duration_cast<Duration>(real).count() * m_Scale));
+}
+
+VirtualClock::Duration VirtualClock::now() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return nowLocked();
+}
+
+std::chrono::system_clock::time_point VirtualClock::wallNow() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_WallStart + std::chrono::duration_cast<std::chrono::system_clock::duration>(nowLocked());
+}
+
+void VirtualClock::setWallStart(std::chrono::system_clock::time_point start)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_WallStart = start;
+}
+
+int VirtualClock::addTimer(Duration delay, Callback callback)
+{
+    std::function<void()> wakeUp;
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        id = m_NextId++;
+        const Duration deadline = nowLocked() + std::max(Duration(0), delay);
+        m_Timers.emplace(std::make_pair(deadline, id), std::move(callback));
+        m_Deadlines.emplace(id, deadline);
+        wakeUp = m_WakeUp;
+    }
+    if (wakeUp)
+        wakeUp();
+    return id;
+}
+
+void VirtualClock::removeTimer(int id)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Deadlines.find(id);
+    if (it == m_Deadlines.end())
+        return;
+    m_Timers.erase(std::make_pair(it->second, id));
+    m_Deadlines.erase(it);
+}
+
+VirtualClock::Duration VirtualClock::remaining(int id) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Deadlines.find(id);
+    if (it == m_Deadlines.end())
+        return Duration(-1);
+    return std::max(Duration(0), it->second - nowLocked());
+}
+
+size_t VirtualClock::pendingTimers() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Timers.size();
+}
+
+size_t VirtualClock::runDue()
+{
+    std::vector<Callback> due;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Timers.empty())
+            return 0;
+
+        Duration now = nowLocked();
+        if (m_Mode == Mode::Discrete)
+        {
+            // Jump to the next deadline, never backwards.
+            now = std::max(now, m_Timers.begin()->first.first);
+            m_VirtualAnchor = now;
+        }
+
+        // Only the timers due now, those added by the callbacks wait for the next call.
+        while (!m_Timers.empty() && m_Timers.begin()->first.first <= now)
+        {
+            auto first = m_Timers.begin();
+            m_Deadlines.erase(first->first.second);
+            due.push_back(std::move(first->second));
+            m_Timers.erase(first);
+        }
+    }
+
+    for (auto &callback : due)
+        callback();
+    return due.size();
+}
+
+VirtualClock::Duration VirtualClock::realDelayToNext() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Timers.empty())
+        return Duration(-1);
+    if (m_Mode == Mode::Discrete)
+        return Duration(0);
+
+    const Duration left = std::max(Duration(0), m_Timers.begin()->first.first - nowLocked());
+    return m_Mode == Mode::Real ? left : Duration(static_cast<int64_t>(left.count() / m_Scale));
+}
+
+void VirtualClock::runUntil(Duration end)
+{
+    while (true)
+    {
+        const Duration delay = realDelayToNext();
+        if (mode() == Mode::Discrete)
+        {
+            bool beyond;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                beyond = m_Timers.empty() || m_Timers.begin()->first.first > end;
+                if (beyond)
+                    m_VirtualAnchor = std::max(m_VirtualAnchor, end);
+            }
+            if (beyond)
+                return;
+            runDue();
+            continue;
+        }
+
+        // Real and scaled: sleep until the next timer or the end, whichever is first.
+        const Duration now = this->now();
+        if (now >= end)
+            return;
+        const Duration realUntilEnd(static_cast<int64_t>((end - now).count() / scale()));
+        if (delay.count() < 0 || delay > realUntilEnd)
+        {
+            std::this_thread::sleep_for(realUntilEnd);
+            continue;
+        }
+        std::this_thread::sleep_for(delay);
+        runDue();
+    }
+}
+
+void VirtualClock::setWakeUp(std::function<void()> wakeUp)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_WakeUp = std::move(wakeUp);
+}
+
+bool VirtualClock::parseMode(const std::string &text, Mode &mode, double &scale)
+{
+    scale = 1.0;
+    if (text.empty() || text == "real")
+    {
+        mode = Mode::Real;
+        return true;
+    }
+    if (text == "discrete")
+    {
+        mode = Mode::Discrete;
+        return true;
+    }
+    if (text.compare(0, 7, "scaled:") == 0)
+    {
+        char *end = nullptr;
+        scale = strtod(text.c_str() + 7, &end);
+        if (end != nullptr && *end == '\0' && scale > 0)
+        {
+            mode = Mode::Scaled;
+            return true;
+        }
+    }
+    return false;
+}
+
+VirtualClock &VirtualClock::shared()
+{
+    static VirtualClock *clock = []
+    {
+        Mode mode = Mode::Real;
+        double scale = 1.0;
+        const char *setting = getenv("INDI_VIRTUAL_CLOCK");
+        if (setting != nullptr && !parseMode(setting, mode, scale))
+            mode = Mode::Real;
+
+        // Never destroyed, timers may still be removed while static drivers go away.
+        VirtualClock *result = new VirtualClock(mode, scale);
+        if (const char *start = getenv("INDI_VIRTUAL_CLOCK_START"))
+            result->setWallStart(std::chrono::system_clock::time_point(std::chrono::seconds(atoll(start))));
+        return result;
+    }();
+    return *clock;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief A clock and timer service whose time can run faster than real time.
+ *
+ * - Real: virtual time is real time.
+ * - Scaled: virtual time runs scale times faster than real time, timers fire
+ *   after their delay divided by scale.
+ * - Discrete: virtual time only moves when a timer fires, it jumps straight to
+ *   the next deadline. Timers fire as fast as they are run, in deadline order,
+ *   ties in the order they were added, so a run is the same every time.
+ *
+ * The service itself does not wait for anything. runDue() fires what is due and
+ * realDelayToNext() says when to call it again; virtual_clock_device.h hooks
+ * this into the INDI event loop, runUntil() runs it standalone.
+ */
+class VirtualClock
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+    using Callback = std::function<void()>;
+
+    enum class Mode
+    {
+        Real,
+        Scaled,
+        Discrete,
+    };
+
+    explicit VirtualClock(Mode mode = Mode::Real, double scale = 1.0);
+
+    Mode mode() const;
+    double scale() const;
+
+    /** @brief Change the mode, time continues from where it is. */
+    void setMode(Mode mode, double scale = 1.0);
+
+    /** @brief Virtual time since the clock was created. */
+    Duration now() const;
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(now()).count();
+    }
+
+    /** @brief Wall clock in virtual time, for timestamps and simulated UTC. */
+    std::chrono::system_clock::time_point wallNow() const;
+
+    /** @brief Wall clock time at virtual time 0, e.g. to start every run on the same night. */
+    void setWallStart(std::chrono::system_clock::time_point start);
+
+    /** @brief Call callback once, delay from now in virtual time. @return timer id. */
+    int addTimer(Duration delay, Callback callback);
+    void removeTimer(int id);
+
+    /** @brief Virtual time left until timer id fires, negative if there is no such timer. */
+    Duration remaining(int id) const;
+
+    size_t pendingTimers() const;
+
+    /**
+     * @brief Fire the timers that are due. In discrete mode, move to the earliest
+     * deadline and fire the timers due then.
+     * @return number of timers fired.
+     */
+    size_t runDue();
+
+    /** @brief Real time until runDue() has something to do, zero in discrete mode, -1 without timers. */
+    Duration realDelayToNext() const;
+
+    /** @brief Run timers until virtual time reaches end, without an event loop. */
+    void runUntil(Duration end);
+
+    /** @brief Called whenever the earliest deadline may have changed, to re-arm an external wait. */
+    void setWakeUp(std::function<void()> wakeUp);
+
+    /**
+     * @brief The clock of the process, configured from the environment:
+     * INDI_VIRTUAL_CLOCK is "real" (default), "scaled:<factor>" or "discrete";
+     * INDI_VIRTUAL_CLOCK_START optionally fixes the wall clock start in Unix seconds.
+     */
+    static VirtualClock &shared();
+
+    /** @brief Parse "real", "scaled:100" or "discrete", false if it is none of these. */
+    static bool parseMode(const std::string &text, Mode &mode, double &scale);
+
+private:
+    Duration nowLocked() const;
+
+    mutable std::mutex m_Mutex;
+    Mode m_Mode;
+    double m_Scale;
+    // now() is m_VirtualAnchor plus the real time since m_RealAnchor, scaled.
+    std::chrono::steady_clock::time_point m_RealAnchor;
+    Duration m_VirtualAnchor {0};
+    std::chrono::system_clock::time_point m_WallStart;
+
+    // Ordered by deadline, then by id so equal deadlines fire in the order added.
+    std::map<std::pair<Duration, int>, Callback> m_Timers;
+    std::unordered_map<int, Duration> m_Deadlines;
+    int m_NextId {1};
+
+    std::function<void()> m_WakeUp;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "libindi/eventloop.h"
+
+#include "virtual_clock.h"
+
+// Drives VirtualClock::shared() from the INDI event loop: one event loop timer
+// is kept armed for the earliest virtual deadline. In discrete mode it is armed
+// with 0 ms, so client messages are still handled between two timers.
+namespace VirtualClockEventLoop
+{
+
+inline int armedTimer = -1;
+
+void arm();
+
+inline void fire(void *)
+{
+    armedTimer = -1;
+    VirtualClock::shared().runDue();
+    arm();
+}
+
+inline void arm()
+{
+    if (armedTimer != -1)
+        IERmTimer(armedTimer);
+    armedTimer = -1;
+
+    const auto delay = VirtualClock::shared().realDelayToNext();
+    if (delay.count() < 0)
+        return;
+    // Round up, firing early would find nothing due.
+    const int ms = static_cast<int>((delay.count() + 999999) / 1000000);
+    armedTimer = IEAddTimer(ms, &fire, nullptr);
+}
+
+inline void attach()
+{
+    static const bool attached = []
+    {
+        VirtualClock::shared().setWakeUp(&arm);
+        return true;
+    }();
+    (void)attached;
+}
+
+}
+
+/**
+ * @brief Runs the timers of a DefaultDevice based driver on the virtual clock.
+ *
+ * Derive from VirtualClockDevice<INDI::Dome> instead of INDI::Dome. SetTimer()
+ * and RemoveTimer() called by the driver then go through VirtualClock::shared(),
+ * which INDI_VIRTUAL_CLOCK configures for the whole process. Take the time from
+ * clock() rather than gettimeofday() or time(), so it runs at the same pace.
+ *
+ * Timers the INDI base classes set for themselves still run in real time.
+ */
+template <typename Base>
+class VirtualClockDevice : public Base
+{
+public:
+    using Base::Base;
+
+    /** @brief Hides DefaultDevice::SetTimer(), TimerHit() is called after ms of virtual time. */
+    int SetTimer(uint32_t ms)
+    {
+        VirtualClockEventLoop::attach();
+        return clock().addTimer(std::chrono::milliseconds(ms), [this]
+        {
+            this->TimerHit();
+        });
+    }
+
+    void RemoveTimer(int id)
+    {
+        clock().removeTimer(id);
+    }
+
+    static VirtualClock &clock()
+    {
+        return VirtualClock::shared();
+    }
+};
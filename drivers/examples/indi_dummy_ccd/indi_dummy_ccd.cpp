@@ -0,0 +1,436 @@
+#include <chrono>
+#include <cstring>
+
+#include "libindi/indibasetypes.h"
+#include "libindi/indicom.h"
+#include "libindi/sharedblob.h"
+
+#include "config.h"
+#include "fits_header.h"
+#include "indi_dummy_ccd.h"
+#include "parallel_deflate.h"
+
+// We declare an auto pointer to DummyCCD.
+static std::unique_ptr<DummyCCD> mydriver(new DummyCCD());
+
+// Our simulated sensor
+static const int SensorWidth  = 1280;
+static const int SensorHeight = 1024;
+
+// Frame buffers preallocated for streaming. One is being captured, one is being
+// sent, the rest absorb jitter. More only adds latency.
+static const int StreamFrames = 4;
+
+DummyCCD::DummyCCD()
+{
+    setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
+}
+
+const char *DummyCCD::getDefaultName()
+{
+    return "Dummy CCD";
+}
+
+bool DummyCCD::initProperties()
+{
+    // initialize the parent's properties first
+    INDI::CCD::initProperties();
+
+    // And here we tell the base class about our camera's capabilities.
+    SetCCDCapability(CCD_CAN_ABORT | CCD_HAS_STREAMING);
+
+    // How finished frames get to the clients.
+    // Zero copy: the frame is rendered straight into a shared memory BLOB buffer,
+    // already laid out as a FITS file, and handed to indiserver as a file
+    // descriptor. Nothing is copied or base64 encoded on the driver side.
+    // Classic: the frame is rendered into the chip frame buffer and the base class
+    // builds the FITS file from it, like most camera drivers do.
+    TransferModeSP[TRANSFER_ZERO_COPY].fill("TRANSFER_ZERO_COPY", "Zero copy", ISS_ON);
+    TransferModeSP[TRANSFER_CLASSIC].fill("TRANSFER_CLASSIC", "Classic", ISS_OFF);
+    TransferModeSP.fill(getDeviceName(), "CCD_TRANSFER_MODE", "Transfer", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    TransferModeSP.onUpdate([this]
+    {
+        TransferModeSP.setState(IPS_OK);
+        TransferModeSP.apply();
+    });
+
+    // Compressing a large frame on a single core can take longer than the
+    // exposure. This compresses on all cores into a standard zlib stream.
+    CompressionSP[COMPRESSION_ON].fill("COMPRESSION_ON", "On", ISS_OFF);
+    CompressionSP[COMPRESSION_OFF].fill("COMPRESSION_OFF", "Off", ISS_ON);
+    CompressionSP.fill(getDeviceName(), "CCD_PARALLEL_COMPRESSION", "Compression", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60,
+                       IPS_IDLE);
+    CompressionSP.onUpdate([this]
+    {
+        CompressionSP.setState(IPS_OK);
+        CompressionSP.apply();
+    });
+
+    // With the level at 0, it is picked from the speed of the link to the clients.
+    CompressionSettingsNP[COMPRESSION_LINK_SPEED].fill("COMPRESSION_LINK_SPEED", "Link (Mbit/s)", "%.0f", 0, 10000, 10, 0);
+    CompressionSettingsNP[COMPRESSION_LEVEL].fill("COMPRESSION_LEVEL", "Level (0 = auto)", "%.0f", 0, 9, 1, 0);
+    CompressionSettingsNP.fill(getDeviceName(), "CCD_PARALLEL_COMPRESSION_SETTINGS", "Compression", OPTIONS_TAB, IP_RW, 60,
+                               IPS_IDLE);
+    CompressionSettingsNP.onUpdate([this]
+    {
+        CompressionSettingsNP.setState(IPS_OK);
+        CompressionSettingsNP.apply();
+    });
+
+    // How the streaming pipeline keeps up. Frames the sender could not keep up
+    // with are dropped before they are encoded, oldest first.
+    StreamStatsNP[STREAM_STATS_FPS].fill("STREAM_STATS_FPS", "Sent (fps)", "%.1f", 0, 1000, 0, 0);
+    StreamStatsNP[STREAM_STATS_DROPPED].fill("STREAM_STATS_DROPPED", "Dropped", "%.0f", 0, 1e9, 0, 0);
+    StreamStatsNP[STREAM_STATS_OVERRUNS].fill("STREAM_STATS_OVERRUNS", "Overruns", "%.0f", 0, 1e9, 0, 0);
+    StreamStatsNP[STREAM_STATS_LATENCY].fill("STREAM_STATS_LATENCY", "Latency (ms)", "%.1f", 0, 1e6, 0, 0);
+    StreamStatsNP[STREAM_STATS_LATENCY_MAX].fill("STREAM_STATS_LATENCY_MAX", "Max Latency (ms)", "%.1f", 0, 1e6, 0, 0);
+    StreamStatsNP.fill(getDeviceName(), "STREAM_PIPELINE_STATS", "Pipeline", "Streaming", IP_RO, 0, IPS_IDLE);
+
+    // Statistics of every captured frame, computed on all cores while the frame
+    // is still in memory, so clients do not have to download it to know the
+    // sky level or whether the stars are in focus.
+    FrameStatsNP[FRAME_STATS_MEDIAN].fill("FRAME_STATS_MEDIAN", "Median", "%.0f", 0, 65535, 0, 0);
+    FrameStatsNP[FRAME_STATS_MEAN].fill("FRAME_STATS_MEAN", "Mean", "%.1f", 0, 65535, 0, 0);
+    FrameStatsNP[FRAME_STATS_BACKGROUND].fill("FRAME_STATS_BACKGROUND", "Background", "%.1f", 0, 65535, 0, 0);
+    FrameStatsNP[FRAME_STATS_NOISE].fill("FRAME_STATS_NOISE", "Noise", "%.1f", 0, 65535, 0, 0);
+    FrameStatsNP[FRAME_STATS_STARS].fill("FRAME_STATS_STARS", "Stars", "%.0f", 0, 1e6, 0, 0);
+    FrameStatsNP[FRAME_STATS_HFR].fill("FRAME_STATS_HFR", "HFR (px)", "%.2f", 0, 100, 0, 0);
+    FrameStatsNP.fill(getDeviceName(), "CCD_FRAME_STATS", "Statistics", IMAGE_INFO_TAB, IP_RO, 0, IPS_IDLE);
+
+    addAuxControls();
+
+    return true;
+}
+
+void DummyCCD::ISGetProperties(const char *dev)
+{
+    INDI::CCD::ISGetProperties(dev);
+
+    defineProperty(TransferModeSP);
+    loadConfig(TransferModeSP);
+
+    defineProperty(CompressionSP);
+    loadConfig(CompressionSP);
+    defineProperty(CompressionSettingsNP);
+    loadConfig(CompressionSettingsNP);
+}
+
+bool DummyCCD::updateProperties()
+{
+    INDI::CCD::updateProperties();
+
+    if (isConnected())
+    {
+        // Let the base class know about our sensor, it sets up the frame and
+        // binning properties from this.
+        SetCCDParams(SensorWidth, SensorHeight, 16, 5.2, 5.2);
+
+        // The classic path renders into the chip frame buffer.
+        uint32_t nbuf = PrimaryCCD.getXRes() * PrimaryCCD.getYRes() * PrimaryCCD.getBPP() / 8;
+        PrimaryCCD.setFrameBufferSize(nbuf);
+
+        StarField::Config config;
+        config.width = SensorWidth;
+        config.height = SensorHeight;
+        m_StarField.reset(new StarField(config));
+
+        defineProperty(FrameStatsNP);
+        defineProperty(StreamStatsNP);
+
+        SetTimer(getCurrentPollingPeriod());
+    }
+    else
+    {
+        deleteProperty(FrameStatsNP);
+        deleteProperty(StreamStatsNP);
+    }
+
+    return true;
+}
+
+bool DummyCCD::saveConfigItems(FILE *fp)
+{
+    INDI::CCD::saveConfigItems(fp);
+
+    TransferModeSP.save(fp);
+    CompressionSP.save(fp);
+    CompressionSettingsNP.save(fp);
+
+    return true;
+}
+
+bool DummyCCD::Connect()
+{
+    LOGF_INFO("Connected successfuly to simulated %s.", getDeviceName());
+    return true;
+}
+
+bool DummyCCD::Disconnect()
+{
+    InExposure = false;
+    StopStreaming();
+    return true;
+}
+
+bool DummyCCD::StartExposure(float duration)
+{
+    PrimaryCCD.setExposureDuration(duration);
+    m_ExposureRequest = duration;
+    m_ExposureStart = clock().seconds();
+    InExposure = true;
+
+    // We're now exposing, TimerHit picks up the frame when the time is over.
+    return true;
+}
+
+bool DummyCCD::AbortExposure()
+{
+    InExposure = false;
+    return true;
+}
+
+double DummyCCD::calcTimeLeft() const
+{
+    double elapsed = clock().seconds() - m_ExposureStart;
+    return m_ExposureRequest - elapsed;
+}
+
+void DummyCCD::TimerHit()
+{
+    if (!isConnected())
+        return;
+
+    if (m_Streaming)
+        updateStreamStats();
+
+    if (InExposure)
+    {
+        double timeLeft = calcTimeLeft();
+        if (timeLeft <= 0)
+        {
+            InExposure = false;
+            PrimaryCCD.setExposureLeft(0);
+            grabFrame();
+        }
+        else
+            PrimaryCCD.setExposureLeft(timeLeft);
+    }
+
+    // If you don't call SetTimer, we'll never get called again, until we disconnect
+    // and reconnect.
+    SetTimer(getCurrentPollingPeriod());
+}
+
+void DummyCCD::grabFrame()
+{
+    // Zero copy only makes sense when the frame goes to the clients. If the user
+    // wants the image saved locally, let the base class do all of it.
+    bool zeroCopy = TransferModeSP.findOnSwitchIndex() == TRANSFER_ZERO_COPY &&
+                    UploadSP.findOnSwitchIndex() == UPLOAD_CLIENT;
+
+    if (zeroCopy && sendZeroCopyFrame())
+        return;
+
+    uint16_t *pixels = reinterpret_cast<uint16_t *>(PrimaryCCD.getFrameBuffer());
+    m_StarField->render(pixels, m_FrameCount++, m_ExposureRequest);
+    updateFrameStats(pixels);
+    ExposureComplete(&PrimaryCCD);
+}
+
+bool DummyCCD::sendZeroCopyFrame()
+{
+    FitsHeader header(SensorWidth, SensorHeight);
+    header.addKeyword("EXPTIME", m_ExposureRequest, "Total Exposure Time (s)");
+    header.addKeyword("INSTRUME", getDeviceName(), "CCD Name");
+    header.addKeyword("DATE-OBS", PrimaryCCD.getExposureStartTime(), "UTC start date of observation");
+
+    const bool compress = CompressionSP.findOnSwitchIndex() == COMPRESSION_ON;
+
+    ParallelDeflate::Options options;
+    options.level = static_cast<int>(CompressionSettingsNP[COMPRESSION_LEVEL].getValue());
+    if (options.level == 0)
+        options.level = ParallelDeflate::levelForLinkSpeed(CompressionSettingsNP[COMPRESSION_LINK_SPEED].getValue());
+
+    // IDSharedBlobAlloc hands out memfd/shm backed memory. When such a buffer is
+    // sent, only its file descriptor travels to indiserver, which passes it on to
+    // local clients as is and base64 encodes it on its own thread for remote ones.
+    const size_t capacity = compress ? ParallelDeflate::bound(header.fileSize(), options) : header.fileSize();
+    void *buffer = IDSharedBlobAlloc(capacity);
+    if (buffer == nullptr)
+    {
+        LOG_WARN("Failed to allocate shared BLOB memory, falling back to classic transfer.");
+        return false;
+    }
+
+    // Header first, then the pixels rendered in place behind it in FITS layout.
+    // When compressing, the FITS file is laid out in our own buffer instead and
+    // compressed from there straight into the shared one.
+    void *fits = buffer;
+    if (compress)
+    {
+        m_CompressionInput.resize(header.fileSize());
+        fits = m_CompressionInput.data();
+    }
+    // The statistics want host order pixels, so the FITS conversion is done
+    // after them, still in place.
+    uint16_t *pixels = header.write(fits);
+    m_StarField->render(pixels, m_FrameCount++, m_ExposureRequest);
+    updateFrameStats(pixels);
+    StarField::toFitsLayout(pixels, SensorWidth * SensorHeight);
+
+    size_t length = header.fileSize();
+    if (compress)
+    {
+        length = ParallelDeflate::compress(fits, header.fileSize(), buffer, capacity, options);
+        if (length == 0)
+        {
+            LOG_ERROR("Failed to compress frame.");
+            IDSharedBlobFree(buffer);
+            return false;
+        }
+        LOGF_DEBUG("Compressed frame from %zu to %zu bytes at level %d.", header.fileSize(), length, options.level);
+
+        // Give back the worst case headroom.
+        void *shrunk = IDSharedBlobRealloc(buffer, length);
+        if (shrunk != nullptr)
+            buffer = shrunk;
+    }
+
+    INDI::PropertyViewBlob *imageBP = getBLOB("CCD1");
+    IBLOB *image = &imageBP->bp[0];
+    image->blob = buffer;
+    image->size = static_cast<int>(header.fileSize());
+    image->bloblen = static_cast<int>(length);
+    strncpy(image->format, compress ? ".fits.z" : ".fits", MAXINDIBLOBFMT);
+    imageBP->s = IPS_OK;
+    IDSetBLOB(imageBP, nullptr);
+
+    // indiserver holds its own reference to the memory now.
+    image->blob = nullptr;
+    image->bloblen = image->size = 0;
+    IDSharedBlobFree(buffer);
+
+    INDI::PropertyViewNumber *exposureNP = getNumber("CCD_EXPOSURE");
+    exposureNP->s = IPS_OK;
+    IDSetNumber(exposureNP, nullptr);
+
+    return true;
+}
+
+bool DummyCCD::StartStreaming()
+{
+    if (m_Streaming)
+        return true;
+
+    Streamer->setPixelFormat(INDI_MONO, 16);
+    Streamer->setSize(SensorWidth, SensorHeight);
+
+    // All the memory the stream will ever use is allocated here.
+    if (!m_Pipeline)
+        m_Pipeline.reset(new FramePipeline(StreamFrames, SensorWidth * SensorHeight * sizeof(uint16_t)));
+    m_Pipeline->restart();
+    m_Pipeline->takeStats();
+
+    m_Streaming = true;
+    m_SendThread = std::thread(&DummyCCD::sendThread, this);
+    m_CaptureThread = std::thread(&DummyCCD::captureThread, this);
+
+    StreamStatsNP.setState(IPS_BUSY);
+    StreamStatsNP.apply();
+
+    return true;
+}
+
+bool DummyCCD::StopStreaming()
+{
+    if (!m_Streaming)
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_StreamMutex);
+        m_Streaming = false;
+    }
+    m_StreamWake.notify_all();
+    m_Pipeline->stop();
+    m_CaptureThread.join();
+    m_SendThread.join();
+
+    updateStreamStats();
+    StreamStatsNP.setState(IPS_IDLE);
+    StreamStatsNP.apply();
+
+    return true;
+}
+
+void DummyCCD::captureThread()
+{
+    uint32_t frameNumber = 0;
+    auto next = std::chrono::steady_clock::now();
+
+    while (m_Streaming)
+    {
+        double exposure = Streamer->getTargetExposure();
+        if (exposure <= 0)
+            exposure = 0.1;
+
+        // A real camera blocks in its SDK here until the next frame is read
+        // out. StopStreaming() cuts the exposure short.
+        next += std::chrono::microseconds(static_cast<int64_t>(exposure * 1e6));
+        {
+            std::unique_lock<std::mutex> lock(m_StreamMutex);
+            if (m_StreamWake.wait_until(lock, next, [this] { return !m_Streaming; }))
+                break;
+        }
+
+        // Never block the camera. A frame the sender did not get to is
+        // overwritten by this one.
+        FramePipeline::Frame *frame = m_Pipeline->acquire();
+        if (frame == nullptr)
+            continue;
+
+        m_StarField->render(reinterpret_cast<uint16_t *>(frame->data.data()), frameNumber++, exposure);
+        m_Pipeline->publish(frame);
+    }
+}
+
+void DummyCCD::sendThread()
+{
+    // takeLatest() returns the newest frame, the ones the sender was too slow
+    // for were replaced before anybody encoded them. It also returns nullptr
+    // while an exposure longer than the timeout is still running.
+    while (!m_Pipeline->isStopped())
+    {
+        FramePipeline::Frame *frame = m_Pipeline->takeLatest(100);
+        if (frame == nullptr)
+            continue;
+        Streamer->newFrame(frame->data.data(), frame->size);
+        m_Pipeline->release(frame);
+    }
+}
+
+void DummyCCD::updateStreamStats()
+{
+    FramePipeline::Stats stats = m_Pipeline->takeStats();
+    StreamStatsNP[STREAM_STATS_FPS].setValue(stats.fps);
+    StreamStatsNP[STREAM_STATS_DROPPED].setValue(stats.dropped);
+    StreamStatsNP[STREAM_STATS_OVERRUNS].setValue(stats.overruns);
+    StreamStatsNP[STREAM_STATS_LATENCY].setValue(stats.latencyAverage);
+    StreamStatsNP[STREAM_STATS_LATENCY_MAX].setValue(stats.latencyMax);
+    StreamStatsNP.apply();
+}
+
+void DummyCCD::updateFrameStats(const uint16_t *pixels)
+{
+    FrameStats::Result result = FrameStats::analyze(pixels, SensorWidth, SensorHeight);
+    FrameStatsNP[FRAME_STATS_MEDIAN].setValue(result.median);
+    FrameStatsNP[FRAME_STATS_MEAN].setValue(result.mean);
+    FrameStatsNP[FRAME_STATS_BACKGROUND].setValue(result.background.level);
+    FrameStatsNP[FRAME_STATS_NOISE].setValue(result.background.noise);
+    FrameStatsNP[FRAME_STATS_STARS].setValue(result.stars);
+    FrameStatsNP[FRAME_STATS_HFR].setValue(result.hfr);
+    FrameStatsNP.setState(IPS_OK);
+    FrameStatsNP.apply();
+
+    LOGF_DEBUG("Frame statistics computed with %s kernels: median %u, %zu stars, HFR %.2f.", FrameStats::simdLevel(),
+               result.median, result.stars, result.hfr);
+}
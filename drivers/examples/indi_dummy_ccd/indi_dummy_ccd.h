@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "libindi/indiccd.h"
+
+#include "frame_pipeline.h"
+#include "frame_stats.h"
+#include "star_field.h"
+#include "virtual_clock_device.h"
+
+class DummyCCD : public VirtualClockDevice<INDI::CCD>
+{
+public:
+    DummyCCD();
+    virtual ~DummyCCD() = default;
+
+    virtual const char *getDefaultName() override;
+
+    virtual bool initProperties() override;
+    virtual bool updateProperties() override;
+
+    virtual void ISGetProperties(const char *dev) override;
+
+    virtual void TimerHit() override;
+
+protected:
+    virtual bool saveConfigItems(FILE *fp) override;
+
+    // There is no hardware behind this camera, so there is no connection plugin
+    // either. Connecting always succeeds.
+    virtual bool Connect() override;
+    virtual bool Disconnect() override;
+
+    virtual bool StartExposure(float duration) override;
+    virtual bool AbortExposure() override;
+
+    virtual bool StartStreaming() override;
+    virtual bool StopStreaming() override;
+
+private:
+    void grabFrame();
+
+    // Render the frame into the BLOB shared memory and send it by reference.
+    bool sendZeroCopyFrame();
+
+    // Time left of the current exposure in seconds.
+    double calcTimeLeft() const;
+
+    // Streaming: the capture thread renders frames into the pipeline, the send
+    // thread hands the newest one to the stream manager.
+    void captureThread();
+    void sendThread();
+    void updateStreamStats();
+
+    // Measure the frame and publish the result in FrameStatsNP.
+    void updateFrameStats(const uint16_t *pixels);
+
+    enum
+    {
+        TRANSFER_ZERO_COPY,
+        TRANSFER_CLASSIC,
+        TRANSFER_N,
+    };
+    INDI::PropertySwitch TransferModeSP {TRANSFER_N};
+
+    // Multithreaded ".fits.z" compression of zero-copy frames.
+    enum
+    {
+        COMPRESSION_ON,
+        COMPRESSION_OFF,
+        COMPRESSION_N,
+    };
+    INDI::PropertySwitch CompressionSP {COMPRESSION_N};
+
+    enum
+    {
+        COMPRESSION_LINK_SPEED,
+        COMPRESSION_LEVEL,
+        COMPRESSION_SETTINGS_N,
+    };
+    INDI::PropertyNumber CompressionSettingsNP {COMPRESSION_SETTINGS_N};
+
+    enum
+    {
+        STREAM_STATS_FPS,
+        STREAM_STATS_DROPPED,
+        STREAM_STATS_OVERRUNS,
+        STREAM_STATS_LATENCY,
+        STREAM_STATS_LATENCY_MAX,
+        STREAM_STATS_N,
+    };
+    INDI::PropertyNumber StreamStatsNP {STREAM_STATS_N};
+
+    // What is in the last frame, for flats, focusing and exposure control.
+    enum
+    {
+        FRAME_STATS_MEDIAN,
+        FRAME_STATS_MEAN,
+        FRAME_STATS_BACKGROUND,
+        FRAME_STATS_NOISE,
+        FRAME_STATS_STARS,
+        FRAME_STATS_HFR,
+        FRAME_STATS_N,
+    };
+    INDI::PropertyNumber FrameStatsNP {FRAME_STATS_N};
+
+    std::unique_ptr<StarField> m_StarField;
+
+    std::unique_ptr<FramePipeline> m_Pipeline;
+    std::thread m_CaptureThread;
+    std::thread m_SendThread;
+    std::atomic<bool> m_Streaming {false};
+    // Set m_Streaming under the mutex and notify, the capture thread waits
+    // out its exposures on the condition variable.
+    std::mutex m_StreamMutex;
+    std::condition_variable m_StreamWake;
+    // Frames to be compressed are rendered here, the compressed stream goes
+    // straight into the shared BLOB buffer.
+    std::vector<uint8_t> m_CompressionInput;
+    uint32_t m_FrameCount {0};
+    double m_ExposureRequest {0};
+    // Virtual clock seconds, so exposures follow INDI_VIRTUAL_CLOCK.
+    double m_ExposureStart {0};
+};
@@ -0,0 +1,9 @@
+<?xml version="1.0" encoding="UTF-8"?>
+<driversList>
+   <devGroup group="CCDs">
+      <device label="Dummy CCD" manufacturer="indi-dev-tutorials">
+         <driver name="Dummy CCD">indi_dummy_ccd</driver>
+         <version>@CDRIVER_VERSION_MAJOR@.@CDRIVER_VERSION_MINOR@</version>
+      </device>
+   </devGroup>
+</driversList>
@@ -1,5 +1,12 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <iterator>
+#include <string>
 
+#include "libindi/connectionplugins/connectiontcp.h"
 #include "libindi/indicom.h"
 
 #include "config.h"
@@ -8,6 +15,22 @@
 // We declare an auto pointer to DummyDome.
 static std::unique_ptr<DummyDome> mydriver(new DummyDome());
 
+// How far the dome may be from its checkpointed azimuth to resume without homing.
+static const double RecoveryToleranceDegrees = 1.0;
+
+// How long parking may take, per step.
+static const int ParkRotationTimeoutMs = 120000;
+static const int ParkShutterTimeoutMs = 60000;
+
+// The simulated dome.
+static const double SimulatedDegreesPerSecond = 6;
+static const int SimulatedShutterSeconds = 5;
+
+// A record of all aux inputs is about 300 bytes, a segment holds a few hours
+// of a busy night and the dome keeps the last four.
+static const size_t JournalSegmentBytes = 4 << 20;
+static const size_t JournalKeepSegments = 4;
+
 DummyDome::DummyDome()
 {
     setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
@@ -39,6 +62,50 @@ bool DummyDome::initProperties()
 
     // TODO: Add any custom properties you need here.
 
+    for (int i = 0; i < AUX_SENSOR_N; i++)
+    {
+        char name[MAXINDINAME], label[MAXINDILABEL];
+        snprintf(name, MAXINDINAME, "AUX_SENSOR_%d", i + 1);
+        snprintf(label, MAXINDILABEL, "Sensor %d", i + 1);
+        AuxSensorsNP[i].fill(name, label, "%.2f", -1000, 1000, 0, 0);
+    }
+    AuxSensorsNP.fill(getDeviceName(), "DOME_AUX_SENSORS", "Aux Sensors", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Send only the changed elements of wide properties such as the aux sensors.
+    DeltaUpdatesSP[DELTA_UPDATES_ON].fill("DELTA_UPDATES_ON", "On", ISS_ON);
+    DeltaUpdatesSP[DELTA_UPDATES_OFF].fill("DELTA_UPDATES_OFF", "Off", ISS_OFF);
+    DeltaUpdatesSP.fill(getDeviceName(), "DELTA_UPDATES", "Delta Updates", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    DeltaUpdatesSP.onUpdate([this]
+    {
+        AuxSensorsDelta.setEnabled(DeltaUpdatesSP.findOnSwitchIndex() == DELTA_UPDATES_ON);
+        DeltaUpdatesSP.setState(IPS_OK);
+        DeltaUpdatesSP.apply();
+    });
+
+    SharedSnoopSP[SHARED_SNOOP_ON].fill("SHARED_SNOOP_ON", "On", ISS_OFF);
+    SharedSnoopSP[SHARED_SNOOP_OFF].fill("SHARED_SNOOP_OFF", "Off", ISS_ON);
+    SharedSnoopSP.fill(getDeviceName(), "SNOOP_SHARED_MEMORY", "Shared Snoop", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    SharedSnoopSP.onUpdate([this]
+    {
+        if (SharedSnoopSP.findOnSwitchIndex() == SHARED_SNOOP_OFF)
+            MountSnoop.stop();
+        else if (isConnected())
+            watchMount();
+        SharedSnoopSP.setState(IPS_OK);
+        SharedSnoopSP.apply();
+    });
+
+    PropertyJournalSP[PROPERTY_JOURNAL_ON].fill("PROPERTY_JOURNAL_ON", "On", ISS_OFF);
+    PropertyJournalSP[PROPERTY_JOURNAL_OFF].fill("PROPERTY_JOURNAL_OFF", "Off", ISS_ON);
+    PropertyJournalSP.fill(getDeviceName(), "PROPERTY_JOURNAL", "Journal", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    PropertyJournalSP.onUpdate([this]
+    {
+        openJournal();
+    });
+
+    TcpProperties.fill(getDeviceName(), Tcp);
+    TelemetrySettings.fill(getDeviceName(), Telemetry);
+
     addAuxControls();
 
     return true;
@@ -49,19 +116,43 @@ void DummyDome::ISGetProperties(const char *dev)
     INDI::Dome::ISGetProperties(dev);
 
     // TODO: Call define* for any custom properties.
+    TcpProperties.define(this);
+    defineProperty(DeltaUpdatesSP);
+    loadConfig(DeltaUpdatesSP);
+    defineProperty(SharedSnoopSP);
+    loadConfig(SharedSnoopSP);
+    defineProperty(PropertyJournalSP);
+    loadConfig(PropertyJournalSP);
+    TelemetrySettings.define(this);
 }
 
 bool DummyDome::updateProperties()
 {
     INDI::Dome::updateProperties();
+    TcpProperties.updateProperties(this);
 
     if (isConnected())
     {
         // TODO: Call define* for any custom properties only visible when connected.
+        defineProperty(AuxSensorsNP);
+        // The definition carried every element, the next delta starts from there.
+        AuxSensorsDelta.invalidate();
+
+        if (TelemetryTimer == -1)
+            telemetryTick();
+        openJournal();
     }
     else
     {
         // TODO: Call deleteProperty for any custom properties only visible when connected.
+        ParkRunner.cancel();
+        MountSnoop.stop();
+        if (TelemetryTimer != -1)
+            clock().removeTimer(TelemetryTimer);
+        TelemetryTimer = -1;
+        checkpoint(true);
+        deleteProperty(AuxSensorsNP);
+        PropertyJournal.close();
     }
 
     return true;
@@ -107,6 +198,10 @@ bool DummyDome::ISSnoopDevice(XMLEle *root)
 {
     // TODO: Check to see if this is for any of my custom Snoops. Fo shizzle.
 
+    // Already delivered through shared memory.
+    if (MountSnoop.covers(root))
+        return true;
+
     return INDI::Dome::ISSnoopDevice(root);
 }
 
@@ -115,6 +210,11 @@ bool DummyDome::saveConfigItems(FILE *fp)
     INDI::Dome::saveConfigItems(fp);
 
     // TODO: Call IUSaveConfig* for any custom properties I want to save.
+    TcpProperties.save(fp);
+    DeltaUpdatesSP.save(fp);
+    SharedSnoopSP.save(fp);
+    PropertyJournalSP.save(fp);
+    TelemetrySettings.save(fp);
 
     return true;
 }
@@ -124,17 +224,119 @@ bool DummyDome::Handshake()
     if (isSimulation())
     {
         LOGF_INFO("Connected successfuly to simulated %s.", getDeviceName());
+        recoverMotion();
         return true;
     }
 
     // NOTE: PortFD is set by the base class.
 
+    TcpProperties.attach(this, tcpConnection, PortFD);
+
     // TODO: Any initial communciation needed with our dome, we have an active
     // connection.
 
+    recoverMotion();
+
     return true;
 }
 
+void DummyDome::recoverMotion()
+{
+    Motion = MotionState();
+    Motion.targetAzimuth = NAN;
+    ResumePending = false;
+
+    if (!MotionCheckpoint.isOpen() &&
+            !MotionCheckpoint.open(StateCheckpoint::defaultDirectory() + "/" + getDeviceName() + ".ckpt", MotionSchema))
+    {
+        LOG_WARN("Cannot open the motion checkpoint, the dome has to be homed after a crash.");
+        return;
+    }
+
+    MotionState saved;
+    int64_t savedAt = 0;
+    if (!MotionCheckpoint.read(saved, &savedAt))
+        return;
+
+    // Somebody may have moved the dome while the driver was down, so cross-check
+    // before trusting the checkpoint. The simulated dome stays where it was.
+    double azimuth = saved.azimuth;
+    if (!isSimulation() && !queryAzimuth(azimuth))
+    {
+        LOG_WARN("Cannot read the azimuth to cross-check the checkpoint, home the dome.");
+        MotionCheckpoint.reset();
+        return;
+    }
+    // The dome may also have finished the move after the last checkpoint.
+    const double drift = std::fabs(std::remainder(azimuth - saved.azimuth, 360.0));
+    const bool arrived = !std::isnan(saved.targetAzimuth) &&
+                         std::fabs(std::remainder(azimuth - saved.targetAzimuth, 360.0)) <= RecoveryToleranceDegrees;
+    if (drift > RecoveryToleranceDegrees && !arrived)
+    {
+        LOGF_WARN("The dome is %.1f degrees off its checkpointed azimuth, home the dome.", drift);
+        MotionCheckpoint.reset();
+        return;
+    }
+
+    Motion = saved;
+    Motion.azimuth = azimuth;
+    // A park still has the shutter to close, so only a plain move is done.
+    if (arrived && saved.domeState != DOME_PARKING)
+    {
+        Motion.targetAzimuth = NAN;
+        Motion.domeState = DOME_IDLE;
+        checkpoint(true);
+    }
+    DomeAbsPosNP[0].setValue(azimuth);
+    SetParked(saved.parked != 0);
+    setShutterState(static_cast<ShutterState>(saved.shutterState));
+    DomeBacklashNP[0].setValue(saved.backlashSteps);
+    DomeBacklashSP[INDI_ENABLED].setState(saved.backlashEnabled ? ISS_ON : ISS_OFF);
+    DomeBacklashSP[INDI_DISABLED].setState(saved.backlashEnabled ? ISS_OFF : ISS_ON);
+
+    LOGF_INFO("Resumed from the checkpoint of %.1f s ago: azimuth %.2f, %s. No homing needed.",
+              StateCheckpoint::secondsSince(savedAt), azimuth,
+              saved.parked ? "parked" : "unparked");
+
+    // A move that was cut short is finished once the properties are up.
+    ResumePending = !std::isnan(Motion.targetAzimuth);
+}
+
+void DummyDome::resumeMotion()
+{
+    ResumePending = false;
+
+    IPState state;
+    if (Motion.domeState == DOME_PARKING)
+    {
+        LOG_INFO("Resuming the interrupted park.");
+        state = Park();
+        if (state == IPS_BUSY)
+            setDomeState(DOME_PARKING);
+    }
+    else
+    {
+        LOGF_INFO("Resuming the interrupted move to %.2f.", Motion.targetAzimuth);
+        state = MoveAbs(Motion.targetAzimuth);
+        if (state == IPS_BUSY)
+            setDomeState(DOME_MOVING);
+    }
+
+    if (state == IPS_ALERT)
+    {
+        LOG_WARN("Could not resume the interrupted move.");
+        Motion.targetAzimuth = NAN;
+        checkpoint(true);
+    }
+}
+
+void DummyDome::checkpoint(bool transition)
+{
+    MotionCheckpoint.write(Motion);
+    if (transition)
+        MotionCheckpoint.flush();
+}
+
 void DummyDome::TimerHit()
 {
     if (!isConnected())
@@ -145,11 +347,225 @@ void DummyDome::TimerHit()
 
     LOG_INFO("timer hit");
 
+    if (isSimulation())
+        simulateMotion(true);
+    else
+        pollAzimuth();
+    // TODO: Poll the shutter of your dome too, and notify ShutterChanged and
+    // journalShutter() when it changes.
+
+    if (ResumePending)
+        resumeMotion();
+
+    watchMount();
+
+    // The position changes with every poll while moving, keep the checkpoint current.
+    Motion.azimuth = DomeAbsPosNP[0].getValue();
+    Motion.domeState = getDomeState();
+    Motion.parked = isParked();
+    Motion.shutterState = getShutterState();
+    Motion.backlashSteps = DomeBacklashNP[0].getValue();
+    Motion.backlashEnabled = DomeBacklashSP[INDI_ENABLED].getState() == ISS_ON;
+    if (Motion.domeState != DOME_MOVING && Motion.domeState != DOME_PARKING)
+        Motion.targetAzimuth = NAN;
+    checkpoint();
+
+    TcpProperties.poll();
+
+    // In simulation one aux input drifts per poll. A real driver reads all of them
+    // from the controller and lets the DeltaSender figure out which ones changed.
+    if (isSimulation())
+    {
+        int index = rand() % AUX_SENSOR_N;
+        AuxSensorsNP[index].setValue(AuxSensorsNP[index].getValue() + (rand() % 200 - 100) / 100.0);
+    }
+    AuxSensorsNP.setState(IPS_OK);
+    if (AuxSensorsDelta.apply(AuxSensorsNP))
+        journalAuxSensors();
+
     // If you don't call SetTimer, we'll never get called again, until we disconnect
     // and reconnect.
     SetTimer(POLLMS);
 }
 
+void DummyDome::telemetryTick()
+{
+    TelemetryTimer = -1;
+    if (!isConnected())
+        return;
+
+    // TODO: Read the encoder of your dome here when telemetry is on, the
+    // simulated one is advanced to now.
+    const bool moving = getDomeState() == DOME_MOVING || getDomeState() == DOME_PARKING;
+    if (isSimulation() && moving && Telemetry.isOpen())
+        simulateMotion(false);
+
+    // Receivers see the stream is alive while nothing moves.
+    const auto now = clock().now();
+    if (Telemetry.isOpen() && (moving || now - TelemetrySentAt >= std::chrono::seconds(1)))
+    {
+        publishTelemetry(Telemetry, DomeAbsPosNP);
+        TelemetrySentAt = now;
+    }
+
+    // Switched off, look again in a second.
+    const int ms = Telemetry.isOpen() ? TelemetrySettings.periodMs() : 1000;
+    TelemetryTimer = clock().addTimer(std::chrono::milliseconds(ms), [this]
+    {
+        telemetryTick();
+    });
+}
+
+void DummyDome::openJournal()
+{
+    PropertyJournal.close();
+    const bool enabled = PropertyJournalSP.findOnSwitchIndex() == PROPERTY_JOURNAL_ON;
+    if (enabled && isConnected())
+    {
+        Journal::Writer::Options options;
+        options.segmentBytes = JournalSegmentBytes;
+        options.keepSegments = JournalKeepSegments;
+        const std::string directory = Journal::defaultDirectory() + "/" + getDeviceName();
+        if (!PropertyJournal.open(directory, options))
+        {
+            PropertyJournalSP.setState(IPS_ALERT);
+            PropertyJournalSP.apply("Cannot write the journal in %s.", directory.c_str());
+            return;
+        }
+
+        // Where the dome is when the journal starts.
+        AbsPosJournalId = journalDefine(PropertyJournal, DomeAbsPosNP);
+        ShutterJournalId = journalDefine(PropertyJournal, DomeShutterSP);
+        AuxSensorsJournalId = journalDefine(PropertyJournal, AuxSensorsNP);
+        journalAzimuth();
+        journalShutter();
+        journalAuxSensors();
+    }
+    PropertyJournalSP.setState(enabled ? IPS_OK : IPS_IDLE);
+    PropertyJournalSP.apply();
+}
+
+void DummyDome::journalAzimuth()
+{
+    if (PropertyJournal.isOpen())
+        journalAppend(PropertyJournal, AbsPosJournalId, DomeAbsPosNP);
+}
+
+void DummyDome::journalShutter()
+{
+    if (PropertyJournal.isOpen())
+        journalAppend(PropertyJournal, ShutterJournalId, DomeShutterSP);
+}
+
+void DummyDome::journalAuxSensors()
+{
+    if (PropertyJournal.isOpen())
+        journalAppend(PropertyJournal, AuxSensorsJournalId, AuxSensorsNP);
+}
+
+void DummyDome::watchMount()
+{
+    if (SharedSnoopSP.findOnSwitchIndex() != SHARED_SNOOP_ON)
+        return;
+
+    // The mount may be started after the dome, restarted, or not publish at all.
+    const char *mount = ActiveDeviceTP[0].getText();
+    if (MountSnoop.isActive() && MountSnoop.isWatching(mount, "EQUATORIAL_EOD_COORD"))
+        return;
+
+    if (MountSnoop.isWatching(mount, "EQUATORIAL_EOD_COORD"))
+        LOGF_INFO("%s stopped publishing through shared memory, snooping it through the server.", mount);
+    MountSnoop.stop();
+
+    auto handler = [this](const SnoopSample & sample)
+    {
+        mountCoordinates(sample);
+    };
+    if (!MountSnoop.watch(mount, "EQUATORIAL_EOD_COORD", handler))
+        return;
+
+    if (MountSnoop.indexOf("RA") < 0 || MountSnoop.indexOf("DEC") < 0)
+    {
+        LOGF_WARN("%s publishes EQUATORIAL_EOD_COORD without RA and DEC, snooping it through the server.", mount);
+        MountSnoop.stop();
+        return;
+    }
+    LOGF_INFO("Snooping %s through shared memory.", mount);
+}
+
+void DummyDome::mountCoordinates(const SnoopSample &sample)
+{
+    const int ra = MountSnoop.indexOf("RA"), dec = MountSnoop.indexOf("DEC");
+    if (ra < 0 || dec < 0)
+        return;
+
+    // What INDI::Dome does with the XML of EQUATORIAL_EOD_COORD.
+    m_MountEquatorialCoords.rightascension = sample.values[ra];
+    m_MountEquatorialCoords.declination = sample.values[dec];
+    m_MountState = static_cast<IPState>(sample.state);
+    UpdateMountCoords();
+}
+
+bool DummyDome::queryAzimuth(double &azimuth)
+{
+    // TODO: Replace with the azimuth query of your dome.
+    std::string answer;
+    if (!TcpProperties.command(PortFD, ":GA#", answer))
+        return false;
+    return sscanf(answer.c_str(), "%lf#", &azimuth) == 1;
+}
+
+void DummyDome::pollAzimuth()
+{
+    double azimuth;
+    if (!queryAzimuth(azimuth))
+    {
+        LOG_WARN("Dome did not answer the azimuth query.");
+        return;
+    }
+    if (azimuth == DomeAbsPosNP[0].getValue())
+        return;
+    DomeAbsPosNP[0].setValue(azimuth);
+    DomeAbsPosNP.apply();
+    journalAzimuth();
+    MotionChanged.notify();
+}
+
+void DummyDome::simulateMotion(bool poll)
+{
+    const auto now = clock().now();
+    if (!std::isnan(SimulatedTarget))
+    {
+        const double azimuth = DomeAbsPosNP[0].getValue();
+        const double left = std::remainder(SimulatedTarget - azimuth, 360.0);
+        const double step = SimulatedDegreesPerSecond * std::chrono::duration<double>(now - SimulatedAt).count();
+        const bool arrived = std::fabs(left) <= step;
+        if (arrived)
+        {
+            DomeAbsPosNP[0].setValue(SimulatedTarget);
+            SimulatedTarget = NAN;
+            if (getDomeState() == DOME_MOVING)
+                setDomeState(DOME_SYNCED);
+        }
+        else
+            DomeAbsPosNP[0].setValue(range360(azimuth + (left > 0 ? step : -step)));
+        if (poll || arrived)
+        {
+            DomeAbsPosNP.apply();
+            journalAzimuth();
+        }
+        MotionChanged.notify();
+    }
+    SimulatedAt = now;
+
+    if (getShutterState() == SHUTTER_MOVING && clock().now() >= SimulatedShutterDone)
+    {
+        setShutterState(SimulatedShutterTarget);
+        journalShutter();
+        ShutterChanged.notify();
+    }
+}
+
 bool DummyDome::SetSpeed(double rpm)
 {
     // TODO: Set the speed of the dome's rotation. Do not start moving, but if we
@@ -169,63 +585,234 @@ IPState DummyDome::MoveAbs(double az)
 {
     // TODO: Move to an absolute azimuth
     LOGF_INFO("MoveAbs(%f)", az);
-    return IPS_ALERT;
+    IPState state = IPS_ALERT;
+    if (isSimulation())
+    {
+        SimulatedTarget = az;
+        SimulatedAt = clock().now();
+        state = IPS_BUSY;
+    }
+
+    // A restarted driver finishes the moves the dome accepted. INDI::Dome
+    // applies the busy azimuth too, once this returns.
+    if (state != IPS_ALERT)
+    {
+        DomeAbsPosNP.setState(IPS_BUSY);
+        DomeAbsPosNP.apply();
+        journalAzimuth();
+
+        Motion.targetAzimuth = az;
+        Motion.domeState = DOME_MOVING;
+        checkpoint(true);
+    }
+    return state;
 }
 
 IPState DummyDome::MoveRel(double azDiff)
 {
     // TODO: Move to an relative azimuth
     LOGF_INFO("MoveRel(%f)", azDiff);
-    return IPS_ALERT;
+    IPState state = IPS_ALERT;
+    if (isSimulation())
+    {
+        SimulatedTarget = range360(DomeAbsPosNP[0].getValue() + azDiff);
+        SimulatedAt = clock().now();
+        state = IPS_BUSY;
+    }
+
+    if (state != IPS_ALERT)
+    {
+        DomeAbsPosNP.setState(IPS_BUSY);
+        DomeAbsPosNP.apply();
+        journalAzimuth();
+
+        Motion.targetAzimuth = range360(DomeAbsPosNP[0].getValue() + azDiff);
+        Motion.domeState = DOME_MOVING;
+        checkpoint(true);
+    }
+    return state;
 }
 
 bool DummyDome::Sync(double az)
 {
     // TODO: Sync to the given azimuth
     LOGF_INFO("Sync(%f)", az);
-    return false;
+    bool synced = false;
+    if (isSimulation())
+    {
+        DomeAbsPosNP[0].setValue(az);
+        synced = true;
+    }
+
+    if (synced)
+    {
+        DomeAbsPosNP.apply();
+        journalAzimuth();
+
+        Motion.azimuth = az;
+        checkpoint(true);
+    }
+    return synced;
 }
 
 bool DummyDome::Abort()
 {
     // TODO: Stop moving
     LOG_INFO("Abort()");
-    return false;
+    ParkRunner.cancel();
+    bool stopped = false;
+    if (isSimulation())
+    {
+        SimulatedTarget = NAN;
+        stopped = true;
+    }
+
+    // Aborted moves are not resumed after a restart.
+    if (stopped)
+    {
+        DomeAbsPosNP.setState(IPS_IDLE);
+        DomeAbsPosNP.apply();
+        journalAzimuth();
+
+        Motion.targetAzimuth = NAN;
+        Motion.domeState = DOME_IDLE;
+        checkpoint(true);
+    }
+    return stopped;
 }
 
 IPState DummyDome::Park()
 {
-    // TODO: Park the dome
     LOG_INFO("Park()");
-    return IPS_ALERT;
+    // Runs until the first wait, the event loop carries on from there.
+    ParkRunner.start(parkSequence());
+    const IPState state = ParkRunner.running() ? IPS_BUSY : isParked() ? IPS_OK : IPS_ALERT;
+
+    if (state == IPS_BUSY)
+    {
+        Motion.targetAzimuth = GetAxis1Park();
+        Motion.domeState = DOME_PARKING;
+        checkpoint(true);
+    }
+    return state;
+}
+
+Async::Task<> DummyDome::parkSequence()
+{
+    Async::Loop &loop = Async::IndiLoop::shared();
+    const double parkAzimuth = GetAxis1Park();
+
+    if (MoveAbs(parkAzimuth) == IPS_ALERT)
+    {
+        LOG_ERROR("Park failed, cannot rotate to the park position.");
+        co_return;
+    }
+    const bool arrived = co_await Async::waitUntil(loop, MotionChanged, [this, parkAzimuth]
+    {
+        return std::fabs(std::remainder(DomeAbsPosNP[0].getValue() - parkAzimuth, 360.0)) < 0.1;
+    }, ParkRotationTimeoutMs);
+    if (!arrived)
+    {
+        LOG_ERROR("Park failed, the dome did not reach the park position.");
+        setDomeState(DOME_ERROR);
+        journalAzimuth();
+        co_return;
+    }
+
+    if (getShutterState() != SHUTTER_CLOSED)
+    {
+        if (ControlShutter(SHUTTER_CLOSE) == IPS_ALERT)
+        {
+            LOG_ERROR("Park failed, cannot close the shutter.");
+            setDomeState(DOME_ERROR);
+            journalAzimuth();
+            co_return;
+        }
+        setShutterState(SHUTTER_MOVING);
+        journalShutter();
+        const bool closed = co_await Async::waitUntil(loop, ShutterChanged, [this]
+        {
+            return getShutterState() == SHUTTER_CLOSED;
+        }, ParkShutterTimeoutMs);
+        if (!closed)
+        {
+            LOG_ERROR("Park failed, the shutter did not close.");
+            setDomeState(DOME_ERROR);
+            journalAzimuth();
+            co_return;
+        }
+    }
+
+    SetParked(true);
+    journalAzimuth();
+    LOG_INFO("Dome parked.");
 }
 
 IPState DummyDome::UnPark()
 {
     // TODO: UnPark the dome
     LOG_INFO("UnPark()");
-    return IPS_ALERT;
+    IPState state = IPS_ALERT;
+    if (isSimulation())
+        state = IPS_OK;
+
+    if (state != IPS_ALERT)
+    {
+        Motion.parked = false;
+        Motion.domeState = state == IPS_BUSY ? DOME_UNPARKING : DOME_IDLE;
+        checkpoint(true);
+    }
+    return state;
 }
 
 bool DummyDome::SetBacklash(int32_t steps)
 {
     // TODO: Set the backlash compensation
     LOGF_INFO("SetBacklash(%d)", steps);
-    return false;
+    bool set = isSimulation();
+
+    if (set)
+    {
+        Motion.backlashSteps = steps;
+        checkpoint(true);
+    }
+    return set;
 }
 
 bool DummyDome::SetBacklashEnabled(bool enabled)
 {
     // TODO: Set the backlash compensation
     LOGF_INFO("SetBacklashEnabled(%d)", enabled);
-    return false;
+    bool set = isSimulation();
+
+    if (set)
+    {
+        Motion.backlashEnabled = enabled;
+        checkpoint(true);
+    }
+    return set;
 }
 
 IPState DummyDome::ControlShutter(ShutterOperation operation)
 {
     // TODO: Open or close the shutter
     LOGF_INFO("ControlShutter(%d)", operation);
-    return IPS_ALERT;
+    IPState state = IPS_ALERT;
+    if (isSimulation())
+    {
+        SimulatedShutterTarget = operation == SHUTTER_OPEN ? SHUTTER_OPENED : SHUTTER_CLOSED;
+        SimulatedShutterDone = clock().now() + std::chrono::seconds(SimulatedShutterSeconds);
+        setShutterState(SHUTTER_MOVING);
+        journalShutter();
+        state = IPS_BUSY;
+    }
+
+    if (state != IPS_ALERT)
+    {
+        Motion.shutterState = SHUTTER_MOVING;
+        checkpoint(true);
+    }
+    return state;
 }
 
 bool DummyDome::SetCurrentPark()
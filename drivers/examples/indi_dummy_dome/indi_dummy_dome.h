@@ -2,12 +2,21 @@
 
 #include "libindi/indidome.h"
 
+#include "async_task_indi.h"
+#include "delta_property.h"
+#include "property_journal_property.h"
+#include "snoop_channel_property.h"
+#include "state_checkpoint.h"
+#include "tcp_transport_property.h"
+#include "udp_telemetry_property.h"
+#include "virtual_clock_device.h"
+
 namespace Connection
 {
     class Serial;
 }
 
-class DummyDome : public INDI::Dome
+class DummyDome : public VirtualClockDevice<INDI::Dome>
 {
 public:
     DummyDome();
@@ -46,4 +55,117 @@ protected:
     virtual IPState ControlShutter(ShutterOperation operation) override;
     virtual bool SetCurrentPark() override;
     virtual bool SetDefaultPark() override;
+
+private:
+    // Park is one sequence: rotate to the park position, then close the
+    // shutter. Its waits return to the event loop, TimerHit() notifies the
+    // events when the azimuth or the shutter change.
+    Async::Task<> parkSequence();
+    Async::Event MotionChanged;
+    Async::Event ShutterChanged;
+    Async::Runner ParkRunner;
+
+    // The simulated dome turns at a fixed speed and takes a while for the shutter.
+    // The azimuth is sent on every poll, between polls only when the dome arrives.
+    void simulateMotion(bool poll);
+
+    // A real dome's azimuth, on every poll and to cross-check the checkpoint.
+    // Over TCP the polls are the traffic that notices a dropped bridge.
+    bool queryAzimuth(double &azimuth);
+    void pollAzimuth();
+    double SimulatedTarget {NAN};
+    std::chrono::nanoseconds SimulatedAt {0};
+    ShutterState SimulatedShutterTarget {SHUTTER_CLOSED};
+    std::chrono::nanoseconds SimulatedShutterDone {0};
+
+    // What the driver knows about the dome's motion, checkpointed so a driver
+    // that indiserver restarts after a crash resumes instead of homing.
+    struct MotionState
+    {
+        double azimuth;
+        // NaN unless a move or park is in flight.
+        double targetAzimuth;
+        int32_t domeState;
+        int32_t parked;
+        int32_t shutterState;
+        int32_t backlashSteps;
+        int32_t backlashEnabled;
+        int32_t reserved;
+    };
+    // Bump when MotionState changes, older checkpoints are ignored then.
+    static const uint32_t MotionSchema = 1;
+
+    void checkpoint(bool transition = false);
+    void recoverMotion();
+    void resumeMotion();
+
+    MotionState Motion {};
+    Checkpoint<MotionState> MotionCheckpoint;
+    bool ResumePending {false};
+
+    // Over TCP: no Nagle delays, half-open detection and reconnects in the
+    // background.
+    TcpTransport Tcp;
+    TcpTransportProperties TcpProperties;
+
+    // The azimuth as UDP telemetry, at the telemetry rate while the dome turns
+    // and once a second otherwise, for clients that want more than the XML
+    // at the polling rate.
+    TelemetryPublisher Telemetry;
+    TelemetryProperties TelemetrySettings;
+    int TelemetryTimer {-1};
+    void telemetryTick();
+    std::chrono::nanoseconds TelemetrySentAt {0};
+
+    // A wide read-only vector standing in for the aux inputs of a real dome
+    // controller (rain sensor, motor currents, limit inputs, ...). Usually only one
+    // or two of them change per poll, so they are sent as deltas.
+    enum
+    {
+        AUX_SENSOR_N = 32
+    };
+    INDI::PropertyNumber AuxSensorsNP {AUX_SENSOR_N};
+    DeltaSender AuxSensorsDelta;
+
+    enum
+    {
+        DELTA_UPDATES_ON,
+        DELTA_UPDATES_OFF,
+        DELTA_UPDATES_N,
+    };
+    INDI::PropertySwitch DeltaUpdatesSP {DELTA_UPDATES_N};
+
+    // Take the coordinates of the mount the dome is slaved to from shared
+    // memory when the mount runs on this host and publishes them there,
+    // instead of waiting for the XML to come through indiserver.
+    enum
+    {
+        SHARED_SNOOP_ON,
+        SHARED_SNOOP_OFF,
+        SHARED_SNOOP_N,
+    };
+    INDI::PropertySwitch SharedSnoopSP {SHARED_SNOOP_N};
+    SharedSnoop MountSnoop;
+    void watchMount();
+    void mountCoordinates(const SnoopSample &sample);
+
+    // Every change of the azimuth, the shutter and the aux inputs as a binary
+    // record in a journal under ~/.indi/journal, to read a night back with
+    // indi_journal. An append is a copy into a mapped file, made next to
+    // every apply() of the property.
+    enum
+    {
+        PROPERTY_JOURNAL_ON,
+        PROPERTY_JOURNAL_OFF,
+        PROPERTY_JOURNAL_N,
+    };
+    INDI::PropertySwitch PropertyJournalSP {PROPERTY_JOURNAL_N};
+    Journal::Writer PropertyJournal;
+    void openJournal();
+    void journalAzimuth();
+    void journalShutter();
+    void journalAuxSensors();
+    uint32_t AbsPosJournalId {0};
+    uint32_t ShutterJournalId {0};
+    uint32_t AuxSensorsJournalId {0};
 };
@@ -3,12 +3,14 @@
 #include "libindi/defaultdevice.h"
 #include "libindi/indidustcapinterface.h"
 
+#include "virtual_clock_device.h"
+
 namespace Connection
 {
     class Serial;
 }
 
-class DummyDustcap : public INDI::DefaultDevice, public INDI::DustCapInterface
+class DummyDustcap : public VirtualClockDevice<INDI::DefaultDevice>, public INDI::DustCapInterface
 {
 public:
     DummyDustcap();
@@ -1,9 +1,14 @@
+#include <chrono>
 #include <cstring>
+#include <thread>
 
+#include "libindi/connectionplugins/connectionserial.h"
+#include "libindi/connectionplugins/connectiontcp.h"
 #include "libindi/indicom.h"
 
 #include "config.h"
 #include "indi_dummy_filterwheel.h"
+#include "serial_autodetect.h"
 
 // We declare an auto pointer to DummyFilterWheel.
 static std::unique_ptr<DummyFilterWheel> mydriver(new DummyFilterWheel());
@@ -14,6 +19,11 @@ DummyFilterWheel::DummyFilterWheel()
 
     // Here we tell the base filterwheel class what types of connections we can support
     setFilterConnection(CONNECTION_SERIAL | CONNECTION_TCP);
+
+    const char *names[] = {"Luminance", "Red", "Green", "Blue", "Ha", "OIII", "SII", "Dark"};
+    SimulatedWheel["slots"] = "8";
+    for (int i = 0; i < 8; i++)
+        SimulatedWheel["filter." + std::to_string(i + 1)] = names[i];
 }
 
 const char *DummyFilterWheel::getDefaultName()
@@ -33,6 +43,8 @@ bool DummyFilterWheel::initProperties()
     // TODO: If you know how many filters are on the wheel before connecting,
     // set FilterSlotN[0].min and FilterSlotN[0].max here.
 
+    TcpProperties.fill(getDeviceName(), Tcp);
+
     addAuxControls();
 
     return true;
@@ -43,11 +55,13 @@ void DummyFilterWheel::ISGetProperties(const char *dev)
     INDI::FilterWheel::ISGetProperties(dev);
 
     // TODO: Call define* for any custom properties.
+    TcpProperties.define(this);
 }
 
 bool DummyFilterWheel::updateProperties()
 {
     INDI::FilterWheel::updateProperties();
+    TcpProperties.updateProperties(this);
 
     if (isConnected())
     {
@@ -56,6 +70,12 @@ bool DummyFilterWheel::updateProperties()
     else
     {
         // TODO: Call deleteProperty for any custom properties only visible when connected.
+        checkpoint(true);
+        if (VerifyCallback != -1)
+            IERmCallback(VerifyCallback);
+        VerifyCallback = -1;
+        // Waits for a verification still talking to the wheel.
+        StateCache.reset();
     }
 
     return true;
@@ -109,6 +129,7 @@ bool DummyFilterWheel::saveConfigItems(FILE *fp)
     INDI::FilterWheel::saveConfigItems(fp);
 
     // TODO: Call IUSaveConfig* for any custom properties I want to save.
+    TcpProperties.save(fp);
 
     return true;
 }
@@ -122,17 +143,162 @@ bool DummyFilterWheel::Handshake()
 
     // NOTE: PortFD is set by the base class.
 
+    TcpProperties.attach(this, tcpConnection, PortFD);
+
     // TODO: Any initial communciation needed with our filterwheel, we have an active
     // connection.
 
-    // TODO: If you can query the hardware to get a count of filters, do it here
+    // The slot count and filter names rarely change, reading them from a slow
+    // wheel on every connect does not pay. Use what we saw last time and
+    // check it in the background, verifyReady() picks up the result.
+    const auto start = std::chrono::steady_clock::now();
+    const bool simulation = isSimulation();
+    StateCache.reset(new DeviceStateCache(DeviceStateCache::defaultDirectory(), deviceIdentity(), StateCacheSchema));
+    const bool cached = StateCache->load();
+    if (!cached)
+    {
+        StateCache->setValues(queryHardwareState(simulation));
+        if (!StateCache->save())
+            LOGF_WARN("Cannot write the state cache %s.", StateCache->path().c_str());
+    }
+
+    applyHardwareState();
+    recoverMotion();
+
+    // Only now, recoverMotion() asked the wheel. Until verifyReady() the
+    // wheel belongs to the verification.
+    if (cached)
+    {
+        StateCache->verify([this, simulation]
+        {
+            return queryHardwareState(simulation);
+        });
+        VerifyCallback = IEAddCallback(StateCache->readyFd(), &DummyFilterWheel::verifyReady, this);
+    }
+
+    LOGF_INFO("Connected in %lld ms, %s.", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start).count()),
+              cached ? "filters from the cache, verifying" : "filters read from the wheel");
+
+    return true;
+}
+
+std::string DummyFilterWheel::deviceIdentity()
+{
+    std::string identity = getDeviceName();
+    if (isSimulation())
+        return identity + "@simulator";
+    if (getActiveConnection() == serialConnection)
+    {
+        // The adapter's serial number follows the wheel from port to port.
+        const std::string serial = SerialAutoDetect::usbSerial(serialConnection->port());
+        return identity + "@" + (serial.empty() ? std::string(serialConnection->port()) : serial);
+    }
+    return identity + "@" + tcpConnection->host() + ":" + std::to_string(tcpConnection->port());
+}
+
+DeviceStateCache::Values DummyFilterWheel::queryHardwareState(bool simulation)
+{
+    // NOTE: This may run on another thread, only talk to the wheel here.
+    DeviceStateCache::Values state;
+    if (simulation)
+    {
+        {
+            std::lock_guard<std::mutex> lock(SimulatedWheelMutex);
+            state = SimulatedWheel;
+        }
+        // A slow wheel, 100 ms for the slot count and for every name.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100 * state.size()));
+        return state;
+    }
+
+    // TODO: Query the hardware for the count of filters and their names.
+    state["slots"] = "8";
+
+    return state;
+}
+
+void DummyFilterWheel::verifyReady(int, void *userpointer)
+{
+    static_cast<DummyFilterWheel *>(userpointer)->verifyDone();
+}
+
+void DummyFilterWheel::verifyDone()
+{
+    bool changed = false;
+    if (!StateCache->verified(changed))
+        return;
+    IERmCallback(VerifyCallback);
+    VerifyCallback = -1;
+
+    if (changed)
+    {
+        LOG_INFO("The wheel differs from the cached state, updating the filters.");
+        applyHardwareState();
+        deleteProperty(FilterNameTP->name);
+        GetFilterNames();
+        defineProperty(FilterNameTP);
+    }
+}
 
+void DummyFilterWheel::applyHardwareState()
+{
     FilterSlotN[0].min = 1;
-    FilterSlotN[0].max = 8;
+    FilterSlotN[0].max = StateCache->getInt("slots", 8);
 
     IUUpdateMinMax(&FilterSlotNP);
+}
 
-    return true;
+void DummyFilterWheel::recoverMotion()
+{
+    Motion = MotionState();
+    Motion.current = CurrentFilter;
+    Motion.target = -1;
+    ResumePending = false;
+
+    if (!MotionCheckpoint.isOpen() &&
+            !MotionCheckpoint.open(StateCheckpoint::defaultDirectory() + "/" + getDeviceName() + ".ckpt", MotionSchema))
+    {
+        LOG_WARN("Cannot open the motion checkpoint, the wheel has to be homed after a crash.");
+        return;
+    }
+
+    MotionState saved;
+    int64_t savedAt = 0;
+    if (!MotionCheckpoint.read(saved, &savedAt))
+        return;
+
+    // The simulated wheel stays where it was, a real one is asked.
+    // It may also have reached the target after the last checkpoint.
+    const int current = isSimulation() ? saved.current : QueryFilter();
+    const bool arrived = saved.target >= 0 && current == saved.target;
+    if (current != saved.current && !arrived)
+    {
+        LOGF_WARN("The wheel is at slot %d, not at its checkpointed slot %d, home the wheel.", current, saved.current);
+        MotionCheckpoint.reset();
+        return;
+    }
+
+    Motion = saved;
+    if (arrived)
+    {
+        Motion.current = current;
+        Motion.target = -1;
+        checkpoint(true);
+    }
+    CurrentFilter = current;
+    FilterSlotN[0].value = current;
+    LOGF_INFO("Resumed from the checkpoint of %.1f s ago at slot %d. No homing needed.",
+              StateCheckpoint::secondsSince(savedAt), current);
+
+    ResumePending = Motion.target >= 0;
+}
+
+void DummyFilterWheel::checkpoint(bool transition)
+{
+    MotionCheckpoint.write(Motion);
+    if (transition)
+        MotionCheckpoint.flush();
 }
 
 void DummyFilterWheel::TimerHit()
@@ -145,6 +311,29 @@ void DummyFilterWheel::TimerHit()
 
     LOG_INFO("timer hit");
 
+    // The wheel answers one command at a time, leave it to the verification.
+    const bool verifying = VerifyCallback != -1;
+
+    if (ResumePending && !verifying)
+    {
+        ResumePending = false;
+        LOGF_INFO("Resuming the interrupted change to slot %d.", Motion.target);
+        // SelectFilterDone() reports the arrival.
+        if (!SelectFilter(Motion.target))
+        {
+            LOG_WARN("Could not resume the interrupted change.");
+            Motion.target = -1;
+            FilterSlotNP.s = IPS_ALERT;
+            IDSetNumber(&FilterSlotNP, nullptr);
+        }
+    }
+
+    Motion.current = CurrentFilter;
+    checkpoint();
+
+    if (!verifying)
+        TcpProperties.poll();
+
     // If you don't call SetTimer, we'll never get called again, until we disconnect
     // and reconnect.
     SetTimer(POLLMS);
@@ -162,12 +351,24 @@ bool DummyFilterWheel::SelectFilter(int index)
 {
     // NOTE: index starts at 1, not 0
 
+    // A client right after connecting waits for the verification to let go
+    // of the wheel.
+    if (StateCache)
+        StateCache->wait();
+
     TargetFilter = index;
 
+    // A restarted driver finishes the change.
+    Motion.target = index;
+    checkpoint(true);
+
     // TODO: Tell the hardware to change to the given index.
     // Be sure to call SelectFilterDone when it has finished moving.
 
     CurrentFilter = TargetFilter;
+    Motion.current = CurrentFilter;
+    Motion.target = -1;
+    checkpoint(true);
     SelectFilterDone(index);
     return true;
 }
@@ -176,6 +377,19 @@ bool DummyFilterWheel::SetFilterNames()
 {
     // TODO: If you can set the filter names to save in hardware, do it here.
     // Filter names are in the FilterNameT class var.
+    if (StateCache)
+    {
+        for (int i = 0; i < FilterNameTP->ntp; i++)
+            StateCache->set("filter." + std::to_string(i + 1), FilterNameT[i].text);
+        StateCache->save();
+
+        if (isSimulation())
+        {
+            std::lock_guard<std::mutex> lock(SimulatedWheelMutex);
+            SimulatedWheel = StateCache->values();
+        }
+    }
+
     // Otherwise, just save them to the config file with this.
     return INDI::FilterInterface::SetFilterNames();
 }
@@ -184,6 +398,31 @@ bool DummyFilterWheel::GetFilterNames()
 {
     // TODO: If you can get the filter names from hardware, do it here.
     // Use the hardware to populate FilterNameT.
+    // They were read in Handshake(), or came from the cache.
+    const int slots = static_cast<int>(FilterSlotN[0].max);
+    if (StateCache && StateCache->has("filter.1"))
+    {
+        if (FilterNameT != nullptr)
+        {
+            for (int i = 0; i < FilterNameTP->ntp; i++)
+                free(FilterNameT[i].text);
+            delete [] FilterNameT;
+        }
+
+        FilterNameT = new IText[slots];
+        memset(FilterNameT, 0, sizeof(IText) * slots);
+        for (int i = 0; i < slots; i++)
+        {
+            char name[MAXINDINAME], label[MAXINDILABEL];
+            snprintf(name, MAXINDINAME, "FILTER_SLOT_NAME_%d", i + 1);
+            snprintf(label, MAXINDILABEL, "Filter#%d", i + 1);
+            IUFillText(&FilterNameT[i], name, label, StateCache->get("filter." + std::to_string(i + 1), label).c_str());
+        }
+        IUFillTextVector(FilterNameTP, FilterNameT, slots, getDeviceName(), "FILTER_NAME", "Filter", FilterSlotNP.group,
+                         IP_RW, 0, IPS_IDLE);
+        return true;
+    }
+
     // Otherwise, just use the default.
     return INDI::FilterInterface::GetFilterNames();
 }
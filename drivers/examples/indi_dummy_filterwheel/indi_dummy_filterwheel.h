@@ -1,13 +1,22 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <string>
+
 #include "libindi/indifilterwheel.h"
 
+#include "device_state_cache.h"
+#include "state_checkpoint.h"
+#include "tcp_transport_property.h"
+#include "virtual_clock_device.h"
+
 namespace Connection
 {
     class Serial;
 }
 
-class DummyFilterWheel : public INDI::FilterWheel
+class DummyFilterWheel : public VirtualClockDevice<INDI::FilterWheel>
 {
 public:
     DummyFilterWheel();
@@ -34,4 +43,44 @@ protected:
     virtual bool SelectFilter(int) override;
     virtual bool SetFilterNames() override;
     virtual bool GetFilterNames() override;
+
+private:
+    // Over TCP: no Nagle delays, half-open detection and reconnects that
+    // replay the commands in flight.
+    TcpTransport Tcp;
+    TcpTransportProperties TcpProperties;
+
+    // The slot count and filter names, taken from the cache when connecting so
+    // the wheel is usable at once, and read from the wheel in the background.
+    // Bump StateCacheSchema when the keys change.
+    static const int StateCacheSchema = 1;
+    std::unique_ptr<DeviceStateCache> StateCache;
+    // Watches StateCache->readyFd() while the verification has the wheel.
+    int VerifyCallback {-1};
+    static void verifyReady(int fd, void *userpointer);
+    void verifyDone();
+    std::string deviceIdentity();
+    DeviceStateCache::Values queryHardwareState(bool simulation);
+    void applyHardwareState();
+
+    // What the simulated wheel has stored, the verification reads it from another thread.
+    std::mutex SimulatedWheelMutex;
+    DeviceStateCache::Values SimulatedWheel;
+
+    // The slot the wheel is at and the one it is turning to, for the restart
+    // after a crash. Bump MotionSchema when MotionState changes.
+    struct MotionState
+    {
+        int32_t current;
+        // -1 unless the wheel is turning.
+        int32_t target;
+    };
+    static const uint32_t MotionSchema = 1;
+
+    void checkpoint(bool transition = false);
+    void recoverMotion();
+
+    MotionState Motion {};
+    Checkpoint<MotionState> MotionCheckpoint;
+    bool ResumePending {false};
 };
@@ -1,13 +1,27 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <thread>
 
+#include "libindi/connectionplugins/connectionserial.h"
+#include "libindi/connectionplugins/connectiontcp.h"
 #include "libindi/indicom.h"
 
 #include "config.h"
 #include "indi_dummy_focuser.h"
+#include "serial_autodetect.h"
 
 // We declare an auto pointer to DummyFocuser.
 static std::unique_ptr<DummyFocuser> mydriver(new DummyFocuser());
 
+// How far the focuser may be from its checkpointed position to resume without homing.
+static const int RecoveryToleranceTicks = 10;
+// How fast the simulated focuser moves.
+static const double SimulatedTicksPerSecond = 5000;
+
 DummyFocuser::DummyFocuser()
 {
     setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
@@ -31,6 +45,9 @@ bool DummyFocuser::initProperties()
 
     // TODO: Add any custom properties you need here.
 
+    TcpProperties.fill(getDeviceName(), Tcp);
+    TelemetrySettings.fill(getDeviceName(), Telemetry);
+
     addAuxControls();
 
     return true;
@@ -41,19 +58,33 @@ void DummyFocuser::ISGetProperties(const char *dev)
     INDI::Focuser::ISGetProperties(dev);
 
     // TODO: Call define* for any custom properties.
+    TcpProperties.define(this);
+    TelemetrySettings.define(this);
 }
 
 bool DummyFocuser::updateProperties()
 {
     INDI::Focuser::updateProperties();
+    TcpProperties.updateProperties(this);
 
     if (isConnected())
     {
         // TODO: Call define* for any custom properties only visible when connected.
+        if (TelemetryTimer == -1)
+            telemetryTick();
     }
     else
     {
         // TODO: Call deleteProperty for any custom properties only visible when connected.
+        if (TelemetryTimer != -1)
+            clock().removeTimer(TelemetryTimer);
+        TelemetryTimer = -1;
+        checkpoint(true);
+        if (VerifyCallback != -1)
+            IERmCallback(VerifyCallback);
+        VerifyCallback = -1;
+        // Waits for a verification still talking to the focuser.
+        StateCache.reset();
     }
 
     return true;
@@ -107,6 +138,8 @@ bool DummyFocuser::saveConfigItems(FILE *fp)
     INDI::Focuser::saveConfigItems(fp);
 
     // TODO: Call IUSaveConfig* for any custom properties I want to save.
+    TcpProperties.save(fp);
+    TelemetrySettings.save(fp);
 
     return true;
 }
@@ -116,17 +149,198 @@ bool DummyFocuser::Handshake()
     if (isSimulation())
     {
         LOGF_INFO("Connected successfuly to simulated %s.", getDeviceName());
-        return true;
     }
 
     // NOTE: PortFD is set by the base class.
 
+    TcpProperties.attach(this, tcpConnection, PortFD);
+
     // TODO: Any initial communciation needed with our focuser, we have an active
     // connection.
 
+    // Use the limits we saw last time and check them in the background once
+    // recoverMotion() is done with the port, verifyReady() picks up the result.
+    const auto start = std::chrono::steady_clock::now();
+    const bool simulation = isSimulation();
+    StateCache.reset(new DeviceStateCache(DeviceStateCache::defaultDirectory(), deviceIdentity(), StateCacheSchema));
+    const bool cached = StateCache->load();
+    if (!cached)
+    {
+        StateCache->setValues(queryHardwareState(simulation));
+        if (!StateCache->save())
+            LOGF_WARN("Cannot write the state cache %s.", StateCache->path().c_str());
+    }
+
+    applyHardwareState();
+    recoverMotion();
+
+    if (cached)
+    {
+        StateCache->verify([this, simulation]
+        {
+            return queryHardwareState(simulation);
+        });
+        VerifyCallback = IEAddCallback(StateCache->readyFd(), &DummyFocuser::verifyReady, this);
+    }
+
+    LOGF_INFO("Connected in %lld ms, %s.", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start).count()),
+              cached ? "limits from the cache, verifying" : "limits read from the focuser");
+
     return true;
 }
 
+std::string DummyFocuser::deviceIdentity()
+{
+    std::string identity = getDeviceName();
+    if (isSimulation())
+        return identity + "@simulator";
+    if (getActiveConnection() == serialConnection)
+    {
+        // The adapter's serial number follows the focuser from port to port.
+        const std::string serial = SerialAutoDetect::usbSerial(serialConnection->port());
+        return identity + "@" + (serial.empty() ? std::string(serialConnection->port()) : serial);
+    }
+    return identity + "@" + tcpConnection->host() + ":" + std::to_string(tcpConnection->port());
+}
+
+DeviceStateCache::Values DummyFocuser::queryHardwareState(bool simulation)
+{
+    // NOTE: This may run on another thread, only talk to the focuser here.
+    DeviceStateCache::Values state;
+    if (simulation)
+    {
+        // A slow controller that needs a while to report its travel.
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        state["max_position"] = "100000";
+        return state;
+    }
+
+    // TODO: Query the hardware for its maximum position.
+    state["max_position"] = "100000";
+
+    return state;
+}
+
+void DummyFocuser::verifyReady(int, void *userpointer)
+{
+    static_cast<DummyFocuser *>(userpointer)->verifyDone();
+}
+
+void DummyFocuser::verifyDone()
+{
+    bool changed = false;
+    if (!StateCache->verified(changed))
+        return;
+    IERmCallback(VerifyCallback);
+    VerifyCallback = -1;
+
+    if (changed)
+    {
+        LOG_INFO("The focuser differs from the cached state, updating the limits.");
+        applyHardwareState();
+        IDSetNumber(&FocusMaxPosNP, nullptr);
+    }
+}
+
+void DummyFocuser::waitForPort()
+{
+    // Commands right after connecting wait for the verification to let go of
+    // the port.
+    if (StateCache)
+        StateCache->wait();
+}
+
+void DummyFocuser::applyHardwareState()
+{
+    FocusMaxPosN[0].value = StateCache->getDouble("max_position", FocusMaxPosN[0].value);
+    FocusAbsPosN[0].max = FocusMaxPosN[0].value;
+
+    IUUpdateMinMax(&FocusAbsPosNP);
+}
+
+void DummyFocuser::recoverMotion()
+{
+    Motion = MotionState();
+    Motion.target = -1;
+    ResumePending = false;
+
+    if (!MotionCheckpoint.isOpen() &&
+            !MotionCheckpoint.open(StateCheckpoint::defaultDirectory() + "/" + getDeviceName() + ".ckpt", MotionSchema))
+    {
+        LOG_WARN("Cannot open the motion checkpoint, the focuser has to be homed after a crash.");
+        return;
+    }
+
+    MotionState saved;
+    int64_t savedAt = 0;
+    if (!MotionCheckpoint.read(saved, &savedAt))
+        return;
+
+    // The simulated focuser stays where it was, a real one is asked.
+    int32_t position = saved.position;
+    if (!isSimulation() && !queryPosition(position))
+    {
+        LOG_WARN("Cannot read the position to cross-check the checkpoint, home the focuser.");
+        MotionCheckpoint.reset();
+        return;
+    }
+    // The focuser may also have finished the move after the last checkpoint.
+    const bool arrived = saved.target >= 0 && std::abs(position - saved.target) <= RecoveryToleranceTicks;
+    if (std::abs(position - saved.position) > RecoveryToleranceTicks && !arrived)
+    {
+        LOGF_WARN("The focuser is %d steps off its checkpointed position, home the focuser.",
+                  std::abs(position - saved.position));
+        MotionCheckpoint.reset();
+        return;
+    }
+
+    Motion = saved;
+    Motion.position = position;
+    if (arrived)
+    {
+        Motion.target = -1;
+        checkpoint(true);
+    }
+    FocusAbsPosN[0].value = position;
+    LOGF_INFO("Resumed from the checkpoint of %.1f s ago at position %d. No homing needed.",
+              StateCheckpoint::secondsSince(savedAt), position);
+
+    ResumePending = Motion.target >= 0;
+}
+
+bool DummyFocuser::queryPosition(int32_t &position)
+{
+    // TODO: Replace with the position query of your focuser.
+    std::string answer;
+    if (!TcpProperties.command(PortFD, ":GP#", answer))
+        return false;
+    return sscanf(answer.c_str(), "%d#", &position) == 1;
+}
+
+void DummyFocuser::resumeMotion()
+{
+    ResumePending = false;
+
+    LOGF_INFO("Resuming the interrupted move to %d.", Motion.target);
+    FocusAbsPosNP.s = MoveAbsFocuser(Motion.target);
+    if (FocusAbsPosNP.s == IPS_ALERT)
+    {
+        LOG_WARN("Could not resume the interrupted move.");
+        Motion.target = -1;
+        checkpoint(true);
+    }
+    FocusAbsPosN[0].value = Motion.position;
+    IDSetNumber(&FocusAbsPosNP, nullptr);
+}
+
+void DummyFocuser::checkpoint(bool transition)
+{
+    MotionCheckpoint.write(Motion);
+    if (transition)
+        MotionCheckpoint.flush();
+}
+
 void DummyFocuser::TimerHit()
 {
     if (!isConnected())
@@ -137,6 +351,23 @@ void DummyFocuser::TimerHit()
 
     LOG_INFO("timer hit");
 
+    if (isSimulation())
+        simulateMotion(true);
+
+    // The verification has the port until verifyReady().
+    const bool verifying = VerifyCallback != -1;
+
+    if (ResumePending && !verifying)
+        resumeMotion();
+
+    Motion.position = FocusAbsPosN[0].value;
+    if (FocusAbsPosNP.s != IPS_BUSY)
+        Motion.target = -1;
+    checkpoint();
+
+    if (!verifying)
+        TcpProperties.poll();
+
     // If you don't call SetTimer, we'll never get called again, until we disconnect
     // and reconnect.
     SetTimer(POLLMS);
@@ -147,6 +378,7 @@ IPState DummyFocuser::MoveFocuser(FocusDirection dir, int speed, uint16_t durati
     // NOTE: This is needed if we don't specify FOCUSER_CAN_ABS_MOVE
     // TODO: Actual code to move the focuser. You can use IEAddTimer to do a
     // callback after "duration" to stop your focuser.
+    waitForPort();
     LOGF_INFO("MoveFocuser: %d %d %d", dir, speed, duration);
     return IPS_OK;
 }
@@ -155,22 +387,118 @@ IPState DummyFocuser::MoveAbsFocuser(uint32_t targetTicks)
 {
     // NOTE: This is needed if we do specify FOCUSER_CAN_ABS_MOVE
     // TODO: Actual code to move the focuser.
+    waitForPort();
     LOGF_INFO("MoveAbsFocuser: %d", targetTicks);
-    return IPS_OK;
+    IPState state = IPS_OK;
+    if (isSimulation())
+    {
+        SimulatedTarget = targetTicks;
+        SimulatedAt = clock().now();
+        state = IPS_BUSY;
+    }
+
+    // A restarted driver finishes the moves the focuser accepted.
+    if (state != IPS_ALERT)
+    {
+        Motion.target = state == IPS_BUSY ? static_cast<int32_t>(targetTicks) : -1;
+        if (state == IPS_OK)
+            Motion.position = targetTicks;
+        checkpoint(true);
+    }
+    return state;
 }
 
 IPState DummyFocuser::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
 {
     // NOTE: This is needed if we do specify FOCUSER_CAN_REL_MOVE
     // TODO: Actual code to move the focuser.
+    waitForPort();
     LOGF_INFO("MoveRelFocuser: %d %d", dir, ticks);
-    return IPS_OK;
+    IPState state = IPS_OK;
+    const int32_t target = Motion.position + (dir == FOCUS_INWARD ? -1 : 1) * static_cast<int32_t>(ticks);
+    if (isSimulation())
+    {
+        SimulatedTarget = target;
+        SimulatedAt = clock().now();
+        state = IPS_BUSY;
+    }
+
+    if (state != IPS_ALERT)
+    {
+        Motion.target = state == IPS_BUSY ? target : -1;
+        if (state == IPS_OK)
+            Motion.position = target;
+        checkpoint(true);
+    }
+    return state;
 }
 
 bool DummyFocuser::AbortFocuser()
 {
     // NOTE: This is needed if we do specify FOCUSER_CAN_ABORT
     // TODO: Actual code to stop the focuser.
+    waitForPort();
     LOG_INFO("AbortFocuser");
+    SimulatedTarget = -1;
+
+    Motion.target = -1;
+    checkpoint(true);
     return true;
 }
+
+void DummyFocuser::simulateMotion(bool poll)
+{
+    const auto now = clock().now();
+    if (SimulatedTarget >= 0)
+    {
+        const double position = FocusAbsPosN[0].value;
+        const double left = SimulatedTarget - position;
+        const double step = SimulatedTicksPerSecond * std::chrono::duration<double>(now - SimulatedAt).count();
+        const bool arrived = std::fabs(left) <= step;
+        if (arrived)
+        {
+            FocusAbsPosN[0].value = SimulatedTarget;
+            SimulatedTarget = -1;
+            FocusAbsPosNP.s = IPS_OK;
+            FocusRelPosNP.s = IPS_OK;
+            IDSetNumber(&FocusRelPosNP, nullptr);
+
+            Motion.position = FocusAbsPosN[0].value;
+            Motion.target = -1;
+            checkpoint(true);
+        }
+        else
+            FocusAbsPosN[0].value = std::round(position + (left > 0 ? step : -step));
+        if (poll || arrived)
+            IDSetNumber(&FocusAbsPosNP, nullptr);
+    }
+    SimulatedAt = now;
+}
+
+void DummyFocuser::telemetryTick()
+{
+    TelemetryTimer = -1;
+    if (!isConnected())
+        return;
+
+    // TODO: Read the position of your focuser here when telemetry is on, the
+    // simulated one is advanced to now.
+    const bool moving = FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY;
+    if (isSimulation() && moving && Telemetry.isOpen())
+        simulateMotion(false);
+
+    // Receivers see the stream is alive while nothing moves.
+    const auto now = clock().now();
+    if (Telemetry.isOpen() && (moving || now - TelemetrySentAt >= std::chrono::seconds(1)))
+    {
+        publishTelemetry(Telemetry, FocusAbsPosNP);
+        TelemetrySentAt = now;
+    }
+
+    // Switched off, look again in a second.
+    const int ms = Telemetry.isOpen() ? TelemetrySettings.periodMs() : 1000;
+    TelemetryTimer = clock().addTimer(std::chrono::milliseconds(ms), [this]
+    {
+        telemetryTick();
+    });
+}
@@ -1,8 +1,18 @@
 #pragma once
 
+#include <chrono>
+#include <memory>
+#include <string>
+
 #include "libindi/indifocuser.h"
 
-class DummyFocuser : public INDI::Focuser
+#include "device_state_cache.h"
+#include "state_checkpoint.h"
+#include "tcp_transport_property.h"
+#include "udp_telemetry_property.h"
+#include "virtual_clock_device.h"
+
+class DummyFocuser : public VirtualClockDevice<INDI::Focuser>
 {
 public:
     DummyFocuser();
@@ -30,4 +40,55 @@ protected:
     virtual IPState MoveAbsFocuser(uint32_t targetTicks);
     virtual IPState MoveRelFocuser(FocusDirection dir, uint32_t ticks);
     virtual bool AbortFocuser();
+
+private:
+    // Over TCP: no Nagle delays, half-open detection and reconnects in the
+    // background.
+    TcpTransport Tcp;
+    TcpTransportProperties TcpProperties;
+
+    // The position as UDP telemetry, at the telemetry rate while the focuser
+    // moves and once a second otherwise.
+    TelemetryPublisher Telemetry;
+    TelemetryProperties TelemetrySettings;
+    int TelemetryTimer {-1};
+    void telemetryTick();
+    std::chrono::nanoseconds TelemetrySentAt {0};
+
+    // The simulated focuser travels to its target at a fixed speed.
+    int32_t SimulatedTarget {-1};
+    std::chrono::nanoseconds SimulatedAt {0};
+    void simulateMotion(bool poll);
+
+    // The travel limit, taken from the cache when connecting and read from
+    // the focuser in the background. Bump StateCacheSchema when the keys change.
+    static const int StateCacheSchema = 1;
+    std::unique_ptr<DeviceStateCache> StateCache;
+    // Watches StateCache->readyFd() while the verification has the port.
+    int VerifyCallback {-1};
+    static void verifyReady(int fd, void *userpointer);
+    void verifyDone();
+    void waitForPort();
+    std::string deviceIdentity();
+    DeviceStateCache::Values queryHardwareState(bool simulation);
+    void applyHardwareState();
+
+    // Position and the move in flight, resumed after a crash when the focuser
+    // is still there. Bump MotionSchema when MotionState changes.
+    struct MotionState
+    {
+        int32_t position;
+        // -1 unless a move is in flight.
+        int32_t target;
+    };
+    static const uint32_t MotionSchema = 1;
+
+    void checkpoint(bool transition = false);
+    void recoverMotion();
+    void resumeMotion();
+    bool queryPosition(int32_t &position);
+
+    MotionState Motion {};
+    Checkpoint<MotionState> MotionCheckpoint;
+    bool ResumePending {false};
 };
@@ -0,0 +1,350 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "libindi/eventloop.h"
+
+#include "config.h"
+#include "indi_dummy_gpio.h"
+
+// We declare an auto pointer to DummyGpio.
+static std::unique_ptr<DummyGpio> mydriver(new DummyGpio());
+
+DummyGpio::DummyGpio() : INDI::InputInterface(this)
+{
+    setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
+}
+
+const char *DummyGpio::getDefaultName()
+{
+    return "Dummy GPIO Inputs";
+}
+
+bool DummyGpio::initProperties()
+{
+    // initialize the parent's properties first
+    INDI::DefaultDevice::initProperties();
+
+    // One switch property per line, no analog inputs.
+    INDI::InputInterface::initProperties(MAIN_CONTROL_TAB, Lines, 0, "Input");
+
+    ChipTP[CHIP_PATH].fill("CHIP_PATH", "Chip", "/dev/gpiochip0");
+    ChipTP[CHIP_LINES].fill("CHIP_LINES", "Lines", "17,27,22,23");
+    ChipTP.fill(getDeviceName(), "GPIO_CHIP", "GPIO", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+    ChipTP.onUpdate([this]
+    {
+        if (isConnected())
+            LOG_INFO("The new lines are requested when connecting again.");
+        ChipTP.setState(IPS_OK);
+        ChipTP.apply();
+    });
+
+    PolaritySP[ACTIVE_LOW].fill("ACTIVE_LOW", "Active low", ISS_ON);
+    PolaritySP[ACTIVE_HIGH].fill("ACTIVE_HIGH", "Active high", ISS_OFF);
+    PolaritySP.fill(getDeviceName(), "GPIO_POLARITY", "Polarity", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    PolaritySP.onUpdate([this]
+    {
+        if (isConnected())
+            LOG_INFO("The polarity changes when connecting again.");
+        PolaritySP.setState(IPS_OK);
+        PolaritySP.apply();
+    });
+
+    DebounceSP[DEBOUNCE_KERNEL].fill("DEBOUNCE_KERNEL", "Kernel", ISS_OFF);
+    DebounceSP[DEBOUNCE_TIMESTAMP].fill("DEBOUNCE_TIMESTAMP", "Timestamps", ISS_ON);
+    DebounceSP.fill(getDeviceName(), "GPIO_DEBOUNCE_MODE", "Debounce", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    DebounceSP.onUpdate([this]
+    {
+        if (isConnected())
+            LOG_INFO("The debouncing changes when connecting again.");
+        DebounceSP.setState(IPS_OK);
+        DebounceSP.apply();
+    });
+
+    DebounceNP[0].fill("PERIOD", "Period (ms)", "%.1f", 0, 100, 1, 5);
+    DebounceNP.fill(getDeviceName(), "GPIO_DEBOUNCE", "Debounce", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+    DebounceNP.onUpdate([this]
+    {
+        if (isConnected())
+            LOG_INFO("The debounce period changes when connecting again.");
+        DebounceNP.setState(IPS_OK);
+        DebounceNP.apply();
+    });
+
+    EdgeStatsNP[STATS_EDGES].fill("EDGES", "Edges", "%.0f", 0, 1e12, 0, 0);
+    EdgeStatsNP[STATS_BOUNCES].fill("BOUNCES", "Bounces", "%.0f", 0, 1e12, 0, 0);
+    EdgeStatsNP[STATS_LATENCY].fill("LATENCY", "Latency (us)", "%.1f", 0, 1e9, 0, 0);
+    EdgeStatsNP.fill(getDeviceName(), "GPIO_EDGE_STATS", "Edges", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Add debug/simulation/etc controls to the driver.
+    addAuxControls();
+
+    setDriverInterface(INPUT_INTERFACE | AUX_INTERFACE);
+
+    return true;
+}
+
+void DummyGpio::ISGetProperties(const char *dev)
+{
+    INDI::DefaultDevice::ISGetProperties(dev);
+
+    defineProperty(ChipTP);
+    loadConfig(ChipTP);
+    defineProperty(PolaritySP);
+    loadConfig(PolaritySP);
+    defineProperty(DebounceSP);
+    loadConfig(DebounceSP);
+    defineProperty(DebounceNP);
+    loadConfig(DebounceNP);
+}
+
+bool DummyGpio::updateProperties()
+{
+    INDI::DefaultDevice::updateProperties();
+
+    if (!INDI::InputInterface::updateProperties())
+    {
+        return false;
+    }
+
+    if (isConnected())
+    {
+        defineProperty(EdgeStatsNP);
+        UpdateDigitalInputs();
+
+        // Nothing to poll: the inputs arrive in edgesReady(). The timer only
+        // plays the sensors in simulation.
+        if (isSimulation())
+            SetTimer(getCurrentPollingPeriod());
+    }
+    else
+    {
+        deleteProperty(EdgeStatsNP);
+    }
+
+    return true;
+}
+
+bool DummyGpio::ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    if (INDI::InputInterface::processText(dev, name, texts, names, n))
+    {
+        return true;
+    }
+
+    // Nobody has claimed this, so let the parent handle it
+    return INDI::DefaultDevice::ISNewText(dev, name, texts, names, n);
+}
+
+bool DummyGpio::saveConfigItems(FILE *fp)
+{
+    INDI::DefaultDevice::saveConfigItems(fp);
+    INDI::InputInterface::saveConfigItems(fp);
+    ChipTP.save(fp);
+    PolaritySP.save(fp);
+    DebounceSP.save(fp);
+    DebounceNP.save(fp);
+    return true;
+}
+
+bool DummyGpio::parseLines(std::vector<unsigned> &offsets)
+{
+    const std::string text = ChipTP[CHIP_LINES].getText();
+    const char *p = text.c_str();
+    while (*p != '\0')
+    {
+        char *last = nullptr;
+        const unsigned long offset = strtoul(p, &last, 10);
+        if (last == p)
+            return false;
+        offsets.push_back(static_cast<unsigned>(offset));
+        p = last;
+        while (*p == ',' || *p == ' ')
+            ++p;
+    }
+    return offsets.size() == Lines;
+}
+
+bool DummyGpio::Connect()
+{
+    std::vector<unsigned> offsets;
+    if (!parseLines(offsets))
+    {
+        LOGF_ERROR("%s does not name %zu lines.", ChipTP[CHIP_LINES].getText(), Lines);
+        return false;
+    }
+
+    const bool kernel = DebounceSP.findOnSwitchIndex() == DEBOUNCE_KERNEL;
+    const auto period = std::chrono::microseconds(static_cast<int64_t>(DebounceNP[0].getValue() * 1000));
+
+    if (isSimulation())
+    {
+        Simulated = new GpioEdge::MockChip(Lines);
+        Chip.reset(Simulated);
+        SimulatedRain = false;
+    }
+    else
+    {
+        std::string error;
+        Chip = GpioEdge::openChip(ChipTP[CHIP_PATH].getText(), offsets,
+                                  kernel ? period : std::chrono::microseconds(0),
+                                  PolaritySP.findOnSwitchIndex() == ACTIVE_LOW, getDeviceName(), error);
+        if (!Chip)
+        {
+            LOGF_ERROR("Cannot request lines %s of %s: %s", ChipTP[CHIP_LINES].getText(),
+                       ChipTP[CHIP_PATH].getText(), error.c_str());
+            return false;
+        }
+    }
+
+    // With the kernel debouncing, every event is a change.
+    Debounce.reset(new GpioEdge::Debouncer(Lines, kernel ? std::chrono::microseconds(0) : period));
+    std::vector<bool> levels;
+    Chip->levels(levels);
+    Debounce->reset(levels);
+    Edges = 0;
+
+    EdgeCallback = IEAddCallback(Chip->fd(), &DummyGpio::edgesReady, this);
+
+    LOGF_INFO("Watching lines %s of %s.", ChipTP[CHIP_LINES].getText(),
+              isSimulation() ? "a simulated chip" : ChipTP[CHIP_PATH].getText());
+    return true;
+}
+
+bool DummyGpio::Disconnect()
+{
+    if (EdgeCallback != -1)
+    {
+        IERmCallback(EdgeCallback);
+        EdgeCallback = -1;
+    }
+    if (SettleTimer != -1)
+    {
+        IERmTimer(SettleTimer);
+        SettleTimer = -1;
+    }
+    Chip.reset();
+    Simulated = nullptr;
+    Debounce.reset();
+
+    return true;
+}
+
+void DummyGpio::edgesReady(int fd, void *userpointer)
+{
+    INDI_UNUSED(fd);
+    static_cast<DummyGpio *>(userpointer)->readEdges();
+}
+
+void DummyGpio::readEdges()
+{
+    if (!Chip)
+        return;
+
+    Events.clear();
+    if (!Chip->read(Events))
+    {
+        LOG_ERROR("Reading the GPIO edge events failed.");
+        return;
+    }
+
+    // A line that settled since the last edges comes before its next edge.
+    settle();
+    for (const auto &event : Events)
+    {
+        if (Debounce->feed(event))
+            publish(event);
+    }
+    settle();
+
+    EdgeStatsNP[STATS_EDGES].setValue(Edges);
+    EdgeStatsNP[STATS_BOUNCES].setValue(Debounce->bounces());
+    EdgeStatsNP.setState(IPS_OK);
+    EdgeStatsNP.apply();
+}
+
+void DummyGpio::settleDue(void *userpointer)
+{
+    DummyGpio *driver = static_cast<DummyGpio *>(userpointer);
+    driver->SettleTimer = -1;
+    driver->settle();
+}
+
+void DummyGpio::settle()
+{
+    if (!Debounce)
+        return;
+
+    std::vector<GpioEdge::Event> settled;
+    Debounce->settle(GpioEdge::monotonicNs(), settled);
+    for (const auto &event : settled)
+        publish(event);
+
+    // Wake up when the next bouncing line has been quiet long enough.
+    const uint64_t deadline = Debounce->deadline();
+    if (deadline != 0 && SettleTimer == -1)
+    {
+        const uint64_t now = GpioEdge::monotonicNs();
+        const int ms = deadline > now ? static_cast<int>((deadline - now + 999999) / 1000000) : 0;
+        SettleTimer = IEAddTimer(ms, &DummyGpio::settleDue, this);
+    }
+}
+
+void DummyGpio::publish(const GpioEdge::Event &event)
+{
+    INDI::PropertySwitch &input = DigitalInputsSP[event.line];
+    input.reset();
+    input[event.rising ? INDI::InputInterface::On : INDI::InputInterface::Off].setState(ISS_ON);
+    input.setState(IPS_OK);
+    input.apply();
+
+    ++Edges;
+    EdgeStatsNP[STATS_LATENCY].setValue((GpioEdge::monotonicNs() - event.timestampNs) / 1e3);
+}
+
+bool DummyGpio::UpdateDigitalInputs()
+{
+    if (!Debounce)
+        return false;
+
+    // The debounced levels, the raw ones may be in the middle of a bounce.
+    for (size_t line = 0; line < Lines && line < DigitalInputsSP.size(); ++line)
+    {
+        DigitalInputsSP[line].reset();
+        DigitalInputsSP[line][Debounce->level(line) ? INDI::InputInterface::On : INDI::InputInterface::Off].setState(
+            ISS_ON);
+        DigitalInputsSP[line].setState(IPS_OK);
+        DigitalInputsSP[line].apply();
+    }
+    return true;
+}
+
+bool DummyGpio::UpdateAnalogInputs()
+{
+    // There are none.
+    return true;
+}
+
+void DummyGpio::simulateInputs()
+{
+    // A rain sensor on the first line closes or opens now and then, its
+    // contact bouncing a few times.
+    if (rand() % 5 != 0)
+        return;
+    SimulatedRain = !SimulatedRain;
+    for (int i = 0; i < 4; ++i)
+        Simulated->drive(0, i % 2 == 0 ? SimulatedRain : !SimulatedRain);
+    Simulated->drive(0, SimulatedRain);
+}
+
+void DummyGpio::TimerHit()
+{
+    if (!isConnected() || !Simulated)
+        return;
+
+    simulateInputs();
+
+    // If you don't call SetTimer, we'll never get called again, until we disconnect
+    // and reconnect.
+    SetTimer(getCurrentPollingPeriod());
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "libindi/defaultdevice.h"
+#include "libindi/indiinputinterface.h"
+
+#include "gpio_edge.h"
+#include "virtual_clock_device.h"
+
+class DummyGpio : public VirtualClockDevice<INDI::DefaultDevice>, public INDI::InputInterface
+{
+public:
+    DummyGpio();
+    virtual ~DummyGpio() = default;
+
+    virtual const char *getDefaultName() override;
+
+    virtual bool initProperties() override;
+    virtual bool updateProperties() override;
+
+    virtual void ISGetProperties(const char *dev) override;
+    virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n) override;
+
+    virtual bool Connect() override;
+    virtual bool Disconnect() override;
+
+    virtual void TimerHit() override;
+
+protected:
+    virtual bool saveConfigItems(FILE *fp) override;
+
+    virtual bool UpdateDigitalInputs() override;
+    virtual bool UpdateAnalogInputs() override;
+
+private:
+    // The inputs, a line of the chip each.
+    static constexpr size_t Lines = 4;
+
+    // The chip and the offsets of the lines on it, as "17,27,22,23".
+    enum { CHIP_PATH, CHIP_LINES, CHIP_N };
+    INDI::PropertyText ChipTP {CHIP_N};
+
+    // Switches to ground with a pull-up read active low.
+    enum { ACTIVE_LOW, ACTIVE_HIGH, POLARITY_N };
+    INDI::PropertySwitch PolaritySP {POLARITY_N};
+
+    // Debounced by the kernel, which reports an edge once the line has been
+    // stable for the period, or with the event timestamps, which reports the
+    // first edge at once and drops the bounces after it.
+    enum { DEBOUNCE_KERNEL, DEBOUNCE_TIMESTAMP, DEBOUNCE_N };
+    INDI::PropertySwitch DebounceSP {DEBOUNCE_N};
+    INDI::PropertyNumber DebounceNP {1};
+
+    // Edges published, bounces dropped and how long after its edge the last
+    // change was published.
+    enum { STATS_EDGES, STATS_BOUNCES, STATS_LATENCY, STATS_N };
+    INDI::PropertyNumber EdgeStatsNP {STATS_N};
+
+    bool parseLines(std::vector<unsigned> &offsets);
+    static void edgesReady(int fd, void *userpointer);
+    // Read the events waiting on the chip and publish the changes.
+    void readEdges();
+    static void settleDue(void *userpointer);
+    // Publish the lines that settled after bouncing, and wait for the next.
+    void settle();
+    void publish(const GpioEdge::Event &event);
+    void simulateInputs();
+
+    std::unique_ptr<GpioEdge::Source> Chip;
+    std::unique_ptr<GpioEdge::Debouncer> Debounce;
+    std::vector<GpioEdge::Event> Events;
+    int EdgeCallback{-1};
+    int SettleTimer{-1};
+    uint64_t Edges{0};
+
+    // Stands in for the chip in simulation.
+    GpioEdge::MockChip *Simulated{nullptr};
+    bool SimulatedRain{false};
+};
@@ -0,0 +1,9 @@
+<?xml version="1.0" encoding="UTF-8"?>
+<driversList>
+   <devGroup group="Auxiliary">
+      <device label="Dummy GPIO Inputs" manufacturer="indi-dev-tutorials">
+         <driver name="Dummy GPIO Inputs">indi_dummy_gpio</driver>
+         <version>@CDRIVER_VERSION_MAJOR@.@CDRIVER_VERSION_MINOR@</version>
+      </device>
+   </devGroup>
+</driversList>
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstring>
 
 #include "libindi/indicom.h"
@@ -25,6 +26,7 @@ bool DummyGPS::initProperties()
     INDI::GPS::initProperties();
 
     // TODO: Add any custom properties you need here.
+    TelemetrySettings.fill(getDeviceName(), Telemetry);
 
     addAuxControls();
 
@@ -42,6 +44,7 @@ void DummyGPS::ISGetProperties(const char *dev)
     INDI::GPS::ISGetProperties(dev);
 
     // TODO: Call define* for any custom properties.
+    TelemetrySettings.define(this);
 }
 
 bool DummyGPS::updateProperties()
@@ -108,6 +111,7 @@ bool DummyGPS::saveConfigItems(FILE *fp)
     INDI::GPS::saveConfigItems(fp);
 
     // TODO: Call IUSaveConfig* for any custom properties I want to save.
+    TelemetrySettings.save(fp);
 
     return true;
 }
@@ -131,8 +135,8 @@ IPState DummyGPS::updateGPS()
     static char ts[32] = {0};
     struct tm *utc, *local;
 
-    time_t raw_time;
-    time(&raw_time);
+    // Simulated time, so a night under INDI_VIRTUAL_CLOCK passes as fast as the timers.
+    time_t raw_time = std::chrono::system_clock::to_time_t(clock().wallNow());
 
     utc = gmtime(&raw_time);
     strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", utc);
@@ -146,6 +150,14 @@ IPState DummyGPS::updateGPS()
     LocationN[LOCATION_LONGITUDE].value = 0.0; // 0 to 360 deg
     LocationN[LOCATION_ELEVATION].value = 0.0; // -200 to 10000 m
 
+    // The base class sets the state from what we return, the datagram goes
+    // out before it does.
+    if (Telemetry.isOpen())
+    {
+        LocationNP.s = IPS_OK;
+        publishTelemetry(Telemetry, LocationNP);
+    }
+
     // Base class calls IDSetNumber and IDSetText for us
 
     return IPS_OK;
@@ -2,12 +2,15 @@
 
 #include "libindi/indigps.h"
 
+#include "udp_telemetry_property.h"
+#include "virtual_clock_device.h"
+
 namespace Connection
 {
     class Serial;
 }
 
-class DummyGPS : public INDI::GPS
+class DummyGPS : public VirtualClockDevice<INDI::GPS>
 {
 public:
     DummyGPS();
@@ -35,4 +38,8 @@ private: // serial connection
     int PortFD{-1};
 
     Connection::Serial *serialConnection{nullptr};
+
+    // Every fix as UDP telemetry.
+    TelemetryPublisher Telemetry;
+    TelemetryProperties TelemetrySettings;
 };
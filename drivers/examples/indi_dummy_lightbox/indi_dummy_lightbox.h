@@ -3,12 +3,14 @@
 #include "libindi/defaultdevice.h"
 #include "libindi/indilightboxinterface.h"
 
+#include "virtual_clock_device.h"
+
 namespace Connection
 {
     class Serial;
 }
 
-class DummyLightbox : public INDI::DefaultDevice, public INDI::LightBoxInterface
+class DummyLightbox : public VirtualClockDevice<INDI::DefaultDevice>, public INDI::LightBoxInterface
 {
 public:
     DummyLightbox();
@@ -0,0 +1,477 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <termios.h>
+
+#include "libindi/indicom.h"
+#include "libindi/connectionplugins/connectionserial.h"
+
+#include "config.h"
+#include "indi_dummy_power.h"
+
+// We declare an auto pointer to DummyPower.
+static std::unique_ptr<DummyPower> mydriver(new DummyPower());
+
+DummyPower::DummyPower() : INDI::PowerInterface(this)
+{
+    setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
+
+    // What the box can do. It has no LEDs to toggle and no automatic dew control.
+    SetCapability(POWER_HAS_DC_OUT | POWER_HAS_DEW_OUT | POWER_HAS_VARIABLE_OUT | POWER_HAS_VOLTAGE_SENSOR |
+                  POWER_HAS_OVERALL_CURRENT | POWER_HAS_PER_PORT_CURRENT | POWER_HAS_POWER_CYCLE |
+                  POWER_HAS_USB_TOGGLE);
+}
+
+const char *DummyPower::getDefaultName()
+{
+    return "Dummy Power Box";
+}
+
+bool DummyPower::initProperties()
+{
+    // initialize the parent's properties first
+    INDI::DefaultDevice::initProperties();
+
+    // The per port properties of the power interface.
+    INDI::PowerInterface::initProperties(MAIN_CONTROL_TAB, Ports.power, Ports.dew, Ports.variable, 0, Ports.usb);
+
+    BatchSP[BATCH_ON].fill("BATCH_ON", "On", ISS_ON);
+    BatchSP[BATCH_OFF].fill("BATCH_OFF", "Off", ISS_OFF);
+    BatchSP.fill(getDeviceName(), "PORT_BATCHING", "Batching", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    BatchSP.onUpdate([this]
+    {
+        // Nothing may wait for a flush that will not come.
+        if (!batching())
+            flush();
+        BatchSP.setState(IPS_OK);
+        BatchSP.apply();
+    });
+
+    TelemetryNP[TELEMETRY_INPUT_VOLTAGE].fill("INPUT_VOLTAGE", "Input (V)", "%.2f", 0, 30, 0, 0);
+    TelemetryNP[TELEMETRY_TOTAL_CURRENT].fill("TOTAL_CURRENT", "Total (A)", "%.2f", 0, 30, 0, 0);
+    size_t index = TELEMETRY_PORTS;
+    for (const auto &group : {std::make_pair("POWER", Ports.power), std::make_pair("DEW", Ports.dew),
+                std::make_pair("VARIABLE", Ports.variable)})
+    {
+        for (size_t port = 1; port <= group.second; ++port)
+        {
+            char name[MAXINDINAME], label[MAXINDILABEL];
+            snprintf(name, sizeof(name), "%s_%zu_VOLTAGE", group.first, port);
+            snprintf(label, sizeof(label), "%s %zu (V)", group.first, port);
+            TelemetryNP[index++].fill(name, label, "%.2f", 0, 30, 0, 0);
+            snprintf(name, sizeof(name), "%s_%zu_CURRENT", group.first, port);
+            snprintf(label, sizeof(label), "%s %zu (A)", group.first, port);
+            TelemetryNP[index++].fill(name, label, "%.2f", 0, 30, 0, 0);
+        }
+    }
+    TelemetryNP.fill(getDeviceName(), "PORT_TELEMETRY", "Telemetry", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Add debug/simulation/etc controls to the driver.
+    addAuxControls();
+
+    setDriverInterface(POWER_INTERFACE | AUX_INTERFACE);
+
+    serialConnection = new Connection::Serial(this);
+    serialConnection->registerHandshake([&]() { return Handshake(); });
+    serialConnection->setDefaultBaudRate(Connection::Serial::B_9600);
+    serialConnection->setDefaultPort("/dev/ttyUSB0");
+    registerConnection(serialConnection);
+
+    return true;
+}
+
+void DummyPower::ISGetProperties(const char *dev)
+{
+    INDI::DefaultDevice::ISGetProperties(dev);
+
+    defineProperty(BatchSP);
+    loadConfig(BatchSP);
+}
+
+bool DummyPower::updateProperties()
+{
+    INDI::DefaultDevice::updateProperties();
+
+    if (!INDI::PowerInterface::updateProperties())
+    {
+        return false;
+    }
+
+    if (isConnected())
+    {
+        defineProperty(TelemetryNP);
+        readTelemetry();
+        SetTimer(getCurrentPollingPeriod());
+    }
+    else
+    {
+        deleteProperty(TelemetryNP);
+    }
+
+    return true;
+}
+
+bool DummyPower::ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n)
+{
+    if (INDI::PowerInterface::processNumber(dev, name, values, names, n))
+    {
+        return true;
+    }
+
+    // Nobody has claimed this, so let the parent handle it
+    return INDI::DefaultDevice::ISNewNumber(dev, name, values, names, n);
+}
+
+bool DummyPower::ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    if (INDI::PowerInterface::processSwitch(dev, name, states, names, n))
+    {
+        return true;
+    }
+
+    // Nobody has claimed this, so let the parent handle it
+    return INDI::DefaultDevice::ISNewSwitch(dev, name, states, names, n);
+}
+
+bool DummyPower::ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    if (INDI::PowerInterface::processText(dev, name, texts, names, n))
+    {
+        return true;
+    }
+
+    // Nobody has claimed this, so let the parent handle it
+    return INDI::DefaultDevice::ISNewText(dev, name, texts, names, n);
+}
+
+bool DummyPower::saveConfigItems(FILE *fp)
+{
+    INDI::DefaultDevice::saveConfigItems(fp);
+    INDI::PowerInterface::saveConfigItems(fp);
+    BatchSP.save(fp);
+    return true;
+}
+
+bool DummyPower::Disconnect()
+{
+    // What the client asked for last still goes to the box.
+    flush();
+    if (FlushTimer != -1)
+    {
+        IERmTimer(FlushTimer);
+        FlushTimer = -1;
+    }
+    Simulator.reset();
+    Accepted.clear();
+
+    return INDI::DefaultDevice::Disconnect();
+}
+
+bool DummyPower::Handshake()
+{
+    if (isSimulation())
+    {
+        Simulator.reset(new PowerBox::Model(Ports));
+        LOGF_INFO("Connected successfuly to simulated %s.", getDeviceName());
+        return true;
+    }
+
+    PortFD = serialConnection->getPortFD();
+
+    std::string answer;
+    return sendCommand(PowerBox::TelemetryCommand, answer);
+}
+
+bool DummyPower::batching()
+{
+    return BatchSP.findOnSwitchIndex() == BATCH_ON;
+}
+
+bool DummyPower::queue(const PowerBox::Setting &setting)
+{
+    if (!batching())
+    {
+        std::string answer;
+        if (!sendCommand(PowerBox::command(setting), answer))
+            return false;
+        Accepted[std::make_pair(setting.kind, setting.port)] = setting;
+        return true;
+    }
+
+    // A client turning on a profile sets every port from the same message,
+    // and messages that came in together are handled before the event loop
+    // gets to its timers: a timer of 0 ms sends all of them at once.
+    Pending.add(setting);
+    if (FlushTimer == -1)
+        FlushTimer = IEAddTimer(0, &DummyPower::flushPending, this);
+
+    // The box has not seen it yet. flush() puts the ports of a batch it
+    // rejects back into the properties.
+    return true;
+}
+
+void DummyPower::flushPending(void *userpointer)
+{
+    DummyPower *driver = static_cast<DummyPower *>(userpointer);
+    driver->FlushTimer = -1;
+    driver->flush();
+}
+
+bool DummyPower::flush()
+{
+    if (Pending.empty())
+        return true;
+
+    const std::vector<PowerBox::Setting> settings = Pending.take();
+    std::string answer;
+    if (!sendCommand(PowerBox::batchCommand(settings), answer))
+    {
+        LOGF_ERROR("The box rejected the settings of %zu ports.", settings.size());
+        revert(settings);
+        return false;
+    }
+    for (const auto &setting : settings)
+        Accepted[std::make_pair(setting.kind, setting.port)] = setting;
+    LOGF_DEBUG("Set %zu ports in one transaction.", settings.size());
+    return true;
+}
+
+void DummyPower::revert(const std::vector<PowerBox::Setting> &rejected)
+{
+    bool power = false, dew = false, variable = false, usb = false;
+    for (const auto &setting : rejected)
+    {
+        const PowerBox::Setting was = accepted(setting.kind, setting.port);
+        const ISState state = was.enabled ? ISS_ON : ISS_OFF;
+        switch (setting.kind)
+        {
+            case PowerBox::Kind::Power:
+                PowerChannelsSP[setting.port].setState(state);
+                power = true;
+                break;
+            case PowerBox::Kind::Dew:
+                DewChannelsSP[setting.port].setState(state);
+                DewChannelDutyCycleNP[setting.port].setValue(was.value);
+                dew = true;
+                break;
+            case PowerBox::Kind::Variable:
+                VariableChannelsSP[setting.port].setState(state);
+                VariableChannelVoltsNP[setting.port].setValue(was.value);
+                variable = true;
+                break;
+            case PowerBox::Kind::Usb:
+                USBPortSP[setting.port].setState(state);
+                usb = true;
+                break;
+        }
+    }
+
+    if (power)
+    {
+        PowerChannelsSP.setState(IPS_ALERT);
+        PowerChannelsSP.apply();
+    }
+    if (dew)
+    {
+        DewChannelsSP.setState(IPS_ALERT);
+        DewChannelsSP.apply();
+        DewChannelDutyCycleNP.setState(IPS_ALERT);
+        DewChannelDutyCycleNP.apply();
+    }
+    if (variable)
+    {
+        VariableChannelsSP.setState(IPS_ALERT);
+        VariableChannelsSP.apply();
+        VariableChannelVoltsNP.setState(IPS_ALERT);
+        VariableChannelVoltsNP.apply();
+    }
+    if (usb)
+    {
+        USBPortSP.setState(IPS_ALERT);
+        USBPortSP.apply();
+    }
+}
+
+PowerBox::Setting DummyPower::accepted(PowerBox::Kind kind, size_t port) const
+{
+    const auto known = Accepted.find({kind, port});
+    if (known != Accepted.end())
+        return known->second;
+
+    // Not set since connecting, the telemetry tells what the port is at. USB
+    // ports are not measured and taken to be off.
+    PowerBox::Setting setting {kind, port, false};
+    if (kind == PowerBox::Kind::Usb)
+        return setting;
+    // Power ports, then dew ports, then variable ports.
+    size_t index = port;
+    if (kind != PowerBox::Kind::Power)
+        index += Ports.power;
+    if (kind == PowerBox::Kind::Variable)
+        index += Ports.dew;
+    if (index >= LastTelemetry.ports.size())
+        return setting;
+
+    const double volts = LastTelemetry.ports[index].voltage;
+    setting.enabled = volts > 0;
+    if (kind == PowerBox::Kind::Dew && LastTelemetry.input.voltage > 0)
+        setting.value = 100 * volts / LastTelemetry.input.voltage;
+    else if (kind == PowerBox::Kind::Variable)
+        setting.value = volts;
+    return setting;
+}
+
+bool DummyPower::SetPowerPort(size_t port, bool enabled)
+{
+    return queue({PowerBox::Kind::Power, port, enabled});
+}
+
+bool DummyPower::SetDewPort(size_t port, bool enabled, double dutyCycle)
+{
+    return queue({PowerBox::Kind::Dew, port, enabled, dutyCycle});
+}
+
+bool DummyPower::SetVariablePort(size_t port, bool enabled, double voltage)
+{
+    return queue({PowerBox::Kind::Variable, port, enabled, voltage});
+}
+
+bool DummyPower::SetUSBPort(size_t port, bool enabled)
+{
+    return queue({PowerBox::Kind::Usb, port, enabled});
+}
+
+bool DummyPower::SetLEDEnabled(bool enabled)
+{
+    INDI_UNUSED(enabled);
+    return false;
+}
+
+bool DummyPower::SetAutoDewEnabled(size_t port, bool enabled)
+{
+    INDI_UNUSED(port);
+    INDI_UNUSED(enabled);
+    return false;
+}
+
+bool DummyPower::CyclePower()
+{
+    // The ports that are on go off and back on, each in one transaction.
+    if (!flush() || !readTelemetry())
+        return false;
+
+    std::vector<PowerBox::Setting> off, on;
+    for (size_t port = 0; port < Ports.power && port < LastTelemetry.ports.size(); ++port)
+    {
+        if (LastTelemetry.ports[port].voltage <= 0)
+            continue;
+        off.push_back({PowerBox::Kind::Power, port, false});
+        on.push_back({PowerBox::Kind::Power, port, true});
+    }
+    if (off.empty())
+        return true;
+
+    std::string answer;
+    return sendCommand(PowerBox::batchCommand(off), answer) && sendCommand(PowerBox::batchCommand(on), answer);
+}
+
+bool DummyPower::readTelemetry()
+{
+    std::string answer;
+    if (batching())
+    {
+        // All ports in one query.
+        if (!sendCommand(PowerBox::TelemetryCommand, answer) || !PowerBox::parseTelemetry(answer, LastTelemetry))
+        {
+            TelemetryNP.setState(IPS_ALERT);
+            TelemetryNP.apply();
+            return false;
+        }
+    }
+    else
+    {
+        // One query per power port, the dew and variable ports are not measured.
+        PowerBox::Telemetry telemetry;
+        telemetry.ports.resize(Ports.measured());
+        for (size_t port = 0; port < Ports.power; ++port)
+        {
+            if (!sendCommand(PowerBox::readCommand(port), answer) ||
+                    !PowerBox::parseReading(answer, telemetry.ports[port]))
+            {
+                TelemetryNP.setState(IPS_ALERT);
+                TelemetryNP.apply();
+                return false;
+            }
+            telemetry.input.voltage = std::max(telemetry.input.voltage, telemetry.ports[port].voltage);
+            telemetry.input.current += telemetry.ports[port].current;
+        }
+        LastTelemetry = telemetry;
+    }
+
+    TelemetryNP[TELEMETRY_INPUT_VOLTAGE].setValue(LastTelemetry.input.voltage);
+    TelemetryNP[TELEMETRY_TOTAL_CURRENT].setValue(LastTelemetry.input.current);
+    for (size_t port = 0; port < LastTelemetry.ports.size() && port < Ports.measured(); ++port)
+    {
+        TelemetryNP[TELEMETRY_PORTS + 2 * port].setValue(LastTelemetry.ports[port].voltage);
+        TelemetryNP[TELEMETRY_PORTS + 2 * port + 1].setValue(LastTelemetry.ports[port].current);
+    }
+    TelemetryNP.setState(IPS_OK);
+    TelemetryNP.apply();
+    return true;
+}
+
+bool DummyPower::sendCommand(const std::string &cmd, std::string &answer)
+{
+    int nbytes_read = 0, nbytes_written = 0, tty_rc = 0;
+    char res[1024] = {0};
+    LOGF_DEBUG("CMD <%s>", cmd.c_str());
+
+    if (isSimulation())
+    {
+        if (!Simulator)
+            return false;
+        answer = Simulator->handle(cmd);
+    }
+    else
+    {
+        tcflush(PortFD, TCIOFLUSH);
+        tty_rc = tty_write_string(PortFD, cmd.c_str(), &nbytes_written);
+        if (tty_rc != TTY_OK)
+        {
+            char errorMessage[MAXRBUF];
+            tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+            LOGF_ERROR("Serial write error: %s", errorMessage);
+            return false;
+        }
+
+        tty_rc = tty_nread_section(PortFD, res, sizeof(res), '#', 1, &nbytes_read);
+        if (tty_rc != TTY_OK)
+        {
+            char errorMessage[MAXRBUF];
+            tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+            LOGF_ERROR("Serial read error: %s", errorMessage);
+            return false;
+        }
+        answer.assign(res, nbytes_read);
+    }
+
+    LOGF_DEBUG("RES <%s>", answer.c_str());
+
+    // Drop the '#'.
+    if (!answer.empty())
+        answer.pop_back();
+    return answer != "ERR";
+}
+
+void DummyPower::TimerHit()
+{
+    if (!isConnected())
+        return;
+
+    readTelemetry();
+
+    // If you don't call SetTimer, we'll never get called again, until we disconnect
+    // and reconnect.
+    SetTimer(getCurrentPollingPeriod());
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "libindi/defaultdevice.h"
+#include "libindi/indipowerinterface.h"
+
+#include "power_box.h"
+#include "virtual_clock_device.h"
+
+namespace Connection
+{
+    class Serial;
+}
+
+class DummyPower : public VirtualClockDevice<INDI::DefaultDevice>, public INDI::PowerInterface
+{
+public:
+    DummyPower();
+    virtual ~DummyPower() = default;
+
+    virtual const char *getDefaultName() override;
+
+    virtual bool initProperties() override;
+    virtual bool updateProperties() override;
+
+    virtual void ISGetProperties(const char *dev) override;
+    virtual bool ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n) override;
+    virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n) override;
+    virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n) override;
+
+    virtual bool Disconnect() override;
+
+    virtual void TimerHit() override;
+
+protected:
+    virtual bool saveConfigItems(FILE *fp) override;
+
+    virtual bool SetPowerPort(size_t port, bool enabled) override;
+    virtual bool SetDewPort(size_t port, bool enabled, double dutyCycle) override;
+    virtual bool SetVariablePort(size_t port, bool enabled, double voltage) override;
+    virtual bool SetLEDEnabled(bool enabled) override;
+    virtual bool SetAutoDewEnabled(size_t port, bool enabled) override;
+    virtual bool CyclePower() override;
+    virtual bool SetUSBPort(size_t port, bool enabled) override;
+
+private:
+    // The ports of the box.
+    static constexpr PowerBox::Layout Ports {16, 4, 2, 6};
+
+    // With batching on, the port settings made while the event loop handles
+    // one round of client messages go to the box as one transaction, and the
+    // telemetry of all ports is read with one query. Off, every setting is a
+    // command of its own and every port is read on its own, for comparison.
+    enum { BATCH_ON, BATCH_OFF, BATCH_N };
+    INDI::PropertySwitch BatchSP {BATCH_N};
+
+    // Input voltage and total current, then volts and amps of every power,
+    // dew and variable port.
+    enum { TELEMETRY_INPUT_VOLTAGE, TELEMETRY_TOTAL_CURRENT, TELEMETRY_PORTS };
+    INDI::PropertyNumber TelemetryNP {TELEMETRY_PORTS + 2 * Ports.measured()};
+
+    bool batching();
+    // Queue a setting, or send it at once with batching off.
+    bool queue(const PowerBox::Setting &setting);
+    static void flushPending(void *userpointer);
+    // Send the queued settings as one transaction.
+    bool flush();
+    // Put the ports of a batch the box rejected back to what it has, in alert.
+    void revert(const std::vector<PowerBox::Setting> &rejected);
+    PowerBox::Setting accepted(PowerBox::Kind kind, size_t port) const;
+    bool readTelemetry();
+
+private: // serial connection
+    bool Handshake();
+    bool sendCommand(const std::string &cmd, std::string &answer);
+    int PortFD{-1};
+
+    PowerBox::Batch Pending;
+    int FlushTimer{-1};
+    // The last setting of each port the box took. It applies a batch as a
+    // whole or not at all, so this is what a rejected port is still at.
+    std::map<std::pair<PowerBox::Kind, size_t>, PowerBox::Setting> Accepted;
+    PowerBox::Telemetry LastTelemetry;
+
+    // Answers in simulation.
+    std::unique_ptr<PowerBox::Model> Simulator;
+
+    Connection::Serial *serialConnection{nullptr};
+};
@@ -0,0 +1,9 @@
+<?xml version="1.0" encoding="UTF-8"?>
+<driversList>
+   <devGroup group="Auxiliary">
+      <device label="Dummy Power Box" manufacturer="indi-dev-tutorials">
+         <driver name="Dummy Power Box">indi_dummy_power</driver>
+         <version>@CDRIVER_VERSION_MAJOR@.@CDRIVER_VERSION_MINOR@</version>
+      </device>
+   </devGroup>
+</driversList>
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cmath>
+
+#include "config.h"
+#include "indi_dummy_weather.h"
+
+// We declare an auto pointer to DummyWeather.
+static std::unique_ptr<DummyWeather> mydriver(new DummyWeather());
+
+// The hazards are published as 0 (clear), 1 (warning) and 2 (danger). With
+// these ranges the weather interface puts 0 in its OK zone, 1 in its warning
+// zone and 2 past the limit, so the critical parameters carry the state the
+// hysteresis decided on.
+static const double HazardMinOK = -2;
+static const double HazardMaxOK = 1.5;
+static const double HazardWarning = 20;
+
+DummyWeather::DummyWeather() : INDI::WeatherInterface(this)
+{
+    setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
+}
+
+const char *DummyWeather::getDefaultName()
+{
+    return "Dummy Weather";
+}
+
+bool DummyWeather::initProperties()
+{
+    // initialize the parent's properties first
+    INDI::DefaultDevice::initProperties();
+
+    INDI::WeatherInterface::initProperties(MAIN_CONTROL_TAB, "Parameters");
+
+    // The aggregates, for the clients to show.
+    addParameter("WEATHER_WIND_SPEED", "Wind (m/s)", 0, 10, 15);
+    addParameter("WEATHER_WIND_GUST", "Gust (m/s)", 0, 15, 15);
+    addParameter("WEATHER_RAIN_RATE", "Rain (mm/h)", 0, 1, 15);
+    addParameter("WEATHER_TEMPERATURE", "Temperature (C)", -10, 30, 15);
+    addParameter("WEATHER_SKY_TEMPERATURE", "Sky (C)", -50, 0, 15);
+    addParameter("WEATHER_SKY_TREND", "Sky trend (C/h)", -5, 5, 20);
+
+    // What the safety decisions are made on.
+    addParameter("WEATHER_WIND_HAZARD", "Wind hazard", HazardMinOK, HazardMaxOK, HazardWarning);
+    addParameter("WEATHER_RAIN_HAZARD", "Rain hazard", HazardMinOK, HazardMaxOK, HazardWarning);
+    addParameter("WEATHER_CLOUD_HAZARD", "Cloud hazard", HazardMinOK, HazardMaxOK, HazardWarning);
+    setCriticalParameter("WEATHER_WIND_HAZARD");
+    setCriticalParameter("WEATHER_RAIN_HAZARD");
+    setCriticalParameter("WEATHER_CLOUD_HAZARD");
+
+    SampleRateNP[0].fill("RATE", "Rate (Hz)", "%.0f", 1, 2000, 10, 200);
+    SampleRateNP.fill(getDeviceName(), "WEATHER_SAMPLE_RATE", "Sensors", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+    SampleRateNP.onUpdate([this]
+    {
+        if (isConnected())
+            resetAggregates();
+        SampleRateNP.setState(IPS_OK);
+        SampleRateNP.apply();
+    });
+
+    LimitsNP[LIMIT_GUST_WARNING].fill("GUST_WARNING", "Gust warning (m/s)", "%.1f", 0, 50, 1, 10);
+    LimitsNP[LIMIT_GUST_DANGER].fill("GUST_DANGER", "Gust danger (m/s)", "%.1f", 0, 50, 1, 15);
+    LimitsNP[LIMIT_GUST_BAND].fill("GUST_BAND", "Gust band (m/s)", "%.1f", 0, 10, 0.5, 2);
+    LimitsNP[LIMIT_RAIN_WARNING].fill("RAIN_WARNING", "Rain warning (mm/h)", "%.2f", 0, 50, 0.1, 0.2);
+    LimitsNP[LIMIT_RAIN_DANGER].fill("RAIN_DANGER", "Rain danger (mm/h)", "%.2f", 0, 50, 0.1, 1);
+    LimitsNP[LIMIT_RAIN_BAND].fill("RAIN_BAND", "Rain band (mm/h)", "%.2f", 0, 10, 0.1, 0.1);
+    LimitsNP[LIMIT_CLOUD_WARNING].fill("CLOUD_WARNING", "Cloud warning, sky - ambient (C)", "%.1f", -50, 10, 1, -20);
+    LimitsNP[LIMIT_CLOUD_DANGER].fill("CLOUD_DANGER", "Cloud danger, sky - ambient (C)", "%.1f", -50, 10, 1, -12);
+    LimitsNP[LIMIT_CLOUD_BAND].fill("CLOUD_BAND", "Cloud band (C)", "%.1f", 0, 20, 0.5, 3);
+    LimitsNP[LIMIT_HOLD].fill("HOLD", "Hold (min)", "%.0f", 0, 120, 1, 10);
+    LimitsNP.fill(getDeviceName(), "WEATHER_SAFETY_LIMITS", "Safety", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+    LimitsNP.onUpdate([this]
+    {
+        applyLimits();
+        LimitsNP.setState(IPS_OK);
+        LimitsNP.apply();
+    });
+
+    // Add debug/simulation/etc controls to the driver.
+    addAuxControls();
+
+    setDriverInterface(WEATHER_INTERFACE);
+
+    return true;
+}
+
+void DummyWeather::ISGetProperties(const char *dev)
+{
+    INDI::DefaultDevice::ISGetProperties(dev);
+
+    defineProperty(SampleRateNP);
+    loadConfig(SampleRateNP);
+    defineProperty(LimitsNP);
+    loadConfig(LimitsNP);
+}
+
+bool DummyWeather::updateProperties()
+{
+    INDI::DefaultDevice::updateProperties();
+    INDI::WeatherInterface::updateProperties();
+
+    if (isConnected())
+    {
+        SetTimer(getCurrentPollingPeriod());
+    }
+
+    return true;
+}
+
+bool DummyWeather::ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n)
+{
+    if (INDI::WeatherInterface::processNumber(dev, name, values, names, n))
+    {
+        return true;
+    }
+
+    // Nobody has claimed this, so let the parent handle it
+    return INDI::DefaultDevice::ISNewNumber(dev, name, values, names, n);
+}
+
+bool DummyWeather::ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    if (INDI::WeatherInterface::processSwitch(dev, name, states, names, n))
+    {
+        return true;
+    }
+
+    // Nobody has claimed this, so let the parent handle it
+    return INDI::DefaultDevice::ISNewSwitch(dev, name, states, names, n);
+}
+
+bool DummyWeather::saveConfigItems(FILE *fp)
+{
+    INDI::DefaultDevice::saveConfigItems(fp);
+    INDI::WeatherInterface::saveConfigItems(fp);
+    SampleRateNP.save(fp);
+    LimitsNP.save(fp);
+    return true;
+}
+
+bool DummyWeather::Connect()
+{
+    resetAggregates();
+    LOGF_INFO("Simulated station sampling its sensors at %.0f Hz.", SampleRateNP[0].getValue());
+    return true;
+}
+
+bool DummyWeather::Disconnect()
+{
+    WindMean.reset();
+    Wind3s.reset();
+    Gusts.reset();
+    Rain.reset();
+    SkyTrend.reset();
+    return true;
+}
+
+void DummyWeather::resetAggregates()
+{
+    const double rate = SampleRateNP[0].getValue();
+    auto window = [](double seconds, double samplesPerSecond)
+    {
+        return std::unique_ptr<RollingWindow>(
+                   new RollingWindow(seconds, static_cast<size_t>(seconds * samplesPerSecond * 1.05) + 16));
+    };
+    WindMean = window(300, rate);
+    Wind3s = window(3, rate);
+    Gusts = window(300, rate);
+    // A tip every second would be a cloudburst.
+    Rain = window(300, 1);
+    SkyTrend = window(900, 1);
+    Ambient.clear();
+    Sky.clear();
+
+    WindHazard = Hysteresis(0, 0, 0, 0);
+    RainHazard = Hysteresis(0, 0, 0, 0);
+    CloudHazard = Hysteresis(0, 0, 0, 0);
+    applyLimits();
+
+    LastSample = NextTrend = clock().seconds();
+}
+
+void DummyWeather::applyLimits()
+{
+    const double hold = LimitsNP[LIMIT_HOLD].getValue() * 60;
+    WindHazard.setLimits(LimitsNP[LIMIT_GUST_WARNING].getValue(), LimitsNP[LIMIT_GUST_DANGER].getValue(),
+                         LimitsNP[LIMIT_GUST_BAND].getValue(), hold);
+    RainHazard.setLimits(LimitsNP[LIMIT_RAIN_WARNING].getValue(), LimitsNP[LIMIT_RAIN_DANGER].getValue(),
+                         LimitsNP[LIMIT_RAIN_BAND].getValue(), hold);
+    CloudHazard.setLimits(LimitsNP[LIMIT_CLOUD_WARNING].getValue(), LimitsNP[LIMIT_CLOUD_DANGER].getValue(),
+                          LimitsNP[LIMIT_CLOUD_BAND].getValue(), hold);
+}
+
+void DummyWeather::ingest(double now)
+{
+    const double rate = SampleRateNP[0].getValue();
+    // After a jump of the clock, what the longest window can hold is enough.
+    LastSample = std::max(LastSample, now - SkyTrend->window());
+
+    const auto count = static_cast<long>((now - LastSample) * rate);
+    for (long i = 1; i <= count; ++i)
+    {
+        const double time = LastSample + i / rate;
+        add(time, Station.next(time));
+    }
+    LastSample += count / rate;
+    // The rain window only gets the tips.
+    Rain->expire(now);
+}
+
+void DummyWeather::add(double time, const Sample &sample)
+{
+    WindMean->add(time, sample.wind);
+    Wind3s->add(time, sample.wind);
+    Gusts->add(time, Wind3s->mean());
+    if (sample.rain > 0)
+        Rain->add(time, sample.rain);
+    Ambient.add(time, sample.ambient);
+    Sky.add(time, sample.sky);
+
+    const double clouds = Sky.value() - Ambient.value();
+    if (time >= NextTrend)
+    {
+        SkyTrend->add(time, clouds);
+        NextTrend = time + 1;
+    }
+
+    WindHazard.update(time, Gusts->max());
+    RainHazard.update(time, rainRate());
+    CloudHazard.update(time, clouds);
+}
+
+double DummyWeather::rainRate() const
+{
+    return Rain->sum() * 3600 / Rain->window();
+}
+
+IPState DummyWeather::updateWeather()
+{
+    if (!Gusts)
+        return IPS_ALERT;
+
+    setParameterValue("WEATHER_WIND_SPEED", WindMean->mean());
+    setParameterValue("WEATHER_WIND_GUST", Gusts->max());
+    setParameterValue("WEATHER_RAIN_RATE", rainRate());
+    setParameterValue("WEATHER_TEMPERATURE", Ambient.value());
+    setParameterValue("WEATHER_SKY_TEMPERATURE", Sky.value());
+    setParameterValue("WEATHER_SKY_TREND", SkyTrend->slope() * 3600);
+
+    setParameterValue("WEATHER_WIND_HAZARD", WindHazard.level());
+    setParameterValue("WEATHER_RAIN_HAZARD", RainHazard.level());
+    setParameterValue("WEATHER_CLOUD_HAZARD", CloudHazard.level());
+    return IPS_OK;
+}
+
+DummyWeather::Sample DummyWeather::Simulation::next(double time)
+{
+    const double elapsed = std::max(0.0, time - last);
+    last = time;
+
+    // A front passes in the second of every three hours, with rain in its
+    // second half.
+    const double phase = std::fmod(time, 3 * 3600);
+    const bool front = phase >= 3600 && phase < 2 * 3600;
+    const double follow = 1 - std::exp(-elapsed / 600);
+    wind += follow * ((front ? 9 : 4) - wind);
+    clouds += follow * ((front ? -6 : -30) - clouds);
+
+    // Gusts last a few seconds, so the 3 s mean sees them: a random walk
+    // pulled back to the mean wind with a 5 s time constant.
+    std::normal_distribution<double> noise(0, 1);
+    const double spread = 0.3 * wind;
+    gust += -gust * std::min(1.0, elapsed / 5) + spread * std::sqrt(2 * elapsed / 5) * noise(random);
+
+    Sample sample;
+    sample.wind = std::max(0.0, wind + gust + 0.5 * noise(random));
+    sample.ambient = 8 + 2 * std::cos(2 * M_PI * phase / (3 * 3600)) + 0.05 * noise(random);
+    sample.sky = sample.ambient + clouds + 0.3 * noise(random);
+    sample.rain = 0;
+    if (front && phase >= 1.5 * 3600 && time >= nextTip)
+    {
+        sample.rain = 0.2;
+        nextTip = time + std::exponential_distribution<double>(1.0 / 120)(random);
+    }
+    return sample;
+}
+
+void DummyWeather::TimerHit()
+{
+    if (!isConnected())
+        return;
+
+    ingest(clock().seconds());
+    INDI::WeatherInterface::checkWeatherUpdate();
+
+    // If you don't call SetTimer, we'll never get called again, until we disconnect
+    // and reconnect.
+    SetTimer(getCurrentPollingPeriod());
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <memory>
+#include <random>
+
+#include "libindi/defaultdevice.h"
+#include "libindi/indiweatherinterface.h"
+
+#include "rolling_window.h"
+#include "virtual_clock_device.h"
+
+class DummyWeather : public VirtualClockDevice<INDI::DefaultDevice>, public INDI::WeatherInterface
+{
+public:
+    DummyWeather();
+    virtual ~DummyWeather() = default;
+
+    virtual const char *getDefaultName() override;
+
+    virtual bool initProperties() override;
+    virtual bool updateProperties() override;
+
+    virtual void ISGetProperties(const char *dev) override;
+    virtual bool ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n) override;
+    virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n) override;
+
+    virtual bool Connect() override;
+    virtual bool Disconnect() override;
+
+    virtual void TimerHit() override;
+
+protected:
+    virtual bool saveConfigItems(FILE *fp) override;
+
+    virtual IPState updateWeather() override;
+
+private:
+    // Samples per second of every sensor.
+    INDI::PropertyNumber SampleRateNP {1};
+
+    // When the wind, the rain and the clouds become a warning and a danger,
+    // how far below a limit the value has to drop to step down, and for how
+    // long it has to stay there.
+    enum
+    {
+        LIMIT_GUST_WARNING,
+        LIMIT_GUST_DANGER,
+        LIMIT_GUST_BAND,
+        LIMIT_RAIN_WARNING,
+        LIMIT_RAIN_DANGER,
+        LIMIT_RAIN_BAND,
+        LIMIT_CLOUD_WARNING,
+        LIMIT_CLOUD_DANGER,
+        LIMIT_CLOUD_BAND,
+        LIMIT_HOLD,
+        LIMIT_N
+    };
+    INDI::PropertyNumber LimitsNP {LIMIT_N};
+
+    // The sensors, as fast as they come.
+    struct Sample
+    {
+        double wind;
+        // mm, a tip of the rain gauge.
+        double rain;
+        double ambient;
+        double sky;
+    };
+
+    // A station on a night with a passing front.
+    struct Simulation
+    {
+        std::mt19937 random {42};
+        double last {0};
+        double wind {4};
+        double gust {0};
+        double clouds {-30};
+        double nextTip {0};
+
+        Sample next(double time);
+    };
+
+    // Windows and hysteresis sized for the sample rate.
+    void resetAggregates();
+    void applyLimits();
+    // Take the samples since the last call.
+    void ingest(double now);
+    void add(double time, const Sample &sample);
+    // mm/h over the last five minutes.
+    double rainRate() const;
+
+    // The mean wind and the gusts, the largest 3 s mean, over five minutes,
+    // at the sample rate.
+    std::unique_ptr<RollingWindow> WindMean;
+    std::unique_ptr<RollingWindow> Wind3s;
+    std::unique_ptr<RollingWindow> Gusts;
+    // The tips of the rain gauge over five minutes, only the tips.
+    std::unique_ptr<RollingWindow> Rain;
+    // The sky against the ambient temperature over 15 minutes, once a second.
+    std::unique_ptr<RollingWindow> SkyTrend;
+    Ewma Ambient {300};
+    Ewma Sky {60};
+    Hysteresis WindHazard {10, 15, 2, 600};
+    Hysteresis RainHazard {0.2, 1, 0.1, 600};
+    Hysteresis CloudHazard {-20, -12, 3, 600};
+
+    Simulation Station;
+    double LastSample {0};
+    double NextTrend {0};
+};
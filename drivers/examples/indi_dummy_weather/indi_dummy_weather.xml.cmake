@@ -0,0 +1,9 @@
+<?xml version="1.0" encoding="UTF-8"?>
+<driversList>
+   <devGroup group="Weather">
+      <device label="Dummy Weather" manufacturer="indi-dev-tutorials">
+         <driver name="Dummy Weather">indi_dummy_weather</driver>
+         <version>@CDRIVER_VERSION_MAJOR@.@CDRIVER_VERSION_MINOR@</version>
+      </device>
+   </devGroup>
+</driversList>
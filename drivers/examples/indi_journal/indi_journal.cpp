@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "property_journal.h"
+
+static const char *StateNames[] = {"Idle", "Ok", "Busy", "Alert"};
+
+static const char *stateName(int state)
+{
+    return state >= 0 && state < 4 ? StateNames[state] : "?";
+}
+
+// 2026-10-18T21:03:11.123456Z, in UTC as indiserver writes its timestamps.
+static void formatTime(int64_t ns, char *buffer, size_t size)
+{
+    const time_t seconds = static_cast<time_t>(ns / 1000000000);
+    tm utc;
+    gmtime_r(&seconds, &utc);
+    const size_t length = strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(buffer + length, size - length, ".%06dZ", static_cast<int>(ns % 1000000000 / 1000));
+}
+
+// 2026-10-18T21:03:11 in UTC with optional fractional seconds, or seconds
+// since the epoch.
+static bool parseTime(const char *text, int64_t &ns)
+{
+    tm utc;
+    memset(&utc, 0, sizeof(utc));
+    const char *rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &utc);
+    if (rest != nullptr)
+    {
+        ns = static_cast<int64_t>(timegm(&utc)) * 1000000000;
+        if (*rest == '.')
+        {
+            char *end;
+            ns += static_cast<int64_t>(strtod(rest, &end) * 1e9);
+            rest = end;
+        }
+        return *rest == 0 || (*rest == 'Z' && rest[1] == 0);
+    }
+    char *end;
+    const double seconds = strtod(text, &end);
+    ns = static_cast<int64_t>(seconds * 1e9);
+    return end != text && *end == 0;
+}
+
+static void printRecord(const Journal::Reader::Record &record)
+{
+    char time[48];
+    formatTime(record.timestampNs, time, sizeof(time));
+    printf("%s %s %s %s", time, record.device->c_str(), record.property->c_str(), stateName(record.state));
+
+    const size_t count = std::min(record.count, record.elements->size());
+    const char *text = record.texts();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char *name = (*record.elements)[i].c_str();
+        switch (record.kind)
+        {
+            case Journal::Kind::Number:
+                printf(" %s=%.10g", name, record.number(i));
+                break;
+            case Journal::Kind::Switch:
+                printf(" %s=%s", name, record.stateOf(i) ? "On" : "Off");
+                break;
+            case Journal::Kind::Light:
+                printf(" %s=%s", name, stateName(record.stateOf(i)));
+                break;
+            default:
+                printf(" %s=\"%s\"", name, text);
+                text += strlen(text) + 1;
+                break;
+        }
+    }
+    putchar('\n');
+}
+
+// The journals under directory: directory itself if it holds segments,
+// otherwise the subdirectory of each device, as the drivers write them.
+// With -d only the one of that device.
+static std::vector<std::string> journalDirectories(const std::string &directory, const std::string &device)
+{
+    if (Journal::Reader().open(directory))
+        return {directory};
+
+    std::vector<std::string> directories;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr)
+        return directories;
+    while (const dirent *entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name == "." || name == ".." || (!device.empty() && name != device))
+            continue;
+        directories.push_back(directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(directories.begin(), directories.end());
+    return directories;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [directory]\n"
+            "  -d device      only this device\n"
+            "  -p property    only this property\n"
+            "  -f time        from this time, UTC as 2026-10-18T21:03:11 or seconds since the epoch\n"
+            "  -t time        up to this time\n"
+            "  -s             count the records per property instead of printing them\n"
+            "The directory defaults to %s, with a journal per device below it.\n",
+            program, Journal::defaultDirectory().c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    Journal::Reader::Filter filter;
+    bool summary = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "d:p:f:t:s")) != -1)
+    {
+        switch (option)
+        {
+            case 'd': filter.device = optarg; break;
+            case 'p': filter.property = optarg; break;
+            case 's': summary = true; break;
+            case 'f':
+            case 't':
+                if (!parseTime(optarg, option == 'f' ? filter.fromNs : filter.toNs))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    const std::string directory = optind < argc ? argv[optind] : Journal::defaultDirectory();
+
+    // One device after the other, each in time order.
+    std::vector<Journal::Reader> readers;
+    for (const auto &journal : journalDirectories(directory, filter.device))
+    {
+        readers.emplace_back();
+        if (!readers.back().open(journal))
+            readers.pop_back();
+    }
+    if (readers.empty())
+    {
+        fprintf(stderr, "No journal segments in %s.\n", directory.c_str());
+        return 1;
+    }
+
+    struct Count
+    {
+        uint64_t records {0};
+        int64_t firstNs {0};
+        int64_t lastNs {0};
+    };
+    std::map<std::string, Count> counts;
+
+    bool ok = true;
+    Journal::Reader::Stats stats;
+    for (auto &reader : readers)
+    {
+        if (summary)
+            ok &= reader.scan(filter, [&counts](const Journal::Reader::Record & record)
+            {
+                Count &count = counts[*record.device + "." + *record.property];
+                if (count.records++ == 0)
+                    count.firstNs = record.timestampNs;
+                count.lastNs = record.timestampNs;
+            });
+        else
+            ok &= reader.scan(filter, printRecord);
+
+        stats.segments += reader.stats().segments;
+        stats.skippedSegments += reader.stats().skippedSegments;
+        stats.records += reader.stats().records;
+        stats.matched += reader.stats().matched;
+        stats.bytes += reader.stats().bytes;
+        stats.dropped += reader.stats().dropped;
+    }
+
+    for (const auto &count : counts)
+    {
+        char first[48], last[48];
+        formatTime(count.second.firstNs, first, sizeof(first));
+        formatTime(count.second.lastNs, last, sizeof(last));
+        printf("%s records=%llu first=%s last=%s\n", count.first.c_str(),
+               static_cast<unsigned long long>(count.second.records), first, last);
+    }
+
+    fprintf(stderr, "%llu segments read, %llu skipped by time, %llu records, %llu matched, %.1f MB",
+            static_cast<unsigned long long>(stats.segments), static_cast<unsigned long long>(stats.skippedSegments),
+            static_cast<unsigned long long>(stats.records), static_cast<unsigned long long>(stats.matched),
+            stats.bytes / 1e6);
+    if (stats.dropped > 0)
+        fprintf(stderr, ", %llu records dropped by the driver", static_cast<unsigned long long>(stats.dropped));
+    fprintf(stderr, ".\n");
+    return ok ? 0 : 1;
+}
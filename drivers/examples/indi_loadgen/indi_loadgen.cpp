@@ -0,0 +1,488 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "indi_loadgen.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Commands a client may have in flight per property before it skips sending.
+static const size_t MaxPending = 64;
+
+LoadClient::LoadClient(const std::vector<Target> &targets, LoadStats &stats, bool connectDevices)
+    : m_Stats(stats), m_ConnectDevices(connectDevices)
+{
+    for (const auto &target : targets)
+    {
+        Channel channel;
+        channel.target = target;
+        m_Channels.push_back(channel);
+        watchDevice(target.device.c_str());
+    }
+}
+
+LoadClient::Channel *LoadClient::findChannel(const INDI::Property &property)
+{
+    for (auto &channel : m_Channels)
+    {
+        if (channel.target.device == property.getDeviceName() && channel.target.property == property.getName())
+            return &channel;
+    }
+    return nullptr;
+}
+
+void LoadClient::newProperty(INDI::Property property)
+{
+    // Only one client turns the devices on, the others just watch them.
+    if (m_ConnectDevices && property.isNameMatch("CONNECTION") && !property.getBaseDevice().isConnected())
+        connectDevice(property.getDeviceName());
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Channel *channel = findChannel(property);
+    if (channel == nullptr || property.getPermission() == IP_RO)
+        return;
+
+    channel->elements.clear();
+    channel->type = property.getType();
+    if (channel->type == INDI_NUMBER)
+    {
+        INumber &number = property.getNumber()->np[0];
+        channel->elements.push_back(number.name);
+        channel->min = number.min;
+        channel->max = number.max;
+        channel->ready = number.max > number.min;
+    }
+    else if (channel->type == INDI_SWITCH)
+    {
+        ISwitchVectorProperty *svp = property.getSwitch();
+        for (int i = 0; i < svp->nsp; ++i)
+            channel->elements.push_back(svp->sp[i].name);
+        channel->ready = svp->nsp > 1;
+    }
+
+    if (!channel->ready)
+        fprintf(stderr, "Ignoring %s.%s: only number properties with a range and switch properties with more than "
+                "one element can be written to.\n", property.getDeviceName(), property.getName());
+}
+
+void LoadClient::updateProperty(INDI::Property property)
+{
+    const auto now = Clock::now();
+    ++m_Stats.updates;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Channel *channel = findChannel(property);
+    if (channel == nullptr || channel->pending.empty())
+        return;
+
+    double value = 0;
+    if (channel->type == INDI_NUMBER)
+        value = property.getNumber()->np[0].value;
+    else if (channel->type == INDI_SWITCH)
+    {
+        ISwitchVectorProperty *svp = property.getSwitch();
+        value = -1;
+        for (int i = 0; i < svp->nsp; ++i)
+            if (svp->sp[i].s == ISS_ON)
+                value = i;
+    }
+
+    // The oldest of our commands this update answers. Updates triggered by
+    // other clients carry other values and are skipped.
+    for (auto it = channel->pending.begin(); it != channel->pending.end(); ++it)
+    {
+        if (std::fabs(it->value - value) > 1e-9 * std::max(1.0, std::fabs(value)))
+            continue;
+
+        const uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(now - it->sentAt).count();
+        channel->pending.erase(it);
+        ++m_Stats.completed;
+        if (property.getState() == IPS_ALERT)
+            ++m_Stats.alerts;
+
+        std::lock_guard<std::mutex> statsLock(m_Stats.mutex);
+        m_Stats.latency.record(latency);
+        break;
+    }
+}
+
+void LoadClient::serverConnected()
+{
+    m_Connected = true;
+}
+
+void LoadClient::serverDisconnected(int exitCode)
+{
+    m_Connected = false;
+    ++m_Stats.disconnects;
+    fprintf(stderr, "Disconnected from server (%d).\n", exitCode);
+
+    // Everything in flight is lost, and the properties are defined again on reconnect.
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto &channel : m_Channels)
+    {
+        m_Stats.dropped += channel.pending.size();
+        channel.pending.clear();
+        channel.ready = false;
+    }
+}
+
+size_t LoadClient::readyTargets()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    size_t ready = 0;
+    for (const auto &channel : m_Channels)
+        ready += channel.ready;
+    return ready;
+}
+
+bool LoadClient::sendCommand(std::mt19937 &rng)
+{
+    std::string device, property, element;
+    double value = 0;
+    INDI_PROPERTY_TYPE type = INDI_UNKNOWN;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::vector<Channel *> ready;
+        for (auto &channel : m_Channels)
+            if (channel.ready)
+                ready.push_back(&channel);
+        if (ready.empty())
+            return false;
+
+        Channel *channel = ready[std::uniform_int_distribution<size_t>(0, ready.size() - 1)(rng)];
+        if (channel->pending.size() >= MaxPending)
+        {
+            ++m_Stats.skipped;
+            return true;
+        }
+
+        type = channel->type;
+        if (type == INDI_NUMBER)
+        {
+            // Whole numbers survive any number format the driver echoes them with.
+            element = channel->elements[0];
+            if (channel->max - channel->min >= 2)
+                value = std::uniform_int_distribution<long>(std::ceil(channel->min), std::floor(channel->max))(rng);
+            else
+                value = std::uniform_real_distribution<double>(channel->min, channel->max)(rng);
+        }
+        else
+        {
+            const size_t index = std::uniform_int_distribution<size_t>(0, channel->elements.size() - 1)(rng);
+            element = channel->elements[index];
+            value = index;
+        }
+        device = channel->target.device;
+        property = channel->target.property;
+
+        // Queued before sending, the answer may arrive before sendNew* returns.
+        channel->pending.push_back({value, Clock::now()});
+    }
+
+    // Not under the lock: a blocking write must not hold up the listener thread.
+    if (type == INDI_NUMBER)
+        sendNewNumber(device.c_str(), property.c_str(), element.c_str(), value);
+    else
+        sendNewSwitch(device.c_str(), property.c_str(), element.c_str());
+    ++m_Stats.sent;
+    return true;
+}
+
+void LoadClient::expire(Clock::time_point now, std::chrono::milliseconds timeout)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto &channel : m_Channels)
+    {
+        while (!channel.pending.empty() && now - channel.pending.front().sentAt > timeout)
+        {
+            channel.pending.pop_front();
+            ++m_Stats.dropped;
+        }
+    }
+}
+
+// Process monitoring, only possible when indiserver runs on this machine.
+
+static int findServerPid()
+{
+    DIR *proc = opendir("/proc");
+    if (proc == nullptr)
+        return -1;
+
+    int pid = -1;
+    while (struct dirent *entry = readdir(proc))
+    {
+        const int candidate = atoi(entry->d_name);
+        if (candidate <= 0)
+            continue;
+        std::ifstream comm(std::string("/proc/") + entry->d_name + "/comm");
+        std::string name;
+        if (std::getline(comm, name) && name == "indiserver")
+        {
+            pid = candidate;
+            break;
+        }
+    }
+    closedir(proc);
+    return pid;
+}
+
+// Resident set size in kB, -1 if the process is gone.
+static long readRss(int pid)
+{
+    if (pid <= 0)
+        return -1;
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6);
+    }
+    return -1;
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+            continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+static std::string jsonLatency(const LatencyHistogram &latency)
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "{\"count\":%llu,\"mean\":%.1f,\"min\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+             (unsigned long long)latency.count(), latency.mean(), (unsigned long long)latency.min(),
+             (unsigned long long)latency.percentile(50), (unsigned long long)latency.percentile(90),
+             (unsigned long long)latency.percentile(99), (unsigned long long)latency.percentile(99.9),
+             (unsigned long long)latency.max());
+    return buffer;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -h host        indiserver host (localhost)\n"
+            "  -p port        indiserver port (7624)\n"
+            "  -c clients     simulated clients, one connection each (10)\n"
+            "  -r rate        commands per second per client (10)\n"
+            "  -d seconds     duration of the run (60)\n"
+            "  -i seconds     report interval (1)\n"
+            "  -w ms          commands unanswered for this long are dropped (5000)\n"
+            "  -t dev:prop    property to write to, repeatable (defaults to the dummy examples)\n"
+            "  -P pid         indiserver pid for memory tracking (looked up in /proc)\n"
+            "  -l label       label copied into every record, e.g. the INDI release\n",
+            program);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string host = "localhost", label;
+    int port = 7624, clientCount = 10, serverPid = 0;
+    double rate = 10, duration = 60, interval = 1;
+    std::chrono::milliseconds timeout(5000);
+    std::vector<Target> targets;
+
+    int option;
+    while ((option = getopt(argc, argv, "h:p:c:r:d:i:w:t:P:l:")) != -1)
+    {
+        switch (option)
+        {
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': clientCount = std::max(1, atoi(optarg)); break;
+            case 'r': rate = atof(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'i': interval = std::max(0.1, atof(optarg)); break;
+            case 'w': timeout = std::chrono::milliseconds(atoi(optarg)); break;
+            case 'P': serverPid = atoi(optarg); break;
+            case 'l': label = optarg; break;
+            case 't':
+            {
+                const char *colon = strrchr(optarg, ':');
+                if (colon == nullptr)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                targets.push_back({std::string(optarg, colon - optarg), colon + 1});
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    // Properties of the example drivers that answer right away. Targets that do
+    // not show up are ignored.
+    if (targets.empty())
+        targets =
+        {
+            {"Dummy CCD", "CCD_TRANSFER_MODE"},
+            {"Dummy CCD", "CCD_PARALLEL_COMPRESSION_SETTINGS"},
+            {"Dummy Dome", "DELTA_UPDATES"},
+            {"Dummy Lightbox", "FLAT_LIGHT_INTENSITY"},
+        };
+
+    if (serverPid == 0 && (host == "localhost" || host == "127.0.0.1"))
+        serverPid = findServerPid();
+
+    LoadStats stats;
+    std::vector<std::unique_ptr<LoadClient>> clients;
+    for (int i = 0; i < clientCount; ++i)
+    {
+        clients.emplace_back(new LoadClient(targets, stats, i == 0));
+        clients.back()->setServer(host.c_str(), port);
+        if (!clients.back()->connectServer())
+        {
+            fprintf(stderr, "Failed to connect to %s:%d.\n", host.c_str(), port);
+            return 1;
+        }
+    }
+
+    // Wait for the devices to be connected and their properties defined.
+    const auto discoveryEnd = Clock::now() + std::chrono::seconds(10);
+    while (Clock::now() < discoveryEnd && clients.back()->readyTargets() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (clients.back()->readyTargets() == 0)
+    {
+        fprintf(stderr, "None of the target properties showed up.\n");
+        return 1;
+    }
+
+    const long rssStart = readRss(serverPid);
+    long rssMax = rssStart;
+
+    std::ostringstream targetList;
+    for (size_t i = 0; i < targets.size(); ++i)
+        targetList << (i ? "," : "") << jsonString(targets[i].device + ":" + targets[i].property);
+    printf("{\"event\":\"start\",\"label\":%s,\"time\":%lld,\"host\":%s,\"port\":%d,\"clients\":%d,\"rate\":%.3f,"
+           "\"duration\":%.1f,\"ready_targets\":%zu,\"targets\":[%s],\"server_pid\":%d,\"server_rss_kb\":%ld}\n",
+           jsonString(label).c_str(), (long long)time(nullptr), jsonString(host).c_str(), port, clientCount, rate,
+           duration, clients.back()->readyTargets(), targetList.str().c_str(), serverPid, rssStart);
+    fflush(stdout);
+
+    // Open loop: every client sends at exponentially distributed intervals,
+    // whether or not the earlier commands were answered.
+    std::mt19937 rng(1);
+    std::exponential_distribution<double> gap(rate > 0 ? rate : 1);
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::microseconds(static_cast<int64_t>(duration * 1e6));
+    std::vector<Clock::time_point> next(clients.size(), start);
+    auto nextReport = start + std::chrono::microseconds(static_cast<int64_t>(interval * 1e6));
+
+    LatencyHistogram total;
+    uint64_t lastSent = 0, lastCompleted = 0, lastDropped = 0, lastAlerts = 0, lastSkipped = 0, lastUpdates = 0,
+             lastDisconnects = 0;
+
+    for (bool last = false; !last;)
+    {
+        const auto now = Clock::now();
+        auto wakeUp = std::min(nextReport, end);
+
+        if (rate > 0)
+        {
+            for (size_t i = 0; i < clients.size(); ++i)
+            {
+                if (now >= next[i])
+                {
+                    if (clients[i]->isConnected())
+                        clients[i]->sendCommand(rng);
+                    next[i] += std::chrono::microseconds(static_cast<int64_t>(gap(rng) * 1e6));
+                    // Do not try to catch up after a stall, that would be a burst nobody asked for.
+                    if (next[i] < now)
+                        next[i] = now;
+                }
+                wakeUp = std::min(wakeUp, next[i]);
+            }
+        }
+
+        if (now >= nextReport || now >= end)
+        {
+            last = now >= end;
+            for (auto &client : clients)
+            {
+                client->expire(now, timeout);
+                // Reconnect clients the server dropped, e.g. for exceeding its queue limit.
+                if (!client->isConnected() && !last)
+                    client->connectServer();
+            }
+
+            LatencyHistogram latency;
+            {
+                std::lock_guard<std::mutex> lock(stats.mutex);
+                latency.merge(stats.latency);
+                stats.latency.reset();
+            }
+            total.merge(latency);
+
+            const long rss = readRss(serverPid);
+            rssMax = std::max(rssMax, rss);
+
+            const uint64_t sent = stats.sent, completed = stats.completed, dropped = stats.dropped,
+                           alerts = stats.alerts, skipped = stats.skipped, updates = stats.updates,
+                           disconnects = stats.disconnects;
+            printf("{\"event\":\"interval\",\"label\":%s,\"t\":%.3f,\"sent\":%llu,\"completed\":%llu,\"dropped\":%llu,"
+                   "\"alerts\":%llu,\"skipped\":%llu,\"updates\":%llu,\"disconnects\":%llu,\"latency_us\":%s,"
+                   "\"server_rss_kb\":%ld}\n",
+                   jsonString(label).c_str(), std::chrono::duration<double>(now - start).count(),
+                   (unsigned long long)(sent - lastSent), (unsigned long long)(completed - lastCompleted),
+                   (unsigned long long)(dropped - lastDropped), (unsigned long long)(alerts - lastAlerts),
+                   (unsigned long long)(skipped - lastSkipped), (unsigned long long)(updates - lastUpdates),
+                   (unsigned long long)(disconnects - lastDisconnects), jsonLatency(latency).c_str(), rss);
+            fflush(stdout);
+
+            lastSent = sent, lastCompleted = completed, lastDropped = dropped, lastAlerts = alerts;
+            lastSkipped = skipped, lastUpdates = updates, lastDisconnects = disconnects;
+            nextReport += std::chrono::microseconds(static_cast<int64_t>(interval * 1e6));
+            continue;
+        }
+
+        std::this_thread::sleep_until(wakeUp);
+    }
+
+    // Give the last answers a chance to arrive, then count what is left as dropped.
+    std::this_thread::sleep_for(timeout);
+    for (auto &client : clients)
+        client->expire(Clock::now() + timeout, timeout);
+    {
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        total.merge(stats.latency);
+    }
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    printf("{\"event\":\"summary\",\"label\":%s,\"seconds\":%.3f,\"sent\":%llu,\"completed\":%llu,\"dropped\":%llu,"
+           "\"alerts\":%llu,\"skipped\":%llu,\"updates\":%llu,\"disconnects\":%llu,\"commands_per_second\":%.1f,"
+           "\"latency_us\":%s,\"server_rss_start_kb\":%ld,\"server_rss_max_kb\":%ld,\"server_rss_end_kb\":%ld}\n",
+           jsonString(label).c_str(), seconds, (unsigned long long)stats.sent.load(),
+           (unsigned long long)stats.completed.load(), (unsigned long long)stats.dropped.load(),
+           (unsigned long long)stats.alerts.load(), (unsigned long long)stats.skipped.load(),
+           (unsigned long long)stats.updates.load(), (unsigned long long)stats.disconnects.load(),
+           stats.sent / seconds, jsonLatency(total).c_str(), rssStart, rssMax, readRss(serverPid));
+
+    for (auto &client : clients)
+        client->disconnectServer();
+
+    return stats.dropped == 0 ? 0 : 2;
+}
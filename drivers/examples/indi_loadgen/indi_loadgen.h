@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "libindi/baseclient.h"
+
+#include "latency_histogram.h"
+
+// A property the load generator writes to, "Device:PROPERTY" on the command line.
+struct Target
+{
+    std::string device;
+    std::string property;
+};
+
+// Counters shared by all simulated clients. The latencies are collected under
+// the mutex, everything else is atomic.
+struct LoadStats
+{
+    std::atomic<uint64_t> sent {0};
+    std::atomic<uint64_t> completed {0};
+    // No answer within the timeout.
+    std::atomic<uint64_t> dropped {0};
+    // Answered with IPS_ALERT.
+    std::atomic<uint64_t> alerts {0};
+    // Not sent because the client had too many commands in flight.
+    std::atomic<uint64_t> skipped {0};
+    std::atomic<uint64_t> updates {0};
+    std::atomic<uint64_t> disconnects {0};
+
+    std::mutex mutex;
+    // Command to state change latency in microseconds.
+    LatencyHistogram latency;
+};
+
+/**
+ * @brief One simulated client with its own connection to indiserver.
+ *
+ * Commands are matched to the first update of the property that carries the
+ * value that was sent, so updates caused by other clients are not mistaken for
+ * the answer.
+ */
+class LoadClient : public INDI::BaseClient
+{
+public:
+    LoadClient(const std::vector<Target> &targets, LoadStats &stats, bool connectDevices);
+
+    // Send one command to a random writable target. False if no target is known yet.
+    bool sendCommand(std::mt19937 &rng);
+
+    // Count the commands still unanswered after timeout as dropped.
+    void expire(std::chrono::steady_clock::time_point now, std::chrono::milliseconds timeout);
+
+    // Number of targets that were found and can be written to.
+    size_t readyTargets();
+
+    bool isConnected() const
+    {
+        return m_Connected;
+    }
+
+protected:
+    virtual void newProperty(INDI::Property property) override;
+    virtual void updateProperty(INDI::Property property) override;
+    virtual void serverConnected() override;
+    virtual void serverDisconnected(int exitCode) override;
+
+private:
+    struct Pending
+    {
+        // For switches the index of the element turned on, for numbers the value.
+        double value;
+        std::chrono::steady_clock::time_point sentAt;
+    };
+
+    struct Channel
+    {
+        Target target;
+        bool ready {false};
+        INDI_PROPERTY_TYPE type {INDI_UNKNOWN};
+        // Numbers: the first element and its range. Switches: all elements.
+        std::vector<std::string> elements;
+        double min {0}, max {0};
+        // Commands in flight, oldest first.
+        std::deque<Pending> pending;
+    };
+
+    Channel *findChannel(const INDI::Property &property);
+
+    LoadStats &m_Stats;
+    bool m_ConnectDevices {false};
+    std::atomic<bool> m_Connected {false};
+
+    std::mutex m_Mutex;
+    std::vector<Channel> m_Channels;
+};
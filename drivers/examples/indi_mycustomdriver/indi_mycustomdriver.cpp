@@ -1,5 +1,10 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <string>
 #include <termios.h>
+#include <unistd.h>
 
 #include "libindi/indicom.h"
 #include "libindi/connectionplugins/connectionserial.h"
@@ -127,6 +132,69 @@ bool MyCustomDriver::initProperties()
         saveConfig(WhatToSayTP);
     });
 
+    // Everything sendCommand() writes and reads can be recorded, with the time
+    // it happened, to replay it later without the device.
+    SerialCaptureSP[CAPTURE_ON].fill("CAPTURE_ON", "On", ISS_OFF);
+    SerialCaptureSP[CAPTURE_OFF].fill("CAPTURE_OFF", "Off", ISS_ON);
+    SerialCaptureSP.fill(getDeviceName(), "SERIAL_CAPTURE", "Capture", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    SerialCaptureSP.onUpdate([this]
+    {
+        if (SerialCaptureSP.findOnSwitchIndex() == CAPTURE_ON)
+        {
+            if (m_Capture.open(SerialCaptureTP[0].getText()))
+            {
+                LOGF_INFO("Capturing serial traffic to %s.", SerialCaptureTP[0].getText());
+                SerialCaptureSP.setState(IPS_BUSY);
+            }
+            else
+            {
+                LOGF_ERROR("Cannot write to %s: %s.", SerialCaptureTP[0].getText(), strerror(errno));
+                SerialCaptureSP.reset();
+                SerialCaptureSP[CAPTURE_OFF].setState(ISS_ON);
+                SerialCaptureSP.setState(IPS_ALERT);
+            }
+        }
+        else
+        {
+            if (m_Capture.isOpen())
+                LOGF_INFO("Captured %llu serial transfers.", (unsigned long long)m_Capture.records());
+            m_Capture.close();
+            SerialCaptureSP.setState(IPS_IDLE);
+        }
+        SerialCaptureSP.apply();
+    });
+
+    SerialCaptureTP[0].fill("CAPTURE_FILE", "File", "/tmp/indi_mycustomdriver.cap");
+    SerialCaptureTP.fill(getDeviceName(), "SERIAL_CAPTURE_FILE", "Capture", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+
+    // In simulation mode, a capture given here plays the device: the answers
+    // come from the file with the recorded timing, scaled by the speed.
+    SerialReplayTP[0].fill("REPLAY_FILE", "File", "");
+    SerialReplayTP.fill(getDeviceName(), "SERIAL_REPLAY_FILE", "Replay", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+
+    SerialReplaySpeedNP[0].fill("REPLAY_SPEED", "Speed (0 = max)", "%.1f", 0, 1000, 1, 1);
+    SerialReplaySpeedNP.fill(getDeviceName(), "SERIAL_REPLAY_SPEED", "Replay", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+
+    AutoDetectSP[AUTO_DETECT_ON].fill("AUTO_DETECT_ON", "On", ISS_ON);
+    AutoDetectSP[AUTO_DETECT_OFF].fill("AUTO_DETECT_OFF", "Off", ISS_OFF);
+    AutoDetectSP.fill(getDeviceName(), "SERIAL_AUTO_DETECT", "Auto Detect", CONNECTION_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    AutoDetectSP.onUpdate([this]
+    {
+        AutoDetectSP.setState(IPS_OK);
+        AutoDetectSP.apply();
+    });
+
+    IoThreadSP[IO_THREAD_ON].fill("IO_THREAD_ON", "On", ISS_OFF);
+    IoThreadSP[IO_THREAD_OFF].fill("IO_THREAD_OFF", "Off", ISS_ON);
+    IoThreadSP.fill(getDeviceName(), "DEVICE_IO_THREAD", "I/O Thread", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    IoThreadSP.onUpdate([this]
+    {
+        if (isConnected())
+            LOG_INFO("The I/O thread setting takes effect at the next connect.");
+        IoThreadSP.setState(IPS_OK);
+        IoThreadSP.apply();
+    });
+
     addAuxControls();
 
     serialConnection = new Connection::Serial(this);
@@ -142,6 +210,55 @@ void MyCustomDriver::ISGetProperties(const char *dev)
 {
     loadConfig(WhatToSayTP);
     DefaultDevice::ISGetProperties(dev);
+
+    defineProperty(SerialCaptureSP);
+    defineProperty(SerialCaptureTP);
+    loadConfig(SerialCaptureTP);
+    defineProperty(SerialReplayTP);
+    loadConfig(SerialReplayTP);
+    defineProperty(SerialReplaySpeedNP);
+    loadConfig(SerialReplaySpeedNP);
+    defineProperty(AutoDetectSP);
+    loadConfig(AutoDetectSP);
+    defineProperty(IoThreadSP);
+    loadConfig(IoThreadSP);
+}
+
+bool MyCustomDriver::Connect()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    if (!isSimulation() && getActiveConnection() == serialConnection &&
+            AutoDetectSP.findOnSwitchIndex() == AUTO_DETECT_ON)
+        detectPort();
+
+    if (!INDI::DefaultDevice::Connect())
+        return false;
+
+    LOGF_INFO("Connected in %lld ms.", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start).count()));
+    return true;
+}
+
+bool MyCustomDriver::Disconnect()
+{
+    // Before the port is closed under the I/O thread.
+    InitRunner.cancel();
+    if (InitFailedTimer >= 0)
+    {
+        IERmTimer(InitFailedTimer);
+        InitFailedTimer = -1;
+    }
+    if (IoCallback >= 0)
+    {
+        IERmCallback(IoCallback);
+        IoCallback = -1;
+    }
+    m_Io.stop();
+    IoAnswers.clear();
+    StatusRequest = 0;
+
+    return INDI::DefaultDevice::Disconnect();
 }
 
 bool MyCustomDriver::updateProperties()
@@ -161,6 +278,15 @@ bool MyCustomDriver::updateProperties()
         deleteProperty(SayHelloSP);
         deleteProperty(WhatToSayTP);
         deleteProperty(SayCountNP);
+
+        if (m_Replay)
+        {
+            const SerialReplay::Stats &stats = m_Replay->stats();
+            LOGF_INFO("Replay stopped at %.0f%%: %llu bytes written, %llu read, %llu differing from the capture.",
+                      m_Replay->progress() * 100, (unsigned long long)stats.bytesWritten,
+                      (unsigned long long)stats.bytesRead, (unsigned long long)stats.mismatches);
+            m_Replay.reset();
+        }
     }
 
     return true;
@@ -170,6 +296,11 @@ bool MyCustomDriver::saveConfigItems(FILE *fp)
 {
     INDI::DefaultDevice::saveConfigItems(fp);
     WhatToSayTP.save(fp);
+    SerialCaptureTP.save(fp);
+    SerialReplayTP.save(fp);
+    SerialReplaySpeedNP.save(fp);
+    AutoDetectSP.save(fp);
+    IoThreadSP.save(fp);
     return true;
 }
 
@@ -177,41 +308,159 @@ bool MyCustomDriver::Handshake()
 {
     if (isSimulation())
     {
+        const char *replayFile = SerialReplayTP[0].getText();
+        if (replayFile != nullptr && replayFile[0] != '\0')
+        {
+            std::vector<SerialCapture::Record> records;
+            if (!SerialCapture::load(replayFile, records))
+            {
+                LOGF_ERROR("Cannot replay %s, it is missing or not a capture.", replayFile);
+                return false;
+            }
+            m_Replay.reset(new SerialReplay(std::move(records), SerialReplaySpeedNP[0].getValue()));
+            LOGF_INFO("Replaying %s at speed %g.", replayFile, SerialReplaySpeedNP[0].getValue());
+        }
+
         LOGF_INFO("Connected successfuly to simulated %s.", getDeviceName());
-        return true;
+    }
+    else
+    {
+        PortFD = serialConnection->getPortFD();
+
+        if (IoThreadSP.findOnSwitchIndex() == IO_THREAD_ON)
+        {
+            if (!m_Io.start(PortFD))
+            {
+                LOGF_ERROR("Cannot start the I/O thread: %s.", strerror(errno));
+                return false;
+            }
+            IoCallback = IEAddCallback(m_Io.eventFd(), &MyCustomDriver::ioReady, this);
+            LOG_INFO("Talking to the device on the I/O thread.");
+        }
     }
 
-    PortFD = serialConnection->getPortFD();
+    // Returns at the first answer it waits for, the rest runs on the event loop.
+    InitRunner.start(initialize());
 
     return true;
 }
 
+Async::Task<> MyCustomDriver::initialize()
+{
+    // The firmware, then the limits, then the position: one step after the
+    // other, but while the device thinks, clients are served.
+    for (const char *query : {":FIRMWARE#", ":LIMITS#", ":POSITION#"})
+    {
+        if (!co_await command(query))
+        {
+            LOGF_ERROR("Initialization failed at %s, disconnecting.", query);
+            InitFailedTimer = IEAddTimer(0, &MyCustomDriver::initFailed, this);
+            co_return;
+        }
+    }
+    LOG_INFO("Device initialized.");
+}
+
+void MyCustomDriver::initFailed(void *userpointer)
+{
+    MyCustomDriver *driver = static_cast<MyCustomDriver *>(userpointer);
+    driver->InitFailedTimer = -1;
+    driver->Disconnect();
+    driver->setConnected(false, IPS_ALERT);
+    driver->updateProperties();
+}
+
+void MyCustomDriver::detectPort()
+{
+    SerialAutoDetect::Options options;
+    options.preferredPort = serialConnection->port();
+    options.preferredBaud = static_cast<int>(serialConnection->baud());
+    // Remember where the device was found, by the serial number of its USB adapter.
+    const char *home = getenv("HOME");
+    if (home != nullptr)
+        options.cachePath = std::string(home) + "/.indi/" + getDeviceName() + ".ports";
+
+    // The same question TimerHit() asks, a probe of every candidate port.
+    auto handshake = [](SerialAutoDetect::Link & link)
+    {
+        char res[8] = {0};
+        return link.write(":STATUS#") && link.readSection(res, sizeof(res), '#', 500) == 3 && strncmp(res, "OK#", 3) == 0;
+    };
+
+    const SerialAutoDetect::Result result = SerialAutoDetect::detect(handshake, options);
+    if (!result.found)
+    {
+        LOGF_WARN("No device answered on any port (%zu probes in %lld ms), trying %s.", result.probes,
+                  static_cast<long long>(result.elapsed.count()), options.preferredPort.c_str());
+        return;
+    }
+    close(result.fd);
+
+    LOGF_INFO("Found the device on %s at %d baud in %lld ms (%zu probes%s).", result.port.c_str(), result.baud,
+              static_cast<long long>(result.elapsed.count()), result.probes, result.fromCache ? ", cached" : "");
+
+    // Point the serial connection at it the way a client would.
+    if (result.port != options.preferredPort)
+    {
+        char port[MAXINDINAME * 4], portName[] = "PORT";
+        strncpy(port, result.port.c_str(), sizeof(port) - 1);
+        port[sizeof(port) - 1] = '\0';
+        char *texts[] = {port}, *names[] = {portName};
+        ISNewText(getDeviceName(), "DEVICE_PORT", texts, names, 1);
+    }
+    if (result.baud != options.preferredBaud)
+    {
+        char baud[16];
+        snprintf(baud, sizeof(baud), "%d", result.baud);
+        ISState states[] = {ISS_ON};
+        char *names[] = {baud};
+        ISNewSwitch(getDeviceName(), "DEVICE_BAUD_RATE", states, names, 1);
+    }
+}
+
 bool MyCustomDriver::sendCommand(const char *cmd)
 {
     int nbytes_read = 0, nbytes_written = 0, tty_rc = 0;
     char res[8] = {0};
     LOGF_DEBUG("CMD <%s>", cmd);
 
-    if (!isSimulation())
+    if (m_Replay)
     {
-        tcflush(PortFD, TCIOFLUSH);
-        if ((tty_rc = tty_write_string(PortFD, cmd, &nbytes_written)) != TTY_OK)
+        // The recorded traffic stands in for the device.
+        if (!m_Replay->write(cmd, strlen(cmd)))
+            LOGF_WARN("Command <%s> differs from the capture.", cmd);
+
+        nbytes_read = m_Replay->readSection(res, sizeof(res), '#', 1000);
+        if (nbytes_read <= 0)
         {
-            char errorMessage[MAXRBUF];
-            tty_error_msg(tty_rc, errorMessage, MAXRBUF);
-            LOGF_ERROR("Serial write error: %s", errorMessage);
+            if (m_Replay->atEnd())
+                LOG_WARN("Replay finished, the capture has no more answers.");
+            else
+                LOG_ERROR("Replay read error: Timeout error");
             return false;
         }
     }
-
-    if (isSimulation())
+    else if (isSimulation())
     {
         strncpy(res, "OK#", 8);
         nbytes_read = 3;
     }
     else
     {
-        if ((tty_rc = tty_read_section(PortFD, res, '#', 1, &nbytes_read)) != TTY_OK)
+        tcflush(PortFD, TCIOFLUSH);
+        tty_rc = tty_write_string(PortFD, cmd, &nbytes_written);
+        m_Capture.record(SerialCapture::Direction::Tx, cmd, nbytes_written);
+        if (tty_rc != TTY_OK)
+        {
+            char errorMessage[MAXRBUF];
+            tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+            LOGF_ERROR("Serial write error: %s", errorMessage);
+            return false;
+        }
+
+        tty_rc = tty_read_section(PortFD, res, '#', 1, &nbytes_read);
+        m_Capture.record(SerialCapture::Direction::Rx, res, nbytes_read);
+        if (tty_rc != TTY_OK)
         {
             char errorMessage[MAXRBUF];
             tty_error_msg(tty_rc, errorMessage, MAXRBUF);
@@ -226,6 +475,87 @@ bool MyCustomDriver::sendCommand(const char *cmd)
     return true;
 }
 
+Async::Task<bool> MyCustomDriver::command(const char *cmd)
+{
+    // Simulation answers at once, replays keep the recorded timing.
+    if (m_Replay || isSimulation())
+        co_return sendCommand(cmd);
+
+    int nbytes_written = 0, tty_rc = 0;
+    LOGF_DEBUG("CMD <%s>", cmd);
+
+    if (m_Io.isRunning())
+    {
+        const uint64_t id = m_Io.submit(cmd, '#', 1000);
+        if (id == 0)
+        {
+            LOG_ERROR("Too many commands waiting for the device.");
+            co_return false;
+        }
+        m_Capture.record(SerialCapture::Direction::Tx, cmd, strlen(cmd));
+
+        co_await Async::waitUntil(Async::IndiLoop::shared(), IoAnswered, [&]
+        {
+            return IoAnswers.count(id) > 0;
+        }, -1);
+        const bool ok = IoAnswers[id];
+        IoAnswers.erase(id);
+        co_return ok;
+    }
+
+    tcflush(PortFD, TCIOFLUSH);
+    tty_rc = tty_write_string(PortFD, cmd, &nbytes_written);
+    m_Capture.record(SerialCapture::Direction::Tx, cmd, nbytes_written);
+    if (tty_rc != TTY_OK)
+    {
+        char errorMessage[MAXRBUF];
+        tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+        LOGF_ERROR("Serial write error: %s", errorMessage);
+        co_return false;
+    }
+
+    const std::optional<std::string> res = co_await Async::readSection(Async::IndiLoop::shared(), PortFD, '#', 1000);
+    if (!res)
+    {
+        LOG_ERROR("Serial read error: Timeout error");
+        co_return false;
+    }
+    m_Capture.record(SerialCapture::Direction::Rx, res->data(), res->size());
+
+    LOGF_DEBUG("RES <%s>", res->substr(0, res->size() - 1).c_str());
+
+    co_return true;
+}
+
+void MyCustomDriver::ioReady(int, void *userpointer)
+{
+    MyCustomDriver *driver = static_cast<MyCustomDriver *>(userpointer);
+    driver->m_Io.drain([driver](const DeviceIoThread::Response & response)
+    {
+        driver->handleAnswer(response);
+    });
+}
+
+void MyCustomDriver::handleAnswer(const DeviceIoThread::Response &response)
+{
+    m_Capture.record(SerialCapture::Direction::Rx, response.answer.data(), response.answer.size());
+    if (response.ok)
+        LOGF_DEBUG("RES <%s> in %.1f ms", response.answer.substr(0, response.answer.size() - 1).c_str(),
+                   response.elapsed.count() / 1e6);
+    else if (response.error == ETIMEDOUT)
+        LOG_ERROR("Serial read error: Timeout error");
+    else
+        LOGF_ERROR("Serial error: %s", strerror(response.error));
+
+    if (response.id == StatusRequest)
+    {
+        StatusRequest = 0;
+        return;
+    }
+    IoAnswers[response.id] = response.ok;
+    IoAnswered.notify();
+}
+
 void MyCustomDriver::TimerHit()
 {
     if (!isConnected())
@@ -233,6 +563,26 @@ void MyCustomDriver::TimerHit()
 
     LOG_INFO("timer hit");
 
+    // The port belongs to initialize() until it is done.
+    if (InitRunner.running())
+    {
+        SetTimer(getCurrentPollingPeriod());
+        return;
+    }
+
+    // Poll the device. This is the traffic a capture records and a replay plays back.
+    if (!m_Io.isRunning())
+        sendCommand(":STATUS#");
+    // The answer comes in handleAnswer(). A device still busy with the last
+    // poll is not asked again.
+    else if (StatusRequest == 0)
+    {
+        LOGF_DEBUG("CMD <%s>", ":STATUS#");
+        StatusRequest = m_Io.submit(":STATUS#", '#', 1000);
+        if (StatusRequest != 0)
+            m_Capture.record(SerialCapture::Direction::Tx, ":STATUS#", 8);
+    }
+
     // If you don't call SetTimer, we'll never get called again, until we disconnect
     // and reconnect.
     SetTimer(getCurrentPollingPeriod());
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
 #include "libindi/defaultdevice.h"
 
+#include "async_task_indi.h"
+#include "device_io_thread.h"
+#include "serial_autodetect.h"
+#include "serial_capture.h"
+#include "serial_replay.h"
+#include "virtual_clock_device.h"
+
 namespace Connection
 {
     class Serial;
 }
 
-class MyCustomDriver : public INDI::DefaultDevice
+class MyCustomDriver : public VirtualClockDevice<INDI::DefaultDevice>
 {
 public:
     MyCustomDriver();
@@ -20,6 +32,9 @@ public:
 
     virtual void ISGetProperties(const char *dev) override;
 
+    virtual bool Connect() override;
+    virtual bool Disconnect() override;
+
     virtual void TimerHit() override;
 
 protected:
@@ -40,10 +55,70 @@ private:
     INDI::PropertyText   WhatToSayTP {1};
     INDI::PropertyNumber SayCountNP  {1};
 
+    // Record all serial traffic to a file, and play such a file back in
+    // simulation mode instead of the built in answers.
+    enum
+    {
+        CAPTURE_ON,
+        CAPTURE_OFF,
+        CAPTURE_N,
+    };
+    INDI::PropertySwitch SerialCaptureSP {CAPTURE_N};
+    INDI::PropertyText   SerialCaptureTP {1};
+    INDI::PropertyText   SerialReplayTP  {1};
+    INDI::PropertyNumber SerialReplaySpeedNP {1};
+
+    // Look for the device on all serial ports and baud rates at once when
+    // connecting, in case the configured port went away.
+    enum
+    {
+        AUTO_DETECT_ON,
+        AUTO_DETECT_OFF,
+        AUTO_DETECT_N,
+    };
+    INDI::PropertySwitch AutoDetectSP {AUTO_DETECT_N};
+
+    // Talk to the device on a thread of its own, so a device that is slow to
+    // answer does not hold up clients. Takes effect when connecting.
+    enum
+    {
+        IO_THREAD_ON,
+        IO_THREAD_OFF,
+        IO_THREAD_N,
+    };
+    INDI::PropertySwitch IoThreadSP {IO_THREAD_N};
+
 private: // serial connection
     bool Handshake();
     bool sendCommand(const char *cmd);
+    // sendCommand() that waits for the answer on the event loop.
+    Async::Task<bool> command(const char *cmd);
+    // What the device needs after connecting, see Handshake().
+    Async::Task<> initialize();
+    // Drops the connection when initialize() failed. From a timer, the task
+    // cannot cancel its own runner.
+    static void initFailed(void *userpointer);
+    int InitFailedTimer{-1};
+    void detectPort();
     int PortFD{-1};
 
+    // With IoThreadSP on, commands go through the I/O thread and the answers
+    // come back to the event loop in ioReady().
+    DeviceIoThread m_Io;
+    int IoCallback{-1};
+    static void ioReady(int fd, void *userpointer);
+    void handleAnswer(const DeviceIoThread::Response &response);
+    // The answers command() waits for, by request id.
+    std::map<uint64_t, bool> IoAnswers;
+    Async::Event IoAnswered;
+    // The :STATUS# poll in flight, 0 if none.
+    uint64_t StatusRequest{0};
+
+    // After IoAnswered, which its task waits on.
+    Async::Runner InitRunner;
+
+    SerialCapture::Writer m_Capture;
+    std::unique_ptr<SerialReplay> m_Replay;
+
     Connection::Serial *serialConnection{nullptr};
 };
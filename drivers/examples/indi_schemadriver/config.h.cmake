@@ -0,0 +1,10 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/* Define INDI Data Dir */
+#cmakedefine INDI_DATA_DIR "@INDI_DATA_DIR@"
+/* Define Driver version */
+#define CDRIVER_VERSION_MAJOR @CDRIVER_VERSION_MAJOR@
+#define CDRIVER_VERSION_MINOR @CDRIVER_VERSION_MINOR@
+
+#endif // CONFIG_H
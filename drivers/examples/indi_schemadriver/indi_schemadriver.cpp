@@ -0,0 +1,127 @@
+#include <cstring>
+#include <memory>
+
+#include "config.h"
+#include "indi_schemadriver.h"
+
+// We declare an auto pointer to SchemaDriver.
+static std::unique_ptr<SchemaDriver> mydriver(new SchemaDriver());
+
+SchemaDriver::SchemaDriver()
+{
+    setVersion(CDRIVER_VERSION_MAJOR, CDRIVER_VERSION_MINOR);
+}
+
+const char *SchemaDriver::getDefaultName()
+{
+    return "Schema Driver";
+}
+
+bool SchemaDriver::initProperties()
+{
+    // initialize the parent's properties first
+    INDI::DefaultDevice::initProperties();
+
+    // The names, labels, limits and initial values of our properties are
+    // declared in the header, all that is left is the name of the device,
+    // which can be changed when the driver is started.
+    Properties.setDevice(getDeviceName());
+
+    addAuxControls();
+
+    return true;
+}
+
+void SchemaDriver::ISGetProperties(const char *dev)
+{
+    DefaultDevice::ISGetProperties(dev);
+    loadConfig(true, WhatToSayTP->name);
+}
+
+bool SchemaDriver::updateProperties()
+{
+    INDI::DefaultDevice::updateProperties();
+
+    if (isConnected())
+    {
+        // Add the properties to the driver when we connect.
+        defineProperty(SayHelloSP);
+        defineProperty(WhatToSayTP);
+        defineProperty(SayCountNP);
+    }
+    else
+    {
+        // And remove them when we disconnect.
+        deleteProperty(SayHelloSP->name);
+        deleteProperty(WhatToSayTP->name);
+        deleteProperty(SayCountNP->name);
+    }
+
+    return true;
+}
+
+bool SchemaDriver::ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0 && strcmp(name, SayHelloSP->name) == 0)
+    {
+        IUUpdateSwitch(SayHelloSP, states, names, n);
+
+        // Find out what switch was clicked.
+        switch (IUFindOnSwitchIndex(SayHelloSP))
+        {
+            case SAY_HELLO_DEFAULT:
+                LOG_INFO("Hello, world!");
+                break;
+            case SAY_HELLO_CUSTOM:
+                LOG_INFO(WhatToSayTP->tp[0].text);
+                break;
+        }
+
+        // Increment our "Say Count" counter and let the clients know.
+        SayCountNP->np[0].value += 1;
+        IDSetNumber(SayCountNP, nullptr);
+
+        // Turn all switches back off and set the property back to idle.
+        IUResetSwitch(SayHelloSP);
+        SayHelloSP->s = IPS_IDLE;
+        IDSetSwitch(SayHelloSP, nullptr);
+        return true;
+    }
+
+    return INDI::DefaultDevice::ISNewSwitch(dev, name, states, names, n);
+}
+
+bool SchemaDriver::ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0 && strcmp(name, WhatToSayTP->name) == 0)
+    {
+        IUUpdateText(WhatToSayTP, texts, names, n);
+        WhatToSayTP->s = IPS_IDLE;
+        IDSetText(WhatToSayTP, nullptr);
+
+        // Saved every time it is set, as in the custom driver example.
+        saveConfig(true, WhatToSayTP->name);
+        return true;
+    }
+
+    return INDI::DefaultDevice::ISNewText(dev, name, texts, names, n);
+}
+
+bool SchemaDriver::saveConfigItems(FILE *fp)
+{
+    INDI::DefaultDevice::saveConfigItems(fp);
+    IUSaveConfigText(fp, WhatToSayTP);
+    return true;
+}
+
+bool SchemaDriver::Connect()
+{
+    // There is no device behind this example.
+    LOGF_INFO("Connected successfully to simulated %s.", getDeviceName());
+    return true;
+}
+
+bool SchemaDriver::Disconnect()
+{
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "libindi/defaultdevice.h"
+
+#include "property_schema.h"
+
+class SchemaDriver : public INDI::DefaultDevice
+{
+public:
+    SchemaDriver();
+    virtual ~SchemaDriver() = default;
+
+    virtual const char *getDefaultName() override;
+
+    virtual bool initProperties() override;
+    virtual bool updateProperties() override;
+
+    virtual void ISGetProperties(const char *dev) override;
+    virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n) override;
+    virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n) override;
+
+    virtual bool Connect() override;
+    virtual bool Disconnect() override;
+
+protected:
+    virtual bool saveConfigItems(FILE *fp) override;
+
+private:
+    // Every property is declared once, here. Each element list generates the
+    // enum of indexes into the property (the names of the elements double as
+    // enumerators), with the last value _N as the total count. The compiler
+    // lays out the names, labels and limits, initProperties() only sets the
+    // device name. See property_schema.h.
+#define SAY_HELLO_ELEMENTS(X) \
+    X(SAY_HELLO_DEFAULT, "Say Hello") \
+    X(SAY_HELLO_CUSTOM, "Say Custom")
+    enum { SAY_HELLO_ELEMENTS(INDI_SCHEMA_INDEX) SAY_HELLO_N };
+    static constexpr Schema::SwitchVector<SAY_HELLO_N> SayHello
+    {
+        "SAY_HELLO", "Hello Commands", Schema::MainControlTab, IP_RW, ISR_ATMOST1, 60, IPS_IDLE,
+        {{SAY_HELLO_ELEMENTS(INDI_SCHEMA_SWITCH)}}
+    };
+#undef SAY_HELLO_ELEMENTS
+    static constexpr Schema::TextVector<1> WhatToSay
+    {
+        "WHAT_TO_SAY", "Got something to say?", Schema::MainControlTab, IP_RW, 60, IPS_IDLE,
+        {{{"WHAT_TO_SAY", "What to say?", "Hello, custom world!"}}}
+    };
+    static constexpr Schema::NumberVector<1> SayCount
+    {
+        "SAY_COUNT", "Say Count", Schema::MainControlTab, IP_RO, 0, IPS_IDLE,
+        {{{"SAY_COUNT", "Count", "%0.f", 0, 0, 0, 0}}}
+    };
+
+    // The storage of all of the above in one block. The driver works with
+    // the vector structs in it through the classic property API.
+    Schema::Block<SayHello, WhatToSay, SayCount> Properties;
+
+    ISwitchVectorProperty *SayHelloSP  {Properties.vector<SayHello>()};
+    ITextVectorProperty   *WhatToSayTP {Properties.vector<WhatToSay>()};
+    INumberVectorProperty *SayCountNP  {Properties.vector<SayCount>()};
+};